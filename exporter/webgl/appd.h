@@ -33,6 +33,17 @@
 #define FLIPBOOK_SAMPLE_ID      29
 #define FLIPBOOK_SAMPLE_RATE_ID 30
 #define CPV_SOURCE_ID           31
+#define BINARY_GEOMETRY_ID      32
+#define BUFFER_GEOMETRY_ID      33
+#define REORDER_FACES_ID        34
+#define OVERDRAW_LOSS_ID        35
+#define QUANTIZE_ID             36
+#define BAKE_PIVOT_ID           37
+#define LOD_RATIOS_ID           38
+#define BATCH_STATIC_ID         39
+#define TEX_SIZE_ID             40
+#define TEX_MIPS_ID             41
+#define TEX_COMPRESS_ID         42
 
 extern void WriteAppData(Interface* ip, int id, TCHAR* val);
 extern void GetAppData(Interface * ip, int id, TCHAR* def,
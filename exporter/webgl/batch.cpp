@@ -0,0 +1,453 @@
+/**********************************************************************
+ *<
+	FILE: batch.cpp
+
+	DESCRIPTION:  Static batching of mesh nodes sharing materials
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+#include <math.h>
+#include <map>
+#include <algorithm>
+#include "weld.h"
+#include "batch.h"
+
+// What the nodes of a batch agree on
+struct BatchKey {
+	IRString materials;     // indices of all slots, in order
+	bool     uvs;
+	bool     colors;
+	bool     normals;
+	int      cell[3];
+
+	bool operator<(const BatchKey& k) const
+	{
+		if (materials != k.materials)
+			return materials < k.materials;
+		if (uvs != k.uvs)
+			return uvs < k.uvs;
+		if (colors != k.colors)
+			return colors < k.colors;
+		if (normals != k.normals)
+			return normals < k.normals;
+		for (int i = 0; i < 3; i++)
+		{
+			if (cell[i] != k.cell[i])
+				return cell[i] < k.cell[i];
+		}
+		return false;
+	}
+};
+
+static void
+Transform(const float* m, const float* p, float* out)
+{
+	for (int k = 0; k < 3; k++)
+		out[k] = p[0] * m[k] + p[1] * m[3 + k] + p[2] * m[6 + k] + m[9 + k];
+}
+
+static int
+DrawCalls(const IRScene& scene)
+{
+	int calls = 0;
+	for (size_t i = 0; i < scene.nodes.size(); i++)
+	{
+		const IRNode& node = scene.nodes[i];
+		if (node.kind == IR_MESH && node.mesh >= 0)
+			calls += node.materials.size() > 1 ? (int) node.materials.size() : 1;
+	}
+	return calls;
+}
+
+void
+BatchAppend(IRMesh& batch, const IRMesh& mesh, const float* world)
+{
+	int v0 = batch.NumVerts(), t0 = batch.NumTVerts(), n0 = batch.NumNormals();
+	const float* m = world;
+	int i, k;
+
+	batch.verts.reserve(batch.verts.size() + mesh.verts.size());
+	for (i = 0; i < mesh.NumVerts(); i++)
+	{
+		float p[3];
+		Transform(world, &mesh.verts[3 * i], p);
+		batch.verts.insert(batch.verts.end(), p, p + 3);
+	}
+	batch.tverts.insert(batch.tverts.end(), mesh.tverts.begin(), mesh.tverts.end());
+	batch.colors.insert(batch.colors.end(), mesh.colors.begin(), mesh.colors.end());
+
+	// Normals go by the cofactors of the 3x3 part, the inverse
+	// transpose times the determinant, whose sign keeps them pointing
+	// out of mirrored nodes
+	double c[9];
+	c[0] = m[4] * m[8] - m[5] * m[7];
+	c[1] = m[5] * m[6] - m[3] * m[8];
+	c[2] = m[3] * m[7] - m[4] * m[6];
+	c[3] = m[2] * m[7] - m[1] * m[8];
+	c[4] = m[0] * m[8] - m[2] * m[6];
+	c[5] = m[1] * m[6] - m[0] * m[7];
+	c[6] = m[1] * m[5] - m[2] * m[4];
+	c[7] = m[2] * m[3] - m[0] * m[5];
+	c[8] = m[0] * m[4] - m[1] * m[3];
+	double det = m[0] * c[0] + m[1] * c[1] + m[2] * c[2];
+	double sign = det < 0.0 ? -1.0 : 1.0;
+	batch.normals.reserve(batch.normals.size() + mesh.normals.size());
+	for (i = 0; i < mesh.NumNormals(); i++)
+	{
+		const float* n = &mesh.normals[3 * i];
+		double r[3];
+		for (k = 0; k < 3; k++)
+			r[k] = sign * (n[0] * c[k] + n[1] * c[3 + k] + n[2] * c[6 + k]);
+		double len = sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2]);
+		if (len > 0.0)
+			for (k = 0; k < 3; k++)
+				r[k] /= len;
+		for (k = 0; k < 3; k++)
+			batch.normals.push_back((float) r[k]);
+	}
+
+	// A mirrored node turns its faces over: corners 1 and 2 trade
+	// places, and edge k becomes edge 2 - k
+	int corner[3] = { 0, 1, 2 };
+	if (det < 0.0)
+	{
+		corner[1] = 2;
+		corner[2] = 1;
+	}
+	bool normals = !mesh.faceNormals.empty();
+	batch.faces.reserve(batch.faces.size() + mesh.faces.size());
+	for (i = 0; i < mesh.NumFaces(); i++)
+	{
+		const IRFace& face = mesh.faces[i];
+		IRFace out = face;
+		for (k = 0; k < 3; k++)
+		{
+			out.v[k] = face.v[corner[k]] + v0;
+			out.t[k] = face.t[corner[k]] + t0;
+			if (normals)
+				batch.faceNormals.push_back(mesh.faceNormals[3 * i + corner[k]] + n0);
+		}
+		if (det < 0.0)
+			out.edgeVis = ((face.edgeVis >> 2) & 1) | (face.edgeVis & 2) |
+				((face.edgeVis & 1) << 2);
+		batch.faces.push_back(out);
+	}
+}
+
+// Drop the meshes no node uses any more and number the others in the
+// order they are first used.  A mesh keeps its name if the node it is
+// named after is still there.
+static void
+RenumberMeshes(IRScene& scene)
+{
+	std::vector<int> map(scene.meshes.size(), -1);
+	std::vector<IRMesh*> meshes;
+	size_t i;
+
+	for (i = 0; i < scene.nodes.size(); i++)
+	{
+		int m = scene.nodes[i].mesh;
+		if (m < 0 || map[m] >= 0)
+			continue;
+		map[m] = (int) meshes.size();
+		meshes.push_back(scene.meshes[m]);
+		scene.meshes[m]->instances = 0;
+	}
+	for (i = 0; i < scene.meshes.size(); i++)
+	{
+		if (map[i] < 0)
+			delete scene.meshes[i];
+	}
+
+	std::vector<bool> named(meshes.size(), false);
+	for (i = 0; i < scene.nodes.size(); i++)
+	{
+		IRNode& node = scene.nodes[i];
+		if (node.mesh < 0)
+			continue;
+		node.mesh = map[node.mesh];
+		meshes[node.mesh]->instances++;
+		if (meshes[node.mesh]->name == node.name)
+			named[node.mesh] = true;
+	}
+	for (i = 0; i < scene.nodes.size(); i++)
+	{
+		IRNode& node = scene.nodes[i];
+		if (node.mesh >= 0 && !named[node.mesh])
+		{
+			meshes[node.mesh]->name = node.name;
+			named[node.mesh] = true;
+		}
+	}
+	scene.meshes.swap(meshes);
+}
+
+void
+BatchStatic(IRScene& scene, int maxVerts, int cells, BatchStats& stats)
+{
+	std::vector<int> welded(scene.meshes.size(), -1);
+	std::vector<int> candidates;
+	std::vector<float> centers;
+	float lo[3] = { 0.0f, 0.0f, 0.0f }, hi[3] = { 0.0f, 0.0f, 0.0f };
+	size_t i, j;
+	int k;
+
+	stats.nodes = stats.batches = 0;
+	stats.drawCalls[0] = stats.drawCalls[1] = DrawCalls(scene);
+
+	for (i = 0; i < scene.nodes.size(); i++)
+	{
+		const IRNode& node = scene.nodes[i];
+		if (node.kind != IR_MESH || !node.isStatic || node.mesh < 0)
+			continue;
+		const IRMesh& mesh = *scene.meshes[node.mesh];
+		if (mesh.prim.kind != IR_PRIM_NONE || mesh.NumFaces() == 0)
+			continue;
+		if (welded[node.mesh] < 0)
+		{
+			WeldedMesh w;
+			WeldMesh(mesh, w);
+			welded[node.mesh] = w.NumVerts();
+		}
+		if (welded[node.mesh] == 0 || welded[node.mesh] > maxVerts)
+			continue;
+
+		// The center of the box around the mesh, in world space
+		float bmin[3], bmax[3], c[3], w[3];
+		for (k = 0; k < 3; k++)
+			bmin[k] = bmax[k] = mesh.verts[k];
+		for (j = 3; j < mesh.verts.size(); j += 3)
+		{
+			for (k = 0; k < 3; k++)
+			{
+				float x = mesh.verts[j + k];
+				if (x < bmin[k])
+					bmin[k] = x;
+				if (x > bmax[k])
+					bmax[k] = x;
+			}
+		}
+		for (k = 0; k < 3; k++)
+			c[k] = 0.5f * (bmin[k] + bmax[k]);
+		Transform(node.world, c, w);
+		for (k = 0; k < 3; k++)
+		{
+			if (candidates.empty() || w[k] < lo[k])
+				lo[k] = w[k];
+			if (candidates.empty() || w[k] > hi[k])
+				hi[k] = w[k];
+		}
+		candidates.push_back((int) i);
+		centers.insert(centers.end(), w, w + 3);
+	}
+	if (candidates.size() < 2)
+		return;
+
+	float size = 0.0f;
+	for (k = 0; k < 3; k++)
+	{
+		if (hi[k] - lo[k] > size)
+			size = hi[k] - lo[k];
+	}
+	size /= cells > 0 ? cells : 1;
+	if (size <= 0.0f)
+		size = 1.0f;
+
+	// Group the nodes, each group in scene order
+	std::map<BatchKey, std::vector<int> > groups;
+	for (i = 0; i < candidates.size(); i++)
+	{
+		const IRNode& node = scene.nodes[candidates[i]];
+		const IRMesh& mesh = *scene.meshes[node.mesh];
+		BatchKey key;
+		for (j = 0; j < node.materials.size(); j++)
+			key.materials += IRNumber(node.materials[j]) + _T(";");
+		key.uvs = mesh.NumTVerts() > 0;
+		key.colors = !mesh.colors.empty();
+		key.normals = !mesh.faceNormals.empty();
+		for (k = 0; k < 3; k++)
+		{
+			int cell = (int) floor((centers[3 * i + k] - lo[k]) / size);
+			key.cell[k] = cell < cells ? cell : cells - 1;
+		}
+		groups[key].push_back(candidates[i]);
+	}
+
+	// Fill each batch up to the vertex budget
+	std::vector<std::vector<int> > batches;
+	std::map<BatchKey, std::vector<int> >::iterator g;
+	for (g = groups.begin(); g != groups.end(); g++)
+	{
+		std::vector<int>& members = g->second;
+		std::vector<int> batch;
+		int verts = 0;
+		for (j = 0; j <= members.size(); j++)
+		{
+			int w = j < members.size() ? welded[scene.nodes[members[j]].mesh] : 0;
+			if (j == members.size() || verts + w > maxVerts)
+			{
+				if (batch.size() > 1)
+					batches.push_back(batch);
+				batch.clear();
+				verts = 0;
+				if (j == members.size())
+					break;
+			}
+			batch.push_back(members[j]);
+			verts += w;
+		}
+	}
+	if (batches.empty())
+		return;
+
+	// Each batch goes where its first node was
+	std::sort(batches.begin(), batches.end());
+	std::vector<int> batchOf(scene.nodes.size(), -1);
+	for (i = 0; i < batches.size(); i++)
+		for (j = 0; j < batches[i].size(); j++)
+			batchOf[batches[i][j]] = (int) i;
+
+	std::vector<IRNode> nodes;
+	for (i = 0; i < scene.nodes.size(); i++)
+	{
+		int b = batchOf[i];
+		if (b < 0)
+		{
+			nodes.push_back(scene.nodes[i]);
+			continue;
+		}
+		const std::vector<int>& members = batches[b];
+		if (members[0] != (int) i)
+			continue;
+		IRMesh* mesh = new IRMesh;
+		for (j = 0; j < members.size(); j++)
+		{
+			const IRNode& member = scene.nodes[members[j]];
+			BatchAppend(*mesh, *scene.meshes[member.mesh], member.world);
+		}
+
+		const IRNode& first = scene.nodes[i];
+		IRNode node;
+		node.kind = IR_MESH;
+		node.name = _T("static_batch_") + IRNumber(b);
+		node.level = first.level;
+		node.materials = first.materials;
+		node.mesh = scene.AddMesh(mesh);
+		mesh->name = node.name;
+		nodes.push_back(node);
+		stats.nodes += (int) members.size();
+		stats.batches++;
+	}
+	scene.nodes.swap(nodes);
+	RenumberMeshes(scene);
+	stats.drawCalls[1] = DrawCalls(scene);
+}
+
+#ifdef BATCH_BENCHMARK
+// Stand-alone timing and checks on a town of small props: a few
+// thousand instances of one grid with four materials, turned, moved
+// and some of them mirrored, over a square of 1000 units:
+//
+//    g++ -O2 -DBATCH_BENCHMARK batch.cpp weld.cpp sceneir.cpp -o batchbench
+//    ./batchbench [props]
+//
+// The faces of the batches must add up to those of the props, no
+// batch may go over the vertex budget, and a corner of each prop must
+// land where its transform puts it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+int
+main(int argc, char** argv)
+{
+	int props = argc > 1 ? atoi(argv[1]) : 5000;
+	IRScene scene;
+	IRMesh* grid = IRMakeGrid(8, 8);
+	int mesh = scene.AddMesh(grid);
+	grid->name = _T("prop_0");
+	int faces = 0;
+	std::vector<float> corners;
+
+	srand(1);
+	for (int i = 0; i < props; i++)
+	{
+		IRMaterial mtl;
+		mtl.isStd = true;
+		mtl.name = _T("mtl_") + IRNumber(i % 4);
+		mtl.diffuse[0] = 0.25f * (i % 4);
+		IRNode node;
+		node.name = _T("prop_") + IRNumber(i);
+		node.isStatic = i % 10 != 0;        // a tenth of them are animated
+		node.mesh = mesh;
+		node.materials.push_back(scene.AddMaterial(mtl));
+		float a = 6.2831853f * rand() / RAND_MAX;
+		float s = i % 7 == 0 ? -1.0f : 1.0f;
+		float world[12] = { s * cosf(a), s * sinf(a), 0.0f,
+							-sinf(a), cosf(a), 0.0f,
+							0.0f, 0.0f, 1.0f,
+							1000.0f * rand() / RAND_MAX, 1000.0f * rand() / RAND_MAX, 0.0f };
+		for (int k = 0; k < 12; k++)
+			node.world[k] = world[k];
+		float p[3];
+		Transform(world, &grid->verts[0], p);
+		corners.insert(corners.end(), p, p + 3);
+		scene.AddNode(node);
+		grid->instances++;
+		faces += grid->NumFaces();
+	}
+
+	BatchStats stats;
+	clock_t start = clock();
+	BatchStatic(scene, BATCH_MAX_VERTS, BATCH_CELLS, stats);
+	double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+	int after = 0, over = 0, maxVerts = 0;
+	for (size_t i = 0; i < scene.nodes.size(); i++)
+	{
+		const IRMesh& m = *scene.meshes[scene.nodes[i].mesh];
+		after += m.NumFaces();
+		WeldedMesh w;
+		WeldMesh(m, w);
+		if (w.NumVerts() > maxVerts)
+			maxVerts = w.NumVerts();
+		if (w.NumVerts() > BATCH_MAX_VERTS)
+			over++;
+	}
+
+	// The first vertex of each prop: the first in its batch, or the
+	// one after the vertices of the props before it in the batch
+	int misplaced = 0, seen = 0;
+	for (size_t i = 0; i < scene.nodes.size(); i++)
+	{
+		const IRNode& node = scene.nodes[i];
+		const IRMesh& m = *scene.meshes[node.mesh];
+		if (node.isStatic || node.name.compare(0, 6, _T("static")) != 0)
+			continue;
+		for (int v = 0; v < m.NumVerts(); v += grid->NumVerts())
+		{
+			const float* p = &m.verts[3 * v];
+			bool found = false;
+			for (int c = 0; c < props && !found; c++)
+				found = fabsf(p[0] - corners[3 * c]) < 1e-3f &&
+					fabsf(p[1] - corners[3 * c + 1]) < 1e-3f;
+			if (!found)
+				misplaced++;
+			seen++;
+		}
+	}
+
+	printf("%d props, %d static: %d merged into %d batches in %.3fs\n",
+		   props, props - (props + 9) / 10, stats.nodes, stats.batches, seconds);
+	printf("draw calls %d -> %d (%.1fx fewer), %d meshes left\n",
+		   stats.drawCalls[0], stats.drawCalls[1],
+		   (double) stats.drawCalls[0] / stats.drawCalls[1], (int) scene.meshes.size());
+	printf("faces %d -> %d%s, largest batch %d welded vertices%s\n",
+		   faces, after, faces != after ? " FAILED" : "", maxVerts,
+		   over ? " FAILED" : "");
+	printf("%d prop corners checked, %d misplaced%s\n", seen, misplaced,
+		   misplaced ? " FAILED" : "");
+	return 0;
+}
+#endif
@@ -0,0 +1,54 @@
+/**********************************************************************
+ *<
+	FILE: batch.h
+
+	DESCRIPTION:  Static batching of mesh nodes sharing materials
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+
+#ifndef __BATCH__H__
+#define __BATCH__H__
+
+// Every mesh node of the scene file is an object of its own, and
+// three.js draws each of its materials with a draw call of its own.
+// Scenes built of many small props pay for that far more than for the
+// triangles.  BatchStatic merges mesh nodes that never move, and use
+// the same materials in the same order, into one mesh per batch, with
+// the vertices put in world space by the object to world transform
+// of each node.  The batch is written as a node at the origin.
+//
+// Nodes are only merged within a cell of a grid of cells cells on the
+// longest side of the box around the nodes, so the batches stay small
+// enough in space for the viewer to cull them.  A batch also stops at
+// maxVerts welded vertices, the most 16 bit indices can reach; a
+// node over that alone is left as it was.  A cell holding a single
+// node has nothing to merge it with.
+//
+// The node list of the scene is rebuilt with each batch in place of
+// the first node merged into it.  Meshes no node uses any more are
+// deleted, the rest renumbered, and a mesh whose node went into a
+// batch is named after the next node still using it.
+//
+// Nothing in here depends on the MAX SDK.
+
+#include "sceneir.h"
+
+#define BATCH_MAX_VERTS 65535
+#define BATCH_CELLS     8
+
+// What a batching did
+struct BatchStats {
+	int nodes;          // nodes merged into batches
+	int batches;
+	int drawCalls[2];   // one per material of each mesh node, before and after
+};
+
+// Merge the static mesh nodes of the scene into batches
+void BatchStatic(IRScene& scene, int maxVerts, int cells, BatchStats& stats);
+
+// Append mesh to batch, moved by the 4x3 matrix world (rows x, y, z
+// and translation).  Faces are turned over if world mirrors.
+void BatchAppend(IRMesh& batch, const IRMesh& mesh, const float* world);
+
+#endif
@@ -0,0 +1,480 @@
+/**********************************************************************
+ *<
+	FILE: binmesh.cpp
+
+	DESCRIPTION:  Binary geometry files for the three.js BinaryLoader
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+#include <string.h>
+#include <math.h>
+#include "binmesh.h"
+
+// The values are assembled byte by byte, so the files come out little
+// endian whatever the host is.
+static unsigned char*
+PutU32(unsigned char* p, unsigned int v)
+{
+	p[0] = (unsigned char) v;
+	p[1] = (unsigned char) (v >> 8);
+	p[2] = (unsigned char) (v >> 16);
+	p[3] = (unsigned char) (v >> 24);
+	return p + 4;
+}
+
+static unsigned char*
+PutU16(unsigned char* p, unsigned int v)
+{
+	p[0] = (unsigned char) v;
+	p[1] = (unsigned char) (v >> 8);
+	return p + 2;
+}
+
+static unsigned char*
+PutF32(unsigned char* p, float f)
+{
+	unsigned int v;
+	memcpy(&v, &f, 4);
+	return PutU32(p, v);
+}
+
+static signed char
+NormalByte(float f)
+{
+	float b = (float) floor(f * 127.0f + 0.5f);
+	if (b > 127.0f)
+		return 127;
+	if (b < -127.0f)
+		return -127;
+	return (signed char) b;
+}
+
+// Pad a block of len bytes to a multiple of 4
+static size_t
+PutPadding(OutBuffer& out, size_t len)
+{
+	static const char zeros[4] = { 0, 0, 0, 0 };
+	size_t pad = (4 - len % 4) % 4;
+	out.PutBytes(zeros, pad);
+	return pad;
+}
+
+// The arrays are assembled in a block on the stack, so that each value
+// does not cost a call into the buffer.
+#define BIN_MESH_BLOCK 4096
+
+size_t
+BinMeshWrite(OutBuffer& out, const IRMesh& mesh, bool zUp, bool mirrored)
+{
+	unsigned char block[BIN_MESH_BLOCK];
+	unsigned char* p;
+	int numverts = mesh.NumVerts();
+	int numnormals = mesh.NumNormals();
+	int numtverts = mesh.NumTVerts();
+	int numfaces = mesh.NumFaces();
+	int numvisible = 0;
+	size_t total = 0;
+	int i, k;
+
+	for (i = 0; i < numfaces; i++)
+	{
+		if (!mesh.faces[i].hidden)
+			numvisible++;
+	}
+	bool hasUVs = numtverts > 0;
+
+	// Header: signature, element sizes, then the eleven counts
+	memset(block, 0, BIN_MESH_HEADER_BYTES);
+	memcpy(block, BIN_MESH_SIGNATURE, 12);
+	block[12] = BIN_MESH_HEADER_BYTES;
+	block[13] = 4;      // vertex coordinate
+	block[14] = 1;      // normal coordinate
+	block[15] = 4;      // uv coordinate
+	block[16] = 4;      // vertex index
+	block[17] = 4;      // normal index
+	block[18] = 4;      // uv index
+	block[19] = 2;      // material index
+	p = PutU32(block + 20, numverts);
+	p = PutU32(p, numnormals);
+	p = PutU32(p, numtverts);
+	p = PutU32(p, 0);                           // flat triangles
+	p = PutU32(p, hasUVs ? 0 : numvisible);     // smooth triangles
+	p = PutU32(p, 0);                           // flat triangles with uvs
+	p = PutU32(p, hasUVs ? numvisible : 0);     // smooth triangles with uvs
+	// no quads
+	out.PutBytes(block, BIN_MESH_HEADER_BYTES);
+	total += BIN_MESH_HEADER_BYTES;
+
+	// Vertices
+	p = block;
+	for (i = 0; i < numverts; i++)
+	{
+		if (p - block > BIN_MESH_BLOCK - 12)
+		{
+			out.PutBytes(block, p - block);
+			p = block;
+		}
+		const float* v = &mesh.verts[3 * i];
+		float x = v[0], y = v[1], z = v[2];
+		if (mirrored)
+		{
+			x = -x;
+			y = -y;
+			z = -z;
+		}
+		p = PutF32(p, x);
+		p = PutF32(p, zUp ? y : z);
+		p = PutF32(p, zUp ? z : -y);
+	}
+	out.PutBytes(block, p - block);
+	total += (size_t) numverts * 12;
+
+	// Normals
+	p = block;
+	for (i = 0; i < numnormals; i++)
+	{
+		if (p - block > BIN_MESH_BLOCK - 3)
+		{
+			out.PutBytes(block, p - block);
+			p = block;
+		}
+		const float* n = &mesh.normals[3 * i];
+		*p++ = (unsigned char) NormalByte(n[0]);
+		*p++ = (unsigned char) NormalByte(zUp ? n[1] : n[2]);
+		*p++ = (unsigned char) NormalByte(zUp ? n[2] : -n[1]);
+	}
+	out.PutBytes(block, p - block);
+	total += (size_t) numnormals * 3;
+	total += PutPadding(out, (size_t) numnormals * 3);
+
+	// Texture vertices
+	p = block;
+	for (i = 0; i < numtverts; i++)
+	{
+		if (p - block > BIN_MESH_BLOCK - 8)
+		{
+			out.PutBytes(block, p - block);
+			p = block;
+		}
+		p = PutF32(p, mesh.tverts[2 * i]);
+		p = PutF32(p, 1.0f - mesh.tverts[2 * i + 1]);
+	}
+	out.PutBytes(block, p - block);
+	total += (size_t) numtverts * 8;
+
+	// The triangles, as consecutive arrays of vertex indices, normal
+	// indices, uv indices and material indices.
+	int arrays = hasUVs ? 4 : 3;
+	for (k = 0; k < arrays; k++)
+	{
+		bool mtl = k == arrays - 1;
+		p = block;
+		for (i = 0; i < numfaces; i++)
+		{
+			const IRFace& f = mesh.faces[i];
+			if (f.hidden)
+				continue;
+			if (p - block > BIN_MESH_BLOCK - 12)
+			{
+				out.PutBytes(block, p - block);
+				p = block;
+			}
+			if (mtl)
+				p = PutU16(p, f.matID);
+			else if (k == 0)
+			{
+				p = PutU32(p, f.v[0]);
+				p = PutU32(p, f.v[1]);
+				p = PutU32(p, f.v[2]);
+			}
+			else if (k == 1)
+			{
+				p = PutU32(p, mesh.faceNormals[3 * i]);
+				p = PutU32(p, mesh.faceNormals[3 * i + 1]);
+				p = PutU32(p, mesh.faceNormals[3 * i + 2]);
+			}
+			else
+			{
+				p = PutU32(p, f.t[0]);
+				p = PutU32(p, f.t[1]);
+				p = PutU32(p, f.t[2]);
+			}
+		}
+		out.PutBytes(block, p - block);
+		total += (size_t) numvisible * (mtl ? 2 : 12);
+	}
+	total += PutPadding(out, (size_t) numvisible * 2);
+	return total;
+}
+
+#ifdef BINMESH_BENCHMARK
+// Stand-alone size and time comparison of the ASCII and binary
+// geometry on an exported scene:
+//
+//    g++ -O2 -DBINMESH_BENCHMARK -o binbench binmesh.cpp outbuf.cpp
+//        fltfmt.cpp sceneir.cpp
+//    ./binbench exports/BMW7/scene.js
+//
+// The meshes are read back from the "embeds" of the scene, written
+// again both ways, and the bytes and times of both are reported.
+// Without a file the synthetic grid is used.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "fltfmt.h"
+
+// Find the next array called name at or after p, returns the first
+// character after its '['
+static const char*
+FindArray(const char* p, const char* end, const char* name)
+{
+	size_t len = strlen(name);
+	for (; p + len < end; p++)
+	{
+		if (*p == '"' && memcmp(p + 1, name, len) == 0 && p[len + 1] == '"')
+		{
+			const char* q = p + len + 2;
+			while (q < end && *q != '[')
+				q++;
+			return q < end ? q + 1 : NULL;
+		}
+	}
+	return NULL;
+}
+
+// Read the numbers of an array up to its closing ']'
+static const char*
+ReadArray(const char* p, std::vector<double>& vals)
+{
+	for (;;)
+	{
+		while (*p == ' ' || *p == ',' || *p == '\n' || *p == '\r' ||
+			   *p == '\t' || *p == '[')
+			p++;
+		if (*p == ']' || *p == 0)
+			return p;
+		char* next;
+		vals.push_back(strtod(p, &next));
+		if (next == p)
+			return p;
+		p = next;
+	}
+}
+
+// Rebuild the meshes written by the ASCII exporter (JSON format 3)
+static void
+ReadEmbeds(const char* text, size_t size, std::vector<IRMesh*>& meshes,
+		   size_t* asciiBytes)
+{
+	const char* end = text + size;
+	const char* p = text;
+	std::vector<double> v, n, uv, f;
+
+	*asciiBytes = 0;
+	while ((p = FindArray(p, end, "vertices")) != NULL)
+	{
+		const char* start = p;
+		v.clear(); n.clear(); uv.clear(); f.clear();
+		p = ReadArray(p, v);
+		if ((p = FindArray(p, end, "normals")) == NULL)
+			break;
+		p = ReadArray(p, n);
+		if ((p = FindArray(p, end, "uvs")) == NULL)
+			break;
+		p = ReadArray(p, uv);
+		if ((p = FindArray(p, end, "faces")) == NULL)
+			break;
+		p = ReadArray(p, f);
+		*asciiBytes += p - start;
+
+		IRMesh* mesh = new IRMesh;
+		size_t i;
+		for (i = 0; i < v.size(); i++)
+			mesh->verts.push_back((float) v[i]);
+		for (i = 0; i < n.size(); i++)
+			mesh->normals.push_back((float) n[i]);
+		for (i = 0; i + 1 < uv.size(); i += 2)
+		{
+			mesh->tverts.push_back((float) uv[i]);
+			mesh->tverts.push_back((float) (1.0 - uv[i + 1]));
+		}
+		for (i = 0; i < f.size(); )
+		{
+			int type = (int) f[i++];
+			int nv = (type & 1) ? 4 : 3;
+			IRFace face;
+			int vi[4], ti[4] = { 0, 0, 0, 0 }, ni[4] = { 0, 0, 0, 0 };
+			int k;
+			for (k = 0; k < nv; k++)
+				vi[k] = (int) f[i++];
+			face.matID = (type & 2) ? (int) f[i++] : 0;
+			if (type & 4)
+				i++;
+			if (type & 8)
+				for (k = 0; k < nv; k++)
+					ti[k] = (int) f[i++];
+			if (type & 16)
+				i++;
+			if (type & 32)
+				for (k = 0; k < nv; k++)
+					ni[k] = (int) f[i++];
+			if (type & 64)
+				i++;
+			if (type & 128)
+				i += nv;
+			face.smGroup = 1;
+			face.hidden = false;
+			for (int t = 0; t < nv - 2; t++)
+			{
+				int c[3] = { 0, t + 1, t + 2 };
+				face.edgeVis = nv == 3 ? 7 : t == 0 ? 3 : 6;
+				for (k = 0; k < 3; k++)
+				{
+					face.v[k] = vi[c[k]];
+					face.t[k] = ti[c[k]];
+					mesh->faceNormals.push_back(ni[c[k]]);
+				}
+				mesh->faces.push_back(face);
+			}
+		}
+		meshes.push_back(mesh);
+	}
+}
+
+// The ASCII arrays as the exporter writes them, without indentation
+static void
+WriteAscii(OutBuffer& out, const IRMesh& mesh, int digits)
+{
+	TCHAR buf[3 * FLT_FMT_MAX];
+	TCHAR* e;
+	int i, k;
+
+	out.Put(_T("\"vertices\" : [\n"));
+	for (i = 0; i < mesh.NumVerts(); i++)
+	{
+		const float* v = &mesh.verts[3 * i];
+		e = FltFixed(buf, v[0], digits);
+		*e++ = ',';
+		e = FltFixed(e, v[1], digits);
+		*e++ = ',';
+		e = FltFixed(e, v[2], digits);
+		out.Put(buf, (int) (e - buf));
+		out.Put(_T(", "), 2);
+	}
+	out.Put(_T("],\n\"normals\" : [\n"));
+	for (i = 0; i < mesh.NumNormals(); i++)
+	{
+		const float* n = &mesh.normals[3 * i];
+		e = FltGeneral(buf, n[0], digits);
+		*e++ = ',';
+		e = FltGeneral(e, n[1], digits);
+		*e++ = ',';
+		e = FltGeneral(e, n[2], digits);
+		out.Put(buf, (int) (e - buf));
+		out.Put(_T(", "), 2);
+	}
+	out.Put(_T("],\n\"uvs\" : [[\n"));
+	for (i = 0; i < mesh.NumTVerts(); i++)
+	{
+		e = FltGeneral(buf, mesh.tverts[2 * i], digits);
+		*e++ = ',';
+		e = FltGeneral(e, 1.0f - mesh.tverts[2 * i + 1], digits);
+		out.Put(buf, (int) (e - buf));
+		out.Put(_T(", "), 2);
+	}
+	out.Put(_T("]],\n\"faces\" : [\n"));
+	for (i = 0; i < mesh.NumFaces(); i++)
+	{
+		const IRFace& f = mesh.faces[i];
+		out.PutInt(mesh.NumTVerts() > 0 ? 42 : 34);
+		for (k = 0; k < 3; k++)
+		{
+			out.Put(_T(", "), 2);
+			out.PutInt(f.v[k]);
+		}
+		out.Put(_T(", "), 2);
+		out.PutInt(f.matID);
+		if (mesh.NumTVerts() > 0)
+			for (k = 0; k < 3; k++)
+			{
+				out.Put(_T(","), 1);
+				out.PutInt(f.t[k]);
+			}
+		for (k = 0; k < 3; k++)
+		{
+			out.Put(_T(","), 1);
+			out.PutInt(mesh.faceNormals[3 * i + k]);
+		}
+		out.Put(_T(","), 1);
+	}
+	out.Put(_T("]\n"));
+}
+
+int
+main(int argc, char** argv)
+{
+	std::vector<IRMesh*> meshes;
+	size_t fileBytes = 0, asciiBytes = 0;
+	int i, m, runs = 10;
+
+	if (argc > 1)
+	{
+		FILE* fp = fopen(argv[1], "rb");
+		if (!fp)
+		{
+			printf("can't open %s\n", argv[1]);
+			return 1;
+		}
+		fseek(fp, 0, SEEK_END);
+		fileBytes = ftell(fp);
+		fseek(fp, 0, SEEK_SET);
+		char* text = (char*) malloc(fileBytes + 1);
+		fileBytes = fread(text, 1, fileBytes, fp);
+		text[fileBytes] = 0;
+		fclose(fp);
+		ReadEmbeds(text, fileBytes, meshes, &asciiBytes);
+		free(text);
+	}
+	else
+		meshes.push_back(IRMakeGrid(300, 300));
+
+	size_t verts = 0, faces = 0;
+	for (m = 0; m < (int) meshes.size(); m++)
+	{
+		verts += meshes[m]->NumVerts();
+		faces += meshes[m]->NumFaces();
+	}
+
+	OutBuffer ascii, binary;
+	clock_t start = clock();
+	for (i = 0; i < runs; i++)
+	{
+		ascii.Clear();
+		for (m = 0; m < (int) meshes.size(); m++)
+			WriteAscii(ascii, *meshes[m], 4);
+	}
+	double asciiTime = (double) (clock() - start) / CLOCKS_PER_SEC / runs;
+
+	start = clock();
+	for (i = 0; i < runs; i++)
+	{
+		binary.Clear();
+		for (m = 0; m < (int) meshes.size(); m++)
+			BinMeshWrite(binary, *meshes[m], true, false);
+	}
+	double binaryTime = (double) (clock() - start) / CLOCKS_PER_SEC / runs;
+
+	printf("%d meshes, %d vertices, %d triangles\n", (int) meshes.size(),
+		   (int) verts, (int) faces);
+	if (fileBytes)
+		printf("scene file %d bytes, geometry arrays %d bytes\n",
+			   (int) fileBytes, (int) asciiBytes);
+	printf("ASCII  %9d bytes, %.2f ms\n", (int) ascii.Size(), asciiTime * 1000.0);
+	printf("binary %9d bytes, %.2f ms\n", (int) binary.Size(), binaryTime * 1000.0);
+
+	for (m = 0; m < (int) meshes.size(); m++)
+		delete meshes[m];
+	return 0;
+}
+#endif
@@ -0,0 +1,37 @@
+/**********************************************************************
+ *<
+	FILE: binmesh.h
+
+	DESCRIPTION:  Binary geometry files for the three.js BinaryLoader
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+
+#ifndef __BINMESH__H__
+#define __BINMESH__H__
+
+// A "bin_mesh" geometry is a small JSON file naming a buffer file, as
+// read by THREE.BinaryLoader:
+//
+//   64 byte header   "Three.js 003", element sizes and counts
+//   vertices         3 float32 each
+//   normals          3 int8 each (x 127), padded to 4 bytes
+//   uvs              2 float32 each
+//   triangles        uint32 vertex, normal and uv indices, uint16
+//                    material index, padded to 4 bytes
+//
+// Everything is little endian.  Positions, normals and uvs are
+// converted the way the ASCII writer does it: Y up unless zUp is set,
+// mirrored meshes negated, v flipped.
+
+#include "sceneir.h"
+#include "outbuf.h"
+
+#define BIN_MESH_SIGNATURE    "Three.js 003"
+#define BIN_MESH_HEADER_BYTES 64
+
+// Write the buffer file of a mesh, returns the number of bytes written
+size_t BinMeshWrite(OutBuffer& out, const IRMesh& mesh, bool zUp,
+					bool mirrored);
+
+#endif
@@ -0,0 +1,341 @@
+/**********************************************************************
+ *<
+	FILE: fltfmt.cpp
+
+	DESCRIPTION:  Locale independent float formatting
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "fltfmt.h"
+
+#ifdef _WIN32
+#define FLT_SNPRINTF _sntprintf
+#else
+#define FLT_SNPRINTF snprintf
+#endif
+
+// A float has 24 significant bits and 5^12 takes 28, so f * 10^n is
+// exact in a double for n up to 12.  Within that range the decimal
+// digits can be had from a single multiply and an integer conversion.
+#define FLT_EXACT_DIGITS 12
+
+typedef unsigned long long FltUInt;
+
+static const double sPow10[] = {
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+	1e8,  1e9,  1e10, 1e11, 1e12, 1e13
+};
+
+static const FltUInt sIPow10[] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+	10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+	100000000000ULL, 1000000000000ULL, 10000000000000ULL
+};
+
+static bool
+IsNegative(float f)
+{
+	union {
+		float        f;
+		unsigned int i;
+	} u;
+	u.f = f;
+	return (u.i & 0x80000000) != 0;
+}
+
+// Round a * 10^digits to an integer, ties to even.  Returns false if
+// the result does not fit in 63 bits (or a is not a number).
+static bool
+ScaleRound(double a, int digits, FltUInt* r)
+{
+	double t = a * sPow10[digits];
+	if (!(t < 9.0e18))
+		return false;
+	double fl = floor(t);
+	double frac = t - fl;
+	FltUInt n = (FltUInt) fl;
+	if (frac > 0.5 || (frac == 0.5 && (n & 1)))
+		n++;
+	*r = n;
+	return true;
+}
+
+// Write n with its last digits after the decimal point
+static TCHAR*
+PutDecimal(TCHAR* buf, bool neg, FltUInt n, int digits)
+{
+	TCHAR tmp[32];
+	int len = 0;
+
+	do {
+		tmp[len++] = (TCHAR) ('0' + (int) (n % 10));
+		n /= 10;
+	} while (n);
+	while (len <= digits)
+		tmp[len++] = '0';
+
+	if (neg)
+		*buf++ = '-';
+	while (len > digits)
+		*buf++ = tmp[--len];
+	if (digits > 0)
+	{
+		*buf++ = '.';
+		while (len > 0)
+			*buf++ = tmp[--len];
+	}
+	return buf;
+}
+
+// Let the C runtime do what the fast path does not handle: large or
+// tiny values, exponent notation, infinities and NaNs.
+static TCHAR*
+CrtFormat(TCHAR* buf, float f, int digits, TCHAR conv)
+{
+	TCHAR format[16];
+	int len;
+
+	if (digits > 20)
+		digits = 20;
+	FLT_SNPRINTF(format, 16, _T("%%.%d%c"), digits, conv);
+	len = FLT_SNPRINTF(buf, FLT_FMT_MAX, format, (double) f);
+	if (len < 0 || len >= FLT_FMT_MAX)
+		len = FLT_FMT_MAX - 1;
+	for (int i = 0; i < len; i++)
+	{
+		if (buf[i] == ',') // NOTE!: International numbers may contain commas
+			buf[i] = '.';
+	}
+	return buf + len;
+}
+
+TCHAR*
+FltFixed(TCHAR* buf, float f, int digits)
+{
+	FltUInt n;
+
+	if (digits < 0 || digits > FLT_EXACT_DIGITS)
+		return CrtFormat(buf, f, digits, 'f');
+	if (!ScaleRound(fabs((double) f), digits, &n))
+		return CrtFormat(buf, f, digits, 'f');
+	return PutDecimal(buf, IsNegative(f), n, digits);
+}
+
+TCHAR*
+FltGeneral(TCHAR* buf, float f, int digits)
+{
+	int prec = digits == 0 ? 1 : digits;
+	bool neg = IsNegative(f);
+	double a = fabs((double) f);
+	int x, decimals;
+	FltUInt n;
+
+	if (digits < 0 || prec > FLT_EXACT_DIGITS || a != a)
+		return CrtFormat(buf, f, digits, 'g');
+
+	if (a == 0.0)
+	{
+		if (neg)
+			*buf++ = '-';
+		*buf++ = '0';
+		return buf;
+	}
+
+	// Find the decimal exponent x, 10^x <= a < 10^(x+1).  Values
+	// that come out in exponent notation go to the runtime.
+	if (a >= 1.0)
+	{
+		if (a >= sPow10[prec])
+			return CrtFormat(buf, f, digits, 'g');
+		for (x = 0; a >= sPow10[x + 1]; x++)
+			;
+	}
+	else
+	{
+		for (x = -1; x >= -5 && a * sPow10[-x] < 1.0; x--)
+			;
+		if (x < -5)
+			return CrtFormat(buf, f, digits, 'g');
+	}
+
+	decimals = prec - 1 - x;
+	if (decimals > FLT_EXACT_DIGITS || !ScaleRound(a, decimals, &n))
+		return CrtFormat(buf, f, digits, 'g');
+	if (n >= sIPow10[prec])
+	{
+		// Rounding carried into a new digit, 9.9996 -> 10.00
+		x++;
+		decimals--;
+		n /= 10;
+	}
+	if (x < -4 || x >= prec)
+		return CrtFormat(buf, f, digits, 'g');
+
+	// %g drops the trailing zeros of the fraction
+	while (decimals > 0 && n % 10 == 0)
+	{
+		n /= 10;
+		decimals--;
+	}
+	return PutDecimal(buf, neg, n, decimals);
+}
+
+#ifdef FLTFMT_BENCHMARK
+// Stand-alone check and timing against the printf path the exporter
+// used before (format string, sprintf, CommaScan):
+//
+//    g++ -O2 -DFLTFMT_BENCHMARK fltfmt.cpp -o fltbench
+//    ./fltbench [count]
+
+#include <stdlib.h>
+#include <time.h>
+#ifndef _WIN32
+#define _tcscmp strcmp
+#endif
+
+static void
+CommaScan(TCHAR* buf)
+{
+	for(; *buf; buf++)
+	{
+		if (*buf == ',')
+			*buf = '.';
+		if (*buf == ' ')
+			*buf = ',';
+	}
+}
+
+static float
+Clamp(float f)
+{
+	if (f < 0.0f) {
+		if (f > -1.0e-5)
+			return 0.0f;
+		return f;
+	}
+	if (f < 1.0e-5)
+		return 0.0f;
+	return f;
+}
+
+static unsigned int sSeed = 12345;
+
+static float
+RandomFloat()
+{
+	sSeed = sSeed * 1103515245 + 12345;
+	unsigned int r = (sSeed >> 8) & 0xffffff;
+	switch (r % 5)
+	{
+	case 0:  return (r / 16777216.0f) * 2.0f - 1.0f;          // normals
+	case 1:  return (r / 16777216.0f) * 2000.0f - 1000.0f;    // positions
+	case 2:  return (r / 16777216.0f) * 0.001f;               // near zero
+	case 3:  return (float) ((int) (r % 4096) - 2048) / 64.0f; // exact ties
+	default: return (r / 16777216.0f) * 1.0e6f;               // large
+	}
+}
+
+static int
+Check(const float* vals, int count)
+{
+	TCHAR format[16], want[FLT_FMT_MAX], got[FLT_FMT_MAX];
+	int bad = 0;
+
+	for (int digits = 0; digits <= 8; digits++)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			for (int g = 0; g < 2; g++)
+			{
+				float f = Clamp(vals[i]);
+				FLT_SNPRINTF(format, 16, g ? _T("%%.%dg") : _T("%%.%df"), digits);
+				FLT_SNPRINTF(want, FLT_FMT_MAX, format, f);
+				TCHAR* end = g ? FltGeneral(got, f, digits) : FltFixed(got, f, digits);
+				*end = 0;
+				if (_tcscmp(want, got) != 0 && bad++ < 10)
+					printf("mismatch %%.%d%c of %.9g: %s vs %s\n", digits,
+						   g ? 'g' : 'f', f, want, got);
+			}
+		}
+	}
+	return bad;
+}
+
+int
+main(int argc, char** argv)
+{
+	int count = argc > 1 ? atoi(argv[1]) : 1000000;
+	float* vals = new float[count * 3];
+	TCHAR format[20], buf[3 * FLT_FMT_MAX];
+	size_t total = 0;
+	int i, digits;
+
+	for (i = 0; i < count * 3; i++)
+		vals[i] = RandomFloat();
+
+	int bad = Check(vals, count < 200000 ? count : 200000);
+	printf("check: %d mismatches\n", bad);
+
+	for (digits = 3; digits <= 6; digits++)
+	{
+		clock_t start = clock();
+		for (i = 0; i < count; i++)
+		{
+			float* p = vals + 3 * i;
+			FLT_SNPRINTF(format, 20, _T("%%.%df %%.%df %%.%df"), digits, digits, digits);
+			FLT_SNPRINTF(buf, 3 * FLT_FMT_MAX, format, Clamp(p[0]), Clamp(p[1]), Clamp(p[2]));
+			CommaScan(buf);
+			total += buf[0];
+		}
+		double oldTime = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+		start = clock();
+		for (i = 0; i < count; i++)
+		{
+			float* p = vals + 3 * i;
+			TCHAR* end = FltFixed(buf, Clamp(p[0]), digits);
+			*end++ = ',';
+			end = FltFixed(end, Clamp(p[1]), digits);
+			*end++ = ',';
+			end = FltFixed(end, Clamp(p[2]), digits);
+			*end = 0;
+			total += buf[0];
+		}
+		double newTime = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+		start = clock();
+		for (i = 0; i < count; i++)
+		{
+			float* p = vals + 3 * i;
+			FLT_SNPRINTF(format, 20, _T("%%.%dg %%.%dg %%.%dg"), digits, digits, digits);
+			FLT_SNPRINTF(buf, 3 * FLT_FMT_MAX, format, Clamp(p[0]), Clamp(p[1]), Clamp(p[2]));
+			CommaScan(buf);
+			total += buf[0];
+		}
+		double oldGTime = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+		start = clock();
+		for (i = 0; i < count; i++)
+		{
+			float* p = vals + 3 * i;
+			TCHAR* end = FltGeneral(buf, Clamp(p[0]), digits);
+			*end++ = ',';
+			end = FltGeneral(end, Clamp(p[1]), digits);
+			*end++ = ',';
+			end = FltGeneral(end, Clamp(p[2]), digits);
+			*end = 0;
+			total += buf[0];
+		}
+		double newGTime = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+		printf("%d digits, %d points: %%f %.3fs -> %.3fs (x%.1f), %%g %.3fs -> %.3fs (x%.1f)\n",
+			   digits, count, oldTime, newTime, oldTime / newTime,
+			   oldGTime, newGTime, oldGTime / newGTime);
+	}
+	delete [] vals;
+	return total == 0;
+}
+#endif
@@ -0,0 +1,36 @@
+/**********************************************************************
+ *<
+	FILE: fltfmt.h
+
+	DESCRIPTION:  Locale independent float formatting
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+
+#ifndef __FLTFMT__H__
+#define __FLTFMT__H__
+
+// FltFixed formats f as printf("%.*f", digits, f) and FltGeneral as
+// printf("%.*g", digits, f), always with a '.' for the decimal point
+// whatever the current locale is.  Both write into buf without a
+// terminating null and return the end of the text they wrote, so
+// several numbers can be put one after the other.  buf must have room
+// for FLT_FMT_MAX characters.
+//
+// Rounding is done on the exact binary value of f, ties to even.
+
+#ifdef _WIN32
+#include <tchar.h>
+#else
+#ifndef _T
+typedef char TCHAR;
+#define _T(x) x
+#endif
+#endif
+
+#define FLT_FMT_MAX 64
+
+TCHAR* FltFixed(TCHAR* buf, float f, int digits);
+TCHAR* FltGeneral(TCHAR* buf, float f, int digits);
+
+#endif
@@ -0,0 +1,345 @@
+/**********************************************************************
+ *<
+	FILE: normtab.cpp
+
+	DESCRIPTION:  Normal Hash Table
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+#include "normtab.h"
+
+NormalTable::NormalTable(int expected)
+{
+	unsigned int size = NORM_TABLE_SIZE;
+	while (size < 2 * (unsigned int) expected)
+		size *= 2;
+	mSlots.assign(size, 0);
+	mMask = size - 1;
+	if (expected > 0)
+		mKeys.reserve(expected);
+	mProbes = 0.0;
+	mLookups = 0.0;
+	mMaxProbe = 0;
+}
+
+// Truncate a normal into the key used by the table
+NormalKey
+NormalTable::MakeKey(const float* norm)
+{
+	NormalKey key;
+	key.x = (int) (NUM_NORMS * norm[0]);
+	key.y = (int) (NUM_NORMS * norm[1]);
+	key.z = (int) (NUM_NORMS * norm[2]);
+	return key;
+}
+
+// Mix all bits of the three components, so that keys differing in the
+// low bits of one component spread over the whole table
+unsigned int
+NormalTable::HashCode(const NormalKey& key)
+{
+	unsigned int h = (unsigned int) key.x;
+	h = h * 0x9E3779B1u + (unsigned int) key.y;
+	h = h * 0x9E3779B1u + (unsigned int) key.z;
+	h ^= h >> 16;
+	h *= 0x85EBCA6Bu;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35u;
+	h ^= h >> 16;
+	return h;
+}
+
+// Look for a key.  Returns its index, or -1 with slot set to the free
+// slot where it belongs.
+int
+NormalTable::Find(const NormalKey& key, unsigned int& slot)
+{
+	int probe = 1;
+	for (slot = HashCode(key) & mMask; ; slot = (slot + 1) & mMask, probe++)
+	{
+		int entry = mSlots[slot];
+		if (entry == 0)
+			break;
+		const NormalKey& k = mKeys[entry - 1];
+		if (k.x == key.x && k.y == key.y && k.z == key.z)
+		{
+			mProbes += probe;
+			mLookups += 1.0;
+			if (probe > mMaxProbe)
+				mMaxProbe = probe;
+			return entry - 1;
+		}
+	}
+	mProbes += probe;
+	mLookups += 1.0;
+	if (probe > mMaxProbe)
+		mMaxProbe = probe;
+	return -1;
+}
+
+// Double the number of slots and put the keys back in
+void
+NormalTable::Grow()
+{
+	unsigned int size = 2 * (mMask + 1);
+	mSlots.assign(size, 0);
+	mMask = size - 1;
+	for (int i = 0; i < (int) mKeys.size(); i++)
+	{
+		unsigned int slot = HashCode(mKeys[i]) & mMask;
+		while (mSlots[slot] != 0)
+			slot = (slot + 1) & mMask;
+		mSlots[slot] = i + 1;
+	}
+}
+
+// Add a normal to the hash table
+int
+NormalTable::AddNormal(const float* norm)
+{
+	NormalKey key = MakeKey(norm);
+	unsigned int slot;
+	int index = Find(key, slot);
+	if (index >= 0)
+		return index;
+
+	// Keep at least half of the slots free so probes stay short
+	if (2 * (mKeys.size() + 1) > mSlots.size())
+	{
+		Grow();
+		slot = HashCode(key) & mMask;
+		while (mSlots[slot] != 0)
+			slot = (slot + 1) & mMask;
+	}
+	index = (int) mKeys.size();
+	mKeys.push_back(key);
+	mSlots[slot] = index + 1;
+	return index;
+}
+
+// Get the index of a normal in the table
+int
+NormalTable::GetIndex(const float* norm)
+{
+	unsigned int slot;
+	return Find(MakeKey(norm), slot);
+}
+
+void
+NormalTable::GetNormal(int index, float* norm) const
+{
+	const NormalKey& key = mKeys[index];
+	norm[0] = (float) key.x / NUM_NORMS;
+	norm[1] = (float) key.y / NUM_NORMS;
+	norm[2] = (float) key.z / NUM_NORMS;
+}
+
+void
+NormalTable::Clear()
+{
+	mKeys.clear();
+	mSlots.assign(mSlots.size(), 0);
+	mProbes = 0.0;
+	mLookups = 0.0;
+	mMaxProbe = 0;
+}
+
+double
+NormalTable::AverageProbe() const
+{
+	return mLookups > 0.0 ? mProbes / mLookups : 0.0;
+}
+
+#ifdef NORMTAB_BENCHMARK
+// Stand-alone timing on synthetic meshes of about a million normals,
+// against the fixed 1001 bucket chained table the exporter used
+// before.  Every normal is looked up once per face corner using it, as
+// the exporter does:
+//
+//    g++ -O2 -DNORMTAB_BENCHMARK normtab.cpp -o normbench
+//    ./normbench [rows]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+// The old table, as it was
+#define OLD_TABLE_SIZE 1001
+
+struct OldDesc {
+	float n[3];
+	int   index;
+	OldDesc* next;
+};
+
+class OldTable {
+public:
+	OldTable()
+	{
+		memset(tab, 0, sizeof(tab));
+		chains = 0.0;
+		lookups = 0.0;
+		maxChain = 0;
+	}
+	~OldTable()
+	{
+		for (int i = 0; i < OLD_TABLE_SIZE; i++)
+		{
+			while (tab[i])
+			{
+				OldDesc* next = tab[i]->next;
+				delete tab[i];
+				tab[i] = next;
+			}
+		}
+	}
+	void AddNormal(const float* norm)
+	{
+		float n[3];
+		Normalize(norm, n);
+		unsigned int code = HashCode(n);
+		if (Find(code, n))
+			return;
+		OldDesc* nd = new OldDesc;
+		memcpy(nd->n, n, sizeof(n));
+		nd->index = -1;
+		nd->next = tab[code];
+		tab[code] = nd;
+	}
+	int GetIndex(const float* norm)
+	{
+		float n[3];
+		Normalize(norm, n);
+		OldDesc* nd = Find(HashCode(n), n);
+		return nd ? nd->index : -1;
+	}
+	// The emit order: all buckets in turn
+	void Number()
+	{
+		int index = 0;
+		for (int i = 0; i < OLD_TABLE_SIZE; i++)
+			for (OldDesc* nd = tab[i]; nd; nd = nd->next)
+				nd->index = index++;
+	}
+
+	double chains;
+	double lookups;
+	int    maxChain;
+
+private:
+	static void Normalize(const float* norm, float* n)
+	{
+		for (int i = 0; i < 3; i++)
+			n[i] = normNorm(norm[i]);
+	}
+	static unsigned int HashCode(const float* n)
+	{
+		unsigned int i[3];
+		memcpy(i, n, sizeof(i));
+		return ((i[0] >> 8) + (i[1] >> 16) + i[2]) % OLD_TABLE_SIZE;
+	}
+	OldDesc* Find(unsigned int code, const float* n)
+	{
+		int length = 1;
+		OldDesc* nd;
+		for (nd = tab[code]; nd; nd = nd->next, length++)
+		{
+			if (nd->n[0] == n[0] && nd->n[1] == n[1] && nd->n[2] == n[2])
+				break;
+		}
+		chains += length;
+		lookups += 1.0;
+		if (length > maxChain)
+			maxChain = length;
+		return nd;
+	}
+
+	OldDesc* tab[OLD_TABLE_SIZE];
+};
+
+// Smooth sphere of rows x rows vertices: each normal is shared by the
+// six corners around its vertex
+static void
+MakeSphere(int rows, std::vector<float>& normals)
+{
+	for (int i = 0; i < rows; i++)
+	{
+		float theta = 3.14159265f * (i + 0.5f) / rows;
+		for (int j = 0; j < rows; j++)
+		{
+			float phi = 2.0f * 3.14159265f * j / rows;
+			float n[3] = { sinf(theta) * cosf(phi), sinf(theta) * sinf(phi),
+						   cosf(theta) };
+			for (int k = 0; k < 6; k++)
+				normals.insert(normals.end(), n, n + 3);
+		}
+	}
+}
+
+// Faceted noisy terrain of rows x rows quads: two face normals each
+// used by three corners
+static void
+MakeFaceted(int rows, std::vector<float>& normals)
+{
+	srand(1);
+	for (int i = 0; i < 2 * rows * rows; i++)
+	{
+		float n[3] = { (float) rand() / RAND_MAX - 0.5f,
+					   (float) rand() / RAND_MAX - 0.5f, 1.0f };
+		float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		for (int k = 0; k < 3; k++)
+			n[k] /= len;
+		for (int k = 0; k < 3; k++)
+			normals.insert(normals.end(), n, n + 3);
+	}
+}
+
+static void
+Run(const char* name, const std::vector<float>& normals)
+{
+	int corners = (int) normals.size() / 3;
+	const float* p = &normals[0];
+	long checksum = 0;
+
+	clock_t start = clock();
+	NormalTable table;
+	for (int i = 0; i < corners; i++)
+		table.AddNormal(p + 3 * i);
+	for (int i = 0; i < corners; i++)
+		checksum += table.GetIndex(p + 3 * i);
+	double newTime = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+	start = clock();
+	OldTable old;
+	for (int i = 0; i < corners; i++)
+		old.AddNormal(p + 3 * i);
+	old.Number();
+	for (int i = 0; i < corners; i++)
+		checksum -= old.GetIndex(p + 3 * i);
+	double oldTime = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+	printf("%s: %d corners, %d normals\n", name, corners, table.Count());
+	printf("  chained 1001:    %.3fs, avg chain %.1f, max %d\n", oldTime,
+		   old.chains / old.lookups, old.maxChain);
+	printf("  open addressing: %.3fs, avg probe %.2f, max %d, %d slots "
+		   "(x%.0f)\n", newTime, table.AverageProbe(), table.MaxProbe(),
+		   table.Slots(), oldTime / newTime);
+	(void) checksum;
+}
+
+int
+main(int argc, char** argv)
+{
+	int rows = argc > 1 ? atoi(argv[1]) : 1000;
+	std::vector<float> normals;
+
+	MakeSphere(rows, normals);
+	Run("smooth sphere", normals);
+	normals.clear();
+	MakeFaceted((int) (rows / 1.414f), normals);
+	Run("faceted terrain", normals);
+	return 0;
+}
+#endif
@@ -9,53 +9,76 @@
  *>	Copyright (c) 1996, All Rights Reserved.
  **********************************************************************/
 
+#ifndef __NORMTAB__H__
+#define __NORMTAB__H__
+
+// Normals are truncated to NUM_NORMS steps per unit so that close
+// normals share one entry.  The truncated integer triple is the key of
+// the table; nothing else about a normal is stored.
+//
+// The table uses open addressing with linear probing in a power of two
+// array of slots that doubles before it is half full, so a mesh with a
+// million distinct normals costs about as much per lookup as a cube.
+// The keys live in one array per table, in the order they were first
+// added, and the index of a normal is its position in that array: the
+// normals can be written out by walking it and an index never changes
+// once handed out.
+//
+// Nothing in here depends on the MAX SDK.  AddNormal and GetIndex take
+// a pointer to x, y and z, which a Point3 converts to.
+
+#include <vector>
+
 #define NUM_NORMS 10000.0f
 #define normNorm(w) ((float) ((int) (NUM_NORMS * (w))))
 
-// Truncate normals into the specified range.
-inline 
-Point3 NormalizeNorm(Point3 norm)
-{
-    Point3 p;
-    p.x = normNorm(norm.x);
-    p.y = normNorm(norm.y);
-    p.z = normNorm(norm.z);
-    return p;
-}
-
-// A normal table hash bucket.
-class NormalDesc {
-public:
-    NormalDesc(Point3& norm) {
-        n = NormalizeNorm(norm);
-        index = -1;
-        next = NULL;
-    }
-    ~NormalDesc() { delete next; }
-    Point3 n;           // The normalize normal
-    int    index;       // The index in the index face set
-    NormalDesc* next;   // Next hash bucket.
-};
+#define NORM_TABLE_SIZE 1024    // initial number of slots, a power of two
 
 // Un-comment this line to get data on the normal hash table
 // #define DEBUG_NORM_HASH
 
+// A truncated normal
+struct NormalKey {
+    int x, y, z;
+};
+
 // Hash table for rendering normals
-class NormalTable 
+class NormalTable
 {
 public:
-    NormalTable();
-    ~NormalTable();
-
-    void AddNormal(Point3& norm);
-    int GetIndex(Point3& norm);
-    NormalDesc* Get(int i) { return tab[i]; }
-    void PrintStats(FILE* mStream);
-    
+    // expected is the number of distinct normals to make room for
+    NormalTable(int expected = 0);
+
+    // Add a normal if it is not in the table yet.  Returns its index.
+    int AddNormal(const float* norm);
+    // Returns the index of a normal, -1 if it was never added
+    int GetIndex(const float* norm);
+
+    // Number of distinct normals, and the truncated normal of an index
+    // scaled back to unit length
+    int  Count() const { return (int) mKeys.size(); }
+    void GetNormal(int index, float* norm) const;
+
+    // Forget all normals, keeping the memory for the next mesh
+    void Clear();
+
+    // Slots visited by lookups so far, for tuning the hash
+    double AverageProbe() const;
+    int    MaxProbe() const { return mMaxProbe; }
+    int    Slots() const    { return (int) mSlots.size(); }
+
 private:
-    DWORD HashCode(Point3 &norm);
-    Tab<NormalDesc*> tab;
-};
+    static NormalKey MakeKey(const float* norm);
+    static unsigned int HashCode(const NormalKey& key);
+    int  Find(const NormalKey& key, unsigned int& slot);
+    void Grow();
 
+    std::vector<NormalKey> mKeys;   // distinct normals, in insertion order
+    std::vector<int>       mSlots;  // index in mKeys plus one, 0 if free
+    unsigned int           mMask;   // number of slots minus one
+    double                 mProbes; // slots visited by all lookups
+    double                 mLookups;
+    int                    mMaxProbe;
+};
 
-#define NORM_TABLE_SIZE 1001
+#endif
@@ -0,0 +1,287 @@
+/**********************************************************************
+ *<
+	FILE: outbuf.cpp
+
+	DESCRIPTION:  Buffered output for the scene writer
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "outbuf.h"
+
+#ifdef _WIN32
+#define OUT_VSNPRINTF _vsntprintf
+#else
+#define OUT_VSNPRINTF vsnprintf
+#endif
+
+#if defined(_UNICODE) || defined(UNICODE)
+#define OUT_WIDE
+#endif
+
+OutBuffer::OutBuffer(FILE* stream, size_t size)
+{
+	mStream  = stream;
+	mSize    = size > 0 ? size : OUTBUF_SIZE;
+	mData    = (char*) malloc(mSize);
+	mLen     = 0;
+	mFlushed = 0;
+	mFlushes = 0;
+	mError   = mData == NULL;
+}
+
+OutBuffer::~OutBuffer()
+{
+	if (mStream)
+		Flush();
+	free(mData);
+}
+
+// Return room for n more bytes, flushing to the stream or growing the
+// block as needed.  Returns NULL if memory runs out.
+char*
+OutBuffer::Reserve(size_t n)
+{
+	if (mLen + n <= mSize)
+		return mData + mLen;
+
+	if (mStream)
+	{
+		Flush();
+		if (n <= mSize)
+			return mData + mLen;
+	}
+
+	size_t size = mSize * 2;
+	while (size < mLen + n)
+		size *= 2;
+	char* data = (char*) realloc(mData, size);
+	if (!data)
+	{
+		mError = true;
+		return NULL;
+	}
+	mData = data;
+	mSize = size;
+	return mData + mLen;
+}
+
+bool
+OutBuffer::Flush()
+{
+	if (mStream && mLen > 0)
+	{
+		if (fwrite(mData, 1, mLen, mStream) != mLen)
+			mError = true;
+		mFlushed += mLen;
+		mFlushes++;
+		mLen = 0;
+	}
+	return !mError;
+}
+
+int
+OutBuffer::Put(const TCHAR* s, int len)
+{
+	if (len <= 0)
+		return 0;
+
+	char* p = Reserve(len);
+	if (!p)
+		return 0;
+#ifdef OUT_WIDE
+	for (int i = 0; i < len; i++)
+	{
+		if ((unsigned) s[i] < 0x80)
+		{
+			*p++ = (char) s[i];
+			continue;
+		}
+		// Same conversion fwprintf applies to wide characters
+		char mb[16];
+		int n = wctomb(mb, s[i]);
+		if (n <= 0)
+		{
+			mb[0] = '?';
+			n = 1;
+		}
+		mLen = p - mData;
+		p = Reserve(n + (len - i - 1));
+		if (!p)
+			return i;
+		memcpy(p, mb, n);
+		p += n;
+	}
+	mLen = p - mData;
+#else
+	memcpy(p, s, len);
+	mLen += len;
+#endif
+	return len;
+}
+
+int
+OutBuffer::Put(const TCHAR* s)
+{
+	int len = 0;
+	while (s[len])
+		len++;
+	return Put(s, len);
+}
+
+int
+OutBuffer::PutInt(int n)
+{
+	char tmp[16];
+	int len = 0;
+	unsigned int u = n < 0 ? 0u - (unsigned int) n : (unsigned int) n;
+
+	do {
+		tmp[len++] = (char) ('0' + u % 10);
+		u /= 10;
+	} while (u);
+	if (n < 0)
+		tmp[len++] = '-';
+
+	char* p = Reserve(len);
+	if (!p)
+		return 0;
+	for (int i = len; i > 0; )
+		*p++ = tmp[--i];
+	mLen += len;
+	return len;
+}
+
+int
+OutBuffer::Repeat(char c, int count)
+{
+	if (count <= 0)
+		return 0;
+	char* p = Reserve(count);
+	if (!p)
+		return 0;
+	memset(p, c, count);
+	mLen += count;
+	return count;
+}
+
+int
+OutBuffer::Printf(const TCHAR* format, ...)
+{
+	TCHAR local[1024];
+	TCHAR* buf = local;
+	int size = 1024;
+	int len;
+	va_list args;
+
+	for (;;)
+	{
+		va_start(args, format);
+		len = OUT_VSNPRINTF(buf, size, format, args);
+		va_end(args);
+		if (len >= 0 && len < size)
+			break;
+		// _vsntprintf returns -1 when the text does not fit
+		size = len >= size ? len + 1 : size * 2;
+		if (buf != local)
+			free(buf);
+		buf = (TCHAR*) malloc(size * sizeof(TCHAR));
+		if (!buf)
+			return 0;
+	}
+	len = Put(buf, len);
+	if (buf != local)
+		free(buf);
+	return len;
+}
+
+void
+OutBuffer::Append(const OutBuffer& other)
+{
+	PutBytes(other.mData, other.mLen);
+}
+
+void
+OutBuffer::PutBytes(const void* data, size_t len)
+{
+	const char* src = (const char*) data;
+
+	while (len > 0)
+	{
+		size_t n = len;
+		if (mStream && n > mSize)
+			n = mSize;
+		char* p = Reserve(n);
+		if (!p)
+			return;
+		memcpy(p, src, n);
+		mLen += n;
+		src += n;
+		len -= n;
+	}
+}
+
+#ifdef OUTBUF_BENCHMARK
+// Stand-alone timing of a vertex list written token by token with
+// fprintf, as the exporter did, against the same text through an
+// OutBuffer:
+//
+//    g++ -O2 -DOUTBUF_BENCHMARK outbuf.cpp -o outbench
+//    ./outbench [count]
+
+#include <time.h>
+
+int
+main(int argc, char** argv)
+{
+	int count = argc > 1 ? atoi(argv[1]) : 3000000;
+	int i;
+
+	FILE* fp = tmpfile();
+	clock_t start = clock();
+	for (i = 0; i < count; i++)
+	{
+		fprintf(fp, "%d, %d, %d", i, i + 1, -i);
+		fprintf(fp, ", ");
+		if (i % 8 == 7)
+		{
+			fprintf(fp, "\n");
+			for (int l = 0; l < 3; l++)
+				fprintf(fp, "  ");
+		}
+	}
+	long oldSize = ftell(fp);
+	double oldTime = (double) (clock() - start) / CLOCKS_PER_SEC;
+	fclose(fp);
+
+	fp = tmpfile();
+	start = clock();
+	{
+		OutBuffer out(fp);
+		for (i = 0; i < count; i++)
+		{
+			out.PutInt(i);
+			out.Put(_T(", "), 2);
+			out.PutInt(i + 1);
+			out.Put(_T(", "), 2);
+			out.PutInt(-i);
+			out.Put(_T(", "), 2);
+			if (i % 8 == 7)
+			{
+				out.Put(_T("\n"), 1);
+				out.Repeat(' ', 6);
+			}
+		}
+		out.Flush();
+		double newTime = (double) (clock() - start) / CLOCKS_PER_SEC;
+		long newSize = ftell(fp);
+		printf("%d triples: fprintf %.3fs, OutBuffer %.3fs (x%.1f), "
+			   "%ld/%ld bytes, %d flushes\n", count, oldTime, newTime,
+			   oldTime / newTime, oldSize, newSize, out.FlushCount());
+	}
+	fclose(fp);
+	return 0;
+}
+#endif
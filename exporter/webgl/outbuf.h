@@ -0,0 +1,83 @@
+/**********************************************************************
+ *<
+	FILE: outbuf.h
+
+	DESCRIPTION:  Buffered output for the scene writer
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+
+#ifndef __OUTBUF__H__
+#define __OUTBUF__H__
+
+// The scene writer emits one token at a time.  OutBuffer collects the
+// text in a large contiguous block and only hands it to the stream when
+// the block is full or on an explicit Flush(), instead of paying for a
+// locked, converting CRT call per number, comma and indent.
+//
+// Text is converted from TCHAR to bytes the way fwprintf does it (ASCII
+// passes straight through, the rest goes through wctomb).  The bytes go
+// to the stream with fwrite, so a text mode stream still turns '\n' into
+// CR/LF.  An OutBuffer without a stream just grows, to build a piece of
+// output in memory and Append() it to another buffer later.
+
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <tchar.h>
+#else
+#ifndef _T
+typedef char TCHAR;
+#define _T(x) x
+#endif
+#endif
+
+#define OUTBUF_SIZE (4 * 1024 * 1024)
+
+class OutBuffer {
+public:
+	OutBuffer(FILE* stream = NULL, size_t size = OUTBUF_SIZE);
+	~OutBuffer();
+
+	// All of these return the number of characters written, as
+	// fwprintf does, so callers can keep track of line widths.
+	int  Printf(const TCHAR* format, ...);
+	int  Put(const TCHAR* s);
+	int  Put(const TCHAR* s, int len);
+	int  PutInt(int n);
+	int  Repeat(char c, int count);
+
+	// Append raw bytes, for binary files
+	void PutBytes(const void* data, size_t len);
+
+	// Append the bytes collected in another buffer
+	void Append(const OutBuffer& other);
+
+	// Hand the buffered bytes to the stream.  Returns false if the
+	// stream reported an error, now or on an earlier flush.
+	bool Flush();
+
+	const char* Data() const        { return mData; }
+	size_t      Size() const        { return mLen; }
+	void        Clear()             { mLen = 0; }
+
+	// Bytes handed to the stream plus the ones still buffered
+	unsigned long long BytesWritten() const { return mFlushed + mLen; }
+	int         FlushCount() const  { return mFlushes; }
+
+private:
+	OutBuffer(const OutBuffer&);
+	OutBuffer& operator=(const OutBuffer&);
+
+	char* Reserve(size_t n);
+
+	FILE*              mStream;     // where the bytes go, NULL to keep them
+	char*              mData;
+	size_t             mLen;        // bytes in mData
+	size_t             mSize;       // capacity of mData
+	unsigned long long mFlushed;    // bytes handed to the stream so far
+	int                mFlushes;    // number of writes to the stream
+	bool               mError;      // the stream failed a write
+};
+
+#endif
@@ -0,0 +1,443 @@
+/**********************************************************************
+ *<
+	FILE: overdraw.cpp
+
+	DESCRIPTION:  Face order for less overdraw
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+#include <math.h>
+#include <algorithm>
+#include "overdraw.h"
+#include "vcache.h"
+
+// A run of the order, drawn as one piece
+struct Cluster {
+	int    first, last;     // positions in the order
+	double score;           // larger is drawn earlier
+};
+
+static bool
+DrawnBefore(const Cluster& a, const Cluster& b)
+{
+	return a.score > b.score;
+}
+
+// View direction i, pointing from the mesh towards the viewer
+static void
+ViewDirection(int i, double* d)
+{
+	if (i < 6)
+	{
+		d[0] = d[1] = d[2] = 0.0;
+		d[i / 2] = (i & 1) ? -1.0 : 1.0;
+	}
+	else
+	{
+		double s = 1.0 / sqrt(3.0);
+		int k = i - 6;
+		d[0] = (k & 1) ? -s : s;
+		d[1] = (k & 2) ? -s : s;
+		d[2] = (k & 4) ? -s : s;
+	}
+}
+
+static double
+Dot(const double* a, const double* b)
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// Area weighted normal and centroid of some triangles; the normal is
+// not normalized and the area is returned
+static double
+Centroid(const float* verts, const int* tris, const int* order, int first,
+		 int last, double* normal, double* center)
+{
+	double area = 0.0;
+	normal[0] = normal[1] = normal[2] = 0.0;
+	center[0] = center[1] = center[2] = 0.0;
+	for (int i = first; i < last; i++)
+	{
+		const int* t = tris + 3 * (order ? order[i] : i);
+		const float* a = verts + 3 * t[0];
+		const float* b = verts + 3 * t[1];
+		const float* c = verts + 3 * t[2];
+		double e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		double e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		double n[3] = { e1[1] * e2[2] - e1[2] * e2[1],
+						e1[2] * e2[0] - e1[0] * e2[2],
+						e1[0] * e2[1] - e1[1] * e2[0] };
+		double len = sqrt(Dot(n, n));
+		for (int k = 0; k < 3; k++)
+		{
+			normal[k] += n[k];
+			center[k] += len * (a[k] + b[k] + c[k]) / 3.0;
+		}
+		area += len;
+	}
+	if (area > 0.0)
+	{
+		for (int k = 0; k < 3; k++)
+			center[k] /= area;
+	}
+	return area;
+}
+
+// Cut an order into clusters, at cache restarts and, if minSize is not
+// 0, where a cluster of at least minSize triangles is no worse for the
+// cache than the whole order
+static void
+CutClusters(const int* tris, int numTris, int numVerts, int cacheSize,
+			const std::vector<int>& order, int minSize, double acmr,
+			std::vector<Cluster>& clusters)
+{
+	std::vector<int> entered(numVerts, -cacheSize - 1);
+	int misses = 0, first = 0, clusterMisses = 0;
+
+	clusters.clear();
+	for (int i = 0; i < numTris; i++)
+	{
+		const int* t = tris + 3 * order[i];
+		int m = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			if (misses - entered[t[k]] > cacheSize)
+			{
+				entered[t[k]] = misses++;
+				m++;
+			}
+		}
+		if (m == 3 && i > first)
+		{
+			Cluster c = { first, i, 0.0 };
+			clusters.push_back(c);
+			first = i;
+			clusterMisses = 0;
+		}
+		clusterMisses += m;
+		if (minSize > 0 && i + 1 - first >= minSize &&
+			clusterMisses <= OVERDRAW_LAMBDA * acmr * (i + 1 - first))
+		{
+			Cluster c = { first, i + 1, 0.0 };
+			clusters.push_back(c);
+			first = i + 1;
+			clusterMisses = 0;
+		}
+	}
+	if (first < numTris)
+	{
+		Cluster c = { first, numTris, 0.0 };
+		clusters.push_back(c);
+	}
+}
+
+int
+OverdrawOrder(const float* verts, const int* tris, int numTris,
+			  int numVerts, int cacheSize, float maxLoss,
+			  std::vector<int>& order)
+{
+	// From the most clusters down to cuts at cache restarts only
+	static const int minSizes[] = { 32, 64, 128, 256, 512, 1024, 0 };
+	double acmr, atvr, normal[3], center[3], meshCenter[3], d[3];
+	std::vector<Cluster> clusters;
+	std::vector<int> sorted;
+
+	if (numTris < 2)
+		return 1;
+	VCacheStats(tris, numTris, numVerts, cacheSize, &order[0], &acmr, &atvr);
+	Centroid(verts, tris, NULL, 0, numTris, normal, meshCenter);
+
+	for (int l = 0; l < (int) (sizeof(minSizes) / sizeof(minSizes[0])); l++)
+	{
+		CutClusters(tris, numTris, numVerts, cacheSize, order, minSizes[l],
+					acmr, clusters);
+		if (clusters.size() < 2)
+			continue;
+
+		for (size_t c = 0; c < clusters.size(); c++)
+		{
+			Cluster& cl = clusters[c];
+			Centroid(verts, tris, &order[0], cl.first, cl.last, normal, center);
+			for (int k = 0; k < 3; k++)
+				center[k] -= meshCenter[k];
+			cl.score = 0.0;
+			for (int v = 0; v < OVERDRAW_VIEWS; v++)
+			{
+				ViewDirection(v, d);
+				if (Dot(normal, d) > 0.0)
+					cl.score += Dot(center, d);
+			}
+		}
+		std::stable_sort(clusters.begin(), clusters.end(), DrawnBefore);
+
+		sorted.clear();
+		for (size_t c = 0; c < clusters.size(); c++)
+			sorted.insert(sorted.end(), order.begin() + clusters[c].first,
+						  order.begin() + clusters[c].last);
+		double sortedAcmr;
+		VCacheStats(tris, numTris, numVerts, cacheSize, &sorted[0],
+					&sortedAcmr, &atvr);
+		if (sortedAcmr <= (1.0 + maxLoss) * acmr)
+		{
+			order.swap(sorted);
+			return (int) clusters.size();
+		}
+	}
+	return 1;
+}
+
+double
+OverdrawMeasure(const float* verts, const int* tris, int numTris,
+				const int* order, int raster)
+{
+	double lo[3], hi[3], mid[3], radius = 0.0;
+	int i, k;
+
+	if (numTris == 0)
+		return 0.0;
+	for (k = 0; k < 3; k++)
+		lo[k] = hi[k] = verts[3 * tris[0] + k];
+	for (i = 0; i < 3 * numTris; i++)
+	{
+		for (k = 0; k < 3; k++)
+		{
+			double x = verts[3 * tris[i] + k];
+			if (x < lo[k]) lo[k] = x;
+			if (x > hi[k]) hi[k] = x;
+		}
+	}
+	for (k = 0; k < 3; k++)
+		mid[k] = 0.5 * (lo[k] + hi[k]);
+	radius = 0.5 * sqrt((hi[0] - lo[0]) * (hi[0] - lo[0]) +
+						(hi[1] - lo[1]) * (hi[1] - lo[1]) +
+						(hi[2] - lo[2]) * (hi[2] - lo[2]));
+	if (radius <= 0.0)
+		return 0.0;
+
+	std::vector<float> depth(raster * raster);
+	double total = 0.0;
+	int views = 0;
+	for (int view = 0; view < OVERDRAW_VIEWS; view++)
+	{
+		// Screen axes u and v with u x v = d, so counter clockwise
+		// front faces keep a positive area on screen
+		double d[3], u[3], v[3];
+		ViewDirection(view, d);
+		double a[3] = { 0.0, 0.0, 0.0 };
+		a[fabs(d[0]) < 0.9 ? 0 : 1] = 1.0;
+		u[0] = a[1] * d[2] - a[2] * d[1];
+		u[1] = a[2] * d[0] - a[0] * d[2];
+		u[2] = a[0] * d[1] - a[1] * d[0];
+		double len = sqrt(Dot(u, u));
+		for (k = 0; k < 3; k++)
+			u[k] /= len;
+		v[0] = d[1] * u[2] - d[2] * u[1];
+		v[1] = d[2] * u[0] - d[0] * u[2];
+		v[2] = d[0] * u[1] - d[1] * u[0];
+
+		std::fill(depth.begin(), depth.end(), 1e30f);
+		double fragments = 0.0;
+		double scale = 0.5 * raster / radius;
+		for (i = 0; i < numTris; i++)
+		{
+			const int* t = tris + 3 * (order ? order[i] : i);
+			double sx[3], sy[3], sz[3];
+			for (k = 0; k < 3; k++)
+			{
+				const float* p = verts + 3 * t[k];
+				double q[3] = { p[0] - mid[0], p[1] - mid[1], p[2] - mid[2] };
+				sx[k] = Dot(q, u) * scale + 0.5 * raster;
+				sy[k] = Dot(q, v) * scale + 0.5 * raster;
+				sz[k] = -Dot(q, d);
+			}
+			double area = (sx[1] - sx[0]) * (sy[2] - sy[0]) -
+						  (sx[2] - sx[0]) * (sy[1] - sy[0]);
+			if (area <= 0.0)
+				continue;   // back face, or edge on
+
+			int x0 = (int) floor(std::min(sx[0], std::min(sx[1], sx[2])));
+			int x1 = (int) ceil(std::max(sx[0], std::max(sx[1], sx[2])));
+			int y0 = (int) floor(std::min(sy[0], std::min(sy[1], sy[2])));
+			int y1 = (int) ceil(std::max(sy[0], std::max(sy[1], sy[2])));
+			x0 = std::max(x0, 0);
+			y0 = std::max(y0, 0);
+			x1 = std::min(x1, raster - 1);
+			y1 = std::min(y1, raster - 1);
+			for (int y = y0; y <= y1; y++)
+			{
+				double py = y + 0.5;
+				for (int x = x0; x <= x1; x++)
+				{
+					double px = x + 0.5;
+					double w0 = (sx[2] - sx[1]) * (py - sy[1]) - (sy[2] - sy[1]) * (px - sx[1]);
+					double w1 = (sx[0] - sx[2]) * (py - sy[2]) - (sy[0] - sy[2]) * (px - sx[2]);
+					double w2 = (sx[1] - sx[0]) * (py - sy[0]) - (sy[1] - sy[0]) * (px - sx[0]);
+					if (w0 < 0.0 || w1 < 0.0 || w2 < 0.0)
+						continue;
+					float z = (float) ((w0 * sz[0] + w1 * sz[1] + w2 * sz[2]) / area);
+					float& zb = depth[y * raster + x];
+					if (z < zb)
+					{
+						zb = z;
+						fragments += 1.0;
+					}
+				}
+			}
+		}
+
+		int covered = 0;
+		for (i = 0; i < raster * raster; i++)
+			if (depth[i] < 1e30f)
+				covered++;
+		if (covered > 0)
+		{
+			total += fragments / covered;
+			views++;
+		}
+	}
+	return views > 0 ? total / views : 0.0;
+}
+
+#ifdef OVERDRAW_BENCHMARK
+// Stand-alone check on two synthetic meshes whose faces are shuffled,
+// put in cache order, and then sorted by cluster for several bounds:
+//   - nested spheres, the inner ones listed first, as an interior seen
+//     through its walls
+//   - one ridged height field, which hides itself from the side
+//
+//    g++ -O2 -DOVERDRAW_BENCHMARK overdraw.cpp vcache.cpp -o odbench
+//    ./odbench [rows]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static void
+AddSphere(float radius, int rows, std::vector<float>& verts,
+		  std::vector<int>& tris)
+{
+	int base = (int) verts.size() / 3;
+	for (int r = 0; r <= rows; r++)
+	{
+		double theta = 3.14159265 * r / rows;
+		for (int c = 0; c <= rows; c++)
+		{
+			double phi = 2.0 * 3.14159265 * c / rows;
+			verts.push_back((float) (radius * sin(theta) * cos(phi)));
+			verts.push_back((float) (radius * sin(theta) * sin(phi)));
+			verts.push_back((float) (radius * cos(theta)));
+		}
+	}
+	for (int r = 0; r < rows; r++)
+	{
+		for (int c = 0; c < rows; c++)
+		{
+			int a = base + r * (rows + 1) + c, b = a + 1;
+			int d = a + rows + 1, e = d + 1;
+			// counter clockwise seen from outside
+			int quad[6] = { a, d, e, a, e, b };
+			tris.insert(tris.end(), quad, quad + 6);
+		}
+	}
+}
+
+// Ridges of height field z = sin(2x) cos(2y) on [0, 10] x [0, 10]
+static void
+AddRidges(int rows, std::vector<float>& verts, std::vector<int>& tris)
+{
+	for (int r = 0; r <= rows; r++)
+	{
+		for (int c = 0; c <= rows; c++)
+		{
+			double x = 10.0 * c / rows, y = 10.0 * r / rows;
+			verts.push_back((float) x);
+			verts.push_back((float) y);
+			verts.push_back((float) (2.0 * sin(2.0 * x) * cos(2.0 * y)));
+		}
+	}
+	for (int r = 0; r < rows; r++)
+	{
+		for (int c = 0; c < rows; c++)
+		{
+			int a = r * (rows + 1) + c, b = a + 1;
+			int d = a + rows + 1, e = d + 1;
+			// counter clockwise seen from above
+			int quad[6] = { a, b, e, a, e, d };
+			tris.insert(tris.end(), quad, quad + 6);
+		}
+	}
+}
+
+static void
+Run(const char* name, const std::vector<float>& verts, std::vector<int>& tris)
+{
+	int numTris = (int) tris.size() / 3;
+	int numVerts = (int) verts.size() / 3;
+
+	srand(1);
+	for (int i = numTris - 1; i > 0; i--)
+	{
+		int j = (int) ((double) rand() / ((double) RAND_MAX + 1) * (i + 1));
+		for (int k = 0; k < 3; k++)
+			std::swap(tris[3 * i + k], tris[3 * j + k]);
+	}
+
+	double acmr, atvr;
+	VCacheStats(&tris[0], numTris, numVerts, VCACHE_SIZE, NULL, &acmr, &atvr);
+	printf("%s, %d triangles\n", name, numTris);
+	printf("  shuffled:      ACMR %.3f, overdraw %.3f\n", acmr,
+		   OverdrawMeasure(&verts[0], &tris[0], numTris, NULL, OVERDRAW_RASTER));
+
+	std::vector<int> cacheOrder;
+	VCacheOrder(&tris[0], numTris, numVerts, VCACHE_SIZE, cacheOrder);
+	VCacheStats(&tris[0], numTris, numVerts, VCACHE_SIZE, &cacheOrder[0],
+				&acmr, &atvr);
+	printf("  cache order:   ACMR %.3f, overdraw %.3f\n", acmr,
+		   OverdrawMeasure(&verts[0], &tris[0], numTris, &cacheOrder[0],
+						   OVERDRAW_RASTER));
+
+	static const float losses[] = { 0.0f, 0.05f, 0.1f, 0.25f };
+	for (int l = 0; l < 4; l++)
+	{
+		std::vector<int> order(cacheOrder);
+		clock_t start = clock();
+		int clusters = OverdrawOrder(&verts[0], &tris[0], numTris, numVerts,
+									 VCACHE_SIZE, losses[l], order);
+		double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+		std::vector<bool> seen(numTris, false);
+		int bad = 0;
+		for (int i = 0; i < numTris; i++)
+		{
+			if (seen[order[i]])
+				bad++;
+			seen[order[i]] = true;
+		}
+		VCacheStats(&tris[0], numTris, numVerts, VCACHE_SIZE, &order[0],
+					&acmr, &atvr);
+		printf("  loss %3.0f%%:     ACMR %.3f, overdraw %.3f, %d clusters, "
+			   "%.3fs%s\n", 100.0 * losses[l], acmr,
+			   OverdrawMeasure(&verts[0], &tris[0], numTris, &order[0],
+							   OVERDRAW_RASTER),
+			   clusters, seconds, bad ? ", BAD ORDER" : "");
+	}
+}
+
+int
+main(int argc, char** argv)
+{
+	int rows = argc > 1 ? atoi(argv[1]) : 200;
+	std::vector<float> verts;
+	std::vector<int> tris;
+
+	for (int s = 0; s < 4; s++)
+		AddSphere(1.0f + s, rows, verts, tris);
+	Run("4 nested spheres", verts, tris);
+
+	verts.clear();
+	tris.clear();
+	AddRidges(2 * rows, verts, tris);
+	Run("ridged height field", verts, tris);
+	return 0;
+}
+#endif
@@ -0,0 +1,60 @@
+/**********************************************************************
+ *<
+	FILE: overdraw.h
+
+	DESCRIPTION:  Face order for less overdraw
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+
+#ifndef __OVERDRAW__H__
+#define __OVERDRAW__H__
+
+// Once the faces are in vertex cache order (see vcache.h), the order
+// is cut into clusters and the clusters are drawn front to back, so the
+// depth test rejects more of the pixels behind them.  This is the
+// second half of Tipsify (Sander, Nehab and Barczak, 2007):
+//
+//   - A cluster ends where the cache order restarts from scratch, and
+//     also, once it has a minimum number of triangles, wherever its
+//     ACMR so far is at most OVERDRAW_LAMBDA times the ACMR of the whole
+//     order, so a cut costs little locality.
+//   - Each cluster is scored over a fixed set of view directions by how
+//     far it sits towards the viewer on the directions it faces, and
+//     the clusters are sorted by decreasing score.  Averaged over all
+//     directions this approaches the view independent measure of the
+//     paper: the offset of the cluster from the mesh center along its
+//     normal.
+//
+// Cutting more finely helps overdraw and costs cache misses.  The
+// minimum cluster size is raised until the ACMR of the sorted order is
+// at most 1 + maxLoss times the ACMR of the cache order; if even the
+// cuts at cache restarts cost more, the cache order is kept.
+//
+// OverdrawMeasure renders the mesh in software, orthographic with back
+// face culling and a depth test, from the same view directions, and
+// returns the number of fragments passing the depth test per covered
+// pixel, 1 at best.
+//
+// Vertices are x, y, z each; triangles are three vertex indices each,
+// counter clockwise seen from the front.
+
+#include <vector>
+
+#define OVERDRAW_VIEWS  14      // 6 axes and 8 diagonals
+#define OVERDRAW_LAMBDA 1.0     // cluster ACMR to cut at, relative
+#define OVERDRAW_RASTER 128     // pixels across a software view
+
+// Sort the clusters of a cache order.  order is the cache order on
+// input and the new order on output.  Returns the number of clusters,
+// 1 if the order was kept.
+int OverdrawOrder(const float* verts, const int* tris, int numTris,
+				  int numVerts, int cacheSize, float maxLoss,
+				  std::vector<int>& order);
+
+// Fragments per covered pixel, averaged over the view directions, for
+// the triangles in order if given
+double OverdrawMeasure(const float* verts, const int* tris, int numTris,
+					   const int* order, int raster);
+
+#endif
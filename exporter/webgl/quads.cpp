@@ -0,0 +1,249 @@
+/**********************************************************************
+ *<
+	FILE: quads.cpp
+
+	DESCRIPTION:  Pairing of mesh triangles into quad face records
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+#include <math.h>
+#include <algorithm>
+#include "quads.h"
+
+// An invisible edge of a face, keyed by its vertices in increasing
+// order
+struct QuadEdge {
+	int lo, hi;
+	int face;
+	int k;              // the edge runs from v[k] to v[k+1]
+
+	bool operator<(const QuadEdge& e) const
+	{
+		if (lo != e.lo)
+			return lo < e.lo;
+		if (hi != e.hi)
+			return hi < e.hi;
+		return face < e.face;
+	}
+};
+
+static void
+Sub(const float* a, const float* b, float* d)
+{
+	d[0] = a[0] - b[0];
+	d[1] = a[1] - b[1];
+	d[2] = a[2] - b[2];
+}
+
+static void
+Cross(const float* a, const float* b, float* c)
+{
+	c[0] = a[1] * b[2] - a[2] * b[1];
+	c[1] = a[2] * b[0] - a[0] * b[2];
+	c[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static float
+Dot(const float* a, const float* b)
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+void
+QuadCorners(const IRMesh& mesh, int face, int partner, int* corners)
+{
+	const IRFace& f = mesh.faces[face];
+	const IRFace& g = mesh.faces[partner];
+	int kf, kg;
+
+	// The shared edge runs v[kf] -> v[kf+1] in face and back in partner
+	for (kf = 0; kf < 3; kf++)
+	{
+		int a = f.v[kf], b = f.v[(kf + 1) % 3];
+		for (kg = 0; kg < 3; kg++)
+		{
+			if (g.v[kg] == b && g.v[(kg + 1) % 3] == a)
+			{
+				corners[0] = 3 * face + (kf + 1) % 3;
+				corners[1] = 3 * face + (kf + 2) % 3;
+				corners[2] = 3 * face + kf;
+				corners[3] = 3 * partner + (kg + 2) % 3;
+				return;
+			}
+		}
+	}
+}
+
+// Flat and convex, as drawn by three.js
+static bool
+IsFlatConvex(const IRMesh& mesh, const int* corners, float flatness)
+{
+	const float* p[4];
+	float e[4][3], n[3], c[3];
+	float longest = 0.0f;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		p[i] = &mesh.verts[3 * mesh.faces[corners[i] / 3].v[corners[i] % 3]];
+	for (i = 0; i < 4; i++)
+	{
+		Sub(p[(i + 1) % 4], p[i], e[i]);
+		float len = Dot(e[i], e[i]);
+		if (len > longest)
+			longest = len;
+	}
+	longest = sqrtf(longest);
+
+	// The plane of the first triangle
+	Cross(e[0], e[1], n);
+	float area = sqrtf(Dot(n, n));
+	if (area <= 0.0f)
+		return false;
+	for (i = 0; i < 3; i++)
+		n[i] /= area;
+
+	float d[3];
+	Sub(p[3], p[0], d);
+	if (fabsf(Dot(d, n)) > flatness * longest)
+		return false;
+
+	// Every corner turns the same way
+	for (i = 0; i < 4; i++)
+	{
+		Cross(e[(i + 3) % 4], e[i], c);
+		if (Dot(c, n) <= 0.0f)
+			return false;
+	}
+	return true;
+}
+
+void
+PairQuads(const IRMesh& mesh, float flatness, std::vector<int>& partner,
+		  QuadStats& stats)
+{
+	int numfaces = mesh.NumFaces();
+	bool hasUVs = mesh.NumTVerts() > 0;
+	std::vector<QuadEdge> edges;
+	int i;
+
+	partner.assign(numfaces, -1);
+	stats.quads = stats.nonPlanar = stats.triangles = 0;
+
+	for (i = 0; i < numfaces; i++)
+	{
+		const IRFace& f = mesh.faces[i];
+		if (f.hidden)
+			continue;
+		stats.triangles++;
+		for (int k = 0; k < 3; k++)
+		{
+			if (f.edgeVis & (1 << k))
+				continue;
+			QuadEdge e;
+			int a = f.v[k], b = f.v[(k + 1) % 3];
+			e.lo = a < b ? a : b;
+			e.hi = a < b ? b : a;
+			e.face = i;
+			e.k = k;
+			edges.push_back(e);
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+
+	// An inner edge belongs to exactly two faces
+	for (size_t j = 0; j + 1 < edges.size(); j++)
+	{
+		const QuadEdge& e0 = edges[j];
+		const QuadEdge& e1 = edges[j + 1];
+		if (e0.lo != e1.lo || e0.hi != e1.hi)
+			continue;
+		if (j + 2 < edges.size() && edges[j + 2].lo == e0.lo &&
+			edges[j + 2].hi == e0.hi)
+			continue;
+		if (j > 0 && edges[j - 1].lo == e0.lo && edges[j - 1].hi == e0.hi)
+			continue;
+		if (partner[e0.face] >= 0 || partner[e1.face] >= 0)
+			continue;
+
+		const IRFace& f = mesh.faces[e0.face];
+		const IRFace& g = mesh.faces[e1.face];
+		int f0 = e0.k, f1 = (e0.k + 1) % 3;
+		int g0 = e1.k, g1 = (e1.k + 1) % 3;
+		if (f.v[f0] != g.v[g1] || f.v[f1] != g.v[g0])
+			continue;       // wound the same way
+		if (f.matID != g.matID || f.smGroup != g.smGroup)
+			continue;
+		if (hasUVs && (f.t[f0] != g.t[g1] || f.t[f1] != g.t[g0]))
+			continue;
+		if (mesh.faceNormals[3 * e0.face + f0] != mesh.faceNormals[3 * e1.face + g1] ||
+			mesh.faceNormals[3 * e0.face + f1] != mesh.faceNormals[3 * e1.face + g0])
+			continue;
+
+		int corners[4];
+		QuadCorners(mesh, e0.face, e1.face, corners);
+		if (!IsFlatConvex(mesh, corners, flatness))
+		{
+			stats.nonPlanar++;
+			continue;
+		}
+		partner[e0.face] = e1.face;
+		partner[e1.face] = e0.face;
+		stats.quads++;
+	}
+	stats.triangles -= 2 * stats.quads;
+}
+
+#ifdef QUADS_BENCHMARK
+// Stand-alone timing and face record sizes on a grid of quads, flat
+// and then wavy (bent quads stay triangles):
+//
+//    g++ -O2 -DQUADS_BENCHMARK quads.cpp sceneir.cpp -o quadsbench
+//    ./quadsbench [rows]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Numbers in the "faces" array: type, vertices, material, uvs, normals
+static int
+RecordInts(int corners, bool uvs)
+{
+	return 1 + corners + 1 + (uvs ? corners : 0) + corners;
+}
+
+static void
+Run(const char* name, IRMesh& mesh)
+{
+	std::vector<int> partner;
+	QuadStats stats;
+
+	clock_t start = clock();
+	PairQuads(mesh, QUAD_FLATNESS, partner, stats);
+	double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+	bool uvs = mesh.NumTVerts() > 0;
+	double before = (double) mesh.NumFaces() * RecordInts(3, uvs);
+	double after = (double) stats.quads * RecordInts(4, uvs) +
+		(double) stats.triangles * RecordInts(3, uvs);
+	printf("%s: %d triangles, %d quads, %d bent pairs, %d triangles left, "
+		   "%.1f ms\n", name, mesh.NumFaces(), stats.quads, stats.nonPlanar,
+		   stats.triangles, seconds * 1000.0);
+	printf("  faces array %.0f -> %.0f numbers (%.0f%% smaller)\n", before,
+		   after, 100.0 * (1.0 - after / before));
+}
+
+int
+main(int argc, char** argv)
+{
+	int rows = argc > 1 ? atoi(argv[1]) : 500;
+	IRMesh* mesh = IRMakeGrid(rows, rows);
+
+	IRMesh flat = *mesh;
+	for (int i = 0; i < flat.NumVerts(); i++)
+		flat.verts[3 * i + 2] = 0.0f;
+	Run("flat grid", flat);
+	Run("wavy grid", *mesh);
+	delete mesh;
+	return 0;
+}
+#endif
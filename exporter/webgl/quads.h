@@ -0,0 +1,53 @@
+/**********************************************************************
+ *<
+	FILE: quads.h
+
+	DESCRIPTION:  Pairing of mesh triangles into quad face records
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+
+#ifndef __QUADS__H__
+#define __QUADS__H__
+
+// MAX keeps the polygons of a mesh as triangles whose inner edges are
+// invisible; a quad is two triangles sharing one invisible edge.  The
+// three.js JSON format has quad face records (type bit 0), which hold
+// four vertex, uv and normal indices instead of the six of two
+// triangle records.
+//
+// PairQuads puts two visible triangles together when:
+//   - they share an invisible edge, wound the opposite way
+//   - material and smoothing groups are the same
+//   - the uv and normal indices on the shared edge are the same, so
+//     each quad corner has one of each
+//   - the quad is flat: the fourth corner is off the plane of the
+//     first triangle by at most flatness times the longest edge
+//   - the quad is convex, as three.js draws it as (a, b, d) and
+//     (b, c, d), the other diagonal
+// Polygons of more sides are paired a triangle at a time, the rest of
+// them staying triangles.
+//
+// Nothing in here depends on the MAX SDK.
+
+#include <vector>
+#include "sceneir.h"
+
+#define QUAD_FLATNESS 1e-3f
+
+// Statistics of a pairing
+struct QuadStats {
+	int quads;          // triangle pairs written as quads
+	int nonPlanar;      // pairs kept as triangles for being bent or concave
+	int triangles;      // visible triangles left alone
+};
+
+// Fill partner with the face each face makes a quad with, -1 if none
+void PairQuads(const IRMesh& mesh, float flatness, std::vector<int>& partner,
+			   QuadStats& stats);
+
+// Corners of the quad of face and its partner, in drawing order, as
+// face corner indices (3 * face + k)
+void QuadCorners(const IRMesh& mesh, int face, int partner, int* corners);
+
+#endif
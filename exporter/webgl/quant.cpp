@@ -0,0 +1,284 @@
+/**********************************************************************
+ *<
+	FILE: quant.cpp
+
+	DESCRIPTION:  Quantized mesh attributes
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+#include <math.h>
+#include "quant.h"
+
+static void
+Bounds(const float* v, int count, int dims, float* lo, float* hi)
+{
+	int k;
+	for (k = 0; k < dims; k++)
+	{
+		lo[k] = count > 0 ? v[k] : 0.0f;
+		hi[k] = lo[k];
+	}
+	for (int i = 1; i < count; i++)
+	{
+		for (k = 0; k < dims; k++)
+		{
+			float x = v[dims * i + k];
+			if (x < lo[k]) lo[k] = x;
+			if (x > hi[k]) hi[k] = x;
+		}
+	}
+}
+
+int
+QuantPositionBits(const float* pos, int count, double tolerance)
+{
+	float lo[3], hi[3];
+	Bounds(pos, count, 3, lo, hi);
+	double extent = 0.0;
+	for (int k = 0; k < 3; k++)
+		if (hi[k] - lo[k] > extent)
+			extent = hi[k] - lo[k];
+
+	// Half a step of the widest axis within tolerance
+	int bits;
+	for (bits = QUANT_MIN_BITS; bits < QUANT_MAX_BITS; bits++)
+		if (0.5 * extent / ((1 << bits) - 1) <= tolerance)
+			break;
+	return bits;
+}
+
+double
+QuantPositionError(const float* pos, int count, const QuantRange& range,
+				   const std::vector<int>& q)
+{
+	double err = 0.0;
+	for (int i = 0; i < 3 * count; i++)
+	{
+		double x = range.min[i % 3] + q[i] * (double) range.scale[i % 3];
+		double d = fabs(x - pos[i]);
+		if (d > err)
+			err = d;
+	}
+	return err;
+}
+
+int
+QuantPositions(const float* pos, int count, double tolerance,
+			   QuantRange& range, std::vector<int>& q)
+{
+	for (int bits = QuantPositionBits(pos, count, tolerance);
+		 bits <= QUANT_MAX_BITS; bits++)
+	{
+		QuantVectors(pos, count, 3, bits, range, q);
+		if (QuantPositionError(pos, count, range, q) <= tolerance)
+			return bits;
+	}
+	q.clear();
+	return 0;
+}
+
+void
+QuantVectors(const float* v, int count, int dims, int bits,
+			 QuantRange& range, std::vector<int>& q)
+{
+	float hi[3];
+	double steps = (double) ((1 << bits) - 1);
+	int k;
+
+	range.bits = bits;
+	Bounds(v, count, dims, range.min, hi);
+	for (k = dims; k < 3; k++)
+		range.min[k] = hi[k] = 0.0f;
+	for (k = 0; k < 3; k++)
+		range.scale[k] = (float) ((hi[k] - range.min[k]) / steps);
+
+	q.resize(dims * count);
+	for (int i = 0; i < count; i++)
+	{
+		for (k = 0; k < dims; k++)
+		{
+			double s = range.scale[k];
+			q[dims * i + k] = s > 0.0
+				? (int) floor((v[dims * i + k] - range.min[k]) / s + 0.5)
+				: 0;
+		}
+	}
+}
+
+static float
+Sign(float x)
+{
+	return x < 0.0f ? -1.0f : 1.0f;
+}
+
+void
+OctDecode(const int* e, int bits, float* n)
+{
+	float m = (float) ((1 << (bits - 1)) - 1);
+	float x = e[0] / m, y = e[1] / m;
+	float z = 1.0f - fabsf(x) - fabsf(y);
+	if (z < 0.0f)
+	{
+		float fx = (1.0f - fabsf(y)) * Sign(x);
+		y = (1.0f - fabsf(x)) * Sign(y);
+		x = fx;
+	}
+	float len = sqrtf(x * x + y * y + z * z);
+	n[0] = x / len;
+	n[1] = y / len;
+	n[2] = z / len;
+}
+
+// Error of an encoding: the largest component difference
+static float
+OctError(const float* n, const int* e, int bits)
+{
+	float d[3], err = 0.0f;
+	OctDecode(e, bits, d);
+	for (int k = 0; k < 3; k++)
+		if (fabsf(d[k] - n[k]) > err)
+			err = fabsf(d[k] - n[k]);
+	return err;
+}
+
+// Project on the octahedron, fold, and keep the best of the four
+// neighboring grid points
+void
+OctEncode(const float* n, int bits, int* e)
+{
+	float m = (float) ((1 << (bits - 1)) - 1);
+	float l1 = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+	if (l1 <= 0.0f)
+	{
+		e[0] = e[1] = 0;
+		return;
+	}
+	float x = n[0] / l1, y = n[1] / l1;
+	if (n[2] < 0.0f)
+	{
+		float fx = (1.0f - fabsf(y)) * Sign(x);
+		y = (1.0f - fabsf(x)) * Sign(y);
+		x = fx;
+	}
+	int bx = (int) floorf(x * m), by = (int) floorf(y * m);
+	float best = 1e30f;
+	for (int i = 0; i < 4; i++)
+	{
+		int c[2] = { bx + (i & 1), by + (i >> 1) };
+		if (c[0] > (int) m) c[0] = (int) m;
+		if (c[1] > (int) m) c[1] = (int) m;
+		float err = OctError(n, c, bits);
+		if (err < best)
+		{
+			best = err;
+			e[0] = c[0];
+			e[1] = c[1];
+		}
+	}
+}
+
+int
+QuantNormalBits(const float* norm, int count, double tolerance)
+{
+	int e[2];
+	for (int i = 0; i < count; i++)
+	{
+		OctEncode(norm + 3 * i, 8, e);
+		if (OctError(norm + 3 * i, e, 8) > tolerance)
+			return 16;
+	}
+	return 8;
+}
+
+void
+QuantNormals(const float* norm, int count, int bits, std::vector<int>& q)
+{
+	q.resize(2 * count);
+	for (int i = 0; i < count; i++)
+		OctEncode(norm + 3 * i, bits, &q[2 * i]);
+}
+
+#ifdef QUANT_BENCHMARK
+// Stand-alone check of the round trip and of the text saved on the
+// synthetic grid, against positions, normals and uvs printed with a
+// fixed number of digits:
+//
+//    g++ -O2 -DQUANT_BENCHMARK quant.cpp sceneir.cpp -o quantbench
+//    ./quantbench [rows] [digits] [position bits]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "sceneir.h"
+
+int
+main(int argc, char** argv)
+{
+	int rows = argc > 1 ? atoi(argv[1]) : 300;
+	int digits = argc > 2 ? atoi(argv[2]) : 4;
+	double tolerance = 0.5 * pow(10.0, -digits);
+	IRMesh* mesh = IRMakeGrid(rows, rows);
+	// A large level: scale the grid to 2 km
+	for (size_t i = 0; i < mesh->verts.size(); i++)
+		mesh->verts[i] *= 200.0f;
+	int nv = mesh->NumVerts(), nt = mesh->NumTVerts(), nn = mesh->NumNormals();
+
+	int normBits = QuantNormalBits(&mesh->normals[0], nn, tolerance);
+	QuantRange pr, ur;
+	std::vector<int> qp, qu, qn;
+	int posBits = argc > 3 ? atoi(argv[3])
+							: QuantPositions(&mesh->verts[0], nv, tolerance, pr, qp);
+	bool floats = posBits == 0;
+	if (floats)
+		posBits = QUANT_MAX_BITS;
+	if (argc > 3 || floats)
+		QuantVectors(&mesh->verts[0], nv, 3, posBits, pr, qp);
+	QuantVectors(&mesh->tverts[0], nt, 2, QUANT_UV_BITS, ur, qu);
+	QuantNormals(&mesh->normals[0], nn, normBits, qn);
+
+	double posErr = QuantPositionError(&mesh->verts[0], nv, pr, qp);
+	double uvErr = 0.0, normErr = 0.0;
+	for (int i = 0; i < 2 * nt; i++)
+	{
+		double x = ur.min[i % 2] + qu[i] * (double) ur.scale[i % 2];
+		uvErr = fmax(uvErr, fabs(x - mesh->tverts[i]));
+	}
+	for (int i = 0; i < nn; i++)
+	{
+		float d[3];
+		OctDecode(&qn[2 * i], normBits, d);
+		for (int k = 0; k < 3; k++)
+			normErr = fmax(normErr, fabs(d[k] - mesh->normals[3 * i + k]));
+	}
+
+	// Characters of the text either way
+	char buf[64];
+	size_t floatChars = 0, quantChars = 0;
+	for (int i = 0; i < 3 * nv; i++)
+		floatChars += sprintf(buf, "%.*f,", digits, mesh->verts[i]);
+	for (int i = 0; i < 3 * nn; i++)
+		floatChars += sprintf(buf, "%.*g,", digits, mesh->normals[i]);
+	for (int i = 0; i < 2 * nt; i++)
+		floatChars += sprintf(buf, "%.*g,", digits, mesh->tverts[i]);
+	for (size_t i = 0; i < qp.size(); i++)
+		quantChars += sprintf(buf, "%d,", qp[i]);
+	for (size_t i = 0; i < qn.size(); i++)
+		quantChars += sprintf(buf, "%d,", qn[i]);
+	for (size_t i = 0; i < qu.size(); i++)
+		quantChars += sprintf(buf, "%d,", qu[i]);
+
+	printf("%d vertices, tolerance %g: %d position bits, %d normal bits\n",
+		   nv, tolerance, posBits, normBits);
+	printf("  max error: position %.3g, uv %.3g, normal %.3g\n",
+		   posErr, uvErr, normErr);
+	if (floats)
+		printf("  positions over tolerance at %d bits: written as floats\n",
+			   posBits);
+	printf("  text: %lu chars with %d digits, %lu quantized (%.0f%%)\n",
+		   (unsigned long) floatChars, digits, (unsigned long) quantChars,
+		   100.0 * quantChars / floatChars);
+	delete mesh;
+	// Automatic bits either keep the tolerance or give up on it
+	return (argc <= 3 && !floats && posErr > tolerance) ||
+		   normErr > tolerance;
+}
+#endif
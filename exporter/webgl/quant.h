@@ -0,0 +1,90 @@
+/**********************************************************************
+ *<
+	FILE: quant.h
+
+	DESCRIPTION:  Quantized mesh attributes
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+
+#ifndef __QUANT__H__
+#define __QUANT__H__
+
+// A quantized mesh stores small integers instead of decimal numbers,
+// with the range of each attribute chosen per mesh:
+//
+//   positions  unsigned N bit integers across the bounding box of the
+//              mesh: x = min + q * scale per axis
+//   uvs        unsigned 16 bit integers across the uv bounding box
+//   normals    octahedral: the unit vector is projected onto the
+//              octahedron |x| + |y| + |z| = 1, whose lower half is
+//              folded over the upper one, and the two remaining
+//              coordinates are stored as signed 8 or 16 bit integers
+//              (two times N bits per normal instead of three floats)
+//
+// Each component rounds to the nearest step, so a position is off by
+// about half a step of its axis; min and scale are stored as floats,
+// which adds their own rounding.  QuantPositions picks the fewest bits
+// whose positions, rebuilt from the stored range, all come back within
+// a tolerance, and fails if even QUANT_MAX_BITS do not.  QuantNormalBits
+// does the same for normals.
+//
+// The attributes come in as the scene file holds them (already
+// converted to Y up, mirrored and with v flipped), so the reader only
+// has to undo the quantization.
+
+#include <vector>
+
+#define QUANT_MIN_BITS  8       // position bits, automatic selection range
+#define QUANT_MAX_BITS  24      // exact in a float
+#define QUANT_UV_BITS   16
+
+// Dequantization parameters of one attribute
+struct QuantRange {
+	int   bits;
+	float min[3];
+	float scale[3];     // size of one step per component
+};
+
+// Fewest position bits, between QUANT_MIN_BITS and QUANT_MAX_BITS, whose
+// half step is within tolerance; a starting point for QuantPositions
+int  QuantPositionBits(const float* pos, int count, double tolerance);
+
+// Largest difference of a component of the positions rebuilt from a
+// quantization, as a reader does, from the original positions
+double QuantPositionError(const float* pos, int count,
+						  const QuantRange& range, const std::vector<int>& q);
+
+// Quantize positions with the fewest bits that bring every one back
+// within tolerance.  Returns the bits, or 0 if QUANT_MAX_BITS are not
+// enough and the positions should be written as they are.
+int  QuantPositions(const float* pos, int count, double tolerance,
+					QuantRange& range, std::vector<int>& q);
+
+// Fewest octahedral bits per component, 8 or 16, that keep every
+// component of every normal within tolerance
+int  QuantNormalBits(const float* norm, int count, double tolerance);
+
+// Quantize count vectors of dims (2 or 3) components to bits each,
+// across their bounding box
+void QuantVectors(const float* v, int count, int dims, int bits,
+				  QuantRange& range, std::vector<int>& q);
+
+// Quantize count unit normals to two octahedral components each
+void QuantNormals(const float* norm, int count, int bits,
+				  std::vector<int>& q);
+
+void OctEncode(const float* n, int bits, int* e);
+void OctDecode(const int* e, int bits, float* n);
+
+// The quantized attributes of a mesh
+struct QuantMesh {
+	QuantRange       pos;
+	QuantRange       uv;
+	int              normBits;
+	std::vector<int> verts;     // 3 per vertex
+	std::vector<int> tverts;    // 2 per texture vertex
+	std::vector<int> normals;   // 2 per normal
+};
+
+#endif
@@ -240,6 +240,17 @@
 #define IDC_POLYGON_TYPE                1231
 #define IDC_PROGRESS_NNAME              1236
 #define IDC_CPV_MAX                     1238
+#define IDC_BINARY_GEOMETRY             1240
+#define IDC_BUFFER_GEOMETRY             1241
+#define IDC_REORDER_FACES               1242
+#define IDC_OVERDRAW_LOSS               1243
+#define IDC_QUANTIZE                    1244
+#define IDC_BAKE_PIVOT                  1245
+#define IDC_LOD_RATIOS                  1246
+#define IDC_BATCH_STATIC                1247
+#define IDC_TEX_SIZE                    1248
+#define IDC_TEX_MIPS                    1249
+#define IDC_TEX_COMPRESS                1250
 #define IDC_MAX_POLY_EDIT               1349
 #define IDC_MAX_POLY_SPIN               1350
 #define IDC_MAX_SELECTED_EDIT           1351
@@ -315,7 +326,7 @@
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        132
 #define _APS_NEXT_COMMAND_VALUE         40001
-#define _APS_NEXT_CONTROL_VALUE         1240
+#define _APS_NEXT_CONTROL_VALUE         1251
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
 #endif
@@ -0,0 +1,282 @@
+/**********************************************************************
+ *<
+	FILE: sceneir.cpp
+
+	DESCRIPTION:  Intermediate representation of an exported scene
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+#include <math.h>
+#include "sceneir.h"
+
+IRMaterial::IRMaterial()
+{
+	isStd     = false;
+	slot      = -1;
+	diffuse[0] = diffuse[1] = diffuse[2] = 0.0f;
+	specular[0] = specular[1] = specular[2] = 0.0f;
+	shininess = 0.0f;
+	selfIllum = 0.0f;
+	opacity   = 1.0f;
+	isWire    = false;
+	twoSided  = false;
+	texture   = -1;
+}
+
+IRTexture::IRTexture()
+{
+	scaled = false;
+}
+
+IRString
+IRNumber(int n)
+{
+	TCHAR digits[16];
+	int i = 15;
+	unsigned int u = n < 0 ? -n : n;
+	digits[i] = 0;
+	do
+	{
+		digits[--i] = (TCHAR) ('0' + u % 10);
+		u /= 10;
+	} while (u);
+	if (n < 0)
+		digits[--i] = '-';
+	return IRString(digits + i);
+}
+
+// FNV-1a over the bytes of some values
+static unsigned int
+HashBytes(unsigned int hash, const void* data, size_t size)
+{
+	const unsigned char* p = (const unsigned char*) data;
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ p[i]) * 16777619u;
+	return hash;
+}
+
+// Floats are hashed by value, so that 0 and -0 agree
+static unsigned int
+HashFloats(unsigned int hash, const float* f, int n)
+{
+	for (int i = 0; i < n; i++)
+	{
+		float x = f[i] + 0.0f;
+		hash = HashBytes(hash, &x, sizeof(x));
+	}
+	return hash;
+}
+
+// A wire color fallback only writes its color
+unsigned int
+IRMaterial::Hash() const
+{
+	unsigned int hash = HashBytes(2166136261u, &isStd, sizeof(isStd));
+	hash = HashFloats(hash, diffuse, 3);
+	if (isStd)
+	{
+		hash = HashFloats(hash, specular, 3);
+		hash = HashFloats(hash, &shininess, 1);
+		hash = HashFloats(hash, &selfIllum, 1);
+		hash = HashFloats(hash, &opacity, 1);
+		hash = HashBytes(hash, &texture, sizeof(texture));
+	}
+	return hash;
+}
+
+bool
+IRMaterial::SameAs(const IRMaterial& m) const
+{
+	if (isStd != m.isStd)
+		return false;
+	for (int i = 0; i < 3; i++)
+	{
+		if (diffuse[i] != m.diffuse[i])
+			return false;
+	}
+	if (!isStd)
+		return true;
+	for (int i = 0; i < 3; i++)
+	{
+		if (specular[i] != m.specular[i])
+			return false;
+	}
+	return shininess == m.shininess && selfIllum == m.selfIllum &&
+		opacity == m.opacity && texture == m.texture;
+}
+
+IRMesh::IRMesh()
+{
+	instances = 0;
+	prim.kind = IR_PRIM_NONE;
+	for (int i = 0; i < 3; i++)
+	{
+		prim.size[i]   = 0.0f;
+		prim.segs[i]   = 1;
+		prim.center[i] = 0.0f;
+	}
+}
+
+IRNode::IRNode()
+{
+	kind     = IR_MESH;
+	level    = 0;
+	mirrored = false;
+	rotated  = false;
+	isStatic = false;
+	for (int i = 0; i < 12; i++)
+		world[i] = i % 4 == 0 ? 1.0f : 0.0f;
+	for (int i = 0; i < 3; i++)
+	{
+		position[i] = 0.0f;
+		euler[i]    = 0.0f;
+		scale[i]    = 1.0f;
+		pivot[i]    = 0.0f;
+	}
+	mesh = -1;
+	light.intensity   = 1.0f;
+	light.color[0] = light.color[1] = light.color[2] = 1.0f;
+	light.useAtten    = false;
+	light.radius      = 0.0f;
+	light.attenuation = 1.0f;
+	light.cutOffAngle = 0.0f;
+	light.beamWidth   = 0.0f;
+	camera.fov = 0.0f;
+}
+
+void
+IRScene::Clear()
+{
+	for (size_t i = 0; i < meshes.size(); i++)
+		delete meshes[i];
+	meshes.clear();
+	nodes.clear();
+	materials.clear();
+	textures.clear();
+	mMtlHash.clear();
+	mMtlKeys.clear();
+	mTexKeys.clear();
+}
+
+int
+IRScene::AddNode(const IRNode& node)
+{
+	nodes.push_back(node);
+	return (int) nodes.size() - 1;
+}
+
+int
+IRScene::AddMesh(IRMesh* mesh)
+{
+	meshes.push_back(mesh);
+	return (int) meshes.size() - 1;
+}
+
+// A material that exports the same parameters as one already in the
+// scene is that one.  A new material is named after its MAX material
+// and slot, with a number after it if another material has that name.
+int
+IRScene::AddMaterial(const IRMaterial& mtl)
+{
+	unsigned int hash = mtl.Hash();
+	std::multimap<unsigned int, int>::iterator it = mMtlHash.lower_bound(hash);
+	for (; it != mMtlHash.end() && it->first == hash; ++it)
+	{
+		if (materials[it->second].SameAs(mtl))
+			return it->second;
+	}
+
+	IRString base = mtl.isStd ? IRString() : IRString(_T("wire_"));
+	base += mtl.name + _T("_") + IRNumber(mtl.slot);
+	IRString key = base;
+	for (int n = 2; mMtlKeys.count(key); n++)
+		key = base + _T("_") + IRNumber(n);
+
+	materials.push_back(mtl);
+	materials.back().key = key;
+	mMtlKeys.insert(key);
+	mMtlHash.insert(std::make_pair(hash, (int) materials.size() - 1));
+	return (int) materials.size() - 1;
+}
+
+// A bitmap from the same file under the same url is the same texture
+int
+IRScene::AddTexture(const IRTexture& tex)
+{
+	IRString key = tex.path + _T("|") + tex.name + _T("|") + tex.url;
+	std::map<IRString, int>::iterator it = mTexKeys.find(key);
+	if (it != mTexKeys.end())
+		return it->second;
+	textures.push_back(tex);
+	mTexKeys[key] = (int) textures.size() - 1;
+	return (int) textures.size() - 1;
+}
+
+// The grid lies in the xy plane with z = sin(x) * cos(y), so that the
+// normals vary over the surface.  Every vertex carries its own normal
+// and uv, each quad is split into two triangles in smoothing group 1.
+IRMesh*
+IRMakeGrid(int rows, int cols)
+{
+	IRMesh* mesh = new IRMesh;
+	int r, c;
+
+	if (rows < 1) rows = 1;
+	if (cols < 1) cols = 1;
+
+	mesh->verts.reserve((rows + 1) * (cols + 1) * 3);
+	mesh->tverts.reserve((rows + 1) * (cols + 1) * 2);
+	mesh->normals.reserve((rows + 1) * (cols + 1) * 3);
+	for (r = 0; r <= rows; r++)
+	{
+		for (c = 0; c <= cols; c++)
+		{
+			float x = 10.0f * c / cols;
+			float y = 10.0f * r / rows;
+			float z = (float) (sin(x) * cos(y));
+			float nx = (float) (-cos(x) * cos(y));
+			float ny = (float) (sin(x) * sin(y));
+			float len = (float) sqrt(nx * nx + ny * ny + 1.0f);
+
+			mesh->verts.push_back(x);
+			mesh->verts.push_back(y);
+			mesh->verts.push_back(z);
+			mesh->tverts.push_back((float) c / cols);
+			mesh->tverts.push_back((float) r / rows);
+			mesh->normals.push_back(nx / len);
+			mesh->normals.push_back(ny / len);
+			mesh->normals.push_back(1.0f / len);
+		}
+	}
+
+	mesh->faces.reserve(rows * cols * 2);
+	mesh->faceNormals.reserve(rows * cols * 6);
+	for (r = 0; r < rows; r++)
+	{
+		for (c = 0; c < cols; c++)
+		{
+			int a = r * (cols + 1) + c;
+			int b = a + 1;
+			int d = a + cols + 1;
+			int e = d + 1;
+			int tri[2][3] = { { a, b, e }, { a, e, d } };
+			unsigned int vis[2] = { 3, 6 };     // the diagonal is hidden
+
+			for (int k = 0; k < 2; k++)
+			{
+				IRFace f;
+				for (int v = 0; v < 3; v++)
+				{
+					f.v[v] = f.t[v] = tri[k][v];
+					mesh->faceNormals.push_back(tri[k][v]);
+				}
+				f.matID   = 0;
+				f.smGroup = 1;
+				f.edgeVis = vis[k];
+				f.hidden  = false;
+				mesh->faces.push_back(f);
+			}
+		}
+	}
+	return mesh;
+}
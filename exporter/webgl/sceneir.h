@@ -0,0 +1,219 @@
+/**********************************************************************
+ *<
+	FILE: sceneir.h
+
+	DESCRIPTION:  Intermediate representation of an exported scene
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+
+#ifndef __SCENEIR__H__
+#define __SCENEIR__H__
+
+// The exporter walks the MAX scene graph once and captures everything
+// the scene file needs (nodes, transforms, meshes, materials, textures,
+// lights and cameras) into the structures below.  Every section of the
+// output is then written from this representation, so the scene graph
+// is never evaluated more than once per node.
+//
+// Nothing in here depends on the MAX SDK; a scene can be assembled
+// from synthetic data to time or check the writers outside of MAX.
+
+#include <vector>
+#include <string>
+#include <map>
+#include <set>
+
+#ifdef _WIN32
+#include <tchar.h>
+#else
+#ifndef _T
+typedef char TCHAR;
+#define _T(x) x
+#endif
+#endif
+
+typedef std::basic_string<TCHAR> IRString;
+
+// What an IRNode turns into in the scene file
+enum IRNodeKind {
+	IR_MESH,
+	IR_POINT_LIGHT,
+	IR_DIRECT_LIGHT,
+	IR_SPOT_LIGHT,
+	IR_CAMERA
+};
+
+// A bitmap referenced by a material
+struct IRTexture {
+	IRTexture();
+
+	IRString name;          // file name, as written in the scene
+	IRString url;           // file name with the url prefix applied
+	IRString path;          // directory the bitmap comes from
+	bool     scaled;        // written scaled by the exporter, not copied
+	std::vector<IRString> mips; // urls of the mip levels below the bitmap,
+								// largest first; scaled bitmaps only
+	IRString s3tc;          // url of the DXT compressed .dds, if made
+	IRString etc1;          // url of the ETC1 compressed .ktx, if made
+};
+
+// A material, evaluated at the start of the animation.  Slots of any
+// node that export the same parameters share one material.
+struct IRMaterial {
+	IRMaterial();
+
+	IRString key;           // unique name in the scene file, set by the scene
+	bool     isStd;         // standard material; wire color fallback otherwise
+	IRString name;          // material name, or node name for wire colors
+	int      slot;          // sub-material index, -1 for a single material
+	float    diffuse[3];    // diffuse color, or the wire color
+	float    specular[3];   // specular color scaled by shininess strength
+	float    shininess;     // specular coefficient
+	float    selfIllum;     // self illumination amount
+	float    opacity;
+	bool     isWire;
+	bool     twoSided;
+	int      texture;       // index in IRScene::textures, -1 if none
+
+	// Hash and comparison of the parameters the scene file gets
+	unsigned int Hash() const;
+	bool         SameAs(const IRMaterial& m) const;
+};
+
+// A triangle of a mesh
+struct IRFace {
+	int          v[3];      // vertex indices
+	int          t[3];      // texture vertex indices, valid if the mesh has uvs
+	int          matID;     // material index
+	unsigned int smGroup;   // smoothing groups
+	unsigned int edgeVis;   // visible edges, bit k for v[k] to v[k+1]
+	bool         hidden;    // hidden faces are not written
+};
+
+// A standard primitive that the viewer builds itself instead of
+// reading a mesh.  Sizes are along the object axes, Z up.
+enum IRPrimKind {
+	IR_PRIM_NONE,
+	IR_PRIM_CUBE,           // size: x, y, z extents; segs: x, y, z
+	IR_PRIM_SPHERE,         // size: radius; segs: around, pole to pole
+	IR_PRIM_CYLINDER,       // size: top radius, bottom radius, height; segs: sides, height
+	IR_PRIM_PLANE           // size: x, y extents
+};
+
+struct IRPrimitive {
+	IRPrimKind kind;
+	float      size[3];
+	int        segs[3];
+	float      center[3];   // of the primitive, in object space
+};
+
+// A simplified level of a mesh, for viewing from further away
+struct IRLod {
+	int   mesh;             // index in IRScene::meshes
+	float error;            // largest distance from the full mesh
+	float distance;         // camera distance the level is used from
+};
+
+// A triangle mesh, in object space.  Instanced nodes share one mesh,
+// which is written once under the name of the first node using it.
+// A primitive has no vertices or faces.  The levels of detail of a
+// mesh are meshes of their own, named after the mesh, and so are its
+// submeshes when it is too large for 16 bit indices; each submesh has
+// levels of detail of its own.
+struct IRMesh {
+	IRMesh();
+
+	IRString            name;           // node the geometry is named after
+	int                 instances;      // number of nodes using the mesh
+	IRPrimitive         prim;           // kind IR_PRIM_NONE for a mesh
+	std::vector<float>  verts;          // x, y, z per vertex
+	std::vector<float>  tverts;         // u, v per texture vertex
+	std::vector<float>  colors;         // r, g, b per vertex, pre-lit meshes only
+	std::vector<float>  normals;        // x, y, z per unique normal
+	std::vector<IRFace> faces;
+	std::vector<int>    faceNormals;    // normal index of each face corner
+	std::vector<int>    quads;          // face each face makes a quad with, -1
+										// if none; empty for triangles only
+	std::vector<IRLod>  lods;           // coarser levels, coarsest last
+	std::vector<int>    submeshes;      // meshes with the rest of the faces,
+										// written under the same object
+
+	int NumVerts() const   { return (int) verts.size() / 3; }
+	int NumTVerts() const  { return (int) tverts.size() / 2; }
+	int NumNormals() const { return (int) normals.size() / 3; }
+	int NumFaces() const   { return (int) faces.size(); }
+};
+
+// Light parameters
+struct IRLight {
+	float intensity;
+	float color[3];
+	bool  useAtten;
+	float radius;
+	float attenuation;      // spot lights only
+	float cutOffAngle;      // spot lights only, radians
+	float beamWidth;        // spot lights only, radians
+};
+
+// Camera parameters
+struct IRCamera {
+	float fov;              // vertical field of view, radians
+};
+
+// A node written to the scene, in scene graph order
+struct IRNode {
+	IRNode();
+
+	IRNodeKind       kind;
+	IRString         name;          // unique, mangled node name
+	int              level;         // indentation level of the node
+	bool             mirrored;      // mirrored by vertices
+	float            pivot[3];      // object offset baked into the mesh
+	float            position[3];
+	bool             rotated;       // euler is meaningful
+	float            euler[3];
+	float            scale[3];
+	bool             isStatic;      // never moves or deforms
+	float            world[12];     // object to world at the start, rows x,
+									// y, z and translation; static nodes only
+	int              mesh;          // index in IRScene::meshes, -1 if none
+	std::vector<int> materials;     // indices in IRScene::materials, one per slot
+	IRLight          light;
+	IRCamera         camera;
+};
+
+// The whole scene
+class IRScene {
+public:
+	IRScene() {}
+	~IRScene() { Clear(); }
+
+	void Clear();
+	int  AddNode(const IRNode& node);
+	int  AddMesh(IRMesh* mesh);
+	int  AddMaterial(const IRMaterial& mtl);
+	int  AddTexture(const IRTexture& tex);
+
+	std::vector<IRNode>     nodes;
+	std::vector<IRMesh*>    meshes;     // owned by the scene
+	std::vector<IRMaterial> materials;  // each written once
+	std::vector<IRTexture>  textures;   // each written once
+
+private:
+	std::multimap<unsigned int, int> mMtlHash;  // material hash to index
+	std::set<IRString>               mMtlKeys;
+	std::map<IRString, int>          mTexKeys;  // path, name and url to index
+
+	IRScene(const IRScene&);
+	IRScene& operator=(const IRScene&);
+};
+
+// Decimal digits of a number, for names and keys
+IRString IRNumber(int n);
+
+// Build a wavy rows x cols grid of quads, for timing and checking the
+// writers on synthetic data.
+IRMesh* IRMakeGrid(int rows, int cols);
+
+#endif
@@ -0,0 +1,731 @@
+/**********************************************************************
+ *<
+	FILE: simplify.cpp
+
+	DESCRIPTION:  Quadric error mesh simplification for LOD chains
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "simplify.h"
+
+// A symmetric 4x4 matrix, its upper triangle by rows (xx, xy, xz, xw,
+// yy, yz, yw, zz, zw, ww), and the total weight of its planes
+struct Quadric {
+	double a[10];
+	double w;
+};
+
+// Add the plane n.p + d = 0, with weight w
+static void
+AddPlane(Quadric& q, const double* n, double d, double w)
+{
+	q.a[0] += w * n[0] * n[0];
+	q.a[1] += w * n[0] * n[1];
+	q.a[2] += w * n[0] * n[2];
+	q.a[3] += w * n[0] * d;
+	q.a[4] += w * n[1] * n[1];
+	q.a[5] += w * n[1] * n[2];
+	q.a[6] += w * n[1] * d;
+	q.a[7] += w * n[2] * n[2];
+	q.a[8] += w * n[2] * d;
+	q.a[9] += w * d * d;
+	q.w += w;
+}
+
+static void
+AddQuadric(Quadric& q, const Quadric& r)
+{
+	for (int i = 0; i < 10; i++)
+		q.a[i] += r.a[i];
+	q.w += r.w;
+}
+
+static double
+QuadricError(const Quadric& q, const float* p)
+{
+	double x = p[0], y = p[1], z = p[2];
+	double e = q.a[0] * x * x + q.a[4] * y * y + q.a[7] * z * z + q.a[9] +
+		2.0 * (q.a[1] * x * y + q.a[2] * x * z + q.a[5] * y * z +
+			   q.a[3] * x + q.a[6] * y + q.a[8] * z);
+	return e > 0.0 ? e : 0.0;
+}
+
+static double
+Dot(const double* a, const double* b)
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void
+Cross(const double* a, const double* b, double* c)
+{
+	c[0] = a[1] * b[2] - a[2] * b[1];
+	c[1] = a[2] * b[0] - a[0] * b[2];
+	c[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+// An edge of a face, keyed by its vertices in increasing order
+struct SimplifyEdge {
+	int  lo, hi;
+	int  face;
+	bool forward;       // the face runs from lo to hi
+
+	bool operator<(const SimplifyEdge& e) const
+	{
+		if (lo != e.lo)
+			return lo < e.lo;
+		if (hi != e.hi)
+			return hi < e.hi;
+		return face < e.face;
+	}
+};
+
+// Moving vertex from onto vertex to
+struct SimplifyCollapse {
+	int    from, to;
+	double cost;
+
+	bool operator<(const SimplifyCollapse& c) const
+	{
+		if (cost != c.cost)
+			return cost < c.cost;
+		return from < c.from;
+	}
+};
+
+class Simplifier {
+public:
+	Simplifier(const IRMesh& mesh);
+
+	void Run(int target, SimplifyStats& stats);
+	void Output(IRMesh& lod);
+
+private:
+	void Adjacency();
+	void Candidates(bool first);
+	bool SameSide(int f0, int f1, int lo, int hi) const;
+	void AddSeamPlanes(const SimplifyEdge& e);
+	bool Collapse(const SimplifyCollapse& c);
+	int  Corner(int f, int v) const;
+	void FaceNormal(int f, int moved, const float* p, double* n) const;
+	const float* Pos(int v) const { return &mMesh.verts[3 * v]; }
+
+	const IRMesh&          mMesh;
+	int                    mVerts;
+	bool                   mUVs;
+	bool                   mNormals;
+	std::vector<int>       mSource;     // mesh face of each face
+	std::vector<int>       mV;          // vertex, uv and normal of each corner
+	std::vector<int>       mT;
+	std::vector<int>       mN;
+	std::vector<bool>      mAlive;
+	int                    mLive;       // faces left
+	std::vector<Quadric>   mQuadrics;   // one per vertex
+	std::vector<int>       mFirst;      // faces around vertex v are
+	std::vector<int>       mAround;     // mAround[mFirst[v]..mFirst[v + 1]]
+	std::vector<int>       mSeams;      // seam edges at each vertex
+	std::vector<bool>      mLocked;
+	std::vector<SimplifyCollapse> mCollapses;
+	std::vector<int>       mTouched;    // pass that last changed a vertex
+	std::vector<int>       mMark;
+	int                    mStamp;
+	int                    mPass;
+	double                 mError;      // largest squared distance so far
+};
+
+Simplifier::Simplifier(const IRMesh& mesh) : mMesh(mesh)
+{
+	mVerts = mesh.NumVerts();
+	mUVs = mesh.NumTVerts() > 0;
+	mNormals = mesh.faceNormals.size() == 3 * mesh.faces.size();
+
+	// Hidden faces are not written, and faces with a repeated vertex
+	// have no edges to collapse
+	for (int f = 0; f < mesh.NumFaces(); f++)
+	{
+		const IRFace& face = mesh.faces[f];
+		if (face.hidden || face.v[0] == face.v[1] || face.v[1] == face.v[2] ||
+			face.v[2] == face.v[0])
+			continue;
+		mSource.push_back(f);
+		for (int k = 0; k < 3; k++)
+		{
+			mV.push_back(face.v[k]);
+			mT.push_back(mUVs ? face.t[k] : 0);
+			mN.push_back(mNormals ? mesh.faceNormals[3 * f + k] : 0);
+		}
+	}
+	mLive = (int) mSource.size();
+	mAlive.assign(mLive, true);
+
+	// The planes of the faces, weighted by area
+	Quadric zero;
+	memset(&zero, 0, sizeof(zero));
+	mQuadrics.assign(mVerts, zero);
+	for (int f = 0; f < mLive; f++)
+	{
+		double n[3];
+		FaceNormal(f, -1, NULL, n);
+		double len = sqrt(Dot(n, n));
+		if (len <= 0.0)
+			continue;
+		n[0] /= len;
+		n[1] /= len;
+		n[2] /= len;
+		const float* p = Pos(mV[3 * f]);
+		double d = -(n[0] * p[0] + n[1] * p[1] + n[2] * p[2]);
+		for (int k = 0; k < 3; k++)
+			AddPlane(mQuadrics[mV[3 * f + k]], n, d, 0.5 * len);
+	}
+
+	mTouched.assign(mVerts, -1);
+	mMark.assign(mVerts, 0);
+	mStamp = 0;
+	mPass = 0;
+	mError = 0.0;
+}
+
+// Corner of face f at vertex v, -1 if v is not on it
+int
+Simplifier::Corner(int f, int v) const
+{
+	for (int k = 0; k < 3; k++)
+	{
+		if (mV[3 * f + k] == v)
+			return 3 * f + k;
+	}
+	return -1;
+}
+
+// Twice the area times the unit normal of face f, with vertex moved at
+// position p
+void
+Simplifier::FaceNormal(int f, int moved, const float* p, double* n) const
+{
+	double q[3][3];
+	for (int k = 0; k < 3; k++)
+	{
+		int v = mV[3 * f + k];
+		const float* src = v == moved ? p : Pos(v);
+		q[k][0] = src[0];
+		q[k][1] = src[1];
+		q[k][2] = src[2];
+	}
+	double e1[3] = { q[1][0] - q[0][0], q[1][1] - q[0][1], q[1][2] - q[0][2] };
+	double e2[3] = { q[2][0] - q[0][0], q[2][1] - q[0][1], q[2][2] - q[0][2] };
+	Cross(e1, e2, n);
+}
+
+// Faces around each vertex, by counting
+void
+Simplifier::Adjacency()
+{
+	int f, k;
+	mFirst.assign(mVerts + 1, 0);
+	for (f = 0; f < (int) mAlive.size(); f++)
+	{
+		if (mAlive[f])
+			for (k = 0; k < 3; k++)
+				mFirst[mV[3 * f + k] + 1]++;
+	}
+	for (int v = 0; v < mVerts; v++)
+		mFirst[v + 1] += mFirst[v];
+	mAround.resize(mFirst[mVerts]);
+	std::vector<int> fill(mFirst.begin(), mFirst.end() - 1);
+	for (f = 0; f < (int) mAlive.size(); f++)
+	{
+		if (mAlive[f])
+			for (k = 0; k < 3; k++)
+				mAround[fill[mV[3 * f + k]]++] = f;
+	}
+}
+
+// Whether two faces of an edge share the uvs and normals of both its
+// ends, and the material
+bool
+Simplifier::SameSide(int f0, int f1, int lo, int hi) const
+{
+	if (mMesh.faces[mSource[f0]].matID != mMesh.faces[mSource[f1]].matID)
+		return false;
+	int ends[2] = { lo, hi };
+	for (int i = 0; i < 2; i++)
+	{
+		int c0 = Corner(f0, ends[i]), c1 = Corner(f1, ends[i]);
+		if (mT[c0] != mT[c1] || mN[c0] != mN[c1])
+			return false;
+	}
+	return true;
+}
+
+// The plane through a seam edge at right angle to its face, so that
+// moving a seam vertex off the line of the seam costs
+void
+Simplifier::AddSeamPlanes(const SimplifyEdge& e)
+{
+	const float* a = Pos(e.lo);
+	const float* b = Pos(e.hi);
+	double edge[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+	double n[3], m[3];
+	FaceNormal(e.face, -1, NULL, n);
+	Cross(edge, n, m);
+	double len = sqrt(Dot(m, m));
+	if (len <= 0.0)
+		return;
+	m[0] /= len;
+	m[1] /= len;
+	m[2] /= len;
+	double d = -(m[0] * a[0] + m[1] * a[1] + m[2] * a[2]);
+	double w = SIMPLIFY_SEAM_WEIGHT * Dot(edge, edge);
+	AddPlane(mQuadrics[e.lo], m, d, w);
+	AddPlane(mQuadrics[e.hi], m, d, w);
+}
+
+// Find the seams, and the collapses the seams allow with their cost
+void
+Simplifier::Candidates(bool first)
+{
+	std::vector<SimplifyEdge> edges;
+	edges.reserve(3 * mLive);
+	for (int f = 0; f < (int) mAlive.size(); f++)
+	{
+		if (!mAlive[f])
+			continue;
+		for (int k = 0; k < 3; k++)
+		{
+			int a = mV[3 * f + k], b = mV[3 * f + (k + 1) % 3];
+			SimplifyEdge e;
+			e.lo = a < b ? a : b;
+			e.hi = a < b ? b : a;
+			e.face = f;
+			e.forward = a < b;
+			edges.push_back(e);
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+
+	// Each edge once: its first record and whether it is a seam
+	std::vector<int> starts;
+	std::vector<bool> seams;
+	mSeams.assign(mVerts, 0);
+	mLocked.assign(mVerts, false);
+	size_t i, j;
+	for (i = 0; i < edges.size(); i = j)
+	{
+		for (j = i + 1; j < edges.size() && edges[j].lo == edges[i].lo &&
+			 edges[j].hi == edges[i].hi; j++)
+			;
+		const SimplifyEdge& e = edges[i];
+		int n = (int) (j - i);
+		if (n > 2 || (n == 2 && e.forward == edges[i + 1].forward))
+		{
+			mLocked[e.lo] = mLocked[e.hi] = true;
+			continue;
+		}
+		bool seam = n == 1 || !SameSide(e.face, edges[i + 1].face, e.lo, e.hi);
+		if (seam)
+		{
+			mSeams[e.lo]++;
+			mSeams[e.hi]++;
+			if (first)
+				for (size_t k = i; k < j; k++)
+					AddSeamPlanes(edges[k]);
+		}
+		starts.push_back((int) i);
+		seams.push_back(seam);
+	}
+
+	// A vertex inside a seam line moves along it; the ends and
+	// crossings of seams stay
+	mCollapses.clear();
+	for (i = 0; i < starts.size(); i++)
+	{
+		const SimplifyEdge& e = edges[starts[i]];
+		int ends[2] = { e.lo, e.hi };
+		SimplifyCollapse best;
+		best.from = -1;
+		for (int k = 0; k < 2; k++)
+		{
+			int u = ends[k], v = ends[1 - k];
+			if (mLocked[u] || (mSeams[u] != 0 && !(seams[i] && mSeams[u] == 2)))
+				continue;
+			double cost = QuadricError(mQuadrics[u], Pos(v)) +
+				QuadricError(mQuadrics[v], Pos(v));
+			if (best.from < 0 || cost < best.cost)
+			{
+				best.from = u;
+				best.to = v;
+				best.cost = cost;
+			}
+		}
+		if (best.from >= 0)
+			mCollapses.push_back(best);
+	}
+}
+
+// Look up the index a corner of the vertex that moves takes
+static bool
+MapIndex(int map[2][2], int count, int from, int& to)
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (map[i][0] == from)
+		{
+			to = map[i][1];
+			return true;
+		}
+	}
+	return false;
+}
+
+// Move a vertex onto the other end of an edge, if nothing around them
+// changed in this pass and the result is sound
+bool
+Simplifier::Collapse(const SimplifyCollapse& c)
+{
+	int u = c.from, v = c.to;
+	int i, k;
+	if (mTouched[u] == mPass || mTouched[v] == mPass)
+		return false;
+
+	// The faces on the edge go.  The corners of u on each side of the
+	// edge take the uv and normal that v has on that side.
+	int removed[2], count = 0;
+	int mapT[2][2], mapN[2][2];
+	for (i = mFirst[u]; i < mFirst[u + 1]; i++)
+	{
+		int f = mAround[i];
+		int cv = Corner(f, v);
+		if (cv < 0)
+			continue;
+		if (count == 2)
+			return false;
+		int cu = Corner(f, u);
+		mapT[count][0] = mT[cu];
+		mapT[count][1] = mT[cv];
+		mapN[count][0] = mN[cu];
+		mapN[count][1] = mN[cv];
+		removed[count++] = f;
+	}
+	if (count == 0)
+		return false;
+	if (count == 2 &&
+		((mapT[0][0] == mapT[1][0] && mapT[0][1] != mapT[1][1]) ||
+		 (mapN[0][0] == mapN[1][0] && mapN[0][1] != mapN[1][1])))
+		return false;
+
+	// The only vertices next to both ends must be the third corners of
+	// the faces that go, or the mesh would fold onto itself
+	int nextToU = ++mStamp;
+	int seen = ++mStamp;
+	int common = 0;
+	for (i = mFirst[u]; i < mFirst[u + 1]; i++)
+		for (k = 0; k < 3; k++)
+			mMark[mV[3 * mAround[i] + k]] = nextToU;
+	for (i = mFirst[v]; i < mFirst[v + 1]; i++)
+	{
+		for (k = 0; k < 3; k++)
+		{
+			int x = mV[3 * mAround[i] + k];
+			if (x != u && x != v && mMark[x] == nextToU)
+			{
+				mMark[x] = seen;
+				common++;
+			}
+		}
+	}
+	if (common != count)
+		return false;
+
+	// Every corner of u must have a side, and no face may flip
+	const float* p = Pos(v);
+	for (i = mFirst[u]; i < mFirst[u + 1]; i++)
+	{
+		int f = mAround[i];
+		if (f == removed[0] || (count == 2 && f == removed[1]))
+			continue;
+		int cu = Corner(f, u), t, n;
+		if (!MapIndex(mapT, count, mT[cu], t) || !MapIndex(mapN, count, mN[cu], n))
+			return false;
+		double before[3], after[3];
+		FaceNormal(f, -1, NULL, before);
+		FaceNormal(f, u, p, after);
+		if (Dot(before, after) <= 0.0)
+			return false;
+	}
+
+	// Nothing around either end may be collapsed again in this pass
+	for (i = mFirst[u]; i < mFirst[u + 1]; i++)
+		for (k = 0; k < 3; k++)
+			mTouched[mV[3 * mAround[i] + k]] = mPass;
+	for (i = mFirst[v]; i < mFirst[v + 1]; i++)
+		for (k = 0; k < 3; k++)
+			mTouched[mV[3 * mAround[i] + k]] = mPass;
+
+	for (i = mFirst[u]; i < mFirst[u + 1]; i++)
+	{
+		int f = mAround[i];
+		if (f == removed[0] || (count == 2 && f == removed[1]))
+			continue;
+		int cu = Corner(f, u);
+		MapIndex(mapT, count, mT[cu], mT[cu]);
+		MapIndex(mapN, count, mN[cu], mN[cu]);
+		mV[cu] = v;
+	}
+	for (i = 0; i < count; i++)
+		mAlive[removed[i]] = false;
+	mLive -= count;
+
+	double w = mQuadrics[u].w + mQuadrics[v].w;
+	if (w > 0.0 && c.cost / w > mError)
+		mError = c.cost / w;
+	AddQuadric(mQuadrics[v], mQuadrics[u]);
+	return true;
+}
+
+void
+Simplifier::Run(int target, SimplifyStats& stats)
+{
+	bool relax = false;
+	stats.faces[0] = mLive;
+	stats.passes = 0;
+	while (mLive > target)
+	{
+		Adjacency();
+		Candidates(stats.passes == 0);
+		if (mCollapses.empty())
+			break;
+		std::sort(mCollapses.begin(), mCollapses.end());
+
+		// Each collapse takes two faces off, one on a border.  Go a
+		// little past the cost of the ones needed, unless the last
+		// pass could do nothing below that.
+		int needed = (mLive - target + 1) / 2;
+		if (needed > (int) mCollapses.size())
+			needed = (int) mCollapses.size();
+		double limit = 1.5 * mCollapses[needed - 1].cost;
+		int done = 0;
+		mPass++;
+		stats.passes++;
+		for (size_t i = 0; i < mCollapses.size() && mLive > target; i++)
+		{
+			if (!relax && mCollapses[i].cost > limit)
+				break;
+			if (Collapse(mCollapses[i]))
+				done++;
+		}
+		if (done == 0 && relax)
+			break;
+		relax = done == 0;
+	}
+	stats.faces[1] = mLive;
+	stats.error = (float) sqrt(mError);
+}
+
+// The faces left, with the vertices, uvs, normals and colors they use
+void
+Simplifier::Output(IRMesh& lod)
+{
+	bool colors = !mMesh.colors.empty() && mMesh.colors.size() == mMesh.verts.size();
+	std::vector<int> vmap(mVerts, -1);
+	std::vector<int> tmap(mMesh.NumTVerts(), -1);
+	std::vector<int> nmap(mMesh.NumNormals(), -1);
+
+	lod.verts.clear();
+	lod.tverts.clear();
+	lod.colors.clear();
+	lod.normals.clear();
+	lod.faces.clear();
+	lod.faceNormals.clear();
+	lod.quads.clear();
+	lod.faces.reserve(mLive);
+	for (int f = 0; f < (int) mAlive.size(); f++)
+	{
+		if (!mAlive[f])
+			continue;
+		IRFace face = mMesh.faces[mSource[f]];
+		for (int k = 0; k < 3; k++)
+		{
+			int c = 3 * f + k;
+			int v = mV[c];
+			if (vmap[v] < 0)
+			{
+				vmap[v] = lod.NumVerts();
+				lod.verts.insert(lod.verts.end(), &mMesh.verts[3 * v],
+								 &mMesh.verts[3 * v] + 3);
+				if (colors)
+					lod.colors.insert(lod.colors.end(), &mMesh.colors[3 * v],
+									  &mMesh.colors[3 * v] + 3);
+			}
+			face.v[k] = vmap[v];
+			if (mUVs)
+			{
+				int t = mT[c];
+				if (tmap[t] < 0)
+				{
+					tmap[t] = lod.NumTVerts();
+					lod.tverts.insert(lod.tverts.end(), &mMesh.tverts[2 * t],
+									  &mMesh.tverts[2 * t] + 2);
+				}
+				face.t[k] = tmap[t];
+			}
+			if (mNormals)
+			{
+				int n = mN[c];
+				if (nmap[n] < 0)
+				{
+					nmap[n] = lod.NumNormals();
+					lod.normals.insert(lod.normals.end(), &mMesh.normals[3 * n],
+									   &mMesh.normals[3 * n] + 3);
+				}
+				lod.faceNormals.push_back(nmap[n]);
+			}
+		}
+		lod.faces.push_back(face);
+	}
+}
+
+void
+SimplifyMesh(const IRMesh& mesh, int target, IRMesh& lod, SimplifyStats& stats)
+{
+	Simplifier simplifier(mesh);
+	simplifier.Run(target, stats);
+	simplifier.Output(lod);
+}
+
+float
+LodDistance(float error)
+{
+	// At distance d the view is 2 d tan(fov / 2) high
+	float tanHalf = (float) tan(LOD_VIEW_FOV * 3.14159265 / 360.0);
+	return error * LOD_VIEW_HEIGHT / (2.0f * tanHalf * LOD_PIXELS);
+}
+
+#ifdef SIMPLIFY_BENCHMARK
+// Stand-alone timing and checks on a wavy grid with a uv seam down the
+// middle column and a smoothing border across the middle row.  The
+// grid is simplified to half, a quarter and a tenth of its faces; the
+// open border and both seams must stay where they were:
+//
+//    g++ -O2 -DSIMPLIFY_BENCHMARK simplify.cpp sceneir.cpp -o simplifybench
+//    ./simplifybench [rows]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <map>
+#include <utility>
+
+// Split the uvs along x = 5 and the normals along y = 5
+static void
+AddSeams(IRMesh& mesh, int rows)
+{
+	int cols = rows, f, k;
+	int tverts = mesh.NumTVerts(), normals = mesh.NumNormals();
+	mesh.tverts.insert(mesh.tverts.end(), mesh.tverts.begin(), mesh.tverts.end());
+	mesh.normals.insert(mesh.normals.end(), mesh.normals.begin(), mesh.normals.end());
+	for (f = 0; f < mesh.NumFaces(); f++)
+	{
+		IRFace& face = mesh.faces[f];
+		int c = (f / 2) % cols, r = (f / 2) / cols;
+		for (k = 0; k < 3; k++)
+		{
+			if (c >= cols / 2)
+				face.t[k] += tverts;
+			if (r >= rows / 2)
+				mesh.faceNormals[3 * f + k] += normals;
+		}
+	}
+}
+
+typedef std::pair<int, int> EdgeKey;
+
+// Count the open border edges, and the uv and normal seam edges, and
+// check each lies where it should
+static void
+CheckSeams(const IRMesh& mesh, int& border, int& uvSeam, int& normalSeam,
+		   int& misplaced)
+{
+	std::map<EdgeKey, std::vector<int> > edges;
+	border = uvSeam = normalSeam = misplaced = 0;
+	for (int f = 0; f < mesh.NumFaces(); f++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			int a = mesh.faces[f].v[k], b = mesh.faces[f].v[(k + 1) % 3];
+			edges[EdgeKey(a < b ? a : b, a < b ? b : a)].push_back(3 * f + k);
+		}
+	}
+	for (std::map<EdgeKey, std::vector<int> >::iterator i = edges.begin();
+		 i != edges.end(); i++)
+	{
+		const float* a = &mesh.verts[3 * i->first.first];
+		const float* b = &mesh.verts[3 * i->first.second];
+		if (i->second.size() == 1)
+		{
+			border++;
+			bool onX = (a[0] == 0.0f && b[0] == 0.0f) || (a[0] == 10.0f && b[0] == 10.0f);
+			bool onY = (a[1] == 0.0f && b[1] == 0.0f) || (a[1] == 10.0f && b[1] == 10.0f);
+			if (!onX && !onY)
+				misplaced++;
+			continue;
+		}
+		int c0 = i->second[0], c1 = i->second[1];
+		int f0 = c0 / 3, f1 = c1 / 3;
+		int a0 = c0, b0 = 3 * f0 + (c0 % 3 + 1) % 3;
+		int a1 = 3 * f1 + (c1 % 3 + 1) % 3, b1 = c1;   // wound the other way
+		if (mesh.faces[f0].t[a0 % 3] != mesh.faces[f1].t[a1 % 3] ||
+			mesh.faces[f0].t[b0 % 3] != mesh.faces[f1].t[b1 % 3])
+		{
+			uvSeam++;
+			if (a[0] != 5.0f || b[0] != 5.0f)
+				misplaced++;
+		}
+		if (mesh.faceNormals[a0] != mesh.faceNormals[a1] ||
+			mesh.faceNormals[b0] != mesh.faceNormals[b1])
+		{
+			normalSeam++;
+			if (a[1] != 5.0f || b[1] != 5.0f)
+				misplaced++;
+		}
+	}
+}
+
+int
+main(int argc, char** argv)
+{
+	int rows = argc > 1 ? atoi(argv[1]) : 300;
+	rows = (rows + 1) & ~1;
+	IRMesh* grid = IRMakeGrid(rows, rows);
+	AddSeams(*grid, rows);
+
+	int border, uvSeam, normalSeam, misplaced;
+	CheckSeams(*grid, border, uvSeam, normalSeam, misplaced);
+	printf("grid: %d faces, %d border, %d uv seam and %d normal seam edges\n",
+		   grid->NumFaces(), border, uvSeam, normalSeam);
+
+	float ratios[3] = { 0.5f, 0.25f, 0.1f };
+	for (int i = 0; i < 3; i++)
+	{
+		int target = (int) (ratios[i] * grid->NumFaces());
+		IRMesh lod;
+		SimplifyStats stats;
+		clock_t start = clock();
+		SimplifyMesh(*grid, target, lod, stats);
+		double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+		CheckSeams(lod, border, uvSeam, normalSeam, misplaced);
+		printf("%3.0f%%: %d -> %d faces (target %d), %d passes, %.3fs\n",
+			   100.0f * ratios[i], stats.faces[0], stats.faces[1], target,
+			   stats.passes, seconds);
+		printf("      %d verts, %d uvs, %d normals, error %.4f, switch at %.1f\n",
+			   lod.NumVerts(), lod.NumTVerts(), lod.NumNormals(), stats.error,
+			   LodDistance(stats.error));
+		printf("      %d border, %d uv seam, %d normal seam edges, %d misplaced%s\n",
+			   border, uvSeam, normalSeam, misplaced, misplaced ? " FAILED" : "");
+	}
+	delete grid;
+	return 0;
+}
+#endif
@@ -0,0 +1,67 @@
+/**********************************************************************
+ *<
+	FILE: simplify.h
+
+	DESCRIPTION:  Quadric error mesh simplification for LOD chains
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+
+#ifndef __SIMPLIFY__H__
+#define __SIMPLIFY__H__
+
+// SimplifyMesh collapses edges of a mesh, cheapest first, until it has
+// no more than a target number of faces.  The cost of moving a vertex
+// is the quadric error of Garland and Heckbert: the sum of squared
+// distances to the planes of the faces around it, weighted by area,
+// which a vertex carries along when it is collapsed.
+//
+// An edge collapse moves one vertex onto the other; no new positions
+// are made, so the uvs and normals of the corners that stay are those
+// of the mesh.  Edges where the uvs, the normals (smoothing group
+// borders) or the material change are seams, and so are the open
+// borders of the mesh.  A vertex on a seam only moves along it, onto
+// another vertex of the same seam, and seams also get planes through
+// them at right angle to the faces, so they keep their shape.  The
+// ends and crossings of seams, and vertices around edges of more than
+// two faces, never move.  Collapses that would flip a face or make
+// the mesh non-manifold are not done.
+//
+// Collapses are done in passes: the candidates of a pass are sorted by
+// cost, and a collapse is skipped if another one of the pass already
+// changed the faces around it.  A pass only goes a little past the
+// cost of the collapses it needs, so cheap collapses blocked by an
+// earlier one get their turn in the next pass.
+//
+// Nothing in here depends on the MAX SDK.
+
+#include "sceneir.h"
+
+// Seam planes count this many times a face of the same size
+#define SIMPLIFY_SEAM_WEIGHT 10.0
+
+// LodDistance assumes a 1080 pixel high view with a 45 degree field
+// of view, and switches when the error is under a pixel
+#define LOD_VIEW_HEIGHT 1080.0f
+#define LOD_VIEW_FOV    45.0f
+#define LOD_PIXELS      1.0f
+
+// What a simplification did
+struct SimplifyStats {
+	int   faces[2];     // visible faces, before and after
+	int   passes;
+	float error;        // largest distance a collapse moved the surface
+};
+
+// Simplify the visible faces of mesh to at most target faces, or as
+// close as the seams allow, into lod.  lod gets only the vertices,
+// uvs, normals and colors its faces use; its name and instances are
+// left to the caller.  Hidden faces are dropped.
+void SimplifyMesh(const IRMesh& mesh, int target, IRMesh& lod,
+				  SimplifyStats& stats);
+
+// Distance from the camera at which a surface error is too small to
+// see, for switching to a coarser level
+float LodDistance(float error);
+
+#endif
@@ -0,0 +1,355 @@
+/**********************************************************************
+ *<
+	FILE: split.cpp
+
+	DESCRIPTION:  Splitting of meshes at the 16 bit index limit
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+#include <algorithm>
+#include "weld.h"
+#include "split.h"
+
+static void
+FaceCenter(const IRMesh& mesh, const IRFace& face, float* c)
+{
+	for (int k = 0; k < 3; k++)
+		c[k] = (mesh.verts[3 * face.v[0] + k] + mesh.verts[3 * face.v[1] + k] +
+				mesh.verts[3 * face.v[2] + k]) / 3.0f;
+}
+
+// Tells the faces with centers below a value along one axis, or
+// not above it
+struct CenterBelow {
+	const float* centers;
+	int          axis;
+	float        value;
+	bool         orEqual;
+
+	bool operator()(int f) const
+	{
+		float x = centers[3 * f + axis];
+		return x < value || (orEqual && x == value);
+	}
+};
+
+// Orders faces by their centers along one axis
+struct CenterLess {
+	const float* centers;
+	int          axis;
+
+	bool operator()(int a, int b) const
+	{
+		return centers[3 * a + axis] < centers[3 * b + axis];
+	}
+};
+
+// The visible faces of a mesh being cut, with the welded vertices
+// they use
+struct Planner {
+	const WeldedMesh*       welded;
+	std::vector<SplitNode>* tree;
+	std::vector<float>      centers;    // x, y, z per welded face
+	std::vector<int>        faces;      // welded faces, in order of the cuts
+	std::vector<int>        stamps;     // per welded vertex, last count it was seen in
+	int                     stamp;
+	int                     maxVerts;
+	int                     count;      // submeshes so far
+};
+
+// Welded vertices used by faces [begin, end) of the planner
+static int
+CountVerts(Planner& p, int begin, int end)
+{
+	int count = 0;
+	p.stamp++;
+	for (int i = begin; i < end; i++)
+	{
+		const int* v = &p.welded->indices[3 * p.faces[i]];
+		for (int k = 0; k < 3; k++)
+		{
+			if (p.stamps[v[k]] != p.stamp)
+			{
+				p.stamps[v[k]] = p.stamp;
+				count++;
+			}
+		}
+	}
+	return count;
+}
+
+// Plan the cuts of faces [begin, end), and return the tree node
+static int
+PlanNode(Planner& p, int begin, int end)
+{
+	int n = (int) p.tree->size();
+	p.tree->push_back(SplitNode());
+	SplitNode node = { -1, 0.0f, { p.count, -1 } };
+
+	if (end - begin > 1 && CountVerts(p, begin, end) > p.maxVerts)
+	{
+		const float* c = &p.centers[0];
+		float lo[3], hi[3];
+		int i, k;
+		for (k = 0; k < 3; k++)
+			lo[k] = hi[k] = c[3 * p.faces[begin] + k];
+		for (i = begin + 1; i < end; i++)
+		{
+			for (k = 0; k < 3; k++)
+			{
+				float x = c[3 * p.faces[i] + k];
+				if (x < lo[k])
+					lo[k] = x;
+				if (x > hi[k])
+					hi[k] = x;
+			}
+		}
+		int axis = 0;
+		for (k = 1; k < 3; k++)
+		{
+			if (hi[k] - lo[k] > hi[axis] - lo[axis])
+				axis = k;
+		}
+
+		// Cut at the median.  Faces with centers at the median go on
+		// the upper side, unless that leaves the lower one empty, so the
+		// two sides are told apart by the value alone.
+		std::vector<int>::iterator first = p.faces.begin() + begin;
+		std::vector<int>::iterator last = p.faces.begin() + end;
+		CenterLess less = { c, axis };
+		std::nth_element(first, first + (end - begin) / 2, last, less);
+		CenterBelow below = { c, axis, c[3 * first[(end - begin) / 2] + axis], false };
+		int cut = (int) (std::partition(first, last, below) - p.faces.begin());
+		if (cut == begin)
+		{
+			below.orEqual = true;
+			cut = (int) (std::partition(first, last, below) - p.faces.begin());
+			if (cut < end)
+				below.value = c[3 * *std::min_element(p.faces.begin() + cut, last, less) + axis];
+		}
+		if (cut < end)
+		{
+			node.axis = axis;
+			node.value = below.value;
+			node.child[0] = PlanNode(p, begin, cut);
+			node.child[1] = PlanNode(p, cut, end);
+			(*p.tree)[n] = node;
+			return n;
+		}
+	}
+
+	// Few enough vertices, or no way to tell the faces apart
+	p.count++;
+	(*p.tree)[n] = node;
+	return n;
+}
+
+int
+SplitPlan(const IRMesh& mesh, int maxVerts, std::vector<SplitNode>& tree)
+{
+	WeldedMesh welded;
+	int i;
+
+	tree.clear();
+	if (mesh.prim.kind != IR_PRIM_NONE || mesh.NumFaces() == 0)
+		return 1;
+	WeldMesh(mesh, welded);
+	if (welded.NumVerts() <= maxVerts)
+		return 1;
+
+	// The welded faces are the visible ones, in order
+	Planner p;
+	p.welded = &welded;
+	p.tree = &tree;
+	p.centers.reserve(3 * welded.NumFaces());
+	for (i = 0; i < mesh.NumFaces(); i++)
+	{
+		if (mesh.faces[i].hidden)
+			continue;
+		float c[3];
+		FaceCenter(mesh, mesh.faces[i], c);
+		p.centers.insert(p.centers.end(), c, c + 3);
+	}
+	p.faces.resize(welded.NumFaces());
+	for (i = 0; i < welded.NumFaces(); i++)
+		p.faces[i] = i;
+	p.stamps.assign(welded.NumVerts(), 0);
+	p.stamp = 0;
+	p.maxVerts = maxVerts;
+	p.count = 0;
+	PlanNode(p, 0, welded.NumFaces());
+
+	if (p.count < 2)
+		tree.clear();
+	return p.count < 2 ? 1 : p.count;
+}
+
+// The submesh a face center falls in
+static int
+FindSubmesh(const std::vector<SplitNode>& tree, const float* c)
+{
+	int n = 0;
+	while (tree[n].axis >= 0)
+		n = tree[n].child[c[tree[n].axis] < tree[n].value ? 0 : 1];
+	return tree[n].child[0];
+}
+
+// Index of an element of the mesh in a submesh, copying it over the
+// first time the submesh uses it
+static int
+MapIndex(std::vector<int>& map, int index, const std::vector<float>& from,
+		 std::vector<float>& to, int size)
+{
+	if (map[index] < 0)
+	{
+		map[index] = (int) to.size() / size;
+		to.insert(to.end(), from.begin() + size * index,
+				  from.begin() + size * (index + 1));
+	}
+	return map[index];
+}
+
+void
+SplitApply(const IRMesh& mesh, const std::vector<SplitNode>& tree, int count,
+		   std::vector<IRMesh*>& submeshes)
+{
+	std::vector<int> which(mesh.NumFaces(), 0);
+	int i, s, k;
+
+	submeshes.clear();
+	if (!tree.empty())
+	{
+		for (i = 0; i < mesh.NumFaces(); i++)
+		{
+			float c[3];
+			FaceCenter(mesh, mesh.faces[i], c);
+			which[i] = FindSubmesh(tree, c);
+		}
+	}
+
+	bool uvs = mesh.NumTVerts() > 0;
+	bool colors = !mesh.colors.empty();
+	bool normals = !mesh.faceNormals.empty();
+	for (s = 0; s < count; s++)
+	{
+		IRMesh* sub = new IRMesh;
+		std::vector<int> vmap(mesh.NumVerts(), -1);
+		std::vector<int> tmap(mesh.NumTVerts(), -1);
+		std::vector<int> nmap(mesh.NumNormals(), -1);
+
+		for (i = 0; i < mesh.NumFaces(); i++)
+		{
+			if (which[i] != s)
+				continue;
+			IRFace face = mesh.faces[i];
+			for (k = 0; k < 3; k++)
+			{
+				// A vertex has its color with it
+				int v = face.v[k];
+				if (colors && vmap[v] < 0)
+					sub->colors.insert(sub->colors.end(), mesh.colors.begin() + 3 * v,
+									   mesh.colors.begin() + 3 * (v + 1));
+				face.v[k] = MapIndex(vmap, v, mesh.verts, sub->verts, 3);
+				if (uvs)
+					face.t[k] = MapIndex(tmap, face.t[k], mesh.tverts, sub->tverts, 2);
+				if (normals)
+					sub->faceNormals.push_back(MapIndex(nmap, mesh.faceNormals[3 * i + k],
+														mesh.normals, sub->normals, 3));
+			}
+			sub->faces.push_back(face);
+		}
+		submeshes.push_back(sub);
+	}
+}
+
+#ifdef SPLIT_BENCHMARK
+// Stand-alone timing and checks on a grid too large for 16 bit
+// indices, and on a coarser grid over the same square standing in for
+// a level of detail of it:
+//
+//    g++ -O2 -DSPLIT_BENCHMARK split.cpp weld.cpp sceneir.cpp -o splitbench
+//    ./splitbench [rows]
+//
+// The submeshes must keep every face, in order, with the positions
+// of its corners, and none may go over the vertex budget.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static void
+Check(const IRMesh& mesh, const std::vector<SplitNode>& tree, int count)
+{
+	std::vector<IRMesh*> subs;
+	clock_t start = clock();
+	SplitApply(mesh, tree, count, subs);
+	double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+	// Walk the faces of the mesh alongside those of their submeshes
+	std::vector<int> next(count, 0);
+	int wrong = 0, over = 0, faces = 0, verts = 0;
+	for (int i = 0; i < mesh.NumFaces(); i++)
+	{
+		float c[3];
+		FaceCenter(mesh, mesh.faces[i], c);
+		int s = tree.empty() ? 0 : FindSubmesh(tree, c);
+		const IRMesh& sub = *subs[s];
+		if (next[s] >= sub.NumFaces())
+		{
+			wrong++;
+			continue;
+		}
+		const IRFace& f = sub.faces[next[s]++];
+		for (int k = 0; k < 3; k++)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				if (sub.verts[3 * f.v[k] + j] != mesh.verts[3 * mesh.faces[i].v[k] + j])
+					wrong++;
+			}
+			if (sub.tverts[2 * f.t[k]] != mesh.tverts[2 * mesh.faces[i].t[k]])
+				wrong++;
+		}
+	}
+	printf("  %.3fs:", seconds);
+	for (int s = 0; s < count; s++)
+	{
+		WeldedMesh w;
+		WeldMesh(*subs[s], w);
+		printf(" %d", w.NumVerts());
+		if (w.NumVerts() > SPLIT_MAX_VERTS)
+			over++;
+		faces += subs[s]->NumFaces();
+		verts += subs[s]->NumVerts();
+		delete subs[s];
+	}
+	printf(" welded vertices\n");
+	printf("  faces %d -> %d%s, vertices %d -> %d (%.1f%% shared by submeshes)\n",
+		   mesh.NumFaces(), faces, faces != mesh.NumFaces() ? " FAILED" : "",
+		   mesh.NumVerts(), verts, 100.0 * (verts - mesh.NumVerts()) / mesh.NumVerts());
+	printf("  %d faces misplaced%s, %d submeshes over budget%s\n", wrong,
+		   wrong ? " FAILED" : "", over, over ? " FAILED" : "");
+}
+
+int
+main(int argc, char** argv)
+{
+	int rows = argc > 1 ? atoi(argv[1]) : 600;
+	IRMesh* mesh = IRMakeGrid(rows, rows);
+	IRMesh* lod = IRMakeGrid(rows / 3, rows / 3);
+	std::vector<SplitNode> tree;
+
+	clock_t start = clock();
+	int count = SplitPlan(*mesh, SPLIT_MAX_VERTS, tree);
+	double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+	printf("%dx%d grid, %d vertices: %d submeshes planned in %.3fs\n",
+		   rows, rows, mesh->NumVerts(), count, seconds);
+	Check(*mesh, tree, count);
+	printf("%dx%d grid cut the same way:\n", rows / 3, rows / 3);
+	Check(*lod, tree, count);
+
+	delete mesh;
+	delete lod;
+	return 0;
+}
+#endif
@@ -0,0 +1,54 @@
+/**********************************************************************
+ *<
+	FILE: split.h
+
+	DESCRIPTION:  Splitting of meshes at the 16 bit index limit
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+
+#ifndef __SPLIT__H__
+#define __SPLIT__H__
+
+// WebGL without OES_element_index_uint draws with 16 bit indices, so
+// no mesh may have more than 65535 vertices once three.js has welded
+// it into buffers.  SplitPlan cuts a larger mesh into submeshes that
+// each fit: the faces are divided at the median of their centers
+// along the longest side of the box around them, again and again,
+// until every side holds few enough welded vertices.  The submeshes
+// are compact pieces of the surface, so the vertices a face uses stay
+// together, and each piece can be culled on its own.
+//
+// The cuts are kept as a tree, so the levels of detail of a mesh can
+// be cut along the same planes, and a submesh and its levels cover the
+// same piece of the surface.  The faces of a submesh keep their order
+// and their material ids.
+//
+// Nothing in here depends on the MAX SDK.
+
+#include <vector>
+#include "sceneir.h"
+
+#define SPLIT_MAX_VERTS 65535
+
+// A cut of a split, or a submesh if axis is -1
+struct SplitNode {
+	int   axis;         // 0, 1 or 2; -1 for a submesh
+	float value;        // faces with centers below go to child[0]
+	int   child[2];     // indices in the tree; child[0] is the submesh
+						// number for a submesh
+};
+
+// Plan the cuts of mesh into submeshes of at most maxVerts welded
+// vertices.  Returns the number of submeshes, and 1 with an empty tree
+// if the mesh fits as it is.
+int SplitPlan(const IRMesh& mesh, int maxVerts, std::vector<SplitNode>& tree);
+
+// Cut mesh along a planned tree into one new mesh per submesh, hidden
+// faces included.  A submesh gets only the vertices, uvs, normals and
+// colors its faces use; names, instances and levels of detail are left
+// to the caller.
+void SplitApply(const IRMesh& mesh, const std::vector<SplitNode>& tree,
+				int count, std::vector<IRMesh*>& submeshes);
+
+#endif
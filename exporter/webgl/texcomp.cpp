@@ -0,0 +1,748 @@
+/**********************************************************************
+ *<
+	FILE: texcomp.cpp
+
+	DESCRIPTION:  Block compression of texture bitmaps
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "texcomp.h"
+
+#ifndef _WIN32
+#define _tfopen fopen
+#endif
+
+int
+TexCompressedSize(TexFormat format, int width, int height)
+{
+	int blocks = ((width + 3) / 4) * ((height + 3) / 4);
+	return blocks * (format == TEXFORMAT_BC3 ? 16 : 8);
+}
+
+// The 16 texels of a block, r, g, b, a each, rows top first
+static void
+FetchBlock(const unsigned char* rgba, int width, int height, int bx, int by,
+		   unsigned char* block)
+{
+	for (int y = 0; y < 4; y++)
+	{
+		int sy = 4 * by + y < height ? 4 * by + y : height - 1;
+		for (int x = 0; x < 4; x++)
+		{
+			int sx = 4 * bx + x < width ? 4 * bx + x : width - 1;
+			memcpy(block + 4 * (4 * y + x), rgba + 4 * (width * sy + sx), 4);
+		}
+	}
+}
+
+static int
+Clamp255(int x)
+{
+	return x < 0 ? 0 : (x > 255 ? 255 : x);
+}
+
+// ---------------------------------------------------------------- BC1
+
+static unsigned short
+Pack565(const float* c)
+{
+	int r = Clamp255((int) (c[0] + 0.5f)) * 31 + 127;
+	int g = Clamp255((int) (c[1] + 0.5f)) * 63 + 127;
+	int b = Clamp255((int) (c[2] + 0.5f)) * 31 + 127;
+	return (unsigned short) (((r / 255) << 11) | ((g / 255) << 5) | (b / 255));
+}
+
+static void
+Unpack565(unsigned short c, int* rgb)
+{
+	int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+// The 4 colors of a BC1 block with end points c0 > c1
+static void
+Palette565(unsigned short c0, unsigned short c1, int palette[4][3])
+{
+	Unpack565(c0, palette[0]);
+	Unpack565(c1, palette[1]);
+	for (int k = 0; k < 3; k++)
+	{
+		palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+		palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+	}
+}
+
+// Nearest palette color of each texel; returns the squared error
+static int
+PickColors(const unsigned char* block, int palette[4][3], int* index)
+{
+	int error = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		const unsigned char* p = block + 4 * i;
+		int best = 0, bestError = 1 << 30;
+		for (int j = 0; j < 4; j++)
+		{
+			int dr = p[0] - palette[j][0];
+			int dg = p[1] - palette[j][1];
+			int db = p[2] - palette[j][2];
+			int e = dr * dr + dg * dg + db * db;
+			if (e < bestError)
+			{
+				bestError = e;
+				best = j;
+			}
+		}
+		index[i] = best;
+		error += bestError;
+	}
+	return error;
+}
+
+// End points on the principal axis of the colors of a block
+static void
+FitAxis(const unsigned char* block, float* e0, float* e1)
+{
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+	int i, k;
+
+	for (i = 0; i < 16; i++)
+	{
+		for (k = 0; k < 3; k++)
+			mean[k] += block[4 * i + k] / 16.0f;
+	}
+	for (i = 0; i < 16; i++)
+	{
+		float r = block[4 * i] - mean[0];
+		float g = block[4 * i + 1] - mean[1];
+		float b = block[4 * i + 2] - mean[2];
+		cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+		cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+	}
+
+	// Power iteration from the grey axis
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (int n = 0; n < 8; n++)
+	{
+		float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+		float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+		float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+		float len = sqrtf(x * x + y * y + z * z);
+		if (len < 1e-6f)
+			break;
+		axis[0] = x / len;
+		axis[1] = y / len;
+		axis[2] = z / len;
+	}
+
+	float lo = 0.0f, hi = 0.0f;
+	for (i = 0; i < 16; i++)
+	{
+		float t = (block[4 * i] - mean[0]) * axis[0] +
+			(block[4 * i + 1] - mean[1]) * axis[1] +
+			(block[4 * i + 2] - mean[2]) * axis[2];
+		lo = t < lo ? t : lo;
+		hi = t > hi ? t : hi;
+	}
+	for (k = 0; k < 3; k++)
+	{
+		e0[k] = mean[k] + axis[k] * hi;
+		e1[k] = mean[k] + axis[k] * lo;
+	}
+}
+
+// The end points that best fit the texels given their palette
+// entries, by least squares
+static bool
+RefineEnds(const unsigned char* block, const int* index, float* e0, float* e1)
+{
+	static const float weight[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+	float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+	float ax[3] = { 0.0f, 0.0f, 0.0f }, bx[3] = { 0.0f, 0.0f, 0.0f };
+
+	for (int i = 0; i < 16; i++)
+	{
+		float a = weight[index[i]], b = 1.0f - a;
+		aa += a * a;
+		bb += b * b;
+		ab += a * b;
+		for (int k = 0; k < 3; k++)
+		{
+			ax[k] += a * block[4 * i + k];
+			bx[k] += b * block[4 * i + k];
+		}
+	}
+	float det = aa * bb - ab * ab;
+	if (fabsf(det) < 1e-6f)
+		return false;
+	for (int k = 0; k < 3; k++)
+	{
+		e0[k] = (ax[k] * bb - bx[k] * ab) / det;
+		e1[k] = (bx[k] * aa - ax[k] * ab) / det;
+	}
+	return true;
+}
+
+static void
+Put16(unsigned char* out, unsigned int x)
+{
+	out[0] = (unsigned char) x;
+	out[1] = (unsigned char) (x >> 8);
+}
+
+// Encode the colors of a block, four color mode
+static void
+EncodeBC1(const unsigned char* block, unsigned char* out)
+{
+	float e0[3], e1[3];
+	int palette[4][3], index[16], bestIndex[16];
+	unsigned short best0 = 0, best1 = 0;
+	int bestError = 1 << 30;
+
+	FitAxis(block, e0, e1);
+	for (int pass = 0; pass < 3; pass++)
+	{
+		unsigned short c0 = Pack565(e0), c1 = Pack565(e1);
+		if (c0 < c1)
+		{
+			unsigned short t = c0;
+			c0 = c1;
+			c1 = t;
+		}
+		Palette565(c0, c1, palette);
+		int error = PickColors(block, palette, index);
+		if (c0 == c1)
+		{
+			for (int i = 0; i < 16; i++)
+				index[i] = 0;
+		}
+		if (error < bestError)
+		{
+			bestError = error;
+			best0 = c0;
+			best1 = c1;
+			memcpy(bestIndex, index, sizeof(index));
+		}
+		if (error == 0 || !RefineEnds(block, index, e0, e1))
+			break;
+	}
+
+	unsigned int bits = 0;
+	for (int i = 0; i < 16; i++)
+		bits |= (unsigned int) bestIndex[i] << (2 * i);
+	Put16(out, best0);
+	Put16(out + 2, best1);
+	Put16(out + 4, bits & 0xffff);
+	Put16(out + 6, bits >> 16);
+}
+
+// Encode the alpha of a block, eight value mode
+static void
+EncodeAlpha(const unsigned char* block, unsigned char* out)
+{
+	int lo = 255, hi = 0, i, j;
+	for (i = 0; i < 16; i++)
+	{
+		int a = block[4 * i + 3];
+		lo = a < lo ? a : lo;
+		hi = a > hi ? a : hi;
+	}
+
+	int values[8];
+	values[0] = hi;
+	values[1] = lo;
+	for (j = 2; j < 8; j++)
+		values[j] = ((8 - j) * hi + (j - 1) * lo) / 7;
+
+	unsigned long long bits = 0;
+	for (i = 0; i < 16 && hi > lo; i++)
+	{
+		int a = block[4 * i + 3], best = 0, bestError = 256;
+		for (j = 0; j < 8; j++)
+		{
+			int e = a > values[j] ? a - values[j] : values[j] - a;
+			if (e < bestError)
+			{
+				bestError = e;
+				best = j;
+			}
+		}
+		bits |= (unsigned long long) best << (3 * i);
+	}
+	out[0] = (unsigned char) hi;
+	out[1] = (unsigned char) lo;
+	for (i = 0; i < 6; i++)
+		out[2 + i] = (unsigned char) (bits >> (8 * i));
+}
+
+// --------------------------------------------------------------- ETC1
+
+static const int sEtcTables[8][2] = {
+	{ 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 },
+	{ 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 }
+};
+
+// A way to encode one sub-block: its base color and table, and the
+// modifier of each of its texels
+struct EtcHalf {
+	int base[3];            // expanded to 8 bits
+	int table;
+	int error;
+	int modifier[16];       // per texel of the block, for its texels
+};
+
+// Best table and modifiers for the texels of a sub-block
+static void
+FitHalf(const unsigned char* block, const int* texels, EtcHalf& half)
+{
+	half.error = 1 << 30;
+	for (int t = 0; t < 8; t++)
+	{
+		int error = 0, mods[16];
+		for (int n = 0; n < 8; n++)
+		{
+			const unsigned char* p = block + 4 * texels[n];
+			int best = 0, bestError = 1 << 30;
+			for (int m = 0; m < 4; m++)
+			{
+				int d = sEtcTables[t][m & 1] * (m & 2 ? -1 : 1);
+				int e = 0;
+				for (int k = 0; k < 3; k++)
+				{
+					int c = Clamp255(half.base[k] + d) - p[k];
+					e += c * c;
+				}
+				if (e < bestError)
+				{
+					bestError = e;
+					best = m;
+				}
+			}
+			mods[texels[n]] = best;
+			error += bestError;
+		}
+		if (error < half.error)
+		{
+			half.error = error;
+			half.table = t;
+			for (int n = 0; n < 8; n++)
+				half.modifier[texels[n]] = mods[texels[n]];
+		}
+	}
+}
+
+static void
+EncodeETC1(const unsigned char* block, unsigned char* out)
+{
+	unsigned long long bestBits = 0;
+	int bestError = 1 << 30;
+
+	for (int flip = 0; flip < 2; flip++)
+	{
+		// Texels of each sub-block: left and right columns, or top and
+		// bottom rows when flipped
+		int texels[2][8], count[2] = { 0, 0 };
+		float mean[2][3] = { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } };
+		int i, h, k;
+		for (i = 0; i < 16; i++)
+		{
+			int x = i & 3, y = i >> 2;
+			h = flip ? (y >= 2) : (x >= 2);
+			texels[h][count[h]++] = i;
+			for (k = 0; k < 3; k++)
+				mean[h][k] += block[4 * i + k] / 8.0f;
+		}
+
+		for (int diff = 0; diff < 2; diff++)
+		{
+			EtcHalf half[2];
+			int code[2][3];
+			bool fits = true;
+			for (h = 0; h < 2; h++)
+			{
+				for (k = 0; k < 3; k++)
+				{
+					if (diff)
+					{
+						code[h][k] = (int) (mean[h][k] * 31.0f / 255.0f + 0.5f);
+						half[h].base[k] = (code[h][k] << 3) | (code[h][k] >> 2);
+					}
+					else
+					{
+						code[h][k] = (int) (mean[h][k] * 15.0f / 255.0f + 0.5f);
+						half[h].base[k] = code[h][k] * 17;
+					}
+				}
+			}
+			for (k = 0; k < 3 && diff; k++)
+			{
+				int d = code[1][k] - code[0][k];
+				fits = fits && d >= -4 && d <= 3;
+			}
+			if (!fits)
+				continue;
+			FitHalf(block, texels[0], half[0]);
+			FitHalf(block, texels[1], half[1]);
+			int error = half[0].error + half[1].error;
+			if (error >= bestError)
+				continue;
+
+			unsigned long long bits = 0;
+			for (k = 0; k < 3; k++)
+			{
+				int shift = 56 - 8 * k;
+				if (diff)
+					bits |= (unsigned long long) ((code[0][k] << 3) |
+												  ((code[1][k] - code[0][k]) & 7)) << shift;
+				else
+					bits |= (unsigned long long) ((code[0][k] << 4) | code[1][k]) << shift;
+			}
+			bits |= (unsigned long long) half[0].table << 37;
+			bits |= (unsigned long long) half[1].table << 34;
+			bits |= (unsigned long long) diff << 33;
+			bits |= (unsigned long long) flip << 32;
+			for (i = 0; i < 16; i++)
+			{
+				int x = i & 3, y = i >> 2, j = 4 * x + y;
+				h = flip ? (y >= 2) : (x >= 2);
+				int m = half[h].modifier[i];
+				bits |= (unsigned long long) (m >> 1) << (16 + j);
+				bits |= (unsigned long long) (m & 1) << j;
+			}
+			bestError = error;
+			bestBits = bits;
+		}
+	}
+
+	// Big endian
+	for (int b = 0; b < 8; b++)
+		out[b] = (unsigned char) (bestBits >> (56 - 8 * b));
+}
+
+void
+TexCompressRows(TexFormat format, const unsigned char* rgba, int width,
+				int height, int first, int end, unsigned char* out)
+{
+	int blocksWide = (width + 3) / 4;
+	int size = format == TEXFORMAT_BC3 ? 16 : 8;
+	unsigned char block[64];
+
+	for (int by = first; by < end; by++)
+	{
+		for (int bx = 0; bx < blocksWide; bx++)
+		{
+			unsigned char* o = out + size * (blocksWide * by + bx);
+			FetchBlock(rgba, width, height, bx, by, block);
+			switch (format)
+			{
+			case TEXFORMAT_BC1:
+				EncodeBC1(block, o);
+				break;
+			case TEXFORMAT_BC3:
+				EncodeAlpha(block, o);
+				EncodeBC1(block, o + 8);
+				break;
+			case TEXFORMAT_ETC1:
+				EncodeETC1(block, o);
+				break;
+			}
+		}
+	}
+}
+
+static void
+Put32(std::vector<unsigned char>& out, unsigned int x)
+{
+	for (int i = 0; i < 4; i++)
+		out.push_back((unsigned char) (x >> (8 * i)));
+}
+
+bool
+TexSaveCompressed(const TCHAR* path, TexFormat format, int width, int height,
+				  const std::vector<std::vector<unsigned char> >& levels)
+{
+	std::vector<unsigned char> header;
+	int count = (int) levels.size();
+	int i;
+
+	if (format == TEXFORMAT_ETC1)
+	{
+		static const unsigned char id[12] = {
+			0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+		};
+		header.insert(header.end(), id, id + 12);
+		Put32(header, 0x04030201);  // endianness
+		Put32(header, 0);           // glType, compressed
+		Put32(header, 1);           // glTypeSize
+		Put32(header, 0);           // glFormat, compressed
+		Put32(header, 0x8D64);      // ETC1_RGB8_OES
+		Put32(header, 0x1907);      // GL_RGB
+		Put32(header, width);
+		Put32(header, height);
+		Put32(header, 0);           // depth
+		Put32(header, 0);           // array elements
+		Put32(header, 1);           // faces
+		Put32(header, count);
+		Put32(header, 0);           // key and value bytes
+	}
+	else
+	{
+		header.push_back('D');
+		header.push_back('D');
+		header.push_back('S');
+		header.push_back(' ');
+		Put32(header, 124);
+		Put32(header, 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000);
+		Put32(header, height);
+		Put32(header, width);
+		Put32(header, levels.empty() ? 0 : (unsigned int) levels[0].size());
+		Put32(header, 0);           // depth
+		Put32(header, count);
+		for (i = 0; i < 11; i++)
+			Put32(header, 0);
+		Put32(header, 32);          // pixel format
+		Put32(header, 0x4);         // DDPF_FOURCC
+		header.push_back('D');
+		header.push_back('X');
+		header.push_back('T');
+		header.push_back(format == TEXFORMAT_BC3 ? '5' : '1');
+		for (i = 0; i < 5; i++)
+			Put32(header, 0);
+		Put32(header, 0x1000 | (count > 1 ? 0x400008 : 0));
+		for (i = 0; i < 4; i++)
+			Put32(header, 0);
+	}
+
+	FILE* fp = _tfopen(path, _T("wb"));
+	if (!fp)
+		return false;
+	bool ok = fwrite(&header[0], 1, header.size(), fp) == header.size();
+	for (i = 0; i < count && ok; i++)
+	{
+		if (format == TEXFORMAT_ETC1)
+		{
+			std::vector<unsigned char> size;
+			Put32(size, (unsigned int) levels[i].size());
+			ok = fwrite(&size[0], 1, 4, fp) == 4;
+		}
+		ok = ok && fwrite(&levels[i][0], 1, levels[i].size(), fp) == levels[i].size();
+	}
+	ok = fclose(fp) == 0 && ok;
+	return ok;
+}
+
+#ifdef TEXCOMP_BENCHMARK
+// Stand-alone timing and checks on a made up bitmap with smooth
+// gradients, sharp edges and alpha, compressed in each format and
+// decoded again, the blocks spread over a WorkPool:
+//
+//    g++ -O2 -DTEXCOMP_BENCHMARK texcomp.cpp workpool.cpp -lpthread -o texcompbench
+//    ./texcompbench [size]
+//
+// Each format must come back within its usual error, and a flat block
+// must come back exact where the format can hold its color.
+
+#include <stdlib.h>
+#include <time.h>
+#include "workpool.h"
+
+struct BenchBand {
+	TexFormat            format;
+	const unsigned char* rgba;
+	int                  size;
+	int                  first;
+	unsigned char*       out;
+};
+
+static void
+CompressBand(void* data, int index)
+{
+	BenchBand& band = ((BenchBand*) data)[index];
+	TexCompressRows(band.format, band.rgba, band.size, band.size, band.first,
+					band.first + 4, band.out);
+}
+
+static void
+DecodeBC1(const unsigned char* in, unsigned char* texels, bool alpha)
+{
+	int palette[4][3];
+	unsigned short c0 = (unsigned short) (in[0] | in[1] << 8);
+	unsigned short c1 = (unsigned short) (in[2] | in[3] << 8);
+	Palette565(c0, c1, palette);
+	unsigned int bits = in[4] | in[5] << 8 | in[6] << 16 | (unsigned int) in[7] << 24;
+	for (int i = 0; i < 16; i++)
+	{
+		for (int k = 0; k < 3; k++)
+			texels[4 * i + k] = (unsigned char) palette[(bits >> (2 * i)) & 3][k];
+		if (!alpha)
+			texels[4 * i + 3] = 255;
+	}
+}
+
+static void
+DecodeAlpha(const unsigned char* in, unsigned char* texels)
+{
+	int values[8];
+	values[0] = in[0];
+	values[1] = in[1];
+	for (int j = 2; j < 8; j++)
+		values[j] = in[0] > in[1] ? ((8 - j) * in[0] + (j - 1) * in[1]) / 7 :
+			(j < 6 ? ((6 - j) * in[0] + (j - 1) * in[1]) / 5 : (j == 6 ? 0 : 255));
+	unsigned long long bits = 0;
+	for (int i = 0; i < 6; i++)
+		bits |= (unsigned long long) in[2 + i] << (8 * i);
+	for (int i = 0; i < 16; i++)
+		texels[4 * i + 3] = (unsigned char) values[(bits >> (3 * i)) & 7];
+}
+
+static void
+DecodeETC1(const unsigned char* in, unsigned char* texels)
+{
+	unsigned long long bits = 0;
+	for (int b = 0; b < 8; b++)
+		bits = bits << 8 | in[b];
+	int diff = (int) (bits >> 33) & 1, flip = (int) (bits >> 32) & 1;
+	int base[2][3], table[2];
+	table[0] = (int) (bits >> 37) & 7;
+	table[1] = (int) (bits >> 34) & 7;
+	for (int k = 0; k < 3; k++)
+	{
+		int v = (int) (bits >> (56 - 8 * k)) & 255;
+		if (diff)
+		{
+			int c0 = v >> 3, d = v & 7;
+			int c1 = c0 + (d >= 4 ? d - 8 : d);
+			base[0][k] = (c0 << 3) | (c0 >> 2);
+			base[1][k] = (c1 << 3) | (c1 >> 2);
+		}
+		else
+		{
+			base[0][k] = (v >> 4) * 17;
+			base[1][k] = (v & 15) * 17;
+		}
+	}
+	for (int i = 0; i < 16; i++)
+	{
+		int x = i & 3, y = i >> 2, j = 4 * x + y;
+		int h = flip ? (y >= 2) : (x >= 2);
+		int m = (int) ((bits >> (16 + j)) & 1) << 1 | (int) ((bits >> j) & 1);
+		int d = sEtcTables[table[h]][m & 1] * (m & 2 ? -1 : 1);
+		for (int k = 0; k < 3; k++)
+			texels[4 * i + k] = (unsigned char) Clamp255(base[h][k] + d);
+		texels[4 * i + 3] = 255;
+	}
+}
+
+// Peak signal to noise of the decoded image, color and alpha apart
+static void
+Check(const char* name, TexFormat format, const std::vector<unsigned char>& rgba,
+	  int size, const std::vector<unsigned char>& packed, double minColor,
+	  double minAlpha)
+{
+	int blocks = size / 4, bytes = format == TEXFORMAT_BC3 ? 16 : 8;
+	double color = 0.0, alpha = 0.0;
+	unsigned char texels[64];
+	for (int by = 0; by < blocks; by++)
+	{
+		for (int bx = 0; bx < blocks; bx++)
+		{
+			const unsigned char* in = &packed[bytes * (blocks * by + bx)];
+			if (format == TEXFORMAT_BC1)
+				DecodeBC1(in, texels, false);
+			else if (format == TEXFORMAT_BC3)
+			{
+				DecodeAlpha(in, texels);
+				DecodeBC1(in + 8, texels, true);
+			}
+			else
+				DecodeETC1(in, texels);
+			for (int i = 0; i < 16; i++)
+			{
+				const unsigned char* p = &rgba[4 * (size * (4 * by + i / 4) + 4 * bx + i % 4)];
+				for (int k = 0; k < 3; k++)
+					color += (double) (p[k] - texels[4 * i + k]) * (p[k] - texels[4 * i + k]);
+				alpha += (double) (p[3] - texels[4 * i + 3]) * (p[3] - texels[4 * i + 3]);
+			}
+		}
+	}
+	double texelCount = (double) size * size;
+	double pc = color > 0.0 ? 10.0 * log10(255.0 * 255.0 * 3.0 * texelCount / color) : 99.0;
+	double pa = alpha > 0.0 ? 10.0 * log10(255.0 * 255.0 * texelCount / alpha) : 99.0;
+	printf("  %-5s color %.1f dB%s", name, pc, pc < minColor ? " FAILED" : "");
+	if (format == TEXFORMAT_BC3)
+		printf(", alpha %.1f dB%s", pa, pa < minAlpha ? " FAILED" : "");
+	printf("\n");
+}
+
+int
+main(int argc, char** argv)
+{
+	int size = argc > 1 ? atoi(argv[1]) : 1024;
+	std::vector<unsigned char> rgba(4 * size * size);
+	int x, y;
+
+	size &= ~15;
+	for (y = 0; y < size; y++)
+	{
+		for (x = 0; x < size; x++)
+		{
+			unsigned char* p = &rgba[4 * (size * y + x)];
+			bool disc = (x - size / 2) * (x - size / 2) + (y - size / 2) * (y - size / 2) <
+				size * size / 9;
+			p[0] = (unsigned char) (255 * x / size);
+			p[1] = (unsigned char) (disc ? 220 : 255 * y / size);
+			p[2] = (unsigned char) (128 + 100 * sin(x * 0.05) * cos(y * 0.03));
+			p[3] = (unsigned char) (disc ? 255 : 255 * (x + y) / (2 * size));
+		}
+	}
+
+	// A flat block of a 565 color comes back exact
+	unsigned char flat[64], out[16], back[64];
+	for (x = 0; x < 16; x++)
+	{
+		flat[4 * x] = 132;
+		flat[4 * x + 1] = 65;
+		flat[4 * x + 2] = 16;
+		flat[4 * x + 3] = 77;
+	}
+	TexCompressRows(TEXFORMAT_BC3, flat, 4, 4, 0, 1, out);
+	DecodeAlpha(out, back);
+	DecodeBC1(out + 8, back, true);
+	printf("flat block: BC3 %s\n", memcmp(flat, back, 64) == 0 ? "exact" : "FAILED");
+
+	WorkPool pool;
+	const TexFormat formats[3] = { TEXFORMAT_BC1, TEXFORMAT_BC3, TEXFORMAT_ETC1 };
+	const char* names[3] = { "BC1", "BC3", "ETC1" };
+	const double minColor[3] = { 32.0, 32.0, 32.0 };
+	printf("%dx%d bitmap on %d threads:\n", size, size, pool.Threads());
+	for (int f = 0; f < 3; f++)
+	{
+		std::vector<unsigned char> packed(TexCompressedSize(formats[f], size, size));
+		std::vector<BenchBand> bands(size / 16);
+		for (size_t b = 0; b < bands.size(); b++)
+		{
+			bands[b].format = formats[f];
+			bands[b].rgba = &rgba[0];
+			bands[b].size = size;
+			bands[b].first = 4 * (int) b;
+			bands[b].out = &packed[0];
+		}
+		pool.Run(CompressBand, &bands[0], (int) bands.size());
+		printf("  %-5s %d bytes in %.3fs (%.1f Mtexels/s)\n", names[f], (int) packed.size(),
+			   pool.RunSeconds(), size * size / pool.RunSeconds() / 1e6);
+		Check(names[f], formats[f], rgba, size, packed, minColor[f], 38.0);
+
+		std::vector<std::vector<unsigned char> > levels(1, packed);
+		const char* path = formats[f] == TEXFORMAT_ETC1 ? "/tmp/texcompbench.ktx" : "/tmp/texcompbench.dds";
+		if (!TexSaveCompressed(path, formats[f], size, size, levels))
+			printf("  %s not written FAILED\n", path);
+	}
+	return 0;
+}
+#endif
@@ -0,0 +1,59 @@
+/**********************************************************************
+ *<
+	FILE: texcomp.h
+
+	DESCRIPTION:  Block compression of texture bitmaps
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+
+#ifndef __TEXCOMP__H__
+#define __TEXCOMP__H__
+
+// A PNG or JPEG is unpacked by the browser to 4 bytes a texel before it
+// goes to the graphics card.  Block compressed textures stay compressed
+// in video memory at 4 or 8 bits a texel, and load without decoding.
+// The encoders here turn 8 bit RGBA levels into:
+//
+//   BC1 (DXT1)  opaque bitmaps, desktop cards, in a .dds file
+//   BC3 (DXT5)  bitmaps with alpha, desktop cards, in a .dds file
+//   ETC1        opaque bitmaps, mobile cards, in a .ktx file
+//
+// Each 4 x 4 block is encoded on its own, so a level can be split into
+// runs of block rows and compressed on several threads at once.  BC1
+// fits its end points along the principal axis of the block colors
+// and refines them by least squares; ETC1 tries both sub-block layouts
+// in both base color modes with every modifier table and keeps the
+// closest.  Texels outside a level smaller than a block repeat the
+// last row or column.
+//
+// Nothing in here depends on the MAX SDK.
+
+#include <vector>
+#include "sceneir.h"
+
+// Sets of compressed variants written for a bitmap
+#define TEXCOMP_S3TC  1         // BC1, or BC3 for bitmaps with alpha
+#define TEXCOMP_ETC1  2         // opaque bitmaps only
+
+enum TexFormat {
+	TEXFORMAT_BC1,
+	TEXFORMAT_BC3,
+	TEXFORMAT_ETC1
+};
+
+// Bytes of a width x height level in a format
+int TexCompressedSize(TexFormat format, int width, int height);
+
+// Compress block rows [first, end) of a width x height level of 8 bit
+// r, g, b, a texels into out, which holds the whole compressed level
+void TexCompressRows(TexFormat format, const unsigned char* rgba, int width,
+					 int height, int first, int end, unsigned char* out);
+
+// Write compressed levels, largest first, to a .dds file for BC1 and
+// BC3 or a .ktx file for ETC1
+bool TexSaveCompressed(const TCHAR* path, TexFormat format, int width,
+					   int height,
+					   const std::vector<std::vector<unsigned char> >& levels);
+
+#endif
@@ -0,0 +1,348 @@
+/**********************************************************************
+ *<
+	FILE: texcopy.cpp
+
+	DESCRIPTION:  Background copying of texture bitmaps
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <string.h>
+#include "texcopy.h"
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#define _tfopen fopen
+#endif
+
+enum {
+	TEXCOPY_COPIED,
+	TEXCOPY_SAME_TIME,
+	TEXCOPY_SAME_HASH,
+	TEXCOPY_FAILED
+};
+
+static double
+Now()
+{
+#ifdef _WIN32
+	LARGE_INTEGER count, freq;
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&freq);
+	return (double) count.QuadPart / (double) freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+// Size and last write time of a file, false if there is none
+static bool
+FileInfo(const TCHAR* path, unsigned long long& size, unsigned long long& time)
+{
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesEx(path, GetFileExInfoStandard, &data))
+		return false;
+	size = ((unsigned long long) data.nFileSizeHigh << 32) | data.nFileSizeLow;
+	time = ((unsigned long long) data.ftLastWriteTime.dwHighDateTime << 32) |
+		data.ftLastWriteTime.dwLowDateTime;
+#else
+	struct stat st;
+	if (stat(path, &st) != 0)
+		return false;
+	size = (unsigned long long) st.st_size;
+	time = (unsigned long long) st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec;
+#endif
+	return true;
+}
+
+// FNV-1a of the content of a file, false if it can't be read
+static bool
+HashFile(const TCHAR* path, unsigned long long& hash)
+{
+	FILE* fp = _tfopen(path, _T("rb"));
+	if (!fp)
+		return false;
+	std::vector<unsigned char> buf(TEXCOPY_CHUNK);
+	size_t n;
+	hash = 14695981039346656037ull;
+	while ((n = fread(&buf[0], 1, buf.size(), fp)) > 0)
+	{
+		for (size_t i = 0; i < n; i++)
+			hash = (hash ^ buf[i]) * 1099511628211ull;
+	}
+	bool ok = ferror(fp) == 0;
+	fclose(fp);
+	return ok;
+}
+
+// Copy a file, keeping its last write time, and return the bytes
+// copied, -1 if it failed
+static double
+CopyBytes(const TCHAR* from, const TCHAR* to)
+{
+#ifdef _WIN32
+	unsigned long long size, time;
+	if (!FileInfo(from, size, time) || !CopyFile(from, to, FALSE))
+		return -1.0;
+	return (double) size;
+#else
+	int in = open(from, O_RDONLY);
+	if (in < 0)
+		return -1.0;
+	struct stat st;
+	int out = -1;
+	if (fstat(in, &st) == 0)
+		out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (out < 0)
+	{
+		close(in);
+		return -1.0;
+	}
+
+	off_t left = st.st_size;
+	bool ok = true;
+#ifdef __linux__
+	while (left > 0)
+	{
+		ssize_t n = copy_file_range(in, NULL, out, NULL, (size_t) left, 0);
+		if (n <= 0)
+			break;
+		left -= n;
+	}
+#endif
+	// Across file systems, or where there is no copy_file_range
+	if (left > 0)
+	{
+		std::vector<char> buf(TEXCOPY_CHUNK);
+		while (ok && left > 0)
+		{
+			ssize_t n = read(in, &buf[0], buf.size());
+			ok = n > 0 && write(out, &buf[0], (size_t) n) == n;
+			left -= n;
+		}
+	}
+	struct timespec times[2] = { st.st_atim, st.st_mtim };
+	ok = ok && futimens(out, times) == 0;
+	ok = close(out) == 0 && ok;
+	close(in);
+	return ok ? (double) st.st_size : -1.0;
+#endif
+}
+
+TexCopier::TexCopier(int threads)
+{
+	mThreads   = threads;
+	mRequested = 0;
+	mSeconds   = 0.0;
+	mRunning   = false;
+}
+
+TexCopier::~TexCopier()
+{
+	TexCopyStats stats;
+	Wait(stats);
+}
+
+void
+TexCopier::Add(const TCHAR* from, const TCHAR* to)
+{
+	mRequested++;
+	if (!mQueued.insert(IRString(from) + _T("|") + to).second)
+		return;
+	Copy copy;
+	copy.from   = from;
+	copy.to     = to;
+	copy.result = TEXCOPY_FAILED;
+	copy.bytes  = 0.0;
+	mCopies.push_back(copy);
+}
+
+void
+TexCopier::CopyOne(void* data, int index)
+{
+	Copy& copy = ((Copy*) data)[index];
+	const TCHAR* from = copy.from.c_str();
+	const TCHAR* to = copy.to.c_str();
+	unsigned long long size[2], time[2];
+
+	if (!FileInfo(from, size[0], time[0]))
+		return;
+	if (FileInfo(to, size[1], time[1]) && size[0] == size[1])
+	{
+		if (time[0] == time[1])
+		{
+			copy.result = TEXCOPY_SAME_TIME;
+			return;
+		}
+		unsigned long long hash[2];
+		if (HashFile(from, hash[0]) && HashFile(to, hash[1]) && hash[0] == hash[1])
+		{
+			copy.result = TEXCOPY_SAME_HASH;
+			return;
+		}
+	}
+	copy.bytes = CopyBytes(from, to);
+	copy.result = copy.bytes < 0.0 ? TEXCOPY_FAILED : TEXCOPY_COPIED;
+}
+
+void
+TexCopier::CopyAll()
+{
+	double start = Now();
+	int threads = mThreads < (int) mCopies.size() ? mThreads : (int) mCopies.size();
+	WorkPool pool(threads);
+	pool.Run(CopyOne, &mCopies[0], (int) mCopies.size());
+	mSeconds = Now() - start;
+}
+
+#ifdef _WIN32
+unsigned __stdcall
+TexCopier::ThreadProc(void* param)
+{
+	((TexCopier*) param)->CopyAll();
+	return 0;
+}
+#else
+void*
+TexCopier::ThreadProc(void* param)
+{
+	((TexCopier*) param)->CopyAll();
+	return NULL;
+}
+#endif
+
+void
+TexCopier::Start()
+{
+	if (mRunning || mCopies.empty())
+		return;
+#ifdef _WIN32
+	mHandle = (HANDLE) _beginthreadex(NULL, 0, ThreadProc, this, 0, NULL);
+	mRunning = mHandle != NULL;
+#else
+	mRunning = pthread_create(&mHandle, NULL, ThreadProc, this) == 0;
+#endif
+	// Copy here and now if there is no thread to copy on
+	if (!mRunning)
+		CopyAll();
+}
+
+void
+TexCopier::Wait(TexCopyStats& stats)
+{
+	if (mRunning)
+	{
+#ifdef _WIN32
+		WaitForSingleObject(mHandle, INFINITE);
+		CloseHandle(mHandle);
+#else
+		pthread_join(mHandle, NULL);
+#endif
+		mRunning = false;
+	}
+
+	memset(&stats, 0, sizeof(stats));
+	stats.requested = mRequested;
+	stats.seconds = mSeconds;
+	for (size_t i = 0; i < mCopies.size(); i++)
+	{
+		switch (mCopies[i].result)
+		{
+		case TEXCOPY_COPIED:
+			stats.copied++;
+			stats.bytes += mCopies[i].bytes;
+			break;
+		case TEXCOPY_SAME_TIME: stats.sameTime++; break;
+		case TEXCOPY_SAME_HASH: stats.sameHash++; break;
+		default:                stats.failed++;   break;
+		}
+	}
+	mCopies.clear();
+	mQueued.clear();
+	mRequested = 0;
+	mSeconds = 0.0;
+}
+
+#ifdef TEXCOPY_BENCHMARK
+// Stand-alone timing and checks on a folder of made up bitmaps, each
+// asked for twice: copied, copied again untouched, copied again with
+// the sources touched but not changed, and with one of them changed:
+//
+//    g++ -O2 -DTEXCOPY_BENCHMARK texcopy.cpp workpool.cpp -lpthread -o texcopybench
+//    ./texcopybench [files] [kilobytes]
+//
+// The first round must copy every file once, the second skip them by
+// time, the third by content, and the last copy only the changed one.
+
+#include <stdlib.h>
+
+static void
+Round(const char* what, int files, int changed)
+{
+	TexCopier copier;
+	TexCopyStats stats;
+	char from[256], to[256];
+	for (int n = 0; n < 2 * files; n++)
+	{
+		sprintf(from, "/tmp/texcopybench/src/tex%d.png", n % files);
+		sprintf(to, "/tmp/texcopybench/dst/tex%d.png", n % files);
+		copier.Add(from, to);
+	}
+	copier.Start();
+	copier.Wait(stats);
+	printf("%-10s %d asked, %d copied (%.1f MB), %d same time, %d same content, %d failed in %.3fs\n",
+		   what, stats.requested, stats.copied, stats.bytes / (1024.0 * 1024.0),
+		   stats.sameTime, stats.sameHash, stats.failed, stats.seconds);
+	if (stats.copied != changed || stats.failed)
+		printf("FAILED\n");
+}
+
+int
+main(int argc, char** argv)
+{
+	int files = argc > 1 ? atoi(argv[1]) : 64;
+	int kb = argc > 2 ? atoi(argv[2]) : 1024;
+	char path[256];
+	std::vector<char> data(kb * 1024);
+
+	if (system("rm -rf /tmp/texcopybench && mkdir -p /tmp/texcopybench/src /tmp/texcopybench/dst") != 0)
+		return 1;
+	srand(1);
+	for (int n = 0; n < files; n++)
+	{
+		for (size_t i = 0; i < data.size(); i++)
+			data[i] = (char) rand();
+		sprintf(path, "/tmp/texcopybench/src/tex%d.png", n);
+		FILE* fp = fopen(path, "wb");
+		fwrite(&data[0], 1, data.size(), fp);
+		fclose(fp);
+	}
+
+	Round("first", files, files);
+	Round("untouched", files, 0);
+	struct timespec now[2] = { { 0, UTIME_NOW }, { 0, UTIME_NOW } };
+	for (int n = 0; n < files; n++)
+	{
+		sprintf(path, "/tmp/texcopybench/src/tex%d.png", n);
+		utimensat(AT_FDCWD, path, now, 0);
+	}
+	Round("touched", files, 0);
+	FILE* fp = fopen("/tmp/texcopybench/src/tex0.png", "r+b");
+	fputc('x', fp);
+	fclose(fp);
+	Round("changed", files, 1);
+	return 0;
+}
+#endif
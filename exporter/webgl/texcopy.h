@@ -0,0 +1,96 @@
+/**********************************************************************
+ *<
+	FILE: texcopy.h
+
+	DESCRIPTION:  Background copying of texture bitmaps
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+
+#ifndef __TEXCOPY__H__
+#define __TEXCOPY__H__
+
+// The bitmaps of the scene are copied next to the scene file.  A
+// TexCopier takes the copies to make, drops those asked for twice, and
+// makes them on a thread of its own with a small WorkPool, so the copy
+// runs while the meshes are written.
+//
+// A copy is skipped if the destination is already the same file: the
+// same size and last write time as the source, which is what the
+// last copy left it with, or else the same size and content hash.
+// Windows copies with CopyFile.  Linux copies with copy_file_range,
+// so the bytes do not go through the process, and falls back to read
+// and write where the kernel can't.
+//
+// Nothing in here depends on the MAX SDK.
+
+#include <vector>
+#include <set>
+#include "sceneir.h"
+#include "workpool.h"
+
+#define TEXCOPY_THREADS 4               // copies run at once; they wait on the disk
+#define TEXCOPY_CHUNK   (256 * 1024)    // bytes read at a time to hash or copy
+
+// What the copies of an export did
+struct TexCopyStats {
+	int    requested;   // copies asked for, repeats included
+	int    copied;
+	int    sameTime;    // skipped, same size and last write time
+	int    sameHash;    // skipped, same size and content
+	int    failed;
+	double bytes;       // bytes copied
+	double seconds;     // from Start() to the end of the last copy
+};
+
+class TexCopier {
+public:
+	TexCopier(int threads = TEXCOPY_THREADS);
+	~TexCopier();
+
+	// Queue a copy.  A source already queued for the same destination
+	// is copied once.
+	void Add(const TCHAR* from, const TCHAR* to);
+
+	// Make the queued copies on a thread of their own, and return
+	// without waiting for them
+	void Start();
+
+	// Wait for the copies to finish, and clear the queue for the next
+	// export
+	void Wait(TexCopyStats& stats);
+
+private:
+	TexCopier(const TexCopier&);
+	TexCopier& operator=(const TexCopier&);
+
+	// A file to copy and what became of it
+	struct Copy {
+		IRString from;
+		IRString to;
+		int      result;    // one of the TEXCOPY_ results in texcopy.cpp
+		double   bytes;
+	};
+
+	static void CopyOne(void* data, int index);
+	void        CopyAll();
+#ifdef _WIN32
+	static unsigned __stdcall ThreadProc(void* param);
+#else
+	static void* ThreadProc(void* param);
+#endif
+
+	int                mThreads;
+	std::vector<Copy>  mCopies;
+	std::set<IRString> mQueued;     // source and destination of each copy
+	int                mRequested;
+	double             mSeconds;
+	bool               mRunning;
+#ifdef _WIN32
+	HANDLE             mHandle;
+#else
+	pthread_t          mHandle;
+#endif
+};
+
+#endif
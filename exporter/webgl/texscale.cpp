@@ -0,0 +1,473 @@
+/**********************************************************************
+ *<
+	FILE: texscale.cpp
+
+	DESCRIPTION:  Power of two scaling and mip levels of texture bitmaps
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+#include <math.h>
+#include "texscale.h"
+
+#ifdef TEXSCALE_SSE
+#include <xmmintrin.h>
+#endif
+
+#define TEXSCALE_PI 3.14159265358979323846
+
+// sRGB to linear for every 16 bit value, and linear to sRGB in 65536
+// steps; built once when the module is loaded
+struct SRGBTables {
+	float          toLinear[65536];
+	unsigned short toSRGB[65536];
+
+	SRGBTables()
+	{
+		for (int i = 0; i < 65536; i++)
+		{
+			double s = i / 65535.0;
+			toLinear[i] = (float) (s <= 0.04045 ? s / 12.92 : pow((s + 0.055) / 1.055, 2.4));
+			double l = i / 65535.0;
+			double e = l <= 0.0031308 ? l * 12.92 : 1.055 * pow(l, 1.0 / 2.4) - 0.055;
+			toSRGB[i] = (unsigned short) (e * 65535.0 + 0.5);
+		}
+	}
+};
+
+static SRGBTables sRGB;
+
+int
+TexPowerOfTwo(int size, int maxSize)
+{
+	int p = 1;
+	// Up while the next power is nearer in ratio
+	while (p < size && (double) size / p > (double) (2 * p) / size)
+		p *= 2;
+	while (maxSize > 0 && p > maxSize)
+		p /= 2;
+	return p;
+}
+
+void
+TexDecode(const unsigned short* rgba, int width, int height, TexImage& image)
+{
+	int count = width * height;
+	image.width = width;
+	image.height = height;
+	image.pixels.resize(4 * count);
+	float* p = image.pixels.empty() ? NULL : &image.pixels[0];
+	for (int i = 0; i < count; i++, p += 4, rgba += 4)
+	{
+		float a = rgba[3] / 65535.0f;
+		p[0] = sRGB.toLinear[rgba[0]] * a;
+		p[1] = sRGB.toLinear[rgba[1]] * a;
+		p[2] = sRGB.toLinear[rgba[2]] * a;
+		p[3] = a;
+	}
+}
+
+static unsigned short
+Quantize(float x, const unsigned short* table)
+{
+	if (!(x > 0.0f))
+		return table ? table[0] : 0;
+	if (x >= 1.0f)
+		return 65535;
+	int i = (int) (x * 65535.0f + 0.5f);
+	return table ? table[i] : (unsigned short) i;
+}
+
+void
+TexEncode(const TexImage& image, unsigned short* rgba)
+{
+	int count = image.width * image.height;
+	const float* p = image.pixels.empty() ? NULL : &image.pixels[0];
+	for (int i = 0; i < count; i++, p += 4, rgba += 4)
+	{
+		float a = p[3];
+		float scale = a > 0.0f ? 1.0f / a : 0.0f;
+		rgba[0] = Quantize(p[0] * scale, sRGB.toSRGB);
+		rgba[1] = Quantize(p[1] * scale, sRGB.toSRGB);
+		rgba[2] = Quantize(p[2] * scale, sRGB.toSRGB);
+		rgba[3] = Quantize(a, NULL);
+	}
+}
+
+void
+TexEncode8(const TexImage& image, unsigned char* rgba)
+{
+	std::vector<unsigned short> wide(4 * image.width * image.height);
+	if (wide.empty())
+		return;
+	TexEncode(image, &wide[0]);
+	int row = 4 * image.width;
+	for (int y = 0; y < image.height; y++)
+	{
+		const unsigned short* in = &wide[row * (image.height - 1 - y)];
+		for (int x = 0; x < row; x++)
+			*rgba++ = (unsigned char) ((in[x] * 255 + 32767) / 65535);
+	}
+}
+
+static double
+Lanczos(double x)
+{
+	if (x == 0.0)
+		return 1.0;
+	if (x <= -TEXSCALE_LOBES || x >= TEXSCALE_LOBES)
+		return 0.0;
+	double px = TEXSCALE_PI * x;
+	return TEXSCALE_LOBES * sin(px) * sin(px / TEXSCALE_LOBES) / (px * px);
+}
+
+// The texels and weights that make each texel of a side scaled from
+// in to out texels: taps of them per output texel, wrapping around
+struct Taps {
+	int                taps;
+	std::vector<int>   index;
+	std::vector<float> weight;
+};
+
+static void
+MakeTaps(int in, int out, Taps& t)
+{
+	double scale = (double) in / out;
+	double stretch = scale > 1.0 ? scale : 1.0;    // wider when shrinking
+	double support = TEXSCALE_LOBES * stretch;
+
+	t.taps = 2 * (int) ceil(support) + 1;
+	t.index.resize(out * t.taps);
+	t.weight.resize(out * t.taps);
+	for (int o = 0; o < out; o++)
+	{
+		double center = (o + 0.5) * scale - 0.5;
+		int first = (int) floor(center - support) + 1;
+		double sum = 0.0;
+		for (int k = 0; k < t.taps; k++)
+		{
+			double w = Lanczos((first + k - center) / stretch);
+			t.weight[o * t.taps + k] = (float) w;
+			t.index[o * t.taps + k] = ((first + k) % in + in) % in;
+			sum += w;
+		}
+		for (int k = 0; k < t.taps; k++)
+			t.weight[o * t.taps + k] = (float) (t.weight[o * t.taps + k] / sum);
+	}
+}
+
+// out = sum of weight[k] * in[index[k]], four floats each
+static void
+Gather(float* out, const float* in, const int* index, const float* weight,
+	   int taps, bool simd)
+{
+#ifdef TEXSCALE_SSE
+	if (simd)
+	{
+		__m128 acc = _mm_setzero_ps();
+		for (int k = 0; k < taps; k++)
+		{
+			if (weight[k] != 0.0f)
+				acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(weight[k]),
+												 _mm_loadu_ps(in + 4 * index[k])));
+		}
+		_mm_storeu_ps(out, acc);
+		return;
+	}
+#endif
+	float acc[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for (int k = 0; k < taps; k++)
+	{
+		if (weight[k] == 0.0f)
+			continue;
+		const float* p = in + 4 * index[k];
+		for (int c = 0; c < 4; c++)
+			acc[c] += weight[k] * p[c];
+	}
+	for (int c = 0; c < 4; c++)
+		out[c] = acc[c];
+}
+
+// out += weight * in over count floats, count a multiple of 4
+static void
+AddRow(float* out, const float* in, float weight, int count, bool simd)
+{
+	int i = 0;
+#ifdef TEXSCALE_SSE
+	if (simd)
+	{
+		__m128 w = _mm_set1_ps(weight);
+		for (; i < count; i += 4)
+			_mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i),
+											  _mm_mul_ps(w, _mm_loadu_ps(in + i))));
+	}
+#endif
+	for (; i < count; i++)
+		out[i] += weight * in[i];
+}
+
+static void
+Resize(const TexImage& from, int width, int height, TexImage& to, bool simd)
+{
+	Taps tx, ty;
+	int x, y, k;
+
+	// Along the rows first, into width x from.height
+	MakeTaps(from.width, width, tx);
+	std::vector<float> rows(4 * width * from.height);
+	for (y = 0; y < from.height; y++)
+	{
+		const float* in = &from.pixels[4 * from.width * y];
+		float* out = &rows[4 * width * y];
+		for (x = 0; x < width; x++)
+			Gather(out + 4 * x, in, &tx.index[x * tx.taps], &tx.weight[x * tx.taps],
+				   tx.taps, simd);
+	}
+
+	// Then down the columns, a whole row at a time
+	MakeTaps(from.height, height, ty);
+	to.width = width;
+	to.height = height;
+	to.pixels.assign(4 * width * height, 0.0f);
+	for (y = 0; y < height; y++)
+	{
+		float* out = &to.pixels[4 * width * y];
+		for (k = 0; k < ty.taps; k++)
+		{
+			float w = ty.weight[y * ty.taps + k];
+			if (w != 0.0f)
+				AddRow(out, &rows[4 * width * ty.index[y * ty.taps + k]], w, 4 * width, simd);
+		}
+	}
+}
+
+void
+TexResize(const TexImage& from, int width, int height, TexImage& to)
+{
+	Resize(from, width, height, to, true);
+}
+
+void
+TexResizeScalar(const TexImage& from, int width, int height, TexImage& to)
+{
+	Resize(from, width, height, to, false);
+}
+
+// Average of 2 x 2 texels; a side of 1 is averaged along the other only
+static void
+BoxHalve(const TexImage& from, TexImage& to)
+{
+	int width = from.width > 1 ? from.width / 2 : 1;
+	int height = from.height > 1 ? from.height / 2 : 1;
+	int dx = from.width > 1 ? 4 : 0;
+	int dy = from.height > 1 ? 4 * from.width : 0;
+
+	to.width = width;
+	to.height = height;
+	to.pixels.resize(4 * width * height);
+	for (int y = 0; y < height; y++)
+	{
+		const float* p = &from.pixels[4 * from.width * (from.height > 1 ? 2 * y : y)];
+		float* out = &to.pixels[4 * width * y];
+		for (int x = 0; x < width; x++, p += dx + dx, out += 4)
+		{
+#ifdef TEXSCALE_SSE
+			__m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(p), _mm_loadu_ps(p + dx)),
+									_mm_add_ps(_mm_loadu_ps(p + dy), _mm_loadu_ps(p + dy + dx)));
+			_mm_storeu_ps(out, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+			for (int c = 0; c < 4; c++)
+				out[c] = (p[c] + p[dx + c] + p[dy + c] + p[dy + dx + c]) * 0.25f;
+#endif
+		}
+	}
+}
+
+void
+TexHalve(const TexImage& from, TexFilter filter, TexImage& to)
+{
+	if (filter == TEXFILTER_BOX)
+		BoxHalve(from, to);
+	else
+		TexResize(from, from.width > 1 ? from.width / 2 : 1,
+				  from.height > 1 ? from.height / 2 : 1, to);
+}
+
+void
+TexMipChain(const TexImage& image, TexFilter filter, std::vector<TexImage>& levels)
+{
+	const TexImage* last = &image;
+	int count = 0;
+	levels.clear();
+	for (int w = image.width, h = image.height; w > 1 || h > 1; w /= 2, h /= 2)
+		count++;
+	levels.resize(count);
+	for (int i = 0; i < count; i++)
+	{
+		TexHalve(*last, filter, levels[i]);
+		last = &levels[i];
+	}
+}
+
+#ifdef TEXSCALE_BENCHMARK
+// Stand-alone timing and checks on made up bitmaps of 8 bit sRGB
+// texels, scaled to powers of two with their mip levels on a WorkPool:
+//
+//    g++ -O2 -DTEXSCALE_BENCHMARK texscale.cpp workpool.cpp -lpthread -o texscalebench
+//    ./texscalebench [width] [height] [bitmaps]
+//
+// 8 bit values must decode and encode to themselves, a flat bitmap
+// must stay flat through scaling and both filters, the last box level
+// must hold the mean of the image, and SSE must match the scalar path.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "workpool.h"
+
+struct BenchJob {
+	TexImage              image;
+	TexImage              scaled;
+	std::vector<TexImage> levels;
+	TexFilter             filter;
+};
+
+static void
+ScaleJob(void* data, int index)
+{
+	BenchJob& job = ((BenchJob*) data)[index];
+	TexResize(job.image, TexPowerOfTwo(job.image.width, 0),
+			  TexPowerOfTwo(job.image.height, 0), job.scaled);
+	TexMipChain(job.scaled, job.filter, job.levels);
+}
+
+static double
+Seconds(clock_t start)
+{
+	return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+static float
+MaxDiff(const TexImage& a, const TexImage& b)
+{
+	float d = 0.0f;
+	for (size_t i = 0; i < a.pixels.size(); i++)
+	{
+		float e = fabsf(a.pixels[i] - b.pixels[i]);
+		if (e > d)
+			d = e;
+	}
+	return d;
+}
+
+static void
+Fill(TexImage& image, int width, int height, int seed)
+{
+	std::vector<unsigned short> rgba(4 * width * height);
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			unsigned short* p = &rgba[4 * (width * y + x)];
+			bool check = ((x / 16) ^ (y / 16) ^ seed) & 1;
+			p[0] = (unsigned short) (257 * (check ? 255 : 32));
+			p[1] = (unsigned short) (257 * (255 * x / width));
+			p[2] = (unsigned short) (257 * (255 * y / height));
+			p[3] = (unsigned short) (257 * (x < width / 2 ? 255 : 128));
+		}
+	}
+	TexDecode(&rgba[0], width, height, image);
+}
+
+int
+main(int argc, char** argv)
+{
+	int width = argc > 1 ? atoi(argv[1]) : 1000;
+	int height = argc > 2 ? atoi(argv[2]) : 700;
+	int count = argc > 3 ? atoi(argv[3]) : 8;
+	int i, bad;
+
+	printf("power of two: 700 -> %d, 1000 -> %d, 3000 max 2048 -> %d, 1 -> %d\n",
+		   TexPowerOfTwo(700, 0), TexPowerOfTwo(1000, 0), TexPowerOfTwo(3000, 2048),
+		   TexPowerOfTwo(1, 0));
+
+	// 8 bit values survive the trip through linear floats
+	std::vector<unsigned short> in(4 * 256), out(4 * 256);
+	for (i = 0; i < 4 * 256; i++)
+		in[i] = (unsigned short) (257 * (i / 4));
+	for (i = 0; i < 256; i++)
+		in[4 * i + 3] = 65535;
+	TexImage image;
+	TexDecode(&in[0], 256, 1, image);
+	TexEncode(image, &out[0]);
+	for (bad = 0, i = 0; i < 4 * 256; i++)
+		bad += (out[i] + 128) / 257 != in[i] / 257;
+	printf("8 bit round trip: %d wrong%s\n", bad, bad ? " FAILED" : "");
+
+	// A flat image stays flat
+	std::vector<unsigned short> flat(4 * 37 * 23);
+	for (i = 0; i < 37 * 23; i++)
+	{
+		flat[4 * i] = 40000;
+		flat[4 * i + 1] = 20000;
+		flat[4 * i + 2] = 5000;
+		flat[4 * i + 3] = 30000;
+	}
+	TexImage f, g;
+	std::vector<TexImage> fl;
+	TexDecode(&flat[0], 37, 23, f);
+	TexResize(f, 64, 16, g);
+	TexMipChain(g, TEXFILTER_LANCZOS, fl);
+	float d = 0.0f;
+	for (i = 0; i < (int) fl.size(); i++)
+	{
+		for (size_t k = 0; k < fl[i].pixels.size(); k++)
+			d = fabsf(fl[i].pixels[k] - f.pixels[k % 4]) > d ?
+				fabsf(fl[i].pixels[k] - f.pixels[k % 4]) : d;
+	}
+	printf("flat 37x23 -> 64x16 and %d Lanczos levels: off by %g%s\n",
+		   (int) fl.size(), d, d > 1e-4f ? " FAILED" : "");
+
+	// The benchmark bitmaps
+	std::vector<BenchJob> jobs(count);
+	for (i = 0; i < count; i++)
+	{
+		Fill(jobs[i].image, width, height, i);
+		jobs[i].filter = i & 1 ? TEXFILTER_LANCZOS : TEXFILTER_BOX;
+	}
+
+	TexImage a, b;
+	clock_t start = clock();
+	TexResize(jobs[0].image, TexPowerOfTwo(width, 0), TexPowerOfTwo(height, 0), a);
+	double simd = Seconds(start);
+	start = clock();
+	TexResizeScalar(jobs[0].image, TexPowerOfTwo(width, 0), TexPowerOfTwo(height, 0), b);
+	double scalar = Seconds(start);
+	d = MaxDiff(a, b);
+	printf("%dx%d -> %dx%d: %.3fs, scalar %.3fs, off by %g%s\n", width, height,
+		   a.width, a.height, simd, scalar, d, d > 1e-5f ? " FAILED" : "");
+
+	// The mean of the image ends in the last box level
+	std::vector<TexImage> levels;
+	start = clock();
+	TexMipChain(a, TEXFILTER_BOX, levels);
+	double box = Seconds(start);
+	double mean[4] = { 0, 0, 0, 0 };
+	for (size_t k = 0; k < a.pixels.size(); k++)
+		mean[k % 4] += a.pixels[k];
+	for (d = 0.0f, i = 0; i < 4; i++)
+	{
+		float e = fabsf((float) (mean[i] / (a.width * a.height)) - levels.back().pixels[i]);
+		d = e > d ? e : d;
+	}
+	start = clock();
+	TexMipChain(a, TEXFILTER_LANCZOS, levels);
+	printf("%d mip levels: box %.3fs, off the mean by %g%s; Lanczos %.3fs\n",
+		   (int) levels.size(), box, d, d > 1e-4f ? " FAILED" : "", Seconds(start));
+
+	WorkPool pool;
+	pool.Run(ScaleJob, &jobs[0], count);
+	printf("%d bitmaps scaled with their mip levels on %d threads in %.3fs\n",
+		   count, pool.Threads(), pool.RunSeconds());
+	return 0;
+}
+#endif
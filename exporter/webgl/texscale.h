@@ -0,0 +1,78 @@
+/**********************************************************************
+ *<
+	FILE: texscale.h
+
+	DESCRIPTION:  Power of two scaling and mip levels of texture bitmaps
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+
+#ifndef __TEXSCALE__H__
+#define __TEXSCALE__H__
+
+// WebGL 1 can only repeat and mip map textures whose sides are powers
+// of two; three.js scales any other bitmap on a canvas when it is
+// loaded, and the browser then builds the mip levels with a box filter.
+// Bitmaps are scaled here instead, once, at export time: each side goes
+// to the nearest power of two, no larger than a chosen size, with a
+// Lanczos filter, and the mip levels below it are made with a box or
+// Lanczos filter down to 1 x 1.
+//
+// Filtering is done on floats, linear and premultiplied by alpha, so
+// dark and transparent texels do not bleed into their neighbours.  The
+// filters wrap around the edges, as the textures are repeated.  A
+// texel is four floats, one SSE register where there is SSE; the
+// scalar path gives the same results to rounding.
+//
+// Nothing in here depends on the MAX SDK.
+
+#include <vector>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#define TEXSCALE_SSE
+#endif
+
+#define TEXSCALE_LOBES 3        // of the Lanczos filter
+
+enum TexFilter {
+	TEXFILTER_BOX,              // average of 2 x 2 texels
+	TEXFILTER_LANCZOS
+};
+
+// A bitmap being scaled
+struct TexImage {
+	TexImage() : width(0), height(0) {}
+
+	int                width;
+	int                height;
+	std::vector<float> pixels;  // r, g, b, a per texel, top row first;
+								// linear, premultiplied by alpha
+};
+
+// Nearest power of two to size, at most maxSize if that is above 0
+int TexPowerOfTwo(int size, int maxSize);
+
+// Convert from and to 16 bit sRGB r, g, b, a per texel, as MAX bitmaps
+// give and take them
+void TexDecode(const unsigned short* rgba, int width, int height, TexImage& image);
+void TexEncode(const TexImage& image, unsigned short* rgba);
+
+// Convert to 8 bit sRGB r, g, b, a per texel, bottom row first, as
+// compressed textures are loaded: WebGL cannot flip them on upload
+void TexEncode8(const TexImage& image, unsigned char* rgba);
+
+// Scale to width x height with the Lanczos filter
+void TexResize(const TexImage& from, int width, int height, TexImage& to);
+
+// The same without the vector unit, for checking
+void TexResizeScalar(const TexImage& from, int width, int height, TexImage& to);
+
+// The next mip level of an image, half its size on each side but not
+// below 1
+void TexHalve(const TexImage& from, TexFilter filter, TexImage& to);
+
+// The mip levels below an image, down to 1 x 1, largest first
+void TexMipChain(const TexImage& image, TexFilter filter,
+				 std::vector<TexImage>& levels);
+
+#endif
@@ -0,0 +1,214 @@
+/**********************************************************************
+ *<
+	FILE: vcache.cpp
+
+	DESCRIPTION:  Face order for the post-transform vertex cache
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+#include "vcache.h"
+
+// The best vertex to fan around next: among the candidates that still
+// have triangles left, the one that entered the cache earliest but will
+// still be in it once its triangles are done.  -1 if none qualifies.
+static int
+NextCandidate(const std::vector<int>& candidates, const std::vector<int>& live,
+			  const std::vector<int>& stamp, int time, int cacheSize)
+{
+	int best = -1, bestPriority = -1;
+	for (int i = 0; i < (int) candidates.size(); i++)
+	{
+		int v = candidates[i];
+		if (live[v] <= 0)
+			continue;
+		int priority = 0;
+		if (time - stamp[v] + 2 * live[v] <= cacheSize)
+			priority = time - stamp[v];
+		if (priority > bestPriority)
+		{
+			best = v;
+			bestPriority = priority;
+		}
+	}
+	return best;
+}
+
+void
+VCacheOrder(const int* tris, int numTris, int numVerts, int cacheSize,
+			std::vector<int>& order)
+{
+	int i, v;
+
+	// Triangles around each vertex, in one array
+	std::vector<int> start(numVerts + 1, 0);
+	for (i = 0; i < 3 * numTris; i++)
+		start[tris[i] + 1]++;
+	for (v = 0; v < numVerts; v++)
+		start[v + 1] += start[v];
+	std::vector<int> adjacent(3 * numTris);
+	std::vector<int> fill(start.begin(), start.end() - 1);
+	for (i = 0; i < 3 * numTris; i++)
+		adjacent[fill[tris[i]]++] = i / 3;
+
+	std::vector<int> live(numVerts);       // triangles left per vertex
+	for (v = 0; v < numVerts; v++)
+		live[v] = start[v + 1] - start[v];
+	std::vector<int> stamp(numVerts, 0);   // time it entered the cache
+	std::vector<bool> emitted(numTris, false);
+	std::vector<int> deadEnd;               // recent vertices, most recent last
+	std::vector<int> candidates;
+	int time = cacheSize + 1;
+	int cursor = 0;
+
+	order.clear();
+	order.reserve(numTris);
+
+	int fan = numVerts > 0 ? 0 : -1;
+	while (fan >= 0)
+	{
+		candidates.clear();
+		for (i = start[fan]; i < start[fan + 1]; i++)
+		{
+			int t = adjacent[i];
+			if (emitted[t])
+				continue;
+			for (int k = 0; k < 3; k++)
+			{
+				v = tris[3 * t + k];
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - stamp[v] > cacheSize)
+					stamp[v] = time++;
+			}
+			emitted[t] = true;
+			order.push_back(t);
+		}
+
+		fan = NextCandidate(candidates, live, stamp, time, cacheSize);
+		if (fan >= 0)
+			continue;
+
+		// Dead end: go back to a recent vertex with triangles left, or
+		// on to the next one in index order
+		while (!deadEnd.empty() && fan < 0)
+		{
+			v = deadEnd.back();
+			deadEnd.pop_back();
+			if (live[v] > 0)
+				fan = v;
+		}
+		while (fan < 0 && cursor < numVerts)
+		{
+			if (live[cursor] > 0)
+				fan = cursor;
+			cursor++;
+		}
+	}
+}
+
+void
+VCacheStats(const int* tris, int numTris, int numVerts, int cacheSize,
+			const int* order, double* acmr, double* atvr)
+{
+	// A FIFO cache: a vertex is in it if it entered less than cacheSize
+	// misses ago
+	std::vector<int> entered(numVerts, -cacheSize - 1);
+	std::vector<bool> used(numVerts, false);
+	int misses = 0, distinct = 0;
+
+	for (int i = 0; i < numTris; i++)
+	{
+		int t = order ? order[i] : i;
+		for (int k = 0; k < 3; k++)
+		{
+			int v = tris[3 * t + k];
+			if (misses - entered[v] > cacheSize)
+			{
+				entered[v] = misses++;
+			}
+			if (!used[v])
+			{
+				used[v] = true;
+				distinct++;
+			}
+		}
+	}
+	*acmr = numTris > 0 ? (double) misses / numTris : 0.0;
+	*atvr = distinct > 0 ? (double) misses / distinct : 0.0;
+}
+
+#ifdef VCACHE_BENCHMARK
+// Stand-alone check and timing on a grid whose faces are shuffled, the
+// worst case of a scanned or boolean-heavy mesh, and on the grid in
+// row order:
+//
+//    g++ -O2 -DVCACHE_BENCHMARK vcache.cpp -o vcachebench
+//    ./vcachebench [rows]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static void
+Run(const char* name, const std::vector<int>& tris, int numVerts)
+{
+	int numTris = (int) tris.size() / 3;
+	double acmr0, atvr0, acmr1, atvr1;
+	std::vector<int> order;
+
+	VCacheStats(&tris[0], numTris, numVerts, VCACHE_SIZE, NULL, &acmr0, &atvr0);
+	clock_t start = clock();
+	VCacheOrder(&tris[0], numTris, numVerts, VCACHE_SIZE, order);
+	double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+	VCacheStats(&tris[0], numTris, numVerts, VCACHE_SIZE, &order[0],
+				&acmr1, &atvr1);
+
+	// Every triangle exactly once
+	std::vector<bool> seen(numTris, false);
+	int bad = (int) order.size() != numTris;
+	for (int i = 0; i < (int) order.size(); i++)
+	{
+		if (seen[order[i]])
+			bad++;
+		seen[order[i]] = true;
+	}
+	printf("%s: %d triangles, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, "
+		   "%.3fs%s\n", name, numTris, acmr0, acmr1, atvr0, atvr1, seconds,
+		   bad ? ", BAD ORDER" : "");
+}
+
+int
+main(int argc, char** argv)
+{
+	int rows = argc > 1 ? atoi(argv[1]) : 500;
+	int numVerts = (rows + 1) * (rows + 1);
+	std::vector<int> tris;
+
+	for (int r = 0; r < rows; r++)
+	{
+		for (int c = 0; c < rows; c++)
+		{
+			int a = r * (rows + 1) + c, b = a + 1, d = a + rows + 1, e = d + 1;
+			int quad[6] = { a, b, e, a, e, d };
+			tris.insert(tris.end(), quad, quad + 6);
+		}
+	}
+	Run("grid, row order", tris, numVerts);
+
+	srand(1);
+	int numTris = (int) tris.size() / 3;
+	for (int i = numTris - 1; i > 0; i--)
+	{
+		int j = (int) ((double) rand() / ((double) RAND_MAX + 1) * (i + 1));
+		for (int k = 0; k < 3; k++)
+		{
+			int t = tris[3 * i + k];
+			tris[3 * i + k] = tris[3 * j + k];
+			tris[3 * j + k] = t;
+		}
+	}
+	Run("grid, shuffled", tris, numVerts);
+	return 0;
+}
+#endif
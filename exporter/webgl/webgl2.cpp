@@ -24,6 +24,23 @@
 #include "webglexp.h"
 #include "decomp.h"
 #include "appd.h"
+#include "sceneir.h"
+#include "fltfmt.h"
+#include "outbuf.h"
+#include "binmesh.h"
+#include "workpool.h"
+#include "weld.h"
+#include "vcache.h"
+#include "overdraw.h"
+#include "quant.h"
+#include "xform.h"
+#include "quads.h"
+#include "simplify.h"
+#include "batch.h"
+#include "split.h"
+#include "texcopy.h"
+#include "texscale.h"
+#include "texcomp.h"
 #include "webgl2.h"
 #include <maxscript/maxscript.h>
 #include <maxscript/maxwrapper/maxclasses.h>
@@ -109,6 +126,16 @@ GetLocalTM(INode* node, TimeValue t)
 	return tm;
 }
 
+// Seconds from the high resolution counter, for timing the export
+static double
+TimerSeconds()
+{
+	LARGE_INTEGER count, freq;
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&freq);
+	return (double) count.QuadPart / (double) freq.QuadPart;
+}
+
 inline float
 round(float f)
 {
@@ -134,175 +161,179 @@ CommaScan(TCHAR* buf)
 	}
 }
 
+// Room for the longest text of the formatters below
+#define FMT_BUF_SIZE (4 * FLT_FMT_MAX)
+
+// Write three formatted values separated by commas
+static TCHAR*
+Triple(TCHAR* buf, float x, float y, float z, int digits,
+	   TCHAR* (*fmt)(TCHAR*, float, int))
+{
+	TCHAR* end = fmt(buf, x, digits);
+	*end++ = ',';
+	end = fmt(end, y, digits);
+	*end++ = ',';
+	end = fmt(end, z, digits);
+	*end = 0;
+	return end;
+}
+
+// The formatters below write into buf, which must hold FMT_BUF_SIZE
+// characters, and return it.  Nothing is kept between calls, so the
+// meshes can be written on several threads at once.
 TCHAR*
-WebGL2Export::point(Point3& p)
+WebGL2Export::point(TCHAR* buf, Point3& p)
 {
-	static TCHAR buf[50];
-	TCHAR format[20];
-	SPRINTF(format, _T("%%.%df %%.%df %%.%df"), mDigits, mDigits, mDigits);
 	if (mZUp)
-		SPRINTF(buf, format, round(p.x), round(p.y), round(p.z));
+		Triple(buf, round(p.x), round(p.y), round(p.z), mDigits, FltFixed);
 	else
-		SPRINTF(buf, format, round(p.x), round(p.z), -round(p.y));
-	CommaScan(buf); // NOTE!: International numbers may contain commas
+		Triple(buf, round(p.x), round(p.z), -round(p.y), mDigits, FltFixed);
 	return buf;
 }
 
 TCHAR*
-WebGL2Export::color(Color& c)
+WebGL2Export::color(TCHAR* buf, Color& c)
 {
-	static TCHAR buf[50];
 	/*
 	TCHAR format[20];
 	sprintf(format, _T("%%.%dg %%.%dg %%.%dg"), mDigits, mDigits, mDigits);
 	sprintf(buf, format, round(c.r), round(c.g), round(c.b));
 	*/
 	SPRINTF (buf, _T("%d"), RGB(FLto255(c.b),FLto255(c.g), FLto255(c.r)));
-	CommaScan(buf);
 	return buf;
 }
 
 TCHAR*
-WebGL2Export::colorString(Color& c)
+WebGL2Export::colorString(TCHAR* buf, Color& c)
 {
-	static TCHAR buf[50];
-
-	TCHAR format[20];
-	SPRINTF(format,  _T("%%.%dg %%.%dg %%.%dg"), mDigits, mDigits, mDigits);
-	SPRINTF(buf, format, round(c.r), round(c.g), round(c.b));
-	CommaScan(buf);
+	Triple(buf, round(c.r), round(c.g), round(c.b), mDigits, FltGeneral);
 	return buf;
 }
 
 TCHAR*
-WebGL2Export::color(Point3& c)
+WebGL2Export::color(TCHAR* buf, Point3& c)
 {
-	static TCHAR buf[50];
 	Color col(c);
-	return color (col);
-	/*
-	TCHAR format[20];
-	sprintf(format, _T("%%.%dg %%.%dg %%.%dg"), mDigits, mDigits, mDigits);
-	sprintf(buf, format, round(c.x), round(c.y), round(c.z));
-	CommaScan(buf);
-	*/
-
-	return buf;
+	return color (buf, col);
 }
 
 
 TCHAR*
-WebGL2Export::floatVal(float f)
+WebGL2Export::floatVal(TCHAR* buf, float f)
 {
-	static TCHAR buf[50];
-	TCHAR format[20];
-	SPRINTF(format, _T("%%.%dg"), mDigits);
-	SPRINTF(buf, format, round(f));
-	CommaScan(buf);
+	*FltGeneral(buf, round(f), mDigits) = 0;
 	return buf;
 }
 
 
 TCHAR*
-WebGL2Export::texture(UVVert& uv)
+WebGL2Export::texture(TCHAR* buf, UVVert& uv)
 {
-	static TCHAR buf[50];
-	TCHAR format[20];
-	SPRINTF(format, _T("%%.%dg %%.%dg"), mDigits, mDigits);
-	SPRINTF(buf, format, round(uv.x), round(1.0-uv.y));
-	CommaScan(buf);
+	TCHAR* end = FltGeneral(buf, round(uv.x), mDigits);
+	*end++ = ',';
+	*FltGeneral(end, round(1.0-uv.y), mDigits) = 0;
 	return buf;
 }
 
 // Format a scale value
 TCHAR*
-WebGL2Export::scalePoint(Point3& p)
+WebGL2Export::scalePoint(TCHAR* buf, Point3& p)
 {
-	static TCHAR buf[50];
-	TCHAR format[20];
-	SPRINTF(format, _T("%%.%dg %%.%dg %%.%dg"), mDigits, mDigits, mDigits);
 	if (mZUp)
-		SPRINTF(buf, format, round(p.x), round( p.y), round(p.z));
+		Triple(buf, round(p.x), round(p.y), round(p.z), mDigits, FltGeneral);
 	else
-		SPRINTF(buf, format, round(p.x), round( p.z), round(p.y));
-	CommaScan(buf);
+		Triple(buf, round(p.x), round(p.z), round(p.y), mDigits, FltGeneral);
 	return buf;
 }
 
 // Format a normal vector
 TCHAR*
-WebGL2Export::normPoint(Point3& p)
+WebGL2Export::normPoint(TCHAR* buf, Point3& p)
 {
-	static TCHAR buf[50];
-	TCHAR format[20];
-	SPRINTF(format, _T("%%.%dg %%.%dg %%.%dg"), mDigits, mDigits, mDigits);
 	if (mZUp)
-		SPRINTF(buf, format, round(p.x), round(p.y), round(p.z));
+		Triple(buf, round(p.x), round(p.y), round(p.z), mDigits, FltGeneral);
 	else
-		SPRINTF(buf, format, round(p.x), round(p.z), round(-p.y));
-	CommaScan(buf);
+		Triple(buf, round(p.x), round(p.z), round(-p.y), mDigits, FltGeneral);
+	return buf;
+}
+
+// Format a mesh vertex or normal, which ConvertMeshes already put in
+// the space of the scene file
+TCHAR*
+WebGL2Export::meshPoint(TCHAR* buf, const float* p)
+{
+	Triple(buf, round(p[0]), round(p[1]), round(p[2]), mDigits, FltFixed);
+	return buf;
+}
+
+TCHAR*
+WebGL2Export::meshNormal(TCHAR* buf, const float* p)
+{
+	Triple(buf, round(p[0]), round(p[1]), round(p[2]), mDigits, FltGeneral);
 	return buf;
 }
 
 // Format an axis value
 TCHAR*
-WebGL2Export::axisPoint(Point3& p, float angle)
+WebGL2Export::axisPoint(TCHAR* buf, Point3& p, float angle)
 {
 	if (p == Point3(0., 0., 0.)) 
 		p = Point3(1., 0., 0.); // default direction
-	static TCHAR buf[50];
-	TCHAR format[20];
-	SPRINTF(format, _T("%%.%dg %%.%dg %%.%dg %%.%dg"),
-			mDigits, mDigits, mDigits, mDigits);
-	if (true || mZUp)
-		SPRINTF(buf, format, round(p.x), round(p.y), round(p.z), round(angle));
-	else
-		SPRINTF(buf, format, round(p.x), round(p.z), round(-p.y), round(angle));
-	CommaScan(buf);
+	TCHAR* end = Triple(buf, round(p.x), round(p.y), round(p.z), mDigits, FltGeneral);
+	*end++ = ',';
+	*FltGeneral(end, round(angle), mDigits) = 0;
 	return buf;
 }
 
 TCHAR*
-WebGL2Export::quat(Quat &q)
+WebGL2Export::quat(TCHAR* buf, Quat &q)
+{
+	Point3 e;
+	q.GetEuler(&e.x, &e.y, &e.z);
+	return euler(buf, e);
+}
+
+// Format euler angles
+TCHAR*
+WebGL2Export::euler(TCHAR* buf, Point3& e)
 {
-	static TCHAR buf[50];
-	TCHAR format[20];
-	float X,  Y, Z;
-	q.GetEuler(&X, &Y, &Z);
-	SPRINTF(format, _T("%%.%dg %%.%dg %%.%dg"),
-			mDigits, mDigits, mDigits);
 	if (mZUp)
-		SPRINTF(buf, format, round(X), round(Y), round(Z));
+		Triple(buf, round(e.x), round(e.y), round(e.z), mDigits, FltGeneral);
 	else
-		SPRINTF(buf, format, round(X), round(Z), round(-Y));
-	CommaScan(buf);
+		Triple(buf, round(e.x), round(e.z), round(-e.y), mDigits, FltGeneral);
 	return buf;
 }
 
 // Indent to the given level.
 void 
-WebGL2Export::Indent(int level)
+WebGL2Export::Indent(OutBuffer& out, int level)
 {
 	if (!mIndent)
 		return;
 	assert(level >= 0);
-	for (; level; level--)
-		fwprintf(mStream, _T("  "));
+	out.Repeat(' ', 2*level);
+}
+
+void
+WebGL2Export::Indent(int level)
+{
+	Indent(*mOut, level);
 }
 	
 // Translates name (if necessary) to WebGL compliant name.
-// Returns name in static buffer, so calling a second time trashes
-// the previous contents.
+// The name is written to buffer, which must hold WEBGL_NAME_SIZE
+// characters.
 #define CTL_CHARS      31
 #define SINGLE_QUOTE   39
-static TCHAR * WebGLName(const TCHAR *name)
+#define WEBGL_NAME_SIZE 256
+static TCHAR * WebGLName(TCHAR *buffer, const TCHAR *name)
 {
-	static TCHAR buffer[256];
 	static int seqnum = 0;
 	TCHAR* cPtr;
 	int firstCharacter = 1;
 
-	_tcscpy(buffer, name);
+	_tcsncpy(buffer, name, WEBGL_NAME_SIZE - 16);
+	buffer[WEBGL_NAME_SIZE - 16] = 0;
 	cPtr = buffer;
 	while(*cPtr)
 	{
@@ -335,13 +366,13 @@ static TCHAR * WebGLName(const TCHAR *name)
 
 // Write beginning of the Transform node.
 void
-WebGL2Export::StartNode(INode* node, int level, BOOL *isFirst)
+WebGL2Export::StartNode(int level, BOOL *isFirst)
 {
 //	if (!node->IsRootNode())
 	if (!*isFirst)
-		fwprintf (mStream, _T(","));
+		mOut->Printf(_T(","));
 	*isFirst = FALSE;
-	fwprintf (mStream, _T("\n"));
+	mOut->Printf(_T("\n"));
 /*    
 	TCHAR *nodnam = mNodes.GetNodeName(node);
 	Indent(level);
@@ -369,9 +400,9 @@ WebGL2Export::EndNode(INode *node, Object* obj, int level, BOOL lastChild)
 {
 	Indent(level);
 	if (lastChild || node->GetParentNode()->IsRootNode())
-		fwprintf(mStream, _T("}\n"));
+		mOut->Printf(_T("}\n"));
 	else
-		fwprintf(mStream, _T("},\n"));    
+		mOut->Printf(_T("},\n"));    
 }
 
 /* test
@@ -393,15 +424,33 @@ HasPivot(INode* node)
 	return p.x != 0.0f || p.y != 0.0f || p.z != 0.0f;
 }
 
-// Write out the transform from the parent node to this current node.
-// Return true if it has a mirror transform
+// The object offset of a mesh node that goes into its vertices, so
+// that the node is written at its pivot.  Only an offset without
+// rotation or scale is baked.
 BOOL
-WebGL2Export::OutputNodeTransform(INode* node, int level, BOOL mirrored)
+WebGL2Export::BakedPivot(INode* node, Point3& pivot)
+{
+	if (!mBakePivot || node->IsRootNode() || !HasPivot(node))
+		return FALSE;
+	Object* obj = node->EvalWorldState(mStart).obj;
+	if (!obj || !obj->CanConvertToType(triObjectClassID) || !node->Renderable())
+		return FALSE;
+	if (!node->GetObjOffsetRot().IsIdentity())
+		return FALSE;
+	Point3 s = node->GetObjOffsetScale().s;
+	if (s.x != 1.0f || s.y != 1.0f || s.z != 1.0f)
+		return FALSE;
+	pivot = node->GetObjOffsetPos();
+	return TRUE;
+}
+
+// Capture the transform from the parent node to this current node.
+void
+WebGL2Export::CaptureTransform(INode* node, IRNode& irNode)
 {
 	// Root node is always identity
 	if (node->IsRootNode())
-		return FALSE;
-	/* FIX: NEEDS geometry AND material */
+		return;
 
 	Matrix3 tm = GetLocalTM(node, mStart);
 	int i, j;
@@ -410,6 +459,16 @@ WebGL2Export::OutputNodeTransform(INode* node, int level, BOOL mirrored)
 	Quat q;
 	float ang;
 
+	// A baked pivot moves the frame of the node, and of its children
+	if (BakedPivot(node, p))
+	{
+		tm.PreTranslate(-p);
+		for (i = 0; i < 3; i++)
+			irNode.pivot[i] = p[i];
+	}
+	if (BakedPivot(node->GetParentNode(), p))
+		tm.Translate(p);
+
 	BOOL isIdentity = TRUE;
 	for (i=0;i<3;i++) {
 		for (j=0;j<3;j++) {
@@ -419,20 +478,15 @@ WebGL2Export::OutputNodeTransform(INode* node, int level, BOOL mirrored)
 		}
 	}
 
-
 	if (isIdentity) {
 		p = tm.GetTrans();
 #ifdef MIRROR_BY_VERTICES
-		if (mirrored)
+		if (irNode.mirrored)
 			p = - p;
 #endif
-		Indent(level);
-		fwprintf(mStream, _T("\"position\": [%s],\n"), point(p));
-		Indent(level);
-		fwprintf(mStream, _T("\"rotation\": [0,0,0],\n"));
-		Indent(level);
-		fwprintf(mStream, _T("\"scale\": [1,1,1],\n"));
-		return FALSE;
+		for (i = 0; i < 3; i++)
+			irNode.position[i] = p[i];
+		return;
 	}
 	AffineParts parts;
 #ifdef DDECOMP
@@ -444,340 +498,387 @@ WebGL2Export::OutputNodeTransform(INode* node, int level, BOOL mirrored)
 	q = parts.q;
 	AngAxisFromQa(q, &ang, axis);
 #ifdef MIRROR_BY_VERTICES
-		if (mirrored)
+		if (irNode.mirrored)
 			p = - p;
 #endif
-	Indent(level);
-	fwprintf(mStream, _T("\"position\": [%s],\n"), point(p));
-	Control*rc = node->GetTMController()->GetRotationController();
-
-	Indent(level);
 	if (ang != 0.0f && ang != -0.0f)
-		fwprintf(mStream, _T("\"rotation\": [%s],\n"), quat(q));
-	else
-		fwprintf(mStream, _T("\"rotation\": [0,0,0],\n"));
+	{
+		irNode.rotated = true;
+		q.GetEuler(&irNode.euler[0], &irNode.euler[1], &irNode.euler[2]);
+	}
 	ScaleValue sv(parts.k, parts.u);
 	s = sv.s;
 #ifndef MIRROR_BY_VERTICES
 	if (parts.f < 0.0f)
 		s = - s;            // this is where we mirror by scale
 #endif
-	Indent(level);
-	if (!(AEQ(s.x, 1.0)) || !(AEQ(s.y, 1.0)) || !(AEQ(s.z, 1.0)))
-		fwprintf(mStream, _T("\"scale\": [%s],\n"), scalePoint(s));
-	else
-		fwprintf(mStream, _T("\"scale\": [1,1,1],\n"));
-	return parts.f < 0.0f;
+	for (i = 0; i < 3; i++)
+	{
+		irNode.position[i] = p[i];
+		irNode.scale[i] = s[i];
+	}
 }
 
-static BOOL
-MeshIsAllOneSmoothingGroup(Mesh& mesh)
+// Write out the captured transform of a node.
+void
+WebGL2Export::OutputNodeTransform(IRNode& node, int level)
 {
-	return FALSE;           // to put out normals whenever they're called for
-
-	int numfaces = mesh.getNumFaces();
-	unsigned int sg;
-	int i;
+	Point3 p(node.position[0], node.position[1], node.position[2]);
+	Point3 s(node.scale[0], node.scale[1], node.scale[2]);
+	TCHAR buf[FMT_BUF_SIZE];
 
-	for(i = 0; i < numfaces; i++) {
-		if (i == 0) {
-			sg = mesh.faces[i].getSmGroup();
-			if (sg == 0)
-				return FALSE;
-		}
-		else {
-			if (sg != mesh.faces[i].getSmGroup())
-				return FALSE;
-		}
+	Indent(level);
+	mOut->Printf(_T("\"position\": [%s],\n"), point(buf, p));
+	Indent(level);
+	if (node.rotated)
+	{
+		Point3 e(node.euler[0], node.euler[1], node.euler[2]);
+		mOut->Printf(_T("\"rotation\": [%s],\n"), euler(buf, e));
 	}
-	return TRUE;
+	else
+		mOut->Printf(_T("\"rotation\": [0,0,0],\n"));
+	Indent(level);
+	if (!(AEQ(s.x, 1.0)) || !(AEQ(s.y, 1.0)) || !(AEQ(s.z, 1.0)))
+		mOut->Printf(_T("\"scale\": [%s],\n"), scalePoint(buf, s));
+	else
+		mOut->Printf(_T("\"scale\": [1,1,1],\n"));
 }
 
 #define CurrentWidth() (mIndent ? 2*level : 0)
 #define MAX_WIDTH 60
 
 int
-WebGL2Export::MaybeNewLine(int width, int level)
+WebGL2Export::MaybeNewLine(OutBuffer& out, int width, int level)
 {
 	if (width > MAX_WIDTH)
 	{
-		fwprintf(mStream, _T("\n"));
-		Indent(level);
+		out.Put(_T("\n"), 1);
+		Indent(out, level);
 		return CurrentWidth();
 	}
 	return width;
 }
 
-void
-WebGL2Export::OutputNormalIndices(Mesh& mesh, NormalTable* normTab, int level,
-								 int textureNum)
+int
+WebGL2Export::MaybeNewLine(int width, int level)
 {
-	Point3 n;
-	int numfaces = mesh.getNumFaces();
-	int i = 0, j = 0, v = 0, norCnt = 0;
-	int width = CurrentWidth();
+	return MaybeNewLine(*mOut, width, level);
+}
 
-	Indent(level);
-	
-	fwprintf(mStream, _T("normalIndex [\n"));
-	Indent(level+1);
-	for (i = 0; i < numfaces; i++)
+// Return the rendering normal of corner v of face i.
+// The render normals of the mesh must have been built.
+static Point3
+CornerNormal(Mesh& mesh, int i, int v)
+{
+	int norCnt = 0;
+	int smGroup = mesh.faces[i].getSmGroup();
+	int cv = mesh.faces[i].v[v];
+	RVertex * rv = mesh.getRVertPtr(cv);
+	if (rv->rFlags & SPECIFIED_NORMAL)
+		return rv->rn.getNormal();
+	if ((norCnt = (int)(rv->rFlags & NORCT_MASK)) != 0 && smGroup)
 	{
-		int id = mesh.faces[i].getMatID();
-		if (textureNum == -1 || id == textureNum)
+		if (norCnt == 1)
+			return rv->rn.getNormal();
+		for (int j = 0; j < norCnt; j++)
 		{
-			int smGroup = mesh.faces[i].getSmGroup();
-			for(v = 0; v < 3; v++) {
-				int cv = mesh.faces[i].v[v];
-				RVertex * rv = mesh.getRVertPtr(cv);
-				if (rv->rFlags & SPECIFIED_NORMAL)
-				{
-					n = rv->rn.getNormal();
-					continue;
-				}
-				else if((norCnt = (int)(rv->rFlags & NORCT_MASK)) != 0 && smGroup)
-				{
-					if (norCnt == 1)
-						n = rv->rn.getNormal();
-					else
-					{
-						for(j = 0; j < norCnt; j++)
-						{
-							if (rv->ern[j].getSmGroup() & smGroup)
-							{
-								n = rv->ern[j].getNormal();
-								break;
-							}
-						}
-					}
-				}
-				else
-					n = mesh.getFaceNormal(i);
-				int index = normTab->GetIndex(n);
-				assert (index != -1);
-				width += fwprintf(mStream, _T("%d, "), index);
-				width = MaybeNewLine(width, level+1);
-			}
-			width += fwprintf(mStream, _T("-1, "));
-			width = MaybeNewLine(width, level+1);
+			if (rv->ern[j].getSmGroup() & smGroup)
+				return rv->ern[j].getNormal();
 		}
+		return rv->ern[0].getNormal();
 	}
-	fwprintf(mStream, _T("]\n"));
+	return mesh.getFaceNormal(i);
 }
 
-NormalTable*
-WebGL2Export::OutputNormals(Mesh& mesh, int level)
+// Build the table of unique normals of the mesh and the normal index
+// of every face corner.
+void
+WebGL2Export::CaptureNormals(Mesh& mesh, IRMesh* irMesh)
 {
-	int norCnt = 0;
-	int numverts = mesh.getNumVerts();
 	int numfaces = mesh.getNumFaces();
-	NormalTable* normTab;
-
+	NormalTable normTab(mesh.getNumVerts());
 
 	mesh.buildRenderNormals();
 
-	if (MeshIsAllOneSmoothingGroup(mesh)) {
-		return NULL;
-	}
-
-	normTab = new NormalTable();
-
-	// Otherwise we have several smoothing groups
-	for (int index = 0; index < numfaces; index++)
+	// Resolve the normal of every corner once; its index in the table
+	// is all the face writers need
+	irMesh->faceNormals.resize(3 * numfaces);
+	for (int i = 0; i < numfaces; i++)
 	{
-		int smGroup = mesh.faces[index].getSmGroup();
-		for (int i = 0; i < 3; i++)
-		{
-			int cv = mesh.faces[index].v[i];
-			RVertex * rv = mesh.getRVertPtr(cv);
-			if (rv->rFlags & SPECIFIED_NORMAL)
-			{
-				normTab->AddNormal(rv->rn.getNormal());
-			}
-			else if((norCnt = (int)(rv->rFlags & NORCT_MASK)) != 0 && smGroup)
-			{
-				if (norCnt == 1)
-					normTab->AddNormal(rv->rn.getNormal());
-				else
-					for (int j = 0; j < norCnt; j++)
-					{
-						normTab->AddNormal(rv->ern[j].getNormal());
-					}
-			}
-			else
-				normTab->AddNormal(mesh.getFaceNormal(index));
-		}
+		for (int v = 0; v < 3; v++)
+			irMesh->faceNormals[3 * i + v] =
+				normTab.AddNormal(CornerNormal(mesh, i, v));
 	}
 
-	NormalDesc* nd;
-	Indent(level);
-	fwprintf(mStream, _T("\"normals\" : [\n"));
-	int width = CurrentWidth();
-	Indent(level+1);
-
-	BOOL isFirstNormal = TRUE;
-	for (int i = 0, index = 0; i < NORM_TABLE_SIZE; i++)
-	{
-		for (nd = normTab->Get(i); nd; nd = nd->next)
-		{
-			nd->index = index++;
-			Point3 p = nd->n / NUM_NORMS;
-			if (!isFirstNormal)
-				fwprintf (mStream, _T(", "));
-			isFirstNormal = FALSE;
-			width += fwprintf(mStream, _T("%s"), normPoint(p));
-			width = MaybeNewLine(width, level+1);
-		}
-	}
-	fwprintf(mStream, _T("],\n"));
-	/*
-	Indent(level);
-	fprintf(mStream, _T("normalPerVertex TRUE\n"));
-	*/
+	// Normals are numbered in the order they were first seen
+	int numnormals = normTab.Count();
+	irMesh->normals.resize(3 * numnormals);
+	for (int i = 0; i < numnormals; i++)
+		normTab.GetNormal(i, &irMesh->normals[3 * i]);
 #ifdef DEBUG_NORM_HASH
-	normTab->PrintStats(mStream);
+	DebugPrint(_T("WebGL export: %d normals, %d slots, avg. probe %.2f, max %d\n"),
+			   numnormals, normTab.Slots(), normTab.AverageProbe(),
+			   normTab.MaxProbe());
 #endif
-
-	return normTab;
 }
 
-void
-WebGL2Export::OutputPolygonObject(INode* node, TriObject* obj, BOOL isMulti,
-							 BOOL isWire, BOOL twoSided, int level,
-							 int textureNum, BOOL pMirror)
-{
-}
+// The Plane primitive, which has no class id define of its own
+#define PLANE_PRIM_CLASS_ID Class_ID(0x81f1dfc, 0x77566f65)
 
-// Write out the data for a single triangle mesh
-void
-WebGL2Export::OutputTriObject(INode* node, TriObject* obj, BOOL isMulti,
-							 BOOL isWire, BOOL twoSided, int level,
-							 int textureNum, BOOL pMirror)
+// Capture an unmodified standard primitive that three.js can build
+// with the same shape.  Returns the index of the mesh in the scene, or
+// -1 if the node needs a real mesh: modified, textured (three.js maps
+// its primitives its own way), pre-lit, mirrored, multi-material,
+// faceted, sliced or hemispherical.  The parameters are checked against
+// the bounding box of the object before they are trusted.
+int
+WebGL2Export::CapturePrimitive(INode* node, Object* obj, IRNode& irNode)
 {
-	assert(obj);
-	Mesh &mesh = obj->GetMesh();
-	int numverts = mesh.getNumVerts();
-	int numtverts = 0;
-	int numfaces = mesh.getNumFaces();
-	int i, width;
-	NormalTable* normTab = NULL;
-	TextureDesc* td = NULL;
-	BOOL dummy;
+	if (obj != node->GetObjectRef() || irNode.mirrored || mPreLight ||
+		irNode.materials.size() > 1 || HasMeshTexture(node))
+		return -1;
 
-	Mtl *mtl = node->GetMtl();
-	if (mtl && mtl->IsMultiMtl() && textureNum != -1)
+	Class_ID id = obj->ClassID();
+	SimpleObject* so = (SimpleObject*) obj;
+	IRPrimitive prim;
+	Point3 lo, hi;
+	int smooth, slice, segs;
+	float hemi, h;
+
+	prim.kind = IR_PRIM_NONE;
+	prim.center[0] = prim.center[1] = prim.center[2] = 0.0f;
+	prim.segs[0] = prim.segs[1] = prim.segs[2] = 1;
+	if (id == Class_ID(BOXOBJ_CLASS_ID, 0))
+	{
+		prim.kind = IR_PRIM_CUBE;
+		so->pblock->GetValue(BOXOBJ_WIDTH,  mStart, prim.size[0], FOREVER);
+		so->pblock->GetValue(BOXOBJ_LENGTH, mStart, prim.size[1], FOREVER);
+		so->pblock->GetValue(BOXOBJ_HEIGHT, mStart, h, FOREVER);
+		so->pblock->GetValue(BOXOBJ_WSEGS,  mStart, prim.segs[0], FOREVER);
+		so->pblock->GetValue(BOXOBJ_LSEGS,  mStart, prim.segs[1], FOREVER);
+		so->pblock->GetValue(BOXOBJ_HSEGS,  mStart, prim.segs[2], FOREVER);
+		prim.size[0] = (float) fabs(prim.size[0]);
+		prim.size[1] = (float) fabs(prim.size[1]);
+		prim.size[2] = (float) fabs(h);
+		prim.center[2] = h / 2.0f;     // MAX boxes grow from z=0
+		lo = Point3(-prim.size[0] / 2.0f, -prim.size[1] / 2.0f, h < 0.0f ? h : 0.0f);
+		hi = Point3(prim.size[0] / 2.0f, prim.size[1] / 2.0f, h < 0.0f ? 0.0f : h);
+	}
+	else if (id == Class_ID(SPHERE_CLASS_ID, 0))
+	{
+		int basePivot;
+		so->pblock->GetValue(SPHERE_SMOOTH, mStart, smooth, FOREVER);
+		so->pblock->GetValue(SPHERE_HEMI, mStart, hemi, FOREVER);
+		so->pblock->GetValue(SPHERE_SLICEON, mStart, slice, FOREVER);
+		if (!smooth || slice || hemi > 0.0f)
+			return -1;
+		prim.kind = IR_PRIM_SPHERE;
+		so->pblock->GetValue(SPHERE_RADIUS, mStart, prim.size[0], FOREVER);
+		so->pblock->GetValue(SPHERE_SEGS, mStart, segs, FOREVER);
+		so->pblock->GetValue(SPHERE_RECENTER, mStart, basePivot, FOREVER);
+		prim.size[1] = prim.size[2] = 0.0f;
+		prim.segs[0] = segs;
+		prim.segs[1] = segs / 2;
+		if (basePivot)
+			prim.center[2] = prim.size[0];
+		lo = Point3(-prim.size[0], -prim.size[0], prim.center[2] - prim.size[0]);
+		hi = Point3(prim.size[0], prim.size[0], prim.center[2] + prim.size[0]);
+	}
+	else if (id == Class_ID(CYLINDER_CLASS_ID, 0) ||
+			 id == Class_ID(CONE_CLASS_ID, 0))
 	{
-		if (mtl != NULL)
+		float r1, r2;
+		if (id == Class_ID(CYLINDER_CLASS_ID, 0))
 		{
-			mtl = mtl->GetSubMtl(textureNum);
-			td = GetMtlTex(mtl, dummy);
+			so->pblock->GetValue(CYLINDER_SMOOTH, mStart, smooth, FOREVER);
+			so->pblock->GetValue(CYLINDER_SLICEON, mStart, slice, FOREVER);
+			so->pblock->GetValue(CYLINDER_RADIUS, mStart, r1, FOREVER);
+			so->pblock->GetValue(CYLINDER_HEIGHT, mStart, h, FOREVER);
+			so->pblock->GetValue(CYLINDER_SIDES, mStart, prim.segs[0], FOREVER);
+			so->pblock->GetValue(CYLINDER_SEGMENTS, mStart, prim.segs[1], FOREVER);
+			r2 = r1;
+		}
+		else
+		{
+			so->pblock->GetValue(CONE_SMOOTH, mStart, smooth, FOREVER);
+			so->pblock->GetValue(CONE_SLICEON, mStart, slice, FOREVER);
+			so->pblock->GetValue(CONE_RADIUS1, mStart, r1, FOREVER);
+			so->pblock->GetValue(CONE_RADIUS2, mStart, r2, FOREVER);
+			so->pblock->GetValue(CONE_HEIGHT, mStart, h, FOREVER);
+			so->pblock->GetValue(CONE_SIDES, mStart, prim.segs[0], FOREVER);
+			so->pblock->GetValue(CONE_SEGMENTS, mStart, prim.segs[1], FOREVER);
 		}
+		if (!smooth || slice)
+			return -1;
+		// radius1 is at z=0, which is the top of a negative height
+		prim.kind = IR_PRIM_CYLINDER;
+		prim.size[0] = h < 0.0f ? r1 : r2;
+		prim.size[1] = h < 0.0f ? r2 : r1;
+		prim.size[2] = (float) fabs(h);
+		prim.center[2] = h / 2.0f;
+		float r = r1 > r2 ? r1 : r2;
+		lo = Point3(-r, -r, h < 0.0f ? h : 0.0f);
+		hi = Point3(r, r, h < 0.0f ? 0.0f : h);
 	}
-	else
-		td = GetMatTex(node, dummy);
-
-	if (td)
-		numtverts = mesh.getNumTVerts();
-
-	if (numfaces == 0)
+	else if (id == PLANE_PRIM_CLASS_ID)
 	{
-		delete td;
-		return;
+		// A flat plane looks the same with one segment; the size comes
+		// from the bounds, the parameter block is not SimpleObject's
+		Box3 box;
+		obj->GetDeformBBox(mStart, box);
+		prim.kind = IR_PRIM_PLANE;
+		prim.size[0] = box.pmax.x - box.pmin.x;
+		prim.size[1] = box.pmax.y - box.pmin.y;
+		prim.size[2] = 0.0f;
+		lo = Point3(-prim.size[0] / 2.0f, -prim.size[1] / 2.0f, 0.0f);
+		hi = Point3(prim.size[0] / 2.0f, prim.size[1] / 2.0f, 0.0f);
 	}
-	
-	if (mSceneFile)
+	else
+		return -1;
+
+	// The tessellated bounds of round primitives are a little smaller
+	Box3 box;
+	obj->GetDeformBBox(mStart, box);
+	float tolerance = 0.02f * Length(hi - lo) + 1e-4f;
+	if (Length(box.pmin - lo) > tolerance || Length(box.pmax - hi) > tolerance)
+		return -1;
+	for (int i = 0; i < 3; i++)
 	{
-		Indent(level++);
-		fwprintf(mStream, _T("\"%s_emb\" : {\n"), mNodes.GetNodeName(node)); // open emb
+		if (prim.segs[i] < 1)
+			prim.segs[i] = 1;
 	}
-	Indent(level+1);
-	fwprintf(mStream, _T("\"scale\" : 1.0,\n"));
-	Indent(level+1);
-	fwprintf(mStream, _T("\"materials\" : [\n"));
 
-	BOOL isFirstMat = TRUE;
-	int numTextures = NumTextures(node);
-	int start, end;
+	IRMesh* irMesh = new IRMesh;
+	irMesh->prim = prim;
+	mPrimitiveCount++;
+	return mScene.AddMesh(irMesh);
+}
 
-	if (numTextures == 0)
+// Write the parameters of a primitive geometry.  The three.js
+// primitives are centered, with the axis of cylinders and spheres
+// along y and planes facing z; "rotation" and "offset" place them
+// where MAX has them.
+void
+WebGL2Export::OutputPrimitive(IRPrimitive& prim, int level)
+{
+	TCHAR buf[FMT_BUF_SIZE];
+	float rotation = 0.0f;      // about x
+
+	Indent(level);
+	switch (prim.kind)
 	{
-		start = -1;
-		end = 0;
+	case IR_PRIM_CUBE:
+		mOut->Printf(_T("\"type\": \"cube\",\n"));
+		Indent(level);
+		mOut->Printf(_T("\"width\": %s,\n"), floatVal(buf, prim.size[0]));
+		Indent(level);
+		mOut->Printf(_T("\"height\": %s,\n"), floatVal(buf, prim.size[mZUp ? 1 : 2]));
+		Indent(level);
+		mOut->Printf(_T("\"depth\": %s,\n"), floatVal(buf, prim.size[mZUp ? 2 : 1]));
+		Indent(level);
+		mOut->Printf(_T("\"segmentsWidth\": %d,\n"), prim.segs[0]);
+		Indent(level);
+		mOut->Printf(_T("\"segmentsHeight\": %d,\n"), prim.segs[mZUp ? 1 : 2]);
+		Indent(level);
+		mOut->Printf(_T("\"segmentsDepth\": %d,\n"), prim.segs[mZUp ? 2 : 1]);
+		break;
+	case IR_PRIM_SPHERE:
+		mOut->Printf(_T("\"type\": \"sphere\",\n"));
+		Indent(level);
+		mOut->Printf(_T("\"radius\": %s,\n"), floatVal(buf, prim.size[0]));
+		Indent(level);
+		mOut->Printf(_T("\"segmentsWidth\": %d,\n"), prim.segs[0]);
+		Indent(level);
+		mOut->Printf(_T("\"segmentsHeight\": %d,\n"), prim.segs[1]);
+		if (mZUp)
+			rotation = float(PI/2.0);
+		break;
+	case IR_PRIM_CYLINDER:
+		mOut->Printf(_T("\"type\": \"cylinder\",\n"));
+		Indent(level);
+		mOut->Printf(_T("\"topRad\": %s,\n"), floatVal(buf, prim.size[0]));
+		Indent(level);
+		mOut->Printf(_T("\"botRad\": %s,\n"), floatVal(buf, prim.size[1]));
+		Indent(level);
+		mOut->Printf(_T("\"height\": %s,\n"), floatVal(buf, prim.size[2]));
+		Indent(level);
+		mOut->Printf(_T("\"radSegs\": %d,\n"), prim.segs[0]);
+		Indent(level);
+		mOut->Printf(_T("\"heightSegs\": %d,\n"), prim.segs[1]);
+		if (mZUp)
+			rotation = float(PI/2.0);
+		break;
+	case IR_PRIM_PLANE:
+		mOut->Printf(_T("\"type\": \"plane\",\n"));
+		Indent(level);
+		mOut->Printf(_T("\"width\": %s,\n"), floatVal(buf, prim.size[0]));
+		Indent(level);
+		mOut->Printf(_T("\"height\": %s,\n"), floatVal(buf, prim.size[1]));
+		Indent(level);
+		mOut->Printf(_T("\"segmentsWidth\": 1,\n"));
+		Indent(level);
+		mOut->Printf(_T("\"segmentsHeight\": 1,\n"));
+		if (!mZUp)
+			rotation = float(-PI/2.0);
+		break;
 	}
-	else
+	if (rotation != 0.0f)
 	{
-		start = 0;
-		end = numTextures;
+		Indent(level);
+		mOut->Printf(_T("\"rotation\": [%s,0,0],\n"), floatVal(buf, rotation));
 	}
-	int old_level = level;
-	for (int i = start; i < end; i++)
-	{
-		BOOL multiMat = FALSE;
-		BOOL isWire = FALSE, twoSided = FALSE;
+	// ConvertMeshes put the center in the space of the scene file
+	Indent(level);
+	mOut->Printf(_T("\"offset\": [%s]\n"), meshPoint(buf, prim.center));
+}
 
-		multiMat = OutputMaterial(node, isWire, twoSided, level+1, i, &isFirstMat, EMBEDS);
-	}
+// Capture the triangle mesh of a node, returns the index of the mesh
+// in the scene or -1.
+int
+WebGL2Export::CaptureMesh(Object* obj, BOOL textured)
+{
+	TriObject *tri = (TriObject *)obj->ConvertToType(mStart, triObjectClassID);
+	if (!tri)
+		return -1;
 
-	fwprintf(mStream, _T("],\n"));
-	Indent(level+1);
-	fwprintf(mStream, _T("\"metadata\" : { \"formatVersion\" : 3 },\n"));
+	Mesh &mesh = tri->GetMesh();
+	int numverts = mesh.getNumVerts();
+	int numtverts = textured ? mesh.getNumTVerts() : 0;
+	int numfaces = mesh.getNumFaces();
+	int i, j;
 
-/*
-	if (!isWire)
+	IRMesh* irMesh = new IRMesh;
+
+	irMesh->verts.resize(3 * numverts);
+	for (i = 0; i < numverts; i++)
 	{
-		Indent(level);
-		fprintf(mStream, _T("ccw %s\n"), pMirror ? _T("FALSE") : _T("TRUE"));
-		Indent(level);
-		fprintf(mStream, _T("solid %s\n"),
-							twoSided ? _T("FALSE") : _T("TRUE"));
+		Point3& p = mesh.verts[i];
+		irMesh->verts[3 * i]     = p.x;
+		irMesh->verts[3 * i + 1] = p.y;
+		irMesh->verts[3 * i + 2] = p.z;
 	}
-*/
+
+	irMesh->tverts.resize(2 * numtverts);
+	for (i = 0; i < numtverts; i++)
+	{
+		UVVert uv = mesh.getTVert(i);
+		irMesh->tverts[2 * i]     = uv.x;
+		irMesh->tverts[2 * i + 1] = uv.y;
+	}
+
 	if (mPreLight)
 	{
 		int numCVerts = mesh.getNumVertCol();
 		if (numCVerts)
 		{
-			VertColor vColor;
-			Indent(level);
-			fwprintf(mStream, _T("\"vertexColors\": true // THIS GOES IN MATERIAL!\n"));
-			Indent(level);
-			width = CurrentWidth();
-			fwprintf(mStream, _T("\"colors\" : [\n"));
-			Indent(level+1);
-			// FIXME need to add colorlist to PMesh
+			irMesh->colors.resize(3 * numverts);
 			for (i = 0; i < numverts; i++)
 			{
-				vColor = mesh.vertCol[i];
-				if (i == numverts - 1)
-					width += fwprintf(mStream, _T("%s "), color(vColor));
-				else
-					width += fwprintf(mStream, _T("%s, "), color(vColor));
-				width = MaybeNewLine(width, level+1);
-			}
-			Indent(level);
-			fwprintf(mStream, _T("],\n"));
-/*
-			Indent(level);
-			fprintf(mStream, _T("colorIndex [\n"));
-			width = CurrentWidth();
-			Indent(level+1);
-
-			for (i = 0; i < numfaces; i++) {
-				int id = mesh.faces[i].getMatID();
-				if (textureNum == -1 || id == textureNum) {
-					if (!(mesh.faces[i].flags & FACE_HIDDEN)) {
-						width += fprintf(mStream, _T("%d, %d, %d, -1"),
-								mesh.faces[i].v[0], mesh.faces[i].v[1],
-								mesh.faces[i].v[2]);
-						if (i != numfaces-1) {
-							width += fprintf(mStream, _T(", "));
-							width = MaybeNewLine(width, level+1);
-						}
-					}
-				}
+				VertColor vColor = i < numCVerts ? mesh.vertCol[i] : VertColor(0, 0, 0);
+				irMesh->colors[3 * i]     = vColor.x;
+				irMesh->colors[3 * i + 1] = vColor.y;
+				irMesh->colors[3 * i + 2] = vColor.z;
 			}
-			fprintf(mStream, _T("]\n"));
-*/
 		}
 		else
 		{
@@ -785,165 +886,330 @@ WebGL2Export::OutputTriObject(INode* node, TriObject* obj, BOOL isMulti,
 		}
 	}
 
-	int numColors = 0;
-	if (!mPreLight && isMulti && textureNum == -1)
+	irMesh->faces.resize(numfaces);
+	for (i = 0; i < numfaces; i++)
 	{
-		Color c;
-		Indent(level);
-		fwprintf(mStream, _T("\"vertexColors\" : false // THIS BELONGS IN MATERIAL\n"));
-		Mtl *sub, *mtl = node->GetMtl();
-		assert (mtl->IsMultiMtl());
-		int num = mtl->NumSubMtls();
-		Indent(level);
-		width = CurrentWidth();
-		fwprintf(mStream, _T("\"colors\" : [\n"));
-		Indent(level+1);
-		for (i = 0; i < num; i++)
+		Face& face = mesh.faces[i];
+		IRFace& f = irMesh->faces[i];
+		for (j = 0; j < 3; j++)
 		{
-			sub = mtl->GetSubMtl(i);
-			if (!sub)
-				continue;
-			numColors++;
-			c = sub->GetDiffuse(mStart);
-			if (i == num - 1)
-				width += fwprintf(mStream, _T("%s "), color(c));
-			else
-				width += fwprintf(mStream, _T("%s, "), color(c));
-			width = MaybeNewLine(width, level+1);
+			f.v[j] = face.v[j];
+			f.t[j] = numtverts > 0 ? mesh.tvFace[i].t[j] : 0;
 		}
-		Indent(level);
-		fwprintf(mStream, _T("],\n"));
+		f.matID   = face.getMatID();
+		f.smGroup = face.getSmGroup();
+		f.edgeVis = 0;
+		for (j = 0; j < 3; j++)
+		{
+			if (face.getEdgeVis(j))
+				f.edgeVis |= 1 << j;
+		}
+		f.hidden  = (face.flags & FACE_HIDDEN) != 0;
 	}
 
-	if (textureNum < 1)
-	{
-		// Output the vertices
-		Indent(level);
-		fwprintf(mStream, _T("\"vertices\" : [\n"));
+	CaptureNormals(mesh, irMesh);
 
-		width = CurrentWidth();
-		Indent(level+1);
-		for (i = 0; i < numverts; i++)
-		{
-			Point3 p = mesh.verts[i];
-#ifdef MIRROR_BY_VERTICES
-			if (pMirror)
-				p = - p;
-#endif
-			width += fwprintf(mStream, _T("%s"), point(p));
-			if (i == numverts-1)
-			{
-				fwprintf(mStream, _T("],\n"));
-			}
-			else
+	if (tri != obj)
+		tri->DeleteMe();
+
+	return mScene.AddMesh(irMesh);
+}
+
+// Write n integers separated by commas
+static int
+PutInts(OutBuffer& out, const int* q, int n)
+{
+	int width = 0;
+	for (int i = 0; i < n; i++)
+	{
+		if (i > 0)
+			width += out.Put(_T(","), 1);
+		width += out.PutInt(q[i]);
+	}
+	return width;
+}
+
+// Quantize the attributes of a mesh the way they are written to the
+// scene: converted by ConvertMeshes, v flipped.  Unless the bits are
+// fixed, every position must come back within half the last digit
+// written without quantization; returns false if no bits manage it,
+// and the mesh is written as floats.
+bool
+WebGL2Export::QuantizeMesh(IRNode& node, QuantMesh& q)
+{
+	IRMesh& mesh = *mScene.meshes[node.mesh];
+	int nv = mesh.NumVerts(), nn = mesh.NumNormals(), nt = mesh.NumTVerts();
+	std::vector<float> verts(mesh.verts), normals(mesh.normals), tverts(2 * nt + 2);
+	int i;
+
+	verts.resize(3 * nv + 3);
+	normals.resize(3 * nn + 3);
+	for (i = 0; i < nt; i++)
+	{
+		tverts[2 * i] = mesh.tverts[2 * i];
+		tverts[2 * i + 1] = 1.0f - mesh.tverts[2 * i + 1];
+	}
+
+	double tolerance = 0.5 * pow(10.0, -mDigits);
+	int bits = mQuantBits;
+	if (bits > 0)
+	{
+		q.normBits = bits <= 12 ? 8 : 16;
+		QuantVectors(&verts[0], nv, 3, bits, q.pos, q.verts);
+	}
+	else
+	{
+		if (QuantPositions(&verts[0], nv, tolerance, q.pos, q.verts) == 0)
+			return false;
+		q.normBits = QuantNormalBits(&normals[0], nn, tolerance);
+	}
+	QuantVectors(&tverts[0], nt, 2, QUANT_UV_BITS, q.uv, q.tverts);
+	QuantNormals(&normals[0], nn, q.normBits, q.normals);
+	return true;
+}
+
+// Write the dequantization parameters of a mesh, as members of its
+// metadata
+void
+WebGL2Export::OutputQuantization(OutBuffer& out, QuantMesh& q)
+{
+	out.Printf(_T(", \"quantization\" : {\n"));
+	out.Printf(_T("\"position\" : { \"bits\" : %d, \"min\" : [%.9g,%.9g,%.9g], \"scale\" : [%.9g,%.9g,%.9g] },\n"),
+			   q.pos.bits, q.pos.min[0], q.pos.min[1], q.pos.min[2],
+			   q.pos.scale[0], q.pos.scale[1], q.pos.scale[2]);
+	out.Printf(_T("\"uv\" : { \"bits\" : %d, \"min\" : [%.9g,%.9g], \"scale\" : [%.9g,%.9g] },\n"),
+			   q.uv.bits, q.uv.min[0], q.uv.min[1], q.uv.scale[0], q.uv.scale[1]);
+	out.Printf(_T("\"normal\" : { \"bits\" : %d, \"encoding\" : \"octahedral\" } }"),
+			   q.normBits);
+}
+
+// Whether face i of a mesh starts a face record: visible, and not the
+// second triangle of a quad
+static bool
+StartsRecord(const IRMesh& mesh, int i)
+{
+	if (mesh.faces[i].hidden)
+		return false;
+	return mesh.quads.empty() || mesh.quads[i] < 0 || mesh.quads[i] > i;
+}
+
+// Write the range of face records of each material, as a member of the
+// metadata of a mesh whose faces GroupFaces sorted by material, so a
+// loader can draw each material once without looking at every face
+void
+WebGL2Export::OutputFaceGroups(OutBuffer& out, IRMesh& mesh)
+{
+	int start = 0, count = 0, matID = -1;
+	BOOL isFirst = TRUE;
+
+	out.Printf(_T(", \"groups\" : ["));
+	for (int i = 0; i <= mesh.NumFaces(); i++)
+	{
+		if (i < mesh.NumFaces() && !StartsRecord(mesh, i))
+			continue;
+		if (i == mesh.NumFaces() || mesh.faces[i].matID != matID)
+		{
+			if (count > 0)
 			{
-				width += fwprintf(mStream, _T(", "));
-				width = MaybeNewLine(width, level+1);
+				out.Printf(_T("%s\n{ \"start\" : %d, \"count\" : %d, \"materialIndex\" : %d }"),
+						   isFirst ? _T("") : _T(","), start, count, matID);
+				isFirst = FALSE;
 			}
+			if (i == mesh.NumFaces())
+				break;
+			start += count;
+			count = 0;
+			matID = mesh.faces[i].matID;
 		}
+		count++;
 	}
-	else // texture num > 0
+	out.Printf(_T(" ]"));
+}
+
+// Number of elements of one part of a mesh, the range OutputMeshPart
+// can be called with
+int
+WebGL2Export::MeshPartSize(IRMesh& mesh, MeshPart part)
+{
+	switch (part)
 	{
-		Indent(level);
-		fwprintf(mStream, _T("TO DO AROUND LINE 774\n"),mNodes.GetNodeName(node));
+	case MESH_VERTICES: return mesh.NumVerts();
+	case MESH_NORMALS:  return mesh.NumNormals();
+	case MESH_UVS:      return mesh.NumTVerts();
+	case MESH_FACES:    return mesh.NumFaces();
+	default:            return 1;
 	}
-	// Output the normals
-	// FIXME share normals on multi-texture objects
-	if (true || mGenNormals && !isWire)
+}
+
+// Write elements [first, last) of one part of a triangle mesh.  The
+// first range of a part writes its opening and the last one its
+// closing, so writing every range of every part in order gives the
+// whole mesh.  A range that does not start the part picks up the line
+// where the previous one left it, counting the line as empty.  Only
+// reads the captured scene, so ranges can be written on several
+// threads at once.
+void
+WebGL2Export::OutputMeshPart(OutBuffer& out, IRNode& node, int level,
+							 MeshPart part, int first, int last)
+{
+	IRMesh& mesh = *mScene.meshes[node.mesh];
+	QuantMesh* quant = mQuantMesh.empty() ? NULL : mQuantMesh[node.mesh];
+	int numverts = mesh.NumVerts();
+	int numtverts = mesh.NumTVerts();
+	int numnormals = mesh.NumNormals();
+	int numfaces = mesh.NumFaces();
+	int i, width;
+	TCHAR buf[FMT_BUF_SIZE];
+
+	if (mSceneFile)
 	{
-		normTab = OutputNormals(mesh, level);
+		if (part == MESH_HEAD)
+		{
+			Indent(out, level);
+			out.Printf(_T("\"%s_emb\" : {\n"), node.name.c_str()); // open emb
+		}
+		level++;
 	}
 
-	// Output Texture coordinates (UV's)
-	Indent(level);
-	fwprintf(mStream, _T("\"uvs\" : [[\n"),mNodes.GetNodeName(node));
-	if (numtverts > 0 && (td || textureNum == 0) && !isWire)
+	switch (part)
 	{
-		if (textureNum < 1)
+	case MESH_HEAD:
+	{
+		Indent(out, level+1);
+		out.Printf(_T("\"scale\" : 1.0,\n"));
+		Indent(out, level+1);
+		out.Printf(_T("\"materials\" : [\n"));
+
+		BOOL isFirstMat = TRUE;
+		for (i = 0; i < (int) node.materials.size(); i++)
+			OutputEmbedMaterial(out, node, i, level+1, &isFirstMat);
+
+		out.Printf(_T("],\n"));
+		Indent(out, level+1);
+		out.Printf(_T("\"metadata\" : { \"formatVersion\" : 3"));
+		if (quant)
+			OutputQuantization(out, *quant);
+		if (node.materials.size() > 1)
+			OutputFaceGroups(out, mesh);
+		out.Printf(_T(" },\n"));
+
+		if (!mesh.colors.empty())
 		{
+			Indent(out, level);
+			out.Printf(_T("\"vertexColors\": true // THIS GOES IN MATERIAL!\n"));
+			Indent(out, level);
 			width = CurrentWidth();
-			Indent(level+1);
-			for (i = 0; i < numtverts; i++)
+			out.Printf(_T("\"colors\" : [\n"));
+			Indent(out, level+1);
+			for (i = 0; i < numverts; i++)
 			{
-				if (i > 0)
-				{
-					width += fwprintf(mStream, _T(", "));
-					width = MaybeNewLine(width, level+1);
-				}
-				Point3 uvw = mesh.tVerts[i];
-				UVVert p = mesh.getTVert(i);
-				width += fwprintf(mStream, _T("%s"), texture(p));
+				Point3 vColor(mesh.colors[3 * i], mesh.colors[3 * i + 1], mesh.colors[3 * i + 2]);
+				width += out.Put(color(buf, vColor));
+				if (i == numverts - 1)
+					width += out.Put(_T(" "), 1);
+				else
+					width += out.Put(_T(", "), 2);
+				width = MaybeNewLine(out, width, level+1);
 			}
+			Indent(out, level);
+			out.Printf(_T("],\n"));
 		}
-		/*
-		else
-		{
-			Indent(level);
-			fprintf(mStream, _T("texCoord USE %s-TEXCOORD\n"),mNodes.GetNodeName(node));
-		}
-		*/
+		break;
 	}
-	fwprintf(mStream, _T("\n"));
-	Indent(level);
-	fwprintf(mStream, _T("]],\n"));
 
-	/*
-	if (numtverts > 0 && td && !isWire) {
-		Indent(level);
-		fprintf(mStream, _T("texCoordIndex [\n"));
-		Indent(level+1);
+	case MESH_VERTICES:
+		if (first == 0)
+		{
+			Indent(out, level);
+			out.Printf(_T("\"vertices\" : [\n"));
+		}
 		width = CurrentWidth();
-		for(i = 0; i < numfaces; i++) {
-			int id = mesh.faces[i].getMatID();
-			if (textureNum == -1 || id == textureNum) {
-				if (!(mesh.faces[i].flags & FACE_HIDDEN)) {
-					width += fprintf(mStream, _T("%d, %d, %d, -1"),
-									 mesh.tvFace[i].t[0], mesh.tvFace[i].t[1],
-									 mesh.tvFace[i].t[2]);
-					if (i != numfaces-1) {
-						width += fprintf(mStream, _T(", "));
-						width = MaybeNewLine(width, level+1);
-					}
-				}
+		if (first == 0)
+			Indent(out, level+1);
+		for (i = first; i < last; i++)
+		{
+			if (quant)
+				width += PutInts(out, &quant->verts[3 * i], 3);
+			else
+				width += out.Put(meshPoint(buf, &mesh.verts[3 * i]));
+			if (i == numverts-1)
+			{
+				out.Put(_T("],\n"), 3);
+			}
+			else
+			{
+				width += out.Put(_T(", "), 2);
+				width = MaybeNewLine(out, width, level+1);
 			}
 		}
-		fprintf(mStream, _T("]\n"));
-	}
+		break;
 
-	if (!mPreLight && isMulti && numColors > 0 && textureNum == -1) {
-		Indent(level);
-		fprintf(mStream, _T("colorIndex [\n"));
+	case MESH_NORMALS:
+		// The unique normals of the mesh
+		if (first == 0)
+		{
+			Indent(out, level);
+			out.Printf(_T("\"normals\" : [\n"));
+		}
 		width = CurrentWidth();
-		Indent(level+1);
-		for(i = 0; i < numfaces; i++) {
-			if (!(mesh.faces[i].flags & FACE_HIDDEN)) {
-				int id = mesh.faces[i].getMatID();
-				id = (id % numColors);   // this is the way MAX does it
-//				if (id >= numColors)
-//					id = 0;
-				width += fprintf(mStream, _T("%d"), id);
-				if (i != numfaces-1) {
-					width += fprintf(mStream, _T(", "));
-					width = MaybeNewLine(width, level+1);
-				}
+		if (first == 0)
+			Indent(out, level+1);
+		for (i = first; i < last; i++)
+		{
+			if (i > 0)
+				out.Put(_T(", "), 2);
+			if (quant)
+				width += PutInts(out, &quant->normals[2 * i], 2);
+			else
+				width += out.Put(meshNormal(buf, &mesh.normals[3 * i]));
+			width = MaybeNewLine(out, width, level+1);
+		}
+		if (last == numnormals)
+			out.Printf(_T("],\n"));
+		break;
+
+	case MESH_UVS:
+		// Texture coordinates (UV's)
+		if (first == 0)
+		{
+			Indent(out, level);
+			out.Printf(_T("\"uvs\" : [[\n"));
+		}
+		width = CurrentWidth();
+		if (first == 0 && numtverts > 0)
+			Indent(out, level+1);
+		for (i = first; i < last; i++)
+		{
+			if (i > 0)
+			{
+				width += out.Put(_T(", "), 2);
+				width = MaybeNewLine(out, width, level+1);
 			}
+			UVVert p(mesh.tverts[2 * i], mesh.tverts[2 * i + 1], 0.0f);
+			if (quant)
+				width += PutInts(out, &quant->tverts[2 * i], 2);
+			else
+				width += out.Put(texture(buf, p));
 		}
-		fprintf(mStream, _T("],\n"));
-	}
-*/
-//	if (mGenNormals && normTab && !isWire) {
-//		OutputNormalIndices(mesh, normTab, level, textureNum);
-//		delete normTab;
-//	}
-		
-	// Output the triangles
-	Indent(level);
-	fwprintf(mStream, _T("\"faces\" : [\n"));
-	Indent(level+1);
-	width = CurrentWidth();
+		if (last == numtverts)
+		{
+			out.Printf(_T("\n"));
+			Indent(out, level);
+			out.Printf(_T("]],\n"));
+		}
+		break;
 
-	for (i = 0; i < numfaces; i++)
+	case MESH_FACES:
 	{
+		// The triangles
+		if (first == 0)
+		{
+			Indent(out, level);
+			out.Printf(_T("\"faces\" : [\n"));
+			Indent(out, level+1);
+		}
+		width = CurrentWidth();
+
 /*
 	isQuad          	= isBitSet( type, 0 );
 	hasMaterial         = isBitSet( type, 1 );
@@ -954,76 +1220,278 @@ WebGL2Export::OutputTriObject(INode* node, TriObject* obj, BOOL isMulti,
 	hasFaceColor	    = isBitSet( type, 6 );
 	hasFaceVertexColor  = isBitSet( type, 7 );
 */
-		int j = 0, v = 0, norCnt = 0;
-		Point3 n;
 		int bitField = 0;
 		bitField |= 2; // materials
 		bitField |= 32; // normals
 		if (numtverts > 0)
 			bitField |= 8; // ONLY IF IT HAS A TEXTURE
-		int id = mesh.faces[i].getMatID();
-		if (!(mesh.faces[i].flags & FACE_HIDDEN))
+
+		// The separator goes before every face record but the first
+		// one of the whole mesh
+		BOOL isFirstFace = TRUE;
+		for (i = 0; i < first && isFirstFace; i++)
+			isFirstFace = !StartsRecord(mesh, i);
+
+		for (i = first; i < last; i++)
 		{
+			if (!StartsRecord(mesh, i))
+				continue;
 
-			if (i > 0)
+			// Corners as face corner indices; a quad takes the corners
+			// of its two triangles
+			int corners[4], numcorners = 3, v;
+			if (!mesh.quads.empty() && mesh.quads[i] >= 0)
+			{
+				QuadCorners(mesh, i, mesh.quads[i], corners);
+				numcorners = 4;
+			}
+			else
 			{
-				width += fwprintf(mStream, _T(","));
-				width = MaybeNewLine(width, level+1);
+				for (v = 0; v < 3; v++)
+					corners[v] = 3 * i + v;
 			}
+
+			if (!isFirstFace)
+			{
+				width += out.Put(_T(","), 1);
+				width = MaybeNewLine(out, width, level+1);
+			}
+			isFirstFace = FALSE;
 			// NOTE! This 5th item is 'material index'
-			width += fwprintf(mStream, _T("%d, %d, %d, %d, %d"), bitField,
-								mesh.faces[i].v[0], mesh.faces[i].v[1],
-								mesh.faces[i].v[2], id);
+			width += out.PutInt(numcorners == 4 ? bitField | 1 : bitField);
+			for (v = 0; v < numcorners; v++)
+			{
+				width += out.Put(_T(", "), 2);
+				width += out.PutInt(mesh.faces[corners[v] / 3].v[corners[v] % 3]);
+			}
+			width += out.Put(_T(", "), 2);
+			width += out.PutInt(mesh.faces[i].matID);
 			if (numtverts > 0) // has UVs
 			{
-				int id = mesh.faces[i].getMatID();
-				if (!(mesh.faces[i].flags & FACE_HIDDEN))
+				for (v = 0; v < numcorners; v++)
 				{
-					width += fwprintf(mStream, _T(", %d,%d,%d"),
-										mesh.tvFace[i].t[0], mesh.tvFace[i].t[1],
-										mesh.tvFace[i].t[2]);
+					width += out.Put(v == 0 ? _T(", ") : _T(","));
+					width += out.PutInt(mesh.faces[corners[v] / 3].t[corners[v] % 3]);
 				}
 			}
-			int smGroup = mesh.faces[i].getSmGroup();
-			for (v = 0; v < 3; v++)
+			for (v = 0; v < numcorners; v++)
 			{
-				int cv = mesh.faces[i].v[v];
-				RVertex * rv = mesh.getRVertPtr(cv);
-				if (rv->rFlags & SPECIFIED_NORMAL)
-				{
-					n = rv->rn.getNormal();
-					continue;
-				}
-				else if ((norCnt = (int)(rv->rFlags & NORCT_MASK)) != 0 && smGroup)
-				{
-					if (norCnt == 1)
-						n = rv->rn.getNormal();
-					else
-						for (j = 0; j < norCnt; j++)
-						{
-							if (rv->ern[j].getSmGroup() & smGroup)
-							{
-								n = rv->ern[j].getNormal();
-								break;
-							}
-						}
-				}
-				else
-					n = mesh.getFaceNormal(i);
-				int index = normTab->GetIndex(n);
-				assert (index != -1);
-				width += fwprintf(mStream, _T(",%d"), index);
-				width = MaybeNewLine(width, level+1);
+				width += out.Put(_T(","), 1);
+				width += out.PutInt(mesh.faceNormals[corners[v]]);
+				width = MaybeNewLine(out, width, level+1);
 			}
 		}
-	}
-	fwprintf(mStream, _T("]\n"));
+		if (last == numfaces)
+		{
+			out.Printf(_T("]\n"));
 	
-	Indent(--level);
-	//if (mSceneFile)
-		fwprintf(mStream, _T("}")); // close emb
-	delete td;
+			Indent(out, --level);
+			//if (mSceneFile)
+				out.Printf(_T("}")); // close emb
+		}
+		break;
+	}
+
+	default:
+		break;
+	}
+}
+
+// Write out the data for a single triangle mesh.  Only reads the
+// captured scene, so meshes can be written on several threads at once.
+void
+WebGL2Export::OutputTriObject(OutBuffer& out, IRNode& node, int level)
+{
+	IRMesh& mesh = *mScene.meshes[node.mesh];
+
+	if (mesh.NumFaces() == 0)
+		return;
+
+	for (int part = MESH_HEAD; part <= MESH_FACES; part++)
+		OutputMeshPart(out, node, level, (MeshPart) part, 0,
+					   MeshPartSize(mesh, (MeshPart) part));
+}
+
+// Write a triangle mesh as one interleaved vertex array and one index
+// array, the layout of a three.js BufferGeometry, so the browser does
+// not have to expand the faces to one vertex per corner.  Returns the
+// number of vertices left after welding.
+int
+WebGL2Export::OutputBufferMesh(OutBuffer& out, IRNode& node, int level)
+{
+	IRMesh& mesh = *mScene.meshes[node.mesh];
+	QuantMesh* quant = mQuantMesh.empty() ? NULL : mQuantMesh[node.mesh];
+	BOOL hasUVs = mesh.NumTVerts() > 0;
+	BOOL hasColors = !mesh.colors.empty();
+	int i, width;
+	TCHAR buf[FMT_BUF_SIZE];
+	WeldedMesh welded;
+
+	if (mesh.NumFaces() == 0)
+		return 0;
+
+	WeldMesh(mesh, welded);
+	int numverts = welded.NumVerts();
+	int numindices = (int) welded.indices.size();
+
+	if (mSceneFile)
+	{
+		Indent(out, level++);
+		out.Printf(_T("\"%s_emb\" : {\n"), node.name.c_str()); // open emb
+	}
+	if (quant)
+	{
+		Indent(out, level+1);
+		out.Printf(_T("\"metadata\" : { \"formatVersion\" : 3"));
+		OutputQuantization(out, *quant);
+		out.Printf(_T(" },\n"));
+	}
+	Indent(out, level+1);
+	out.Printf(_T("\"stride\" : %d,\n"),
+			   (quant ? 5 : 6) + (hasUVs ? 2 : 0) + (hasColors ? 3 : 0));
+	Indent(out, level+1);
+	out.Printf(_T("\"attributes\" : [ \"position\", \"normal\"%s%s ],\n"),
+			   hasUVs ? _T(", \"uv\"") : _T(""),
+			   hasColors ? _T(", \"color\"") : _T(""));
+
+	// Output the interleaved vertices
+	Indent(out, level);
+	out.Printf(_T("\"vertices\" : [\n"));
+	width = CurrentWidth();
+	Indent(out, level+1);
+	for (i = 0; i < numverts; i++)
+	{
+		const int* c = &welded.corners[3 * i];
+		if (i > 0)
+		{
+			width += out.Put(_T(", "), 2);
+			width = MaybeNewLine(out, width, level+1);
+		}
+		if (quant)
+		{
+			width += PutInts(out, &quant->verts[3 * c[0]], 3);
+			width += out.Put(_T(","), 1);
+			width += PutInts(out, &quant->normals[2 * c[1]], 2);
+			if (hasUVs)
+			{
+				width += out.Put(_T(","), 1);
+				width += PutInts(out, &quant->tverts[2 * c[2]], 2);
+			}
+		}
+		else
+		{
+			width += out.Put(meshPoint(buf, &mesh.verts[3 * c[0]]));
+			width += out.Put(_T(","), 1);
+			width += out.Put(meshNormal(buf, &mesh.normals[3 * c[1]]));
+			if (hasUVs)
+			{
+				UVVert uv(mesh.tverts[2 * c[2]], mesh.tverts[2 * c[2] + 1], 0.0f);
+				width += out.Put(_T(","), 1);
+				width += out.Put(texture(buf, uv));
+			}
+		}
+		if (hasColors)
+		{
+			Color vColor(mesh.colors[3 * c[0]], mesh.colors[3 * c[0] + 1], mesh.colors[3 * c[0] + 2]);
+			width += out.Put(_T(","), 1);
+			width += out.Put(colorString(buf, vColor));
+		}
+	}
+	out.Printf(_T("],\n"));
+
+	// Output the triangles, three vertices each
+	Indent(out, level);
+	out.Printf(_T("\"indices\" : [\n"));
+	width = CurrentWidth();
+	Indent(out, level+1);
+	for (i = 0; i < numindices; i++)
+	{
+		if (i > 0)
+			width += out.Put(_T(","), 1);
+		width += out.PutInt(welded.indices[i]);
+		width = MaybeNewLine(out, width, level+1);
+	}
+	out.Printf(_T("]\n"));
+
+	Indent(out, --level);
+	out.Printf(_T("}")); // close emb
+	return numverts;
+}
+
+// Write the mesh of a node to a buffer file for the three.js
+// BinaryLoader, and the small JSON file with its materials that names
+// the buffer file.  url is set to the JSON file, relative to the scene.
+BOOL
+WebGL2Export::OutputBinaryMesh(IRNode& node, TSTR& url)
+{
+	IRMesh& mesh = *mScene.meshes[node.mesh];
+	TCHAR base[MAX_PATH];
+	TCHAR path[1024];
+
+	// The node name is unique but may not make a valid file name
+	SPRINTF(base, _T("%s_%d"), node.name.c_str(), node.mesh);
+	for (TCHAR* c = base; *c; c++)
+	{
+		if (_tcschr(_T("\\/:*?\"<>|#% "), *c))
+			*c = '_';
+	}
+
+	// The buffer file must not go through text mode translation
+	SPRINTF(path, _T("%s\\%s.bin"), mFilepath, base);
+	FILE* fp = _tfopen(path, _T("wb"));
+	if (!fp)
+		return FALSE;
+	OutBuffer bin(fp, 1024 * 1024);
+	// ConvertMeshes already did the axes and the mirroring
+	size_t bytes = BinMeshWrite(bin, mesh, true, false);
+	BOOL ok = bin.Flush();
+	if (fclose(fp) != 0 || !ok)
+		return FALSE;
+	mBinaryBytes += bytes;
+
+	SPRINTF(path, _T("%s\\%s.js"), mFilepath, base);
+	fp = _tfopen(path, _T("w"));
+	if (!fp)
+		return FALSE;
+	OutBuffer js(fp);
+	js.Printf(_T("{\n"));
+	Indent(js, 1);
+	js.Printf(_T("\"metadata\" : { \"formatVersion\" : 3 },\n"));
+	Indent(js, 1);
+	js.Printf(_T("\"materials\" : [\n"));
+	BOOL isFirstMat = TRUE;
+	for (int i = 0; i < (int) node.materials.size(); i++)
+		OutputEmbedMaterial(js, node, i, 1, &isFirstMat);
+	js.Printf(_T("],\n"));
+	Indent(js, 1);
+	js.Printf(_T("\"buffers\" : \"%s.bin\"\n"), base);
+	js.Printf(_T("}\n"));
+	ok = js.Flush();
+	if (fclose(fp) != 0 || !ok)
+		return FALSE;
+
+	url = base;
+	url += _T(".js");
+	return TRUE;
+}
+
+// Texture coordinates are written if the first material of the node
+// has a texture
+BOOL
+WebGL2Export::HasMeshTexture(INode* node)
+{
+	TextureDesc* td;
+	BOOL dummy;
 
+	Mtl *mtl = node->GetMtl();
+	if (mtl && mtl->IsMultiMtl())
+		td = GetMtlTex(mtl->GetSubMtl(0), dummy);
+	else
+		td = GetMatTex(node, dummy);
+	if (!td)
+		return FALSE;
+	delete td;
+	return TRUE;
 }
 
 BOOL
@@ -1103,303 +1571,663 @@ WebGL2Export::GetMtlTex(Mtl* mtl, BOOL& isWire)
 	return td;
 }
 
-BOOL
-WebGL2Export::OutputMaterial(INode* node, BOOL& isWire, BOOL& twoSided,
-							int level, int textureNum, BOOL *isFirst, ClassToFind targetClass)
+// Capture material slot textureNum of a node, returns the index of the
+// material in the scene.
+int
+WebGL2Export::CaptureMaterial(INode* node, int textureNum)
 {
 	Mtl* mtl = node->GetMtl();
-	BOOL isMulti = FALSE;
-	isWire = FALSE;
-	twoSided = FALSE;
-	const TCHAR *nodeName = node->GetName();
-	Color c;
+	IRMaterial m;
+	m.slot = textureNum;
 
 	if (mtl && mtl->IsMultiMtl())
 	{
-		int numSubMtls = mtl->NumSubMtls();
+		// Use first material for specular, etc.
 		if (textureNum > -1)
 			mtl = mtl->GetSubMtl(textureNum);
 		else
 			mtl = mtl->GetSubMtl(0);
-		isMulti = TRUE;
-		// Use first material for specular, etc.
 	}
 
 	// If no material is assigned, use the wire color
-	if (mtl)
-	{
-		Class_ID mtlClassID = mtl->ClassID();//
-		twoSided = FALSE;
-	}
 	if (!mtl || (mtl->SuperClassID() != 0x7773160f && mtl->ClassID() != Class_ID(DMTL_CLASS_ID, 0) &&
 				 mtl->ClassID() != Class_ID(0x3e0810d6, 0x603532f0)))
 	{
 		Color col(node->GetWireColor());
-	//	c = sm->GetDiffuse(mStart);
-//		fprintf (mStream, _T("\"%s\": {\n"), mNodes.GetNodeName(node));
-		if (targetClass == OBJECTS)
-		{
-			if (!*isFirst)
-				fwprintf (mStream, _T(","));
-			*isFirst = FALSE;
-			fwprintf (mStream, _T("\"wire_%s_%d\""), nodeName, textureNum);
-			return FALSE; // just here for the name
-		}
-		else if (targetClass == MATERIALS)// || targetClass == EMBEDS)
-		{
-			StartNode (node, level, isFirst);
-			Indent(level);
-			fwprintf (mStream, _T("\"wire_%s_%d\" : {\n"), nodeName, textureNum); // open mat
-			Indent(level+1);
-//		"type": "MeshBasicMaterial",
-//		"parameters": { "color": 6710886, "wireframe": true }
-			fwprintf(mStream, _T("\"type\": \"MeshLambertMaterial\",\n"));
-			Indent(level+1);
-			fwprintf(mStream, _T("\"parameters\": {\n"));  // open params
-			Indent(level+2);
-			fwprintf(mStream, _T("\"color\": %s"), color(col));
-//			Indent(level+2);
-//			fprintf(mStream, _T("\"shading\": \"flat\"\n"));
-			Indent(level+1);
-			fwprintf(mStream, _T("}\n")); // close params
-		}
-		else if (targetClass == EMBEDS)
-		{
-			if (!*isFirst)
-				fwprintf (mStream, _T(","));
-			*isFirst = FALSE;
-			fwprintf(mStream, _T("\n"));
-			Indent(level+1);
-			fwprintf(mStream, _T("{\n")); // open mat
-			Indent(level+2);
-			fwprintf(mStream, _T("\"DbgColor\": %s,\n"), color(col));
-			Indent(level+2);
-			fwprintf(mStream, _T("\"DbgIndex\": %d,\n"), textureNum);
-			Indent(level+2);
-			fwprintf(mStream, _T("\"DbgName\": \"wire_%s_%d\",\n"), nodeName, textureNum);
-			Indent(level+2);
-			fwprintf(mStream, _T("\"colorAmbient\": [0,0,0],\n"));
-			Indent(level+2);
-			fwprintf(mStream, _T("\"colorDiffuse\": [%s],\n"), colorString(col));
-			Indent(level+2);
-			fwprintf(mStream, _T("\"colorSpecular\": [%s],\n"), colorString(col));
-			Indent(level+2);
-			fwprintf(mStream, _T("\"specularCoef\": 0,\n"));
-			Indent(level+2);
-			fwprintf(mStream, _T("\"transparency\": 1.0,\n"));
-			Indent(level+2);
-			fwprintf(mStream, _T("\"vertexColors\": false\n"));
-		}
-		if (targetClass != TEXTURES)
-		{
-			Indent(level+1);
-			fwprintf(mStream, _T("}")); // close mat
-		}
-		return FALSE;
+		m.name = node->GetName();
+		m.diffuse[0] = col.r;
+		m.diffuse[1] = col.g;
+		m.diffuse[2] = col.b;
+		return mScene.AddMaterial(m);
 	}
 
-	StdMat* sm = (StdMat*) mtl;
-	isWire = sm->GetWire();
-	twoSided = sm->GetTwoSided();
+	// A slot of a MAX material evaluated before gets the same material,
+	// without updating the material or looking up its bitmap again
+	MtlBucket* mb = mMtlTable.AddMtl(mtl, textureNum);
+	if (mb->material >= 0)
+		return mb->material;
 
+	StdMat* sm = (StdMat*) mtl;
 	Interval i = FOREVER;
 	sm->Update(0, i);
-//	fprintf (mStream, _T("\"%s\": {\n"), mNodes.GetNodeName(node));
-	if (targetClass == MATERIALS)
+
+	m.isStd    = true;
+	m.name     = mtl->GetName().data();
+	m.isWire   = sm->GetWire() != FALSE;
+	m.twoSided = sm->GetTwoSided() != FALSE;
+
+	Color c = sm->GetDiffuse(mStart);
+	m.diffuse[0] = c.r;
+	m.diffuse[1] = c.g;
+	m.diffuse[2] = c.b;
+	c = sm->GetSpecular(mStart);
+	c *= sm->GetShinStr(mStart);
+	m.specular[0] = c.r;
+	m.specular[1] = c.g;
+	m.specular[2] = c.b;
+	m.shininess = sm->GetShininess(mStart) * 0.95f + 0.05f;
+	m.selfIllum = sm->GetSelfIllum(mStart);
+	m.opacity   = sm->GetOpacity(mStart);
+
+	BOOL dummy;
+	TextureDesc* td = GetMtlTex(mtl, dummy);
+	if (td)
 	{
-		StartNode (node, level, isFirst);
-		Indent(level);
-		fwprintf (mStream, _T("\"%s_%d\": {\n"), mtl->GetName(), textureNum); // open mat
+		IRTexture tex;
+		tex.name = td->name.data();
+		tex.url  = td->url.data();
+		tex.path = td->path.data();
+		m.texture = mScene.AddTexture(tex);
+		delete td;
 	}
-	/*
-	else if (targetClass == EMBEDS)
+	mb->material = mScene.AddMaterial(m);
+	return mb->material;
+}
+
+// Capture all the material slots of a node
+void
+WebGL2Export::CaptureMaterials(INode* node, IRNode& irNode)
+{
+	int numTextures = NumTextures(node);
+	int start, end;
+
+	if (numTextures == 0)
 	{
-		StartNode (node, level, isFirst);
-		Indent(level);
-		fprintf (mStream, _T("{\n"));
+		start = -1;
+		end = 0;
 	}
-	*/
-	else if (targetClass == OBJECTS)
+	else
 	{
-		if (!*isFirst)
-			fwprintf (mStream, _T(","));
-		*isFirst = FALSE;
-		fwprintf (mStream, _T("\"%s_%d\""), mtl->GetName(), textureNum);
-		return FALSE; // just here for the name
+		start = 0;
+		end = numTextures;
 	}
+	for (int i = start; i < end; i++)
+		irNode.materials.push_back(CaptureMaterial(node, i));
+}
 
-	if (targetClass == MATERIALS)
+// Write out a material of the "materials" section
+void
+WebGL2Export::OutputMaterial(IRMaterial& m, int level, BOOL *isFirst)
+{
+	Color c(m.diffuse[0], m.diffuse[1], m.diffuse[2]);
+	TCHAR buf[FMT_BUF_SIZE];
+
+	StartNode (level, isFirst);
+	Indent(level);
+	if (!m.isStd)
 	{
+		mOut->Printf(_T("\"%s\" : {\n"), m.key.c_str()); // open mat
 		Indent(level+1);
 //		"type": "MeshBasicMaterial",
 //		"parameters": { "color": 6710886, "wireframe": true }
-		fwprintf(mStream, _T("\"type\": \"MeshLambertMaterial\",\n"));
+		mOut->Printf(_T("\"type\": \"MeshLambertMaterial\",\n"));
 		Indent(level+1);
-		fwprintf(mStream, _T("\"parameters\": {\n")); // open params
+		mOut->Printf(_T("\"parameters\": {\n"));  // open params
 		Indent(level+2);
-		c = sm->GetDiffuse(mStart);
-		fwprintf(mStream, _T("\"color\": %s,\n"), color(c));
-//		Indent(level+2);
-//		fprintf(mStream, _T("\"shading\": \"flat\",\n"));
-//		fprintf(mStream, _T("\"colorDiffuse\": %d,\n"), c);
-//		Indent(level+1);
-//		float difin = (c.r+c.g+c.b) / 3.0f;
-//		c = sm->GetAmbient(mStart);
-//		float ambin = (c.r+c.g+c.b) / 3.0f;
-//		if (ambin >= difin)
-//			fprintf(mStream, _T("\"ambientIntensity\": 1.0,\n"));
-//		else
-//			fprintf(mStream, _T("\"ambientIntensity\": %s,\n"), floatVal(ambin/difin));
+		mOut->Printf(_T("\"color\": %s"), color(buf, c));
+		Indent(level+1);
+		mOut->Printf(_T("}\n")); // close params
+		Indent(level+1);
+		mOut->Printf(_T("}")); // close mat
+		return;
+	}
+
+	mOut->Printf(_T("\"%s\": {\n"), m.key.c_str()); // open mat
+	Indent(level+1);
+//		"type": "MeshBasicMaterial",
+//		"parameters": { "color": 6710886, "wireframe": true }
+	mOut->Printf(_T("\"type\": \"MeshLambertMaterial\",\n"));
+	Indent(level+1);
+	mOut->Printf(_T("\"parameters\": {\n")); // open params
+	Indent(level+2);
+	mOut->Printf(_T("\"color\": %s,\n"), color(buf, c));
+	Indent(level+2);
+	Color spec(m.specular[0], m.specular[1], m.specular[2]);
+	mOut->Printf(_T("\"colorSpecular\": %s,\n"), color(buf, spec));
+	Indent(level+2);
+	mOut->Printf(_T("\"specularCoef\": %s,\n"), floatVal(buf, m.shininess));
+	if (m.selfIllum > 0.0f)
+	{
 		Indent(level+2);
-		c = sm->GetSpecular(mStart);
-		c *= sm->GetShinStr(mStart);
-		fwprintf(mStream, _T("\"colorSpecular\": %s,\n"), color(c));
-		float sh = sm->GetShininess(mStart);
-		sh = sh * 0.95f + 0.05f;
+		Point3 p = m.selfIllum*Point3(c.r, c.g, c.b);
+		mOut->Printf(_T("\"colorEmissive\": %s,\n"), color(buf, p));
+	}
+	if (m.texture >= 0)
+	{
 		Indent(level+2);
-		fwprintf(mStream, _T("\"specularCoef\": %s,\n"), floatVal(sh));
-		float si = sm->GetSelfIllum(mStart);
-		if (si > 0.0f)
-		{
-			Indent(level+2);
-			c = sm->GetDiffuse(mStart);
-			Point3 p = si*Point3(c.r, c.g, c.b);
-			fwprintf(mStream, _T("\"colorEmissive\": %d,\n"), p);
-		}
+		mOut->Printf(_T("\"map\" : \"%s\",\n"), mScene.textures[m.texture].name.c_str());
+	}
+	Indent(level+2);
+	mOut->Printf(_T("\"vertexColors\": false,\n"));
+	Indent(level+2);
+	mOut->Printf(_T("\"opacity\": %s\n"), floatVal(buf, m.opacity));
+	Indent(level+1);
+	mOut->Printf(_T("}\n")); // close params
+	Indent(level);
+	mOut->Printf(_T("}\n")); // close mat
+}
+
+// Write out a texture of the "textures" section.  Its bitmap is copied
+// by StartTextureCopies.
+void
+WebGL2Export::OutputTexture(IRTexture& td, int level, BOOL *isFirst)
+{
+	StartNode (level, isFirst);
+	Indent(level+1);
+	mOut->Printf(_T("\"%s\" : {\n"), td.name.c_str()); // open url
+	Indent(level+1);
+	mOut->Printf(_T("\"url\" : \"%s\",\n"), td.url.c_str());
+	if (!td.mips.empty())
+	{
+		Indent(level+1);
+		mOut->Printf(_T("\"mipmaps\" : ["));
+		for (size_t i = 0; i < td.mips.size(); i++)
+			mOut->Printf(_T("%s\"%s\""), i > 0 ? _T(", ") : _T(""), td.mips[i].c_str());
+		mOut->Printf(_T("],\n"));
 	}
-	else if (targetClass == EMBEDS)
+	if (!td.s3tc.empty() || !td.etc1.empty())
 	{
-		if (!*isFirst)
-			fwprintf (mStream, _T(","));
-		*isFirst = FALSE;
-		fwprintf(mStream, _T("\n"));
-		c = sm->GetDiffuse(mStart);
 		Indent(level+1);
-		fwprintf(mStream, _T("{\n")); // open mat
-		Indent(level+2);
-		fwprintf(mStream, _T("\"DbgColor\": %s,\n"), color(c));
-		Indent(level+2);
-		fwprintf(mStream, _T("\"DbgIndex\": %d,\n"), textureNum);
-		Indent(level+2);
-		fwprintf(mStream, _T("\"DbgName\": \"%s_%d\",\n"),  mtl->GetName(), textureNum);
-		Indent(level+2);
-		fwprintf(mStream, _T("\"colorAmbient\": [0,0,0],\n"));
-		Indent(level+2);
-		fwprintf(mStream, _T("\"colorDiffuse\": [%s],\n"), colorString(c));
-		Indent(level+2);
-		c = sm->GetSpecular(mStart);
-		c *= sm->GetShinStr(mStart);
-		fwprintf(mStream, _T("\"colorSpecular\": [%s],\n"), colorString(c));
-		Indent(level+2);
-		float sh = sm->GetShininess(mStart);
-		sh = sh * 0.95f + 0.05f;
-		fwprintf(mStream, _T("\"specularCoef\": %f,\n"), sh);
-		Indent(level+2);
-		fwprintf(mStream, _T("\"transparency\": %s,\n"), floatVal(sm->GetOpacity(mStart)));
+		mOut->Printf(_T("\"compressed\" : { "));
+		if (!td.s3tc.empty())
+			mOut->Printf(_T("\"s3tc\" : \"%s\"%s"), td.s3tc.c_str(),
+						 td.etc1.empty() ? _T("") : _T(", "));
+		if (!td.etc1.empty())
+			mOut->Printf(_T("\"etc1\" : \"%s\""), td.etc1.c_str());
+		mOut->Printf(_T(" },\n"));
 	}
+	Indent(level);
+	mOut->Printf(_T("\"wrap\" : [\"repeat\", \"repeat\"]"));
+	Indent(level);
+	mOut->Printf(_T("}")); // close url
+}
 
-/*
-	if (isMulti && textureNum == -1) {
-		Indent(level--);
-		fprintf(mStream, _T("}\n"));
-		return TRUE;
+#define TEX_BATCH_TEXELS (16 * 1024 * 1024) // texels loaded at once to scale
+#define TEX_BAND_BLOCKS  (64 * 1024)        // blocks compressed in one work item
+
+typedef std::vector<std::vector<unsigned char> > TexLevels;
+
+// A bitmap scaled to a power of two on a worker thread
+struct TexScaleJob {
+	int                   texture;  // index in IRScene::textures
+	int                   width;    // size to scale to
+	int                   height;
+	int                   filter;   // TexFilter of the mip levels, -1 for none
+	bool                  save;     // write the levels as bitmaps
+	bool                  saveMips; // with the levels below the first
+	int                   compress; // TEXCOMP_ variants to make
+	TexImage              image;    // as loaded, then scaled
+	std::vector<TexImage> levels;   // mip levels below it
+	TexLevels             rgba;     // 8 bit texels of each level to compress
+	bool                  alpha;    // some texel is not opaque
+	TexLevels             s3tc;     // compressed levels, empty if not made
+	TexLevels             etc1;
+};
+
+// A run of block rows of one level compressed on a worker thread
+struct TexBandJob {
+	TexFormat            format;
+	const unsigned char* rgba;
+	int                  width;
+	int                  height;
+	int                  first;     // block rows [first, end)
+	int                  end;
+	unsigned char*       out;       // the whole compressed level
+};
+
+static void
+ScaleTexture(void* data, int index)
+{
+	TexScaleJob& job = ((TexScaleJob*) data)[index];
+	if (job.width != job.image.width || job.height != job.image.height)
+	{
+		TexImage scaled;
+		TexResize(job.image, job.width, job.height, scaled);
+		job.image.pixels.swap(scaled.pixels);
+		job.image.width = job.width;
+		job.image.height = job.height;
 	}
-*/
-	BOOL dummy;
-	TextureDesc* td = GetMtlTex(mtl, dummy);
-	if (td)
+	if (job.filter >= 0)
+		TexMipChain(job.image, (TexFilter) job.filter, job.levels);
+	if (!job.compress)
+		return;
+
+	job.alpha = false;
+	job.rgba.resize(job.levels.size() + 1);
+	for (size_t k = 0; k < job.rgba.size(); k++)
+	{
+		const TexImage& image = k == 0 ? job.image : job.levels[k-1];
+		job.rgba[k].resize(4 * image.width * image.height);
+		TexEncode8(image, &job.rgba[k][0]);
+	}
+	for (size_t i = 3; i < job.rgba[0].size() && !job.alpha; i += 4)
+		job.alpha = job.rgba[0][i] < 255;
+}
+
+static void
+CompressBand(void* data, int index)
+{
+	TexBandJob& band = ((TexBandJob*) data)[index];
+	TexCompressRows(band.format, band.rgba, band.width, band.height,
+					band.first, band.end, band.out);
+}
+
+// Split the levels of a bitmap into bands of block rows to compress,
+// making room for the compressed levels
+static void
+AddBands(TexScaleJob& job, TexFormat format, TexLevels& packed,
+		 std::vector<TexBandJob>& bands)
+{
+	packed.resize(job.rgba.size());
+	for (size_t k = 0; k < job.rgba.size(); k++)
 	{
-		if (targetClass == MATERIALS)
+		const TexImage& image = k == 0 ? job.image : job.levels[k-1];
+		packed[k].resize(TexCompressedSize(format, image.width, image.height));
+		int rows = (image.height + 3) / 4;
+		int step = TEX_BAND_BLOCKS / ((image.width + 3) / 4);
+		step = step < 1 ? 1 : step;
+		for (int first = 0; first < rows; first += step)
 		{
-			Indent(level+2);
-			fwprintf(mStream, _T("\"map\" : \"%s\",\n"), td->name);
+			TexBandJob band;
+			band.format = format;
+			band.rgba = &job.rgba[k][0];
+			band.width = image.width;
+			band.height = image.height;
+			band.first = first;
+			band.end = first + step < rows ? first + step : rows;
+			band.out = &packed[k][0];
+			bands.push_back(band);
 		}
-		else if (targetClass == TEXTURES)
+	}
+}
+
+// Read a bitmap through MAX, which can read more formats than a
+// browser.  MAX bitmaps may only be used on the main thread.
+static BOOL
+LoadTexImage(const TCHAR* path, TexImage& image)
+{
+	BitmapInfo bi;
+	BMMRES status;
+	bi.SetName(path);
+	Bitmap* bm = TheManager->Load(&bi, &status);
+	if (!bm)
+		return FALSE;
+	int width = bm->Width();
+	int height = bm->Height();
+	std::vector<unsigned short> rgba(4 * width * height);
+	for (int y = 0; y < height; y++)
+		bm->GetPixels(0, y, width, (BMM_Color_64*) &rgba[4 * width * y]);
+	bm->DeleteThis();
+	TexDecode(&rgba[0], width, height, image);
+	return TRUE;
+}
+
+static BOOL
+SaveTexImage(const TCHAR* path, const TexImage& image)
+{
+	BitmapInfo bi;
+	bi.SetName(path);
+	bi.SetWidth(image.width);
+	bi.SetHeight(image.height);
+	bi.SetType(BMM_TRUE_64);
+	bi.SetFlags(MAP_HAS_ALPHA);
+	Bitmap* bm = TheManager->Create(&bi);
+	if (!bm)
+		return FALSE;
+	std::vector<unsigned short> rgba(4 * image.width * image.height);
+	TexEncode(image, &rgba[0]);
+	for (int y = 0; y < image.height; y++)
+		bm->PutPixels(0, y, image.width, (BMM_Color_64*) &rgba[4 * image.width * y]);
+	BOOL ok = bm->OpenOutput(&bi) == BMMRES_SUCCESS &&
+		bm->Write(&bi) == BMMRES_SUCCESS;
+	bm->Close(&bi);
+	bm->DeleteThis();
+	return ok;
+}
+
+// Scale the bitmaps of the scene to powers of two, no larger than
+// mTexSize, and make their mip levels, so the viewer can repeat and
+// mip map them as they are.  Each level is written next to the scene
+// file as <name>_<width>x<height>, JPEG if the bitmap was one and PNG
+// otherwise; the texture takes the name of the largest level.  Bitmaps
+// already the right size are copied as they are unless they need mip
+// levels.  Loading and saving go through MAX on this thread, the
+// scaling runs on the work pool, a batch of bitmaps at a time.
+//
+// With mTexCompress the scaled bitmaps and all their mip levels are
+// also block compressed, in bands of block rows spread over the work
+// pool across all the bitmaps of a batch, and written beside them as
+// <name>_<width>x<height>.dds for S3TC and .ktx for ETC1.  ETC1 has no
+// alpha, so bitmaps with alpha only get S3TC.
+void
+WebGL2Export::ScaleTextures()
+{
+	// Mip levels need powers of two; compressed textures need all of
+	// them, boxed if no filter was chosen for the bitmap levels
+	int maxSize = mTexSize < 0 ? 0 : mTexSize;
+	int filter = mTexMips >= 0 ? mTexMips : (mTexCompress ? TEXFILTER_BOX : -1);
+	std::vector<TexScaleJob> jobs;
+	std::vector<TexBandJob> bands;
+	WorkPool pool;
+	double start = TimerSeconds();
+	double scaling = 0.0, compressing = 0.0;
+	int scaled = 0, levels = 0, compressed = 0, failed = 0;
+	size_t next = 0;
+
+	while (next < mScene.textures.size())
+	{
+		// Load a batch
+		jobs.clear();
+		double texels = 0.0;
+		for (; next < mScene.textures.size() && texels < TEX_BATCH_TEXELS; next++)
 		{
-			StartNode (node, level, isFirst);
-			Indent(level+1);
-			fwprintf(mStream, _T("\"%s\" : {\n"), td->name); // open url
-			Indent(level+1);
-			fwprintf(mStream, _T("\"url\" : \"%s\",\n"), td->url);
-			Indent(level);
-			fwprintf(mStream, _T("\"wrap\" : [\"repeat\", \"repeat\"]"), td->url);
-			Indent(level);
-			fwprintf(mStream, _T("}")); // close url
-			TCHAR from[1024];
-			TCHAR to[1024];
-			SPRINTF (from, _T("%s\\%s"), td->path, td->name);
-			SPRINTF (to, _T("%s\\%s"), mFilepath, td->name);
-			CopyFile (from, to, FALSE);
+			IRTexture& td = mScene.textures[next];
+			TCHAR path[1024];
+			SPRINTF(path, _T("%s\\%s"), td.path.c_str(), td.name.c_str());
+			BitmapInfo bi;
+			bi.SetName(path);
+			if (TheManager->GetImageInfo(&bi) != BMMRES_SUCCESS)
+				continue;
+			int width = TexPowerOfTwo(bi.Width(), maxSize);
+			int height = TexPowerOfTwo(bi.Height(), maxSize);
+			bool resize = width != bi.Width() || height != bi.Height();
+			if (!resize && mTexMips < 0 && !mTexCompress)
+				continue;
+
+			TexScaleJob job;
+			jobs.push_back(job);
+			TexScaleJob& added = jobs.back();
+			added.texture = (int) next;
+			added.width = width;
+			added.height = height;
+			added.filter = filter;
+			added.save = resize || mTexMips >= 0;
+			added.saveMips = mTexMips >= 0;
+			added.compress = mTexCompress;
+			if (!LoadTexImage(path, added.image))
+			{
+				jobs.pop_back();
+				failed++;
+				continue;
+			}
+			texels += (double) added.image.width * added.image.height;
 		}
-		else if (targetClass == EMBEDS)
+		if (jobs.empty())
+			continue;
+
+		double t = TimerSeconds();
+		pool.Run(ScaleTexture, &jobs[0], (int) jobs.size());
+		scaling += TimerSeconds() - t;
+
+		if (mTexCompress)
 		{
-			if (!mSceneFile)
+			bands.clear();
+			for (size_t j = 0; j < jobs.size(); j++)
 			{
-				Indent(level+2);
-				fwprintf(mStream, _T("\"mapDiffuse\" : \"%s,\"\n"), td->url);
-				TCHAR from[1024];
-				TCHAR to[1024];
-				SPRINTF (from, _T("%s\\%s"), td->path, td->name);
-				SPRINTF (to, _T("%s\\%s"), mFilepath, td->name);
-				CopyFile (from, to, FALSE);
+				TexScaleJob& job = jobs[j];
+				if (job.compress & TEXCOMP_S3TC)
+					AddBands(job, job.alpha ? TEXFORMAT_BC3 : TEXFORMAT_BC1, job.s3tc, bands);
+				if ((job.compress & TEXCOMP_ETC1) && !job.alpha)
+					AddBands(job, TEXFORMAT_ETC1, job.etc1, bands);
 			}
+			t = TimerSeconds();
+			if (!bands.empty())
+				pool.Run(CompressBand, &bands[0], (int) bands.size());
+			compressing += TimerSeconds() - t;
 		}
 
-		// fwprintf(mStream, _T("repeatS TRUE\n"));
-		// fwprintf(mStream, _T("repeatT TRUE\n"));
+		// Save the levels and point the textures at them
+		for (size_t j = 0; j < jobs.size(); j++)
+		{
+			TexScaleJob& job = jobs[j];
+			IRTexture& td = mScene.textures[job.texture];
+			IRString base = td.name;
+			IRString ext = _T(".png");
+			size_t dot = base.rfind(_T('.'));
+			if (dot != IRString::npos)
+			{
+				IRString e = base.substr(dot);
+				if (_tcsicmp(e.c_str(), _T(".jpg")) == 0 ||
+					_tcsicmp(e.c_str(), _T(".jpeg")) == 0)
+					ext = e;
+				base.resize(dot);
+			}
+
+			for (int v = 0; v < 2; v++)
+			{
+				const TexLevels& packed = v == 0 ? job.s3tc : job.etc1;
+				if (packed.empty())
+					continue;
+				TexFormat format = v == 1 ? TEXFORMAT_ETC1 :
+					(job.alpha ? TEXFORMAT_BC3 : TEXFORMAT_BC1);
+				TCHAR name[1024];
+				TCHAR path[1024];
+				SPRINTF(name, _T("%s_%dx%d%s"), base.c_str(), job.image.width,
+						job.image.height, v == 0 ? _T(".dds") : _T(".ktx"));
+				SPRINTF(path, _T("%s\\%s"), mFilepath, name);
+				if (!TexSaveCompressed(path, format, job.image.width,
+									   job.image.height, packed))
+				{
+					failed++;
+					continue;
+				}
+				TSTR url = name;
+				if (v == 0)
+					td.s3tc = PrefixUrl(url).data();
+				else
+					td.etc1 = PrefixUrl(url).data();
+				compressed++;
+			}
+			if (!job.save)
+				continue;
 
-		BitmapTex* bm = td->tex;
-		delete td;
+			std::vector<IRString> names;
+			BOOL ok = TRUE;
+			int saveLevels = job.saveMips ? (int) job.levels.size() : 0;
+			for (int k = -1; k < saveLevels && ok; k++)
+			{
+				const TexImage& image = k < 0 ? job.image : job.levels[k];
+				TCHAR name[1024];
+				TCHAR path[1024];
+				SPRINTF(name, _T("%s_%dx%d%s"), base.c_str(), image.width,
+						image.height, ext.c_str());
+				SPRINTF(path, _T("%s\\%s"), mFilepath, name);
+				ok = SaveTexImage(path, image);
+				names.push_back(name);
+			}
+			if (!ok)
+			{
+				// Copied as it is
+				failed++;
+				continue;
+			}
+
+			td.name = names[0];
+			TSTR url = names[0].c_str();
+			td.url = PrefixUrl(url).data();
+			for (size_t k = 1; k < names.size(); k++)
+			{
+				url = names[k].c_str();
+				td.mips.push_back(IRString(PrefixUrl(url).data()));
+			}
+			td.scaled = true;
+			scaled++;
+			levels += saveLevels;
+		}
 	}
-	if (targetClass == MATERIALS || targetClass == EMBEDS)
+
+	if (scaled > 0 || compressed > 0 || failed > 0)
+		DebugPrint(_T("WebGL export: %d bitmaps scaled with %d mip levels on %d threads in %.1f ms, %d compressed in %.1f ms, %.1f ms with loading and saving, %d left as they are\n"),
+				   scaled, levels, pool.Threads(), scaling * 1000.0,
+				   compressed, compressing * 1000.0,
+				   (TimerSeconds() - start) * 1000.0, failed);
+}
+
+// Copy the bitmaps of the scene that are not scaled next to the scene
+// file, in the background while the meshes are prepared and written
+void
+WebGL2Export::StartTextureCopies()
+{
+	TCHAR from[1024];
+	TCHAR to[1024];
+	for (size_t i = 0; i < mScene.textures.size(); i++)
 	{
-		Indent(level+2);
-		fwprintf(mStream, _T("\"vertexColors\": false,\n"));
-		Indent(level+2);
-		fwprintf(mStream, _T("\"opacity\": %s\n"), floatVal(sm->GetOpacity(mStart)));
-		if (targetClass == MATERIALS)
-		{
-			Indent(level+1);
-			fwprintf(mStream, _T("}\n")); // close params
-		}
+		IRTexture& td = mScene.textures[i];
+		if (td.scaled)
+			continue;
+		SPRINTF (from, _T("%s\\%s"), td.path.c_str(), td.name.c_str());
+		SPRINTF (to, _T("%s\\%s"), mFilepath, td.name.c_str());
+		mTexCopier.Add(from, to);
+	}
+	mTexCopier.Start();
+}
+
+// Wait for the bitmaps to be copied
+void
+WebGL2Export::FinishTextureCopies()
+{
+	TexCopyStats stats;
+	mTexCopier.Wait(stats);
+	if (stats.requested == 0)
+		return;
+	DebugPrint(_T("WebGL export: %d bitmaps, %d copied (%.0f bytes), %d unchanged by time, %d by content, %d failed, %.1f ms in the background\n"),
+			   stats.requested, stats.copied, stats.bytes, stats.sameTime,
+			   stats.sameHash, stats.failed, stats.seconds * 1000.0);
+}
+
+// Write the names of the materials of a node, for the "materials" list
+// of its object
+void
+WebGL2Export::OutputMaterialKeys(IRNode& node)
+{
+	for (size_t i = 0; i < node.materials.size(); i++)
+		mOut->Printf(_T("%s\"%s\""), i > 0 ? _T(",") : _T(""),
+					 mScene.materials[node.materials[i]].key.c_str());
+}
+
+// Write out material slot of a node in the materials list of an
+// embedded or binary mesh.  Only reads the captured scene, so it can
+// run on several threads at once.
+void
+WebGL2Export::OutputEmbedMaterial(OutBuffer& out, IRNode& node, int slot,
+								  int level, BOOL *isFirst)
+{
+	IRMaterial& m = mScene.materials[node.materials[slot]];
+	int textureNum = slot;
+	Color c(m.diffuse[0], m.diffuse[1], m.diffuse[2]);
+	TCHAR buf[FMT_BUF_SIZE];
+
+	if (!*isFirst)
+		out.Printf(_T(","));
+	*isFirst = FALSE;
+	out.Printf(_T("\n"));
+	Indent(out, level+1);
+	out.Printf(_T("{\n")); // open mat
+	Indent(out, level+2);
+	out.Printf(_T("\"DbgColor\": %s,\n"), color(buf, c));
+	Indent(out, level+2);
+	out.Printf(_T("\"DbgIndex\": %d,\n"), textureNum);
+
+	if (!m.isStd)
+	{
+		Indent(out, level+2);
+		out.Printf(_T("\"DbgName\": \"%s\",\n"), m.key.c_str());
+		Indent(out, level+2);
+		out.Printf(_T("\"colorAmbient\": [0,0,0],\n"));
+		Indent(out, level+2);
+		out.Printf(_T("\"colorDiffuse\": [%s],\n"), colorString(buf, c));
+		Indent(out, level+2);
+		out.Printf(_T("\"colorSpecular\": [%s],\n"), colorString(buf, c));
+		Indent(out, level+2);
+		out.Printf(_T("\"specularCoef\": 0,\n"));
+		Indent(out, level+2);
+		out.Printf(_T("\"transparency\": 1.0,\n"));
+		Indent(out, level+2);
+		out.Printf(_T("\"vertexColors\": false\n"));
+		Indent(out, level+1);
+		out.Printf(_T("}")); // close mat
+		return;
 	}
-	if (targetClass != TEXTURES)
+
+	Indent(out, level+2);
+	out.Printf(_T("\"DbgName\": \"%s\",\n"), m.key.c_str());
+	Indent(out, level+2);
+	out.Printf(_T("\"colorAmbient\": [0,0,0],\n"));
+	Indent(out, level+2);
+	out.Printf(_T("\"colorDiffuse\": [%s],\n"), colorString(buf, c));
+	Indent(out, level+2);
+	Color spec(m.specular[0], m.specular[1], m.specular[2]);
+	out.Printf(_T("\"colorSpecular\": [%s],\n"), colorString(buf, spec));
+	Indent(out, level+2);
+	out.Printf(_T("\"specularCoef\": %f,\n"), m.shininess);
+	Indent(out, level+2);
+	out.Printf(_T("\"transparency\": %s,\n"), floatVal(buf, m.opacity));
+
+	if (m.texture >= 0 && !mSceneFile)
 	{
-		Indent(level);
-		fwprintf(mStream, _T("}\n")); // close mat
+		IRTexture& td = mScene.textures[m.texture];
+		Indent(out, level+2);
+		out.Printf(_T("\"mapDiffuse\" : \"%s,\"\n"), td.url.c_str());
 	}
-//	Indent(level);
-//	fwprintf(mStream, _T("}\n"));
-//	Indent(--level);
-	return FALSE;
+
+	Indent(out, level+2);
+	out.Printf(_T("\"vertexColors\": false,\n"));
+	Indent(out, level+2);
+	out.Printf(_T("\"opacity\": %s\n"), floatVal(buf, m.opacity));
+	Indent(out, level);
+	out.Printf(_T("}\n")); // close mat
 }
 
 
 #define INTENDED_ASPECT_RATIO 1.3333
 
-BOOL
-WebGL2Export::WebGLOutCamera(INode* node, Object* obj, int level)
+void
+WebGL2Export::CaptureCamera(INode* node, Object* obj, IRNode& irNode)
 {
-	// compute camera transform
-	ViewParams vp;
 	CameraState cs;
 	Interval iv;
 	CameraObject *cam = (CameraObject *)obj;
 	cam->EvalCameraState(0, iv, &cs);
-	vp.fov = (float)(2.0 * atan(tan(cs.fov / 2.0) / INTENDED_ASPECT_RATIO));
+	irNode.camera.fov = (float)(2.0 * atan(tan(cs.fov / 2.0) / INTENDED_ASPECT_RATIO));
+}
+
+BOOL
+WebGL2Export::WebGLOutCamera(IRNode& node, int level)
+{
+	TCHAR buf[FMT_BUF_SIZE];
 
 	Indent(level);
-	fwprintf(mStream, _T("\"%s\": {\n"), mNodes.GetNodeName(node));
+	mOut->Printf(_T("\"%s\": {\n"), node.name.c_str());
 	Indent(level+1);
-	fwprintf(mStream, _T("\"type\": \"perspective\",\n"));
+	mOut->Printf(_T("\"type\": \"perspective\",\n"));
 	Indent(level+1);
-	fwprintf(mStream, _T("\"position\": [0, 0, 0],\n"));
+	mOut->Printf(_T("\"position\": [0, 0, 0],\n"));
 	Indent(level+1);
-	fwprintf(mStream, _T("\"target\": [0, 0, 0],\n"));
+	mOut->Printf(_T("\"target\": [0, 0, 0],\n"));
 	Indent(level+1);
-	fwprintf(mStream, _T("\"fov\": %s\n"), floatVal(vp.fov));
+	mOut->Printf(_T("\"fov\": %s\n"), floatVal(buf, node.camera.fov));
 	Indent(level);
-	fwprintf(mStream, _T("}"));
+	mOut->Printf(_T("}"));
 
 	return TRUE;
 }
@@ -1415,182 +2243,119 @@ GetTopLevelParent(INode* node)
 	return node;
 }
 
-BOOL
-WebGL2Export::WebGLOutPointLight(INode* node, LightObject* light, int level, BOOL top)
+void
+WebGL2Export::CaptureLight(INode* node, LightObject* light, IRNode& irNode)
 {
 	LightState ls;
 	Interval iv = FOREVER;
 
 	light->EvalLightState(mStart, iv, &ls);
 
+	Point3 col = light->GetRGBColor(mStart, FOREVER);
+	irNode.light.intensity = light->GetIntensity(mStart, FOREVER);
+	irNode.light.color[0]  = col.x;
+	irNode.light.color[1]  = col.y;
+	irNode.light.color[2]  = col.z;
+	irNode.light.useAtten  = ls.useAtten != FALSE;
+	irNode.light.radius    = ls.attenEnd;
+
+	if (irNode.kind == IR_SPOT_LIGHT)
+	{
+		irNode.light.cutOffAngle = DegToRad(ls.fallsize);
+		irNode.light.beamWidth   = DegToRad(ls.hotsize);
+		if (!ls.useAtten || ls.attenEnd == 0.0f)
+			irNode.light.radius = Length(mBoundBox.Width());
+		if (ls.useAtten)
+			irNode.light.attenuation = (ls.attenStart <= 1.0f) ? 1.0f : 1.0f/ls.attenStart;
+	}
+}
+
+BOOL
+WebGL2Export::WebGLOutPointLight(IRNode& node, int level)
+{
+	IRLight& light = node.light;
+	TCHAR buf[FMT_BUF_SIZE];
+
 	Indent(level);
-	fwprintf(mStream, _T("\"%s\": {\n"), mNodes.GetNodeName(node));
-	Indent(level+1);
-	fwprintf(mStream, _T("\"type\": \"point\",\n"));
+	mOut->Printf(_T("\"%s\": {\n"), node.name.c_str());
 	Indent(level+1);
-	fwprintf(mStream, _T("\"intensity\": %s,\n"),
-			floatVal(light->GetIntensity(mStart, FOREVER)));
+	mOut->Printf(_T("\"type\": \"point\",\n"));
 	Indent(level+1);
-	Point3 col = light->GetRGBColor(mStart, FOREVER);
-	fwprintf(mStream, _T("\"color\": %s,\n"), color(col));
+	mOut->Printf(_T("\"intensity\": %s,\n"), floatVal(buf, light.intensity));
 	Indent(level+1);
-	if (top)
-	{
-		Point3 p = node->GetObjTMAfterWSM(mStart).GetTrans();
-		fwprintf(mStream, _T("\"position\": [%s],\n"), point(p));
-	}
-	else
-		fwprintf(mStream, _T("\"position\": [0, 0, 0],\n"));
-/*
+	Point3 col(light.color[0], light.color[1], light.color[2]);
+	mOut->Printf(_T("\"color\": %s,\n"), color(buf, col));
 	Indent(level+1);
-	fwprintf(mStream, _T("on %s\n"), ls.on ? _T("TRUE") : _T("FALSE"));
-*/
-	if (ls.useAtten) {
+	mOut->Printf(_T("\"position\": [0, 0, 0],\n"));
+	if (light.useAtten) {
 		Indent(level+1);
-		fwprintf(mStream, _T("attenuation [0 1 0],\n"));
+		mOut->Printf(_T("attenuation [0 1 0],\n"));
 	}
 	Indent(level+1);
-	fwprintf(mStream, _T("\"radius\": %s\n"), floatVal(ls.attenEnd));
+	mOut->Printf(_T("\"radius\": %s\n"), floatVal(buf, light.radius));
 	Indent(level);
-	fwprintf(mStream, _T("}"));
+	mOut->Printf(_T("}"));
 	return TRUE;
 }
 
 BOOL
-WebGL2Export::WebGLOutDirectLight(INode* node, LightObject* light, int level, BOOL top)
+WebGL2Export::WebGLOutDirectLight(IRNode& node, int level)
 {
+	IRLight& light = node.light;
 	Point3 dir(0,0,-1);
-
-	LightState ls;
-	Interval iv = FOREVER;
-
-	light->EvalLightState(mStart, iv, &ls);
+	TCHAR buf[FMT_BUF_SIZE];
 
 	Indent(level);
-	fwprintf(mStream, _T("\"%s\": {\n"), mNodes.GetNodeName(node));
-	Indent(level+1);
-	fwprintf(mStream, _T("\"type\": \"directional\",\n"));
+	mOut->Printf(_T("\"%s\": {\n"), node.name.c_str());
 	Indent(level+1);
-	fwprintf(mStream, _T("\"intensity\": %s,\n"),
-			floatVal(light->GetIntensity(mStart, FOREVER)));
+	mOut->Printf(_T("\"type\": \"directional\",\n"));
 	Indent(level+1);
-	if (top)
-	{
-		Point3 p = Point3(0,0,-1);
-		Matrix3 tm = node->GetObjTMAfterWSM(mStart);
-		Point3 trans, s;
-		Quat q;
-		AffineParts parts;
-		decomp_affine(tm, &parts);
-		q = parts.q;
-		Matrix3 rot;
-		q.MakeMatrix(rot);
-		p = p * rot;
-		fwprintf(mStream, _T("\"direction\": [%s],\n"), point(p));
-	}
-	else
-		fwprintf(mStream, _T("\"direction\": [%s],\n"), normPoint(dir));
+	mOut->Printf(_T("\"intensity\": %s,\n"), floatVal(buf, light.intensity));
 	Indent(level+1);
-	Point3 col = light->GetRGBColor(mStart, FOREVER);
-
-	fwprintf(mStream, _T("\"color\": %s\n"), color(col));
-/*
+	mOut->Printf(_T("\"direction\": [%s],\n"), normPoint(buf, dir));
 	Indent(level+1);
-	fwprintf(mStream, _T("on %s\n"), ls.on ? _T("TRUE") : _T("FALSE"));
-*/
+	Point3 col(light.color[0], light.color[1], light.color[2]);
+	mOut->Printf(_T("\"color\": %s\n"), color(buf, col));
 	Indent(level);
-	fwprintf(mStream, _T("}"));
+	mOut->Printf(_T("}"));
 	return TRUE;
 }
 
 BOOL
-WebGL2Export::WebGLOutSpotLight(INode* node, LightObject* light, int level, BOOL top)
+WebGL2Export::WebGLOutSpotLight(IRNode& node, int level)
 {
-	LightState ls;
-	Interval iv = FOREVER;
-
+	IRLight& light = node.light;
 	Point3 dir(0,0,-1);
+	TCHAR buf[FMT_BUF_SIZE];
 
-	light->EvalLightState(mStart, iv, &ls);
 	Indent(level);
-	fwprintf(mStream, _T("\"%s\": {\n"), mNodes.GetNodeName(node));
+	mOut->Printf(_T("\"%s\": {\n"), node.name.c_str());
 	Indent(level+1);
-	fwprintf(mStream, _T("\"type\": \"spot\",\n"));
+	mOut->Printf(_T("\"type\": \"spot\",\n"));
 	Indent(level+1);
-	fwprintf(mStream, _T("\"intensity\": %s,\n"),
-			floatVal(light->GetIntensity(mStart,FOREVER)));
+	mOut->Printf(_T("\"intensity\": %s,\n"), floatVal(buf, light.intensity));
 	Indent(level+1);
-	Point3 col = light->GetRGBColor(mStart, FOREVER);
-	fwprintf(mStream, _T("\"color\": %s,\n"), color(col));
-	Indent(level+1);
-	if (top)
-	{
-		Point3 p = node->GetObjTMAfterWSM(mStart).GetTrans();
-		fwprintf(mStream, _T("\"position\": [%s],\n"), point(p));
-	}
-	else
-		fwprintf(mStream, _T("\"position\": [0, 0, 0],\n"));
+	Point3 col(light.color[0], light.color[1], light.color[2]);
+	mOut->Printf(_T("\"color\": %s,\n"), color(buf, col));
 	Indent(level+1);
-	if (top)
-	{
-		Matrix3 tm = node->GetObjTMAfterWSM(mStart);
-		Point3 p = Point3(0,0,-1);
-		Point3 trans, s;
-		Quat q;
-		Matrix3 rot;
-		AffineParts parts;
-		decomp_affine(tm, &parts);
-		q = parts.q;
-		q.MakeMatrix(rot);
-		p = p * rot;
-		fwprintf(mStream, _T("\"direction\": [%s],\n"), normPoint(p));
-	}
-	else
-		fwprintf(mStream, _T("\"direction\": [%s],\n"), normPoint(dir));
+	mOut->Printf(_T("\"position\": [0, 0, 0],\n"));
 	Indent(level+1);
-	fwprintf(mStream, _T("\"cutOffAngle\": %s,\n"),
-			floatVal(DegToRad(ls.fallsize)));
+	mOut->Printf(_T("\"direction\": [%s],\n"), normPoint(buf, dir));
 	Indent(level+1);
-	fwprintf(mStream, _T("\"beamWidth\": %s,\n"), floatVal(DegToRad(ls.hotsize)));
+	mOut->Printf(_T("\"cutOffAngle\": %s,\n"), floatVal(buf, light.cutOffAngle));
 	Indent(level+1);
-/*
-	fwprintf(mStream, _T("on %s\n"), ls.on ? _T("TRUE") : _T("FALSE"));
+	mOut->Printf(_T("\"beamWidth\": %s,\n"), floatVal(buf, light.beamWidth));
 	Indent(level+1);
-*/
-	float radius;
-	if (!ls.useAtten || ls.attenEnd == 0.0f)
-		radius = Length(mBoundBox.Width());
-	else
-		radius = ls.attenEnd;
-	fwprintf(mStream, _T("\"radius\": %s\n"), floatVal(radius));
-	if (ls.useAtten) {
-		float attn;
-		attn = (ls.attenStart <= 1.0f) ? 1.0f : 1.0f/ls.attenStart;
+	mOut->Printf(_T("\"radius\": %s\n"), floatVal(buf, light.radius));
+	if (light.useAtten) {
 		Indent(1);
-		fwprintf(mStream, _T("\"attenuation\": [0 %s 0]\n"), floatVal(attn));
+		mOut->Printf(_T("\"attenuation\": [0 %s 0]\n"), floatVal(buf, light.attenuation));
 	}
 	Indent(level);
-	fwprintf(mStream, _T("}"));
+	mOut->Printf(_T("}"));
 	return TRUE;
 }
 
-void
-WebGL2Export::OutputTopLevelLight(INode* node, LightObject *light)
-{
-	Class_ID id = light->ClassID();
-	if (id == Class_ID(OMNI_LIGHT_CLASS_ID, 0))
-		WebGLOutPointLight(node, light, 1, TRUE);
-	else if (id == Class_ID(DIR_LIGHT_CLASS_ID, 0) ||
-			 id == Class_ID(TDIR_LIGHT_CLASS_ID, 0))
-		WebGLOutDirectLight(node, light, 1, TRUE);
-	else if (id == Class_ID(SPOT_LIGHT_CLASS_ID, 0) ||
-			 id == Class_ID(FSPOT_LIGHT_CLASS_ID, 0))
-		WebGLOutSpotLight(node, light, 1, TRUE);
-	else
-		return;
-	
-}
-
 /*
 // Distance comparison function for sorting LOD lists.
 static int
@@ -1603,35 +2368,6 @@ DistComp(LODObj** obj1, LODObj** obj2)
 }
 */
 
-// Write out the WebGL for node we know about, including Opus nodes, 
-// lights, cameras
-BOOL
-WebGL2Export::WebGLOutSpecial(INode* node, INode* parent,
-							 Object* obj, int level, BOOL mirrored)
-{
-	Class_ID id = obj->ClassID();
-
-	if (id == Class_ID(OMNI_LIGHT_CLASS_ID, 0))
-		return WebGLOutPointLight(node, (LightObject*) obj, level+1, FALSE);
-
-	if (id == Class_ID(DIR_LIGHT_CLASS_ID, 0) ||
-		id == Class_ID(TDIR_LIGHT_CLASS_ID, 0))
-		return WebGLOutDirectLight(node, (LightObject*) obj, level+1, FALSE);
-
-	if (id == Class_ID(SPOT_LIGHT_CLASS_ID, 0) ||
-		id == Class_ID(FSPOT_LIGHT_CLASS_ID, 0))
-		return WebGLOutSpotLight(node, (LightObject*) obj, level+1, FALSE);
-
-//	if (id == Class_ID(WebGL_INS_CLASS_ID1, WebGL_INS_CLASS_ID2))
-//		return WebGLOutInline((WebGLInsObject*) obj, level+1);
-
-	if (id == Class_ID(SIMPLE_CAM_CLASS_ID, 0) ||
-		id == Class_ID(LOOKAT_CAM_CLASS_ID, 0))
-		return WebGLOutCamera(node, obj, level+1);
-
-	return FALSE;
-		
-}
 /*
 static BOOL
 IsLODObject(Object* obj)
@@ -1750,6 +2486,21 @@ WebGL2Export::ObjIsAnimated(Object *obj)
 	return !(iv == FOREVER);
 }
 
+// A node whose object does not change and which does not move, nor do
+// any of its parents
+BOOL
+WebGL2Export::IsStatic(INode* node, Object* obj)
+{
+	if (ObjIsAnimated(obj))
+		return FALSE;
+	for (INode* n = node; n && !n->IsRootNode(); n = n->GetParentNode())
+	{
+		if (n->IsAnimated() || n->GetTMController()->IsAnimated())
+			return FALSE;
+	}
+	return TRUE;
+}
+
 static BOOL
 MtlHasTexture(Mtl* mtl)
 {
@@ -1803,139 +2554,347 @@ NumTextures(INode* node)
 	return 0;
 }
 
-// Write the data for a single object.
-// This function also takes care of identifying WebGL primitive objects
+// Capture the data for a single object.
 void
-WebGL2Export::WebGLOutObject(INode* node, INode* parent, Object* obj, int level,
-						   BOOL mirrored, ClassToFind targetClass, BOOL *isFirst)
+WebGL2Export::CaptureObject(INode* node, int level, BOOL mirrored)
 {
  // need to get a valid obj ptr
+	Object* obj = node->EvalWorldState(mStart).obj;
+	if (!obj)
+		return;
 
-	obj = node->EvalWorldState(mStart).obj;
-	BOOL isTriMesh = obj->CanConvertToType(triObjectClassID);
-	BOOL instance = FALSE;
-	BOOL special = FALSE;
-	Class_ID id;
-	if (obj) id = obj->ClassID();
+	Class_ID id = obj->ClassID();
+	IRNode irNode;
+	irNode.name     = mNodes.GetNodeName(node);
+	irNode.level    = level;
+	irNode.mirrored = mirrored != FALSE;
 
-	if (targetClass == LIGHTS)
+	if (id == Class_ID(OMNI_LIGHT_CLASS_ID, 0))
+	{
+		irNode.kind = IR_POINT_LIGHT;
+		CaptureLight(node, (LightObject*) obj, irNode);
+	}
+	else if (id == Class_ID(DIR_LIGHT_CLASS_ID, 0) ||
+			id == Class_ID(TDIR_LIGHT_CLASS_ID, 0))
+	{
+		irNode.kind = IR_DIRECT_LIGHT;
+		CaptureLight(node, (LightObject*) obj, irNode);
+	}
+	else if (id == Class_ID(SPOT_LIGHT_CLASS_ID, 0) ||
+			id == Class_ID(FSPOT_LIGHT_CLASS_ID, 0))
 	{
-		if (id == Class_ID(OMNI_LIGHT_CLASS_ID, 0))
+		irNode.kind = IR_SPOT_LIGHT;
+		CaptureLight(node, (LightObject*) obj, irNode);
+	}
+	else if (id == Class_ID(SIMPLE_CAM_CLASS_ID, 0) || id == Class_ID(LOOKAT_CAM_CLASS_ID, 0))
+	{
+		irNode.kind = IR_CAMERA;
+		CaptureCamera(node, obj, irNode);
+	}
+	else if (obj->CanConvertToType(triObjectClassID) && node->Renderable())
+	{
+		irNode.kind = IR_MESH;
+		CaptureTransform(node, irNode);
+		CaptureMaterials(node, irNode);
+
+		// Static nodes may be merged into batches in world space
+		if (mBatchStatic && IsStatic(node, obj))
 		{
-			StartNode (parent, level+1, isFirst);
-			WebGLOutPointLight(node, (LightObject*) obj, level+1, FALSE);
+			Matrix3 tm = node->GetObjTMAfterWSM(mStart);
+			irNode.isStatic = true;
+			for (int i = 0; i < 4; i++)
+				for (int k = 0; k < 3; k++)
+					irNode.world[3 * i + k] = tm.GetRow(i)[k];
 		}
-		else if (id == Class_ID(DIR_LIGHT_CLASS_ID, 0) ||
-				id == Class_ID(TDIR_LIGHT_CLASS_ID, 0))
+
+		// Instances of an object already captured share its mesh
+		Point3 pivot(irNode.pivot[0], irNode.pivot[1], irNode.pivot[2]);
+		ObjectBucket* ob = mObjTable.AddObject(obj, mirrored,
+											   HasMeshTexture(node),
+											   (int) irNode.materials.size(),
+											   pivot);
+		if (ob->mesh < 0)
 		{
-			StartNode (parent, level+1, isFirst);
-			WebGLOutDirectLight(node, (LightObject*) obj, level+1, FALSE);
+			double start = TimerSeconds();
+			ob->mesh = mPrimitives ? CapturePrimitive(node, obj, irNode) : -1;
+			if (ob->mesh < 0)
+				ob->mesh = CaptureMesh(obj, ob->textured);
+			if (ob->mesh < 0)
+				return;
+			ob->captureTime = TimerSeconds() - start;
+			mScene.meshes[ob->mesh]->name = irNode.name;
 		}
-		else if (id == Class_ID(SPOT_LIGHT_CLASS_ID, 0) ||
-				id == Class_ID(FSPOT_LIGHT_CLASS_ID, 0))
+		else
 		{
-			StartNode (parent, level+1, isFirst);
-			WebGLOutSpotLight(node, (LightObject*) obj, level+1, FALSE);
+			mInstances++;
+			mInstanceTime += ob->captureTime;
 		}
+		irNode.mesh = ob->mesh;
+		mScene.meshes[ob->mesh]->instances++;
 	}
+	else
+		return;
 
-//	else if (id == Class_ID(WebGL_INS_CLASS_ID1, WebGL_INS_CLASS_ID2))
-//		WebGLOutInline((WebGLInsObject*) obj, level+1);
-
-	else if (targetClass == CAMERAS)
+	mScene.AddNode(irNode);
+}
+
+// Account for the output of a mesh that instancing spared the other
+// nodes using it
+void
+WebGL2Export::AddInstanceSavings(IRMesh& mesh, double bytes, double seconds)
+{
+	if (mesh.instances > 1)
 	{
-		if (id == Class_ID(SIMPLE_CAM_CLASS_ID, 0) || id == Class_ID(LOOKAT_CAM_CLASS_ID, 0))
-		{
-			StartNode (parent, level+1, isFirst);
-			WebGLOutCamera(node, obj, level+1);
-		}
+		mInstanceBytes += (mesh.instances - 1) * bytes;
+		mInstanceTime += (mesh.instances - 1) * seconds;
 	}
-	else if (isTriMesh && node->Renderable())
+}
+
+// The node a level of detail of a mesh is written under: the node
+// the mesh is named after, with the mesh and name of the level
+void
+WebGL2Export::LodNode(IRNode& node, int level, IRNode& lod)
+{
+	lod = node;
+	lod.mesh = mScene.meshes[node.mesh]->lods[level].mesh;
+	lod.name = mScene.meshes[lod.mesh]->name;
+}
+
+// The node a submesh is written under, like a level of detail.  Its
+// levels of detail are those of the submesh.
+void
+WebGL2Export::SubmeshNode(IRNode& node, int index, IRNode& sub)
+{
+	sub = node;
+	sub.mesh = mScene.meshes[node.mesh]->submeshes[index];
+	sub.name = mScene.meshes[sub.mesh]->name;
+}
+
+// Append the nodes the geometries of the mesh of a node are written
+// under: the node, its levels of detail, then each submesh followed
+// by its levels of detail
+void
+WebGL2Export::GeometryNodes(IRNode& node, std::vector<IRNode>& nodes)
+{
+	IRMesh& mesh = *mScene.meshes[node.mesh];
+	IRNode sub;
+	int i, k;
+
+	nodes.push_back(node);
+	for (i = -1; i < (int) mesh.submeshes.size(); i++)
 	{
-		if (targetClass == EMBEDS)
+		if (i >= 0)
 		{
-			StartNode (parent, level+1, isFirst);
-//			ob->objectUsed = TRUE;
-//			ob->instName = mNodes.GetNodeName(node);
-			instance = FALSE;
-			TriObject *tri = (TriObject *)obj->ConvertToType(mStart, triObjectClassID);
-				
-//			OutputTriObject(node, tri, multiMat, isWire, twoSided, level+1, 0, mirrored);
-			OutputTriObject(node, tri, FALSE, FALSE, FALSE, level+1, 0, mirrored);
+			SubmeshNode(node, i, sub);
+			nodes.push_back(sub);
 		}
-		else if (targetClass == OBJECTS || targetClass == GEOMETRIES)
+		IRNode& from = i < 0 ? node : sub;
+		for (k = 0; k < (int) mScene.meshes[from.mesh]->lods.size(); k++)
 		{
-			StartNode (parent, level+1, isFirst);
-			if (targetClass == OBJECTS)
-			{
-				Indent(level);
-				fwprintf(mStream, _T("\"%s\": {\n"), mNodes.GetNodeName(node));
-				OutputNodeTransform(node, level+1, mirrored);
-			}
-			else if (targetClass == GEOMETRIES)
-			{
-				Indent(level);
-				fwprintf(mStream, _T("\"%s_geo\": {\n"), mNodes.GetNodeName(node));
-				Indent(level+1);
-				fwprintf(mStream, _T("\"type\": \"embedded_mesh\",\n"));
-				Indent(level+1);
-				fwprintf(mStream, _T("\"id\" : \"%s_emb\"\n"), mNodes.GetNodeName(node));
-				Indent(level);
-				fwprintf(mStream, _T("}"), mNodes.GetNodeName(node));
-			}
-
-//			ObjectBucket* ob = mObjTable.AddObject(obj);
-			if (targetClass == OBJECTS)
-			{
-				instance = TRUE;
-				// We have an instance
-				//	StartNode (parent, level+1, isFirst);
-				Indent(level+1);
-				fwprintf(mStream, _T("\"geometry\": \"%s_geo\",\n"), mNodes.GetNodeName(node));
-				Indent(level+1);
-				fwprintf(mStream, _T("\"visible\": true,\n"));
-			}
+			nodes.push_back(IRNode());
+			LodNode(from, k, nodes.back());
 		}
+	}
+}
 
-		if (targetClass == OBJECTS)
+// Write the "geometries" entry of the mesh of a node
+void
+WebGL2Export::OutputGeometry(IRNode& node, BOOL *isFirst)
+{
+	int level = node.level;
+	const TCHAR* name = node.name.c_str();
+	IRMesh& mesh = *mScene.meshes[node.mesh];
+
+	// Meshes that can't be written to binary files stay embedded
+	TSTR url;
+	if (mBinaryGeometry && mesh.prim.kind == IR_PRIM_NONE)
+	{
+		double start = TimerSeconds();
+		size_t bytes = mBinaryBytes;
+		if (OutputBinaryMesh(node, url))
 		{
-			Indent(level+1);
-			fwprintf(mStream, _T("\"materials\": ["));
+			mBinaryMesh[node.mesh] = true;
+			AddInstanceSavings(mesh, (double) (mBinaryBytes - bytes),
+							   TimerSeconds() - start);
 		}
-		int numTextures = NumTextures(node);
-		int start, end;
+	}
+	StartNode (level+1, isFirst);
+	Indent(level);
+	mOut->Printf(_T("\"%s_geo\": {\n"), name);
+	if (mesh.prim.kind != IR_PRIM_NONE)
+		OutputPrimitive(mesh.prim, level+1);
+	else if (mBinaryMesh[node.mesh])
+	{
+		Indent(level+1);
+		mOut->Printf(_T("\"type\": \"bin_mesh\",\n"));
+		Indent(level+1);
+		mOut->Printf(_T("\"url\" : \"%s\"\n"), url.data());
+	}
+	else if (mBufferGeometry && node.materials.size() <= 1)
+	{
+		// BufferGeometry draws with a single material
+		mBufferMesh[node.mesh] = true;
+		Indent(level+1);
+		mOut->Printf(_T("\"type\": \"buffer_mesh\",\n"));
+		Indent(level+1);
+		mOut->Printf(_T("\"id\" : \"%s_emb\"\n"), name);
+	}
+	else
+	{
+		Indent(level+1);
+		mOut->Printf(_T("\"type\": \"embedded_mesh\",\n"));
+		Indent(level+1);
+		mOut->Printf(_T("\"id\" : \"%s_emb\"\n"), name);
+	}
+	Indent(level);
+	mOut->Printf(_T("}"));
+}
+
+// Write the levels of detail of an object, with the camera distance
+// each one takes over at.  The error of a level is in mesh units, so
+// the distance grows with the scale of the node.
+void
+WebGL2Export::OutputLods(IRNode& node, int level)
+{
+	IRMesh& mesh = *mScene.meshes[node.mesh];
+	TCHAR buf[MAX_PATH];
+	float scale = 0.0f;
+	for (int k = 0; k < 3; k++)
+	{
+		float s = (float) fabs(node.scale[k]);
+		if (s > scale)
+			scale = s;
+	}
+
+	Indent(level);
+	mOut->Printf(_T("\"lod\": ["));
+	for (int i = 0; i < (int) mesh.lods.size(); i++)
+	{
+		IRLod& lod = mesh.lods[i];
+		mOut->Printf(_T("%s{ \"geometry\": \"%s_geo\", \"distance\": %s }"),
+					 i > 0 ? _T(", ") : _T(""),
+					 mScene.meshes[lod.mesh]->name.c_str(),
+					 floatVal(buf, scale * lod.distance));
+	}
+	mOut->Printf(_T("],\n"));
+}
+
+// Write the submeshes of an object as children that sit where it does,
+// each with the materials of the object and levels of detail of its
+// own.  The children are named after the object, as instances share
+// the submeshes.
+void
+WebGL2Export::OutputSubmeshes(IRNode& node, int level)
+{
+	IRMesh& mesh = *mScene.meshes[node.mesh];
 
-		if (numTextures == 0)
+	Indent(level);
+	mOut->Printf(_T("\"children\": {"));
+	for (int i = 0; i < (int) mesh.submeshes.size(); i++)
+	{
+		IRNode sub;
+		SubmeshNode(node, i, sub);
+		mOut->Printf(_T("%s\n"), i > 0 ? _T(",") : _T(""));
+		Indent(level+1);
+		mOut->Printf(_T("\"%s_sub%d\": {\n"), node.name.c_str(), i + 1);
+		Indent(level+2);
+		mOut->Printf(_T("\"position\": [0,0,0],\n"));
+		Indent(level+2);
+		mOut->Printf(_T("\"rotation\": [0,0,0],\n"));
+		Indent(level+2);
+		mOut->Printf(_T("\"scale\": [1,1,1],\n"));
+		Indent(level+2);
+		mOut->Printf(_T("\"geometry\": \"%s_geo\",\n"), sub.name.c_str());
+		if (!mScene.meshes[sub.mesh]->lods.empty())
+			OutputLods(sub, level+2);
+		Indent(level+2);
+		mOut->Printf(_T("\"visible\": true,\n"));
+		Indent(level+2);
+		mOut->Printf(_T("\"materials\": ["));
+		OutputMaterialKeys(node);
+		mOut->Printf(_T("]\n"));
+		Indent(level+1);
+		mOut->Printf(_T("}"));
+	}
+	mOut->Printf(_T("\n"));
+	Indent(level);
+	mOut->Printf(_T("}\n"));
+}
+
+// Write the part of a captured node that belongs to the given section.
+void
+WebGL2Export::WebGLOutObject(IRNode& node, ClassToFind targetClass, BOOL *isFirst)
+{
+	int level = node.level;
+	const TCHAR* name = node.name.c_str();
+
+	if (targetClass == LIGHTS)
+	{
+		if (node.kind == IR_POINT_LIGHT)
 		{
-			start = -1;
-			end = 0;
+			StartNode (level+1, isFirst);
+			WebGLOutPointLight(node, level+1);
 		}
-		else
+		else if (node.kind == IR_DIRECT_LIGHT)
 		{
-			start = 0;
-			end = numTextures;
+			StartNode (level+1, isFirst);
+			WebGLOutDirectLight(node, level+1);
 		}
-		int old_level = level;
-		BOOL isFirstMat = TRUE;
-		for (int i = start; i < end; i++)
+		else if (node.kind == IR_SPOT_LIGHT)
 		{
-			BOOL multiMat = FALSE;
-			BOOL isWire = FALSE, twoSided = FALSE;
-		
-			// Output the material
-			if (targetClass == MATERIALS || targetClass == OBJECTS || targetClass == TEXTURES)  // if not trimesh, needs no matl
-			{
-				if (targetClass == MATERIALS || targetClass == TEXTURES)
-					multiMat = OutputMaterial(node, isWire, twoSided, level+1, i, isFirst, targetClass);
-				else
-					multiMat = OutputMaterial(node, isWire, twoSided, level+1, i, &isFirstMat, targetClass);
-			}
+			StartNode (level+1, isFirst);
+			WebGLOutSpotLight(node, level+1);
 		}
+	}
+	else if (targetClass == CAMERAS)
+	{
+		if (node.kind == IR_CAMERA)
+		{
+			StartNode (level+1, isFirst);
+			WebGLOutCamera(node, level+1);
+		}
+	}
+	else if (node.kind == IR_MESH)
+	{
+		// Only the node a shared mesh is named after writes it out
+		IRMesh& mesh = *mScene.meshes[node.mesh];
+		BOOL isOwner = mesh.name == node.name;
+
 		if (targetClass == OBJECTS)
 		{
-			fwprintf(mStream, _T("]\n")); // end of 'materials' list for this object
+			StartNode (level+1, isFirst);
 			Indent(level);
-			fwprintf(mStream, _T("}"));
+			mOut->Printf(_T("\"%s\": {\n"), name);
+			OutputNodeTransform(node, level+1);
+			Indent(level+1);
+			mOut->Printf(_T("\"geometry\": \"%s_geo\",\n"), mesh.name.c_str());
+			if (!mesh.lods.empty())
+				OutputLods(node, level+1);
+			Indent(level+1);
+			mOut->Printf(_T("\"visible\": true,\n"));
+			Indent(level+1);
+			mOut->Printf(_T("\"materials\": ["));
+			OutputMaterialKeys(node);
+		}
+		else if (targetClass == GEOMETRIES && isOwner)
+		{
+			std::vector<IRNode> geometries;
+			GeometryNodes(node, geometries);
+			for (size_t i = 0; i < geometries.size(); i++)
+				OutputGeometry(geometries[i], isFirst);
+		}
+
+		if (targetClass == OBJECTS)
+		{
+			if (mesh.submeshes.empty())
+				mOut->Printf(_T("]\n")); // end of 'materials' list for this object
+			else
+			{
+				mOut->Printf(_T("],\n"));
+				OutputSubmeshes(node, level+1);
+			}
+			Indent(level);
+			mOut->Printf(_T("}"));
 		}
 	}
 }
@@ -1943,10 +2902,8 @@ WebGL2Export::WebGLOutObject(INode* node, INode* parent, Object* obj, int level,
 TCHAR*
 WebGL2Export::WebGLParent(INode* node)
 {
-	static TCHAR buf[256];
 	assert (node);
-	_tcscpy(buf, mNodes.GetNodeName(node));
-	return buf;
+	return mNodes.GetNodeName(node);
 }
 
 BOOL
@@ -2237,15 +3194,15 @@ WebGL2Export::WriteVisibilityData(INode *node, int level) {
 		if (vis != lastVis) {
 			mHadAnim = TRUE;
 			Indent(level);
-			fwprintf(mStream, _T("HideKey_ktx_com {\n"));
+			mOut->Printf(_T("HideKey_ktx_com {\n"));
 			if (mGenFields) {
 				Indent(level+1);
-				fwprintf(mStream, _T("fields [ SFLong frame] \n"));
+				mOut->Printf(_T("fields [ SFLong frame] \n"));
 			}
 			Indent(level+1);
-			fwprintf(mStream, _T("frame %d\n"), i);
+			mOut->Printf(_T("frame %d\n"), i);
 			Indent(level);
-			fwprintf(mStream, _T("}\n"));
+			mOut->Printf(_T("}\n"));
 		}
 		lastVis = vis;
 	}    
@@ -2354,14 +3311,15 @@ WebGL2Export::WebGLOutControllers(INode* node, int level)
 	int ts = NodeNeedsTimeSensor(node);
 
 	if (ts != 0) {
+		TCHAR buf[FMT_BUF_SIZE];
 		mCycleInterval = (mIp->GetAnimRange().End() - mStart) /
 			((float) GetTicksPerFrame()* GetFrameRate());
 		Indent(level);
-		fwprintf(mStream,
+		mOut->Printf(
 		 _T("DEF %s-TIMER TimeSensor { loop %s cycleInterval %s },\n"),
 				mNodes.GetNodeName(node),
 				(ts < 0) ? _T("TRUE") : _T("FALSE"),
-				floatVal(mCycleInterval));
+				floatVal(buf, mCycleInterval));
 	}
 
 	lc = GetLightColorControl(node);
@@ -2405,307 +3363,1151 @@ WebGL2Export::WebGLOutControllers(INode* node, int level)
 #endif
 }
 
-void
-WebGL2Export::WebGLOutTopLevelCamera(int level, INode* node, BOOL topLevel)
+void
+WebGL2Export::WebGLOutTopLevelCamera(int level, INode* node, BOOL topLevel)
+{
+//	if (!topLevel && node == mCamera)
+//		return;
+		
+	CameraObject* cam = (CameraObject*) node->EvalWorldState(mStart).obj;
+	Matrix3 tm = node->GetObjTMAfterWSM(mStart);
+	Point3 p, s, axis;
+	Quat q;
+	float ang;
+
+	AffineParts parts;
+	decomp_affine(tm, &parts);
+	p = parts.t;
+	q = parts.q;
+	if (!mZUp)
+	{
+		// Now rotate around the X Axis PI/2
+		Matrix3 rot = RotateXMatrix(PI/2);
+		Quat qRot(rot);
+		AngAxisFromQa(q/qRot, &ang, axis);
+	}
+	else
+		AngAxisFromQa(q, &ang, axis);
+
+	// compute camera transform
+	ViewParams vp;
+	CameraState cs;
+	Interval iv;
+	cam->EvalCameraState(0, iv, &cs);
+	vp.fov = (float)(2.0 * atan(tan(cs.fov / 2.0) / INTENDED_ASPECT_RATIO));
+	/*
+	Indent(level);
+	mOut->Printf(_T("DEF %s Viewpoint {\n"), mNodes.GetNodeName(node));
+	Indent(level+1);
+	mOut->Printf(_T("position %s\n"), point(buf, p));
+	Indent(level+1);
+	mOut->Printf(_T("orientation %s\n"), axisPoint(buf, axis, -ang));
+	Indent(level+1);
+	mOut->Printf(_T("fieldOfView %s\n"), floatVal(buf, vp.fov));
+	Indent(level + 1);
+	mOut->Printf(_T("description \"%s\"\n"), mNodes.GetNodeName(node));
+	Indent(level);
+	mOut->Printf(_T("}\n"));
+
+	// Write out any animation data
+	InitInterpolators(node);
+	WebGLOutControllers(node, 0);
+	WriteInterpolatorRoutes(level, TRUE);
+	*/
+	// cameras go here
+}
+
+void
+WebGL2Export::WebGLOutTopLevelNavInfo(int level, INode* node, BOOL topLevel)
+{
+}
+
+void
+WebGL2Export::WebGLOutTopLevelBackground(int level, INode* node, BOOL topLevel)
+{
+}
+
+void
+WebGL2Export::WebGLOutTopLevelFog(int level, INode* node, BOOL topLevel)
+{
+}
+
+void
+WebGL2Export::WebGLOutInitializeAudioClip(int level, INode* node)
+{
+}
+
+void
+WebGL2Export::WebGLOutAudioClip(int level, INode* node)
+{
+}
+
+// From dllmain.cpp
+extern HINSTANCE hInstance;
+
+void
+WebGL2Export::WebGLOutFileInfo()
+{
+	TCHAR filename[MAX_PATH];
+	DWORD size, dummy;
+	float vernum = 2.0f;
+	float betanum = 0.0f;
+
+	GetModuleFileName(hInstance, filename, MAX_PATH);
+	size = GetFileVersionInfoSize(filename, &dummy);
+	if (size)
+	{
+		TCHAR *buf = (TCHAR *)malloc(size*sizeof(TCHAR));
+		GetFileVersionInfo(filename, NULL, size*sizeof(TCHAR), buf);
+		VS_FIXEDFILEINFO *qbuf;
+		UINT len;
+		if (VerQueryValue(buf, _T("\\"), (void **)&qbuf, &len))
+		{
+			// got the version information
+			DWORD ms = qbuf->dwProductVersionMS;
+			DWORD ls = qbuf->dwProductVersionLS;
+			vernum = HIWORD(ms) + (LOWORD(ms) / 100.0f);
+			betanum = HIWORD(ls) + (LOWORD(ls) / 100.0f);
+		}
+		free(buf);
+	}
+	mOut->Printf(_T("\"metadata\": {\n"));
+	Indent (1);
+	mOut->Printf(_T("\"formatVersion\": 3,\n"));
+	Indent (1);
+	mOut->Printf(_T("\"type\": \"scene\",\n"));
+	Indent (1);
+	const TCHAR* fn = mIp->GetCurFileName();
+	mOut->Printf(_T("\"sourceFile\": \"%s\",\n"), fn);
+	Indent (1);
+	mOut->Printf(_T("\"generatedBy\" : \"3D Studio MAX WebGL exporter, Version %.5g, Revision %.5g\""),
+		vernum, betanum);
+	mOut->Printf(_T("\n},\n"));
+
+/*	
+	time_t ltime;
+	time( &ltime );
+	char * time = ctime(&ltime);
+	// strip the CR
+	time[strlen(time)-1] = '\0';
+	if (fn && _tcslen(fn) > 0) {
+		mOut->Printf(_T("// MAX File: %s, Date: %s\n\n"), fn, time);
+	} else {
+		mOut->Printf(_T("// Date: %s\n\n"), time);
+	}
+*/
+}
+
+void
+WebGL2Export::WebGLOutWorldInfo()
+{
+	if (mTitle.Length() == 0 && mInfo.Length() == 0)
+		return;
+
+	mOut->Printf(_T("\"metadata\":\n"));
+	Indent(1);
+	mOut->Printf(_T("{\n"));
+	if (mTitle.Length() != 0)
+	{
+		Indent(2);
+		mOut->Printf(_T("\"sourceFile\"    : \"%s\""), mTitle.data());
+//		mOut->Printf(_T("title \"%s\"\n"), mTitle.data());
+	}
+	/*
+	if (mInfo.Length() != 0)
+	{
+		Indent(1);
+		mOut->Printf(_T("info \"%s\"\n"), mInfo.data());
+	}
+	*/
+	Indent(1);
+	mOut->Printf(_T("}\n"));
+}
+
+int
+WebGL2Export::StartAnchor(INode* node, int& level)
+{
+	return 0;
+}
+
+// Recursively count a node and all its children
+static int
+CountNodes(INode *node)
+{
+	int total, kids, i;
+	
+	if (node == NULL)
+		return 0;
+	total = 1;
+	kids = node->NumberOfChildren();
+	for (i = 0; i < kids; i++)
+		total += CountNodes(node->GetChildNode(i));
+	return total;
+}
+
+// Capture a single node and recursively capture the children of
+// the node.
+void
+WebGL2Export::CaptureNode(INode* node, INode* parent, int level, BOOL isLOD,
+						 BOOL mirrored)
+{
+ // Don't gen code for LOD references, only LOD nodes
+	if (!isLOD && ObjectIsLODRef(node))
+		return;
+	
+	if (mEnableProgressBar)
+		SendMessage(hWndPDlg, 666, 0, (LPARAM) mNodes.GetNodeName(node));
+	
+	Object* obj         = node->EvalWorldState(mStart).obj;
+	int     numChildren = node->NumberOfChildren();
+	BOOL    isWebGL      = isWebGLObject(node, obj, parent);
+	BOOL    mirror      = FALSE;
+
+	if ((isWebGL && (mExportHidden || !node->IsHidden())) || IsAnimTrigger(obj))
+	{
+		CaptureObject(node, level+2, mirrored ^ mirror);
+	}
+	
+	if (mEnableProgressBar) SendMessage(hWndPB, PBM_STEPIT, 0, 0);
+
+	// Now capture the children
+	for (int i = 0; i < numChildren; i++)
+	{
+		CaptureNode(node->GetChildNode(i), node, level+2, FALSE,
+			mirrored ^ mirror);
+	}
+}
+
+// Walk the scene graph once and capture everything the scene file needs.
+void
+WebGL2Export::CaptureScene()
+{
+	mScene.Clear();
+	mObjTable.Clear();
+	mMtlTable.Clear();
+	mInstances = 0;
+	mInstanceBytes = 0.0;
+	mInstanceTime = 0.0;
+	mPrimitiveCount = 0;
+	CaptureNode(mIp->GetRootNode(), NULL, -2, FALSE, FALSE);
+	int slots = 0;
+	for (size_t i = 0; i < mScene.nodes.size(); i++)
+		slots += (int) mScene.nodes[i].materials.size();
+	DebugPrint(_T("WebGL export: %d material slots share %d materials and %d textures\n"),
+			   slots, (int) mScene.materials.size(), (int) mScene.textures.size());
+	DebugPrint(_T("WebGL export: %d material slots evaluated, %d found in the cache\n"),
+			   mMtlTable.Misses(), mMtlTable.Hits());
+	if (mPrimitives)
+		DebugPrint(_T("WebGL export: %d primitives written as three.js geometries\n"),
+				   mPrimitiveCount);
+}
+
+// Merge the static mesh nodes that share their materials into batches
+// in world space, and report the draw calls it saves.  Runs before the
+// meshes are converted, on the vertices as MAX has them.
+void
+WebGL2Export::BatchMeshes()
+{
+	BatchStats stats;
+	double start = TimerSeconds();
+	BatchStatic(mScene, BATCH_MAX_VERTS, BATCH_CELLS, stats);
+	DebugPrint(_T("WebGL export: %d static nodes merged into %d batches in %.1f ms, draw calls %d -> %d\n"),
+			   stats.nodes, stats.batches, (TimerSeconds() - start) * 1000.0,
+			   stats.drawCalls[0], stats.drawCalls[1]);
+}
+
+// Move every captured mesh into the space of the scene file, one pass
+// over each array: pivot baked, mirrored by vertices, Y up.  The
+// writers take the arrays as they are from here on.
+void
+WebGL2Export::ConvertMeshes()
+{
+	std::vector<bool> done(mScene.meshes.size(), false);
+	int verts = 0, normals = 0;
+	double start = TimerSeconds();
+
+	for (size_t i = 0; i < mScene.nodes.size(); i++)
+	{
+		IRNode& node = mScene.nodes[i];
+		if (node.mesh < 0 || done[node.mesh])
+			continue;
+		done[node.mesh] = true;
+
+		// Nodes sharing a mesh agree on mirroring and pivot
+		IRMesh& mesh = *mScene.meshes[node.mesh];
+		bool mirror = false;
+#ifdef MIRROR_BY_VERTICES
+		mirror = node.mirrored;
+#endif
+		if (!mesh.verts.empty())
+			XformPoints(&mesh.verts[0], mesh.NumVerts(), node.pivot, mirror,
+						!mZUp);
+		if (!mesh.normals.empty())
+			XformPoints(&mesh.normals[0], mesh.NumNormals(), NULL, false,
+						!mZUp);
+		if (mesh.prim.kind != IR_PRIM_NONE)
+			XformPoints(mesh.prim.center, 1, node.pivot, mirror, !mZUp);
+		verts += mesh.NumVerts();
+		normals += mesh.NumNormals();
+	}
+	DebugPrint(_T("WebGL export: converted %d vertices and %d normals in %.1f ms\n"),
+			   verts, normals, (TimerSeconds() - start) * 1000.0);
+}
+
+// The LOD option lists the faces of each level in percent of the
+// mesh, as "50% 25%".  A level that is not smaller than the one before
+// it is dropped; "Off" has none.
+void
+WebGL2Export::ParseLodRatios(const TCHAR* text)
+{
+	float last = 1.0f;
+	mLodRatios.clear();
+	while (*text)
+	{
+		if (!_istdigit(*text))
+		{
+			text++;
+			continue;
+		}
+		TCHAR* end;
+		float ratio = (float) _tcstod(text, &end) / 100.0f;
+		text = end;
+		if (ratio > 0.0f && ratio < last)
+		{
+			mLodRatios.push_back(ratio);
+			last = ratio;
+		}
+	}
+}
+
+// Meshes with fewer faces get no levels of detail, and a chain stops
+// at a level that could not get below this much of the one before
+#define LOD_MIN_FACES 256
+#define LOD_MIN_STEP  0.9f
+
+// A mesh whose levels of detail are simplified on a worker thread,
+// each level from the one before it
+struct LodJob {
+	IRMesh*              mesh;
+	std::vector<float>*  ratios;
+	std::vector<IRMesh*> levels;    // coarsest last
+	std::vector<float>   errors;    // from the mesh, of each level
+	int                  faces;     // visible faces of the mesh
+};
+
+static void
+SimplifyLods(void* data, int index)
+{
+	LodJob& job = ((LodJob*) data)[index];
+	const IRMesh* from = job.mesh;
+	float error = 0.0f;
+
+	for (size_t i = 0; i < job.ratios->size(); i++)
+	{
+		IRMesh* lod = new IRMesh;
+		SimplifyStats stats;
+		SimplifyMesh(*from, (int) ((*job.ratios)[i] * job.faces), *lod, stats);
+		if (i == 0)
+			job.faces = stats.faces[0];
+		if (stats.faces[1] == 0 ||
+			stats.faces[1] > LOD_MIN_STEP * stats.faces[0])
+		{
+			delete lod;
+			break;
+		}
+		// The errors of a chain add up at worst
+		error += stats.error;
+		job.levels.push_back(lod);
+		job.errors.push_back(error);
+		from = lod;
+	}
+}
+
+// Simplify every captured mesh into the levels of detail of the LOD
+// option.  The levels are meshes of the scene named after their mesh,
+// so the passes after this one treat them like any other mesh.
+void
+WebGL2Export::GenerateLods()
+{
+	std::vector<LodJob> jobs;
+	size_t i;
+	for (i = 0; i < mScene.meshes.size(); i++)
+	{
+		IRMesh* mesh = mScene.meshes[i];
+		if (mesh->prim.kind != IR_PRIM_NONE || mesh->NumFaces() < LOD_MIN_FACES)
+			continue;
+		LodJob job;
+		job.mesh = mesh;
+		job.ratios = &mLodRatios;
+		job.faces = 0;
+		for (int f = 0; f < mesh->NumFaces(); f++)
+		{
+			if (!mesh->faces[f].hidden)
+				job.faces++;
+		}
+		jobs.push_back(job);
+	}
+	if (jobs.empty())
+		return;
+
+	WorkPool pool;
+	double start = TimerSeconds();
+	pool.Run(SimplifyLods, &jobs[0], (int) jobs.size());
+	double seconds = TimerSeconds() - start;
+
+	int levels = 0, faces[2] = { 0, 0 };
+	for (i = 0; i < jobs.size(); i++)
+	{
+		LodJob& job = jobs[i];
+		IRMesh& mesh = *job.mesh;
+		float distance = 0.0f;
+		for (int k = 0; k < (int) job.levels.size(); k++)
+		{
+			TCHAR name[MAX_PATH];
+			IRMesh* lod = job.levels[k];
+			SPRINTF(name, _T("%s_lod%d"), mesh.name.c_str(), k + 1);
+			lod->name = name;
+			lod->instances = mesh.instances;
+
+			// Coarser levels never come in closer
+			IRLod level;
+			level.error = job.errors[k];
+			level.distance = LodDistance(level.error);
+			if (level.distance < distance)
+				level.distance = distance;
+			distance = level.distance;
+			level.mesh = mScene.AddMesh(lod);
+			mesh.lods.push_back(level);
+#ifdef DEBUG_LOD
+			DebugPrint(_T("WebGL export: %s: LOD %d, %d -> %d faces, error %g, from %g\n"),
+					   mesh.name.c_str(), k + 1, job.faces, lod->NumFaces(),
+					   level.error, level.distance);
+#endif
+			faces[1] += lod->NumFaces();
+			levels++;
+		}
+		faces[0] += job.faces;
+	}
+	DebugPrint(_T("WebGL export: %d LOD levels of %d meshes (%d faces, %d in levels) on %d threads in %.1f ms\n"),
+			   levels, (int) jobs.size(), faces[0], faces[1], pool.Threads(),
+			   seconds * 1000.0);
+}
+
+// A mesh cut into submeshes on a worker thread, with its levels of
+// detail cut along the same planes
+struct SplitJob {
+	IRMesh*              mesh;
+	std::vector<IRMesh*> levels;    // meshes of its levels of detail
+	int                  count;     // submeshes, 1 if the mesh fits
+	int                  keep;      // levels that fit once cut
+	std::vector<IRMesh*> subs;      // count per level, the mesh first
+};
+
+static void
+SplitMeshLevels(void* data, int index)
+{
+	SplitJob& job = ((SplitJob*) data)[index];
+	std::vector<SplitNode> tree;
+
+	job.keep = 0;
+	job.count = SplitPlan(*job.mesh, SPLIT_MAX_VERTS, tree);
+	if (job.count < 2)
+		return;
+	SplitApply(*job.mesh, tree, job.count, job.subs);
+
+	// A level whose pieces still do not fit ends the chain
+	for (size_t k = 0; k < job.levels.size(); k++)
+	{
+		std::vector<IRMesh*> subs;
+		SplitApply(*job.levels[k], tree, job.count, subs);
+		bool fits = true;
+		for (int s = 0; s < job.count && fits; s++)
+		{
+			WeldedMesh welded;
+			WeldMesh(*subs[s], welded);
+			fits = welded.NumVerts() <= SPLIT_MAX_VERTS;
+		}
+		if (!fits)
+		{
+			for (int s = 0; s < job.count; s++)
+				delete subs[s];
+			break;
+		}
+		job.subs.insert(job.subs.end(), subs.begin(), subs.end());
+		job.keep++;
+	}
+}
+
+// Delete the meshes marked in drop, which nothing may use, and
+// renumber the others in the nodes, levels of detail and submeshes
+static void
+DropMeshes(IRScene& scene, const std::vector<bool>& drop)
+{
+	std::vector<int> map(scene.meshes.size(), -1);
+	std::vector<IRMesh*> meshes;
+	size_t i, k;
+
+	for (i = 0; i < scene.meshes.size(); i++)
+	{
+		if (drop[i])
+			delete scene.meshes[i];
+		else
+		{
+			map[i] = (int) meshes.size();
+			meshes.push_back(scene.meshes[i]);
+		}
+	}
+	for (i = 0; i < scene.nodes.size(); i++)
+	{
+		if (scene.nodes[i].mesh >= 0)
+			scene.nodes[i].mesh = map[scene.nodes[i].mesh];
+	}
+	for (i = 0; i < meshes.size(); i++)
+	{
+		IRMesh& mesh = *meshes[i];
+		for (k = 0; k < mesh.lods.size(); k++)
+			mesh.lods[k].mesh = map[mesh.lods[k].mesh];
+		for (k = 0; k < mesh.submeshes.size(); k++)
+			mesh.submeshes[k] = map[mesh.submeshes[k]];
+	}
+	scene.meshes.swap(meshes);
+}
+
+// Cut every captured mesh with more welded vertices than 16 bit
+// indices reach into submeshes that fit, so the viewer can draw them
+// on any WebGL.  The first submesh stays in the mesh; the others, and
+// the pieces of the levels of detail, are meshes of the scene named
+// after the one they come from.  Levels of detail still too large
+// once cut are dropped from the scene.  Runs after the levels of
+// detail are made from the whole mesh, and before the faces are
+// reordered.
+void
+WebGL2Export::SplitMeshes()
+{
+	std::vector<SplitJob> jobs;
+	std::vector<bool> isLevel(mScene.meshes.size(), false);
+	size_t i;
+	int s, k;
+
+	for (i = 0; i < mScene.meshes.size(); i++)
+	{
+		for (k = 0; k < (int) mScene.meshes[i]->lods.size(); k++)
+			isLevel[mScene.meshes[i]->lods[k].mesh] = true;
+	}
+	for (i = 0; i < mScene.meshes.size(); i++)
+	{
+		IRMesh* mesh = mScene.meshes[i];
+		if (isLevel[i] || mesh->prim.kind != IR_PRIM_NONE ||
+			mesh->NumFaces() == 0)
+			continue;
+		SplitJob job;
+		job.mesh = mesh;
+		for (k = 0; k < (int) mesh->lods.size(); k++)
+			job.levels.push_back(mScene.meshes[mesh->lods[k].mesh]);
+		jobs.push_back(job);
+	}
+	if (jobs.empty())
+		return;
+
+	WorkPool pool;
+	double start = TimerSeconds();
+	pool.Run(SplitMeshLevels, &jobs[0], (int) jobs.size());
+	double seconds = TimerSeconds() - start;
+
+	int meshes = 0, submeshes = 0, dropped = 0;
+	std::vector<bool> drop(mScene.meshes.size(), false);
+	for (i = 0; i < jobs.size(); i++)
+	{
+		SplitJob& job = jobs[i];
+		if (job.count < 2)
+			continue;
+		IRMesh& mesh = *job.mesh;
+#ifdef DEBUG_SPLIT
+		int faces = mesh.NumFaces();
+#endif
+		if (job.keep < (int) mesh.lods.size())
+		{
+#ifdef DEBUG_SPLIT
+			DebugPrint(_T("WebGL export: %s: LOD %d and coarser dropped, too large once cut\n"),
+					   mesh.name.c_str(), job.keep + 1);
+#endif
+			for (k = job.keep; k < (int) mesh.lods.size(); k++)
+				drop[mesh.lods[k].mesh] = true;
+			dropped += (int) mesh.lods.size() - job.keep;
+			mesh.lods.resize(job.keep);
+		}
+		for (k = 0; k <= job.keep; k++)
+		{
+			IRMesh& whole = k == 0 ? mesh : *mScene.meshes[mesh.lods[k - 1].mesh];
+			IRMesh** subs = &job.subs[k * job.count];
+			whole.verts.swap(subs[0]->verts);
+			whole.tverts.swap(subs[0]->tverts);
+			whole.colors.swap(subs[0]->colors);
+			whole.normals.swap(subs[0]->normals);
+			whole.faces.swap(subs[0]->faces);
+			whole.faceNormals.swap(subs[0]->faceNormals);
+			delete subs[0];
+
+			for (s = 1; s < job.count; s++)
+			{
+				TCHAR name[MAX_PATH];
+				SPRINTF(name, _T("%s_sub%d"), whole.name.c_str(), s);
+				subs[s]->name = name;
+				subs[s]->instances = mesh.instances;
+				int m = mScene.AddMesh(subs[s]);
+				if (k == 0)
+					mesh.submeshes.push_back(m);
+				else
+				{
+					IRLod level = mesh.lods[k - 1];
+					level.mesh = m;
+					mScene.meshes[mesh.submeshes[s - 1]]->lods.push_back(level);
+				}
+			}
+		}
+#ifdef DEBUG_SPLIT
+		DebugPrint(_T("WebGL export: %s: %d faces cut into %d submeshes\n"),
+				   mesh.name.c_str(), faces, job.count);
+#endif
+		meshes++;
+		submeshes += job.count;
+	}
+	if (dropped > 0)
+	{
+		drop.resize(mScene.meshes.size(), false);
+		DropMeshes(mScene, drop);
+	}
+	if (meshes > 0)
+		DebugPrint(_T("WebGL export: %d meshes over %d vertices cut into %d submeshes on %d threads in %.1f ms, %d LOD levels dropped\n"),
+				   meshes, SPLIT_MAX_VERTS, submeshes, pool.Threads(),
+				   seconds * 1000.0, dropped);
+}
+
+// A mesh whose faces are put in vertex cache order on a worker thread
+struct ReorderJob {
+	IRMesh* mesh;
+	float   maxLoss;    // ACMR loss allowed for less overdraw, < 0 for none
+	int     faces;      // visible faces
+	int     clusters;   // clusters sorted for overdraw, 0 if not tried
+	double  acmr[2];    // before and after
+	double  atvr[2];
+	double  overdraw[2];
+};
+
+static void
+ReorderMesh(void* data, int index)
+{
+	ReorderJob& job = ((ReorderJob*) data)[index];
+	IRMesh& mesh = *job.mesh;
+	WeldedMesh welded;
+	std::vector<int> order;
+	int i;
+
+	// The GPU caches the vertices of the indexed buffer, which are the
+	// corners sharing position, normal and uv
+	WeldMesh(mesh, welded);
+	job.faces = welded.NumFaces();
+	if (job.faces == 0)
+		return;
+	int* tris = &welded.indices[0];
+	VCacheStats(tris, job.faces, welded.NumVerts(), VCACHE_SIZE, NULL,
+				&job.acmr[0], &job.atvr[0]);
+	VCacheOrder(tris, job.faces, welded.NumVerts(), VCACHE_SIZE, order);
+
+	if (job.maxLoss >= 0.0f)
+	{
+		// Sort clusters front to back, and keep them only if the
+		// software render shows less overdraw
+		std::vector<float> verts(3 * welded.NumVerts());
+		for (i = 0; i < welded.NumVerts(); i++)
+		{
+			int v = welded.corners[3 * i];
+			for (int k = 0; k < 3; k++)
+				verts[3 * i + k] = mesh.verts[3 * v + k];
+		}
+		std::vector<int> sorted(order);
+		job.overdraw[0] = OverdrawMeasure(&verts[0], tris, job.faces, &order[0],
+										  OVERDRAW_RASTER);
+		job.clusters = OverdrawOrder(&verts[0], tris, job.faces,
+									 welded.NumVerts(), VCACHE_SIZE,
+									 job.maxLoss, sorted);
+		job.overdraw[1] = OverdrawMeasure(&verts[0], tris, job.faces, &sorted[0],
+										  OVERDRAW_RASTER);
+		if (job.overdraw[1] < job.overdraw[0])
+			order.swap(sorted);
+		else
+		{
+			job.clusters = 1;
+			job.overdraw[1] = job.overdraw[0];
+		}
+	}
+	VCacheStats(tris, job.faces, welded.NumVerts(), VCACHE_SIZE, &order[0],
+				&job.acmr[1], &job.atvr[1]);
+
+	// The welded faces are the visible ones; hidden faces go last
+	std::vector<int> visible, hidden;
+	for (i = 0; i < mesh.NumFaces(); i++)
+		(mesh.faces[i].hidden ? hidden : visible).push_back(i);
+	for (i = 0; i < (int) order.size(); i++)
+		order[i] = visible[order[i]];
+	order.insert(order.end(), hidden.begin(), hidden.end());
+
+	std::vector<IRFace> faces;
+	std::vector<int> faceNormals;
+	faces.reserve(order.size());
+	faceNormals.reserve(3 * order.size());
+	for (i = 0; i < (int) order.size(); i++)
+	{
+		int f = order[i];
+		faces.push_back(mesh.faces[f]);
+		faceNormals.insert(faceNormals.end(), &mesh.faceNormals[3 * f],
+						   &mesh.faceNormals[3 * f] + 3);
+	}
+	mesh.faces.swap(faces);
+	mesh.faceNormals.swap(faceNormals);
+}
+
+// Put the faces of every captured mesh in vertex cache order, and
+// report the simulated cache misses before and after.
+void
+WebGL2Export::ReorderFaces()
+{
+	std::vector<ReorderJob> jobs(mScene.meshes.size());
+	if (jobs.empty())
+		return;
+	for (size_t i = 0; i < jobs.size(); i++)
+	{
+		ReorderJob& job = jobs[i];
+		job.mesh = mScene.meshes[i];
+		job.maxLoss = mOverdrawLoss < 0 ? -1.0f : mOverdrawLoss / 100.0f;
+		job.faces = 0;
+		job.clusters = 0;
+		job.acmr[0] = job.acmr[1] = job.atvr[0] = job.atvr[1] = 0.0;
+		job.overdraw[0] = job.overdraw[1] = 0.0;
+	}
+
+	WorkPool pool;
+	double start = TimerSeconds();
+	pool.Run(ReorderMesh, &jobs[0], (int) jobs.size());
+	double seconds = TimerSeconds() - start;
+
+	int faces = 0;
+	double misses[2] = { 0.0, 0.0 };
+	for (size_t i = 0; i < jobs.size(); i++)
+	{
+		ReorderJob& job = jobs[i];
+		if (job.faces == 0)
+			continue;
+#ifdef DEBUG_REORDER
+		DebugPrint(_T("WebGL export: %s: %d faces, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n"),
+				   job.mesh->name.c_str(), job.faces, job.acmr[0], job.acmr[1],
+				   job.atvr[0], job.atvr[1]);
+		if (job.clusters > 0)
+			DebugPrint(_T("WebGL export: %s: %d clusters, overdraw %.3f -> %.3f\n"),
+					   job.mesh->name.c_str(), job.clusters,
+					   job.overdraw[0], job.overdraw[1]);
+#endif
+		faces += job.faces;
+		misses[0] += job.acmr[0] * job.faces;
+		misses[1] += job.acmr[1] * job.faces;
+	}
+	if (faces > 0)
+		DebugPrint(_T("WebGL export: reordered %d faces on %d threads in %.1f ms, ACMR %.3f -> %.3f\n"),
+				   faces, pool.Threads(), seconds * 1000.0,
+				   misses[0] / faces, misses[1] / faces);
+}
+
+// Sort the faces of a mesh by material with a counting sort, hidden
+// faces last.  The sort is stable, so the faces of each material keep
+// the vertex cache order they had.  Returns the runs of faces of one
+// material the visible faces were in before.
+static int
+SortFacesByMaterial(IRMesh& mesh)
 {
-//	if (!topLevel && node == mCamera)
-//		return;
-		
-	CameraObject* cam = (CameraObject*) node->EvalWorldState(mStart).obj;
-	Matrix3 tm = node->GetObjTMAfterWSM(mStart);
-	Point3 p, s, axis;
-	Quat q;
-	float ang;
+	int numfaces = mesh.NumFaces();
+	int i, maxID = 0, runs = 0, last = -1;
 
-	AffineParts parts;
-	decomp_affine(tm, &parts);
-	p = parts.t;
-	q = parts.q;
-	if (!mZUp)
+	for (i = 0; i < numfaces; i++)
 	{
-		// Now rotate around the X Axis PI/2
-		Matrix3 rot = RotateXMatrix(PI/2);
-		Quat qRot(rot);
-		AngAxisFromQa(q/qRot, &ang, axis);
+		const IRFace& f = mesh.faces[i];
+		if (f.matID > maxID)
+			maxID = f.matID;
+		if (!f.hidden && f.matID != last)
+		{
+			runs++;
+			last = f.matID;
+		}
 	}
-	else
-		AngAxisFromQa(q, &ang, axis);
+	if (runs <= 1)
+		return runs;
 
-	// compute camera transform
-	ViewParams vp;
-	CameraState cs;
-	Interval iv;
-	cam->EvalCameraState(0, iv, &cs);
-	vp.fov = (float)(2.0 * atan(tan(cs.fov / 2.0) / INTENDED_ASPECT_RATIO));
-	/*
-	Indent(level);
-	fwprintf(mStream, _T("DEF %s Viewpoint {\n"), mNodes.GetNodeName(node));
-	Indent(level+1);
-	fwprintf(mStream, _T("position %s\n"), point(p));
-	Indent(level+1);
-	fwprintf(mStream, _T("orientation %s\n"), axisPoint(axis, -ang));
-	Indent(level+1);
-	fwprintf(mStream, _T("fieldOfView %s\n"), floatVal(vp.fov));
-	Indent(level + 1);
-	fwprintf(mStream, _T("description \"%s\"\n"), mNodes.GetNodeName(node));
-	Indent(level);
-	fwprintf(mStream, _T("}\n"));
+	// Bucket maxID + 1 holds the hidden faces
+	std::vector<int> starts(maxID + 3, 0);
+	for (i = 0; i < numfaces; i++)
+	{
+		const IRFace& f = mesh.faces[i];
+		starts[(f.hidden ? maxID + 1 : f.matID) + 1]++;
+	}
+	for (i = 1; i < (int) starts.size(); i++)
+		starts[i] += starts[i - 1];
 
-	// Write out any animation data
-	InitInterpolators(node);
-	WebGLOutControllers(node, 0);
-	WriteInterpolatorRoutes(level, TRUE);
-	*/
-	// cameras go here
+	bool normals = !mesh.faceNormals.empty();
+	std::vector<IRFace> faces(numfaces);
+	std::vector<int> faceNormals(mesh.faceNormals.size());
+	for (i = 0; i < numfaces; i++)
+	{
+		const IRFace& f = mesh.faces[i];
+		int to = starts[f.hidden ? maxID + 1 : f.matID]++;
+		faces[to] = f;
+		if (normals)
+		{
+			for (int k = 0; k < 3; k++)
+				faceNormals[3 * to + k] = mesh.faceNormals[3 * i + k];
+		}
+	}
+	mesh.faces.swap(faces);
+	mesh.faceNormals.swap(faceNormals);
+	return runs;
 }
 
+// Put the faces of every mesh used by a node with more than one
+// material slot in one range per material, which the metadata of the
+// mesh lists.  Meshes of single material nodes keep their vertex cache
+// order, however many material IDs their faces carry.  Runs after the
+// faces are reordered, and before they are paired into quads.
 void
-WebGL2Export::WebGLOutTopLevelNavInfo(int level, INode* node, BOOL topLevel)
+WebGL2Export::GroupFaces()
 {
-}
+	int meshes = 0, runs = 0, groups = 0;
+	double start = TimerSeconds();
+
+	// The meshes of multi-material nodes, with their levels of detail
+	// and the meshes split off them
+	std::vector<bool> multi(mScene.meshes.size(), false);
+	std::vector<int> stack;
+	for (size_t i = 0; i < mScene.nodes.size(); i++)
+	{
+		const IRNode& node = mScene.nodes[i];
+		if (node.mesh >= 0 && node.materials.size() > 1)
+			stack.push_back(node.mesh);
+	}
+	while (!stack.empty())
+	{
+		int m = stack.back();
+		stack.pop_back();
+		if (multi[m])
+			continue;
+		multi[m] = true;
+		const IRMesh& mesh = *mScene.meshes[m];
+		for (size_t k = 0; k < mesh.lods.size(); k++)
+			stack.push_back(mesh.lods[k].mesh);
+		for (size_t k = 0; k < mesh.submeshes.size(); k++)
+			stack.push_back(mesh.submeshes[k]);
+	}
 
-void
-WebGL2Export::WebGLOutTopLevelBackground(int level, INode* node, BOOL topLevel)
-{
+	for (size_t i = 0; i < mScene.meshes.size(); i++)
+	{
+		if (!multi[i])
+			continue;
+		IRMesh& mesh = *mScene.meshes[i];
+		int before = SortFacesByMaterial(mesh);
+		if (before <= 1)
+			continue;
+		int after = 1;
+		for (int f = 1; f < mesh.NumFaces(); f++)
+		{
+			if (!mesh.faces[f].hidden && mesh.faces[f].matID != mesh.faces[f - 1].matID)
+				after++;
+		}
+		meshes++;
+		runs += before;
+		groups += after;
+	}
+	if (meshes > 0)
+		DebugPrint(_T("WebGL export: faces of %d meshes sorted by material in %.1f ms, %d runs -> %d groups\n"),
+				   meshes, (TimerSeconds() - start) * 1000.0, runs, groups);
 }
 
-void
-WebGL2Export::WebGLOutTopLevelFog(int level, INode* node, BOOL topLevel)
-{
-}
+// A mesh whose triangles are paired into quads on a worker thread
+struct QuadJob {
+	IRMesh*   mesh;
+	QuadStats stats;
+	double    numbers[2];   // of the "faces" array, before and after
+};
 
-void
-WebGL2Export::WebGLOutInitializeAudioClip(int level, INode* node)
+static void
+PairMeshQuads(void* data, int index)
 {
+	QuadJob& job = ((QuadJob*) data)[index];
+	IRMesh& mesh = *job.mesh;
+	PairQuads(mesh, QUAD_FLATNESS, mesh.quads, job.stats);
+	if (job.stats.quads == 0)
+		mesh.quads.clear();
+
+	// type, vertices, material, uvs, normals
+	int uvs = mesh.NumTVerts() > 0 ? 1 : 0;
+	int tri = 2 + 3 * (2 + uvs), quad = 2 + 4 * (2 + uvs);
+	job.numbers[0] = (double) tri * (job.stats.triangles + 2 * job.stats.quads);
+	job.numbers[1] = (double) tri * job.stats.triangles +
+		(double) quad * job.stats.quads;
 }
 
+// Pair the triangles of every captured mesh into quad face records,
+// for the quad and n-gon polygon types.  Runs after the faces are
+// reordered, as it indexes them.
 void
-WebGL2Export::WebGLOutAudioClip(int level, INode* node)
+WebGL2Export::MakeQuads()
 {
-}
-
-// From dllmain.cpp
-extern HINSTANCE hInstance;
+	std::vector<QuadJob> jobs(mScene.meshes.size());
+	if (jobs.empty())
+		return;
+	for (size_t i = 0; i < jobs.size(); i++)
+		jobs[i].mesh = mScene.meshes[i];
 
-void
-WebGL2Export::WebGLOutFileInfo()
-{
-	TCHAR filename[MAX_PATH];
-	DWORD size, dummy;
-	float vernum = 2.0f;
-	float betanum = 0.0f;
+	WorkPool pool;
+	double start = TimerSeconds();
+	pool.Run(PairMeshQuads, &jobs[0], (int) jobs.size());
+	double seconds = TimerSeconds() - start;
 
-	GetModuleFileName(hInstance, filename, MAX_PATH);
-	size = GetFileVersionInfoSize(filename, &dummy);
-	if (size)
+	int quads = 0, nonPlanar = 0, triangles = 0;
+	double numbers[2] = { 0.0, 0.0 };
+	for (size_t i = 0; i < jobs.size(); i++)
 	{
-		TCHAR *buf = (TCHAR *)malloc(size*sizeof(TCHAR));
-		GetFileVersionInfo(filename, NULL, size*sizeof(TCHAR), buf);
-		VS_FIXEDFILEINFO *qbuf;
-		UINT len;
-		if (VerQueryValue(buf, _T("\\"), (void **)&qbuf, &len))
-		{
-			// got the version information
-			DWORD ms = qbuf->dwProductVersionMS;
-			DWORD ls = qbuf->dwProductVersionLS;
-			vernum = HIWORD(ms) + (LOWORD(ms) / 100.0f);
-			betanum = HIWORD(ls) + (LOWORD(ls) / 100.0f);
-		}
-		free(buf);
-	}
-	fwprintf (mStream, _T("\"metadata\": {\n"));
-	Indent (1);
-	fwprintf (mStream, _T("\"formatVersion\": 3,\n"));
-	Indent (1);
-	fwprintf (mStream, _T("\"type\": \"scene\",\n"));
-	Indent (1);
-	const TCHAR* fn = mIp->GetCurFileName();
-	fwprintf (mStream, _T("\"sourceFile\": \"%s\",\n"), fn);
-	Indent (1);
-	fwprintf(mStream, _T("\"generatedBy\" : \"3D Studio MAX WebGL exporter, Version %.5g, Revision %.5g\""),
-		vernum, betanum);
-	fwprintf (mStream, _T("\n},\n"));
-
-/*	
-	time_t ltime;
-	time( &ltime );
-	char * time = ctime(&ltime);
-	// strip the CR
-	time[strlen(time)-1] = '\0';
-	if (fn && _tcslen(fn) > 0) {
-		fwprintf(mStream, _T("// MAX File: %s, Date: %s\n\n"), fn, time);
-	} else {
-		fwprintf(mStream, _T("// Date: %s\n\n"), time);
+		quads += jobs[i].stats.quads;
+		nonPlanar += jobs[i].stats.nonPlanar;
+		triangles += jobs[i].stats.triangles;
+		numbers[0] += jobs[i].numbers[0];
+		numbers[1] += jobs[i].numbers[1];
 	}
-*/
+	DebugPrint(_T("WebGL export: %d quads, %d triangles (%d pairs bent or concave), %.1f ms\n"),
+			   quads, triangles, nonPlanar, seconds * 1000.0);
+	if (numbers[0] > 0.0)
+		DebugPrint(_T("WebGL export: faces arrays %.0f -> %.0f numbers (%.0f%% smaller)\n"),
+				   numbers[0], numbers[1], 100.0 * (1.0 - numbers[1] / numbers[0]));
 }
 
+// Write one section of the scene file from the captured scene.
 void
-WebGL2Export::WebGLOutWorldInfo()
+WebGL2Export::WebGLOutScene(ClassToFind targetClass, BOOL *isFirst)
 {
-	if (mTitle.Length() == 0 && mInfo.Length() == 0)
+	if (targetClass == EMBEDS)
+	{
+		WebGLOutEmbeds(isFirst);
 		return;
+	}
 
-	fwprintf(mStream, _T("\"metadata\":\n"));
-	Indent(1);
-	fwprintf(mStream, _T("{\n"));
-	if (mTitle.Length() != 0)
+	// Materials and textures are written once, however many nodes use
+	// them
+	size_t i;
+	if (targetClass == MATERIALS)
 	{
-		Indent(2);
-		fwprintf(mStream, _T("\"sourceFile\"    : \"%s\""), mTitle.data());
-//		fwprintf(mStream, _T("title \"%s\"\n"), mTitle.data());
+		for (i = 0; i < mScene.materials.size(); i++)
+			OutputMaterial(mScene.materials[i], 1, isFirst);
+		return;
 	}
-	/*
-	if (mInfo.Length() != 0)
+	if (targetClass == TEXTURES)
 	{
-		Indent(1);
-		fwprintf(mStream, _T("info \"%s\"\n"), mInfo.data());
+		for (i = 0; i < mScene.textures.size(); i++)
+			OutputTexture(mScene.textures[i], 1, isFirst);
+		return;
 	}
-	*/
-	Indent(1);
-	fwprintf(mStream, _T("}\n"));
+	for (i = 0; i < mScene.nodes.size(); i++)
+		WebGLOutObject(mScene.nodes[i], targetClass, isFirst);
 }
 
-int
-WebGL2Export::StartAnchor(INode* node, int& level)
+// A mesh of the "embeds" section, or a range of one part of a large
+// mesh, written on a worker thread
+struct EmbedJob {
+	WebGL2Export* exp;
+	IRNode*       node;
+	MeshPart      part;     // MESH_WHOLE for a mesh written in one go
+	int           first;    // range of elements of the part
+	int           last;
+	BOOL          start;    // first job of its mesh
+	BOOL          buffer;   // write the mesh as a BufferGeometry
+	int           welded;   // vertices of the BufferGeometry
+	OutBuffer*    out;      // the text of the job
+	double        seconds;  // time it took to write it
+};
+
+#define EMBED_BUFFER_SIZE (4 * 1024)
+
+// A mesh quantized on a worker thread before the embeds are written
+struct QuantJob {
+	WebGL2Export* exp;
+	IRNode*       node;
+};
+
+void
+WebGL2Export::QuantizeEmbed(void* data, int index)
 {
-	return 0;
+	QuantJob& job = ((QuantJob*) data)[index];
+	QuantMesh* q = new QuantMesh;
+	if (job.exp->QuantizeMesh(*job.node, *q))
+		job.exp->mQuantMesh[job.node->mesh] = q;
+	else
+		delete q;
 }
 
-// Recursively count a node and all its children
-static int
-CountNodes(INode *node)
+// Meshes with more faces than this are split in ranges of this many
+// elements, so that one large mesh keeps all threads busy.  The ranges
+// do not depend on the number of threads, nor does the file.
+#define EMBED_CHUNK 16384
+
+void
+WebGL2Export::EncodeEmbed(void* data, int index)
 {
-	int total, kids, i;
-	
-	if (node == NULL)
-		return 0;
-	total = 1;
-	kids = node->NumberOfChildren();
-	for (i = 0; i < kids; i++)
-		total += CountNodes(node->GetChildNode(i));
-	return total;
+	EmbedJob& job = ((EmbedJob*) data)[index];
+	double start = TimerSeconds();
+	job.out = new OutBuffer(NULL, EMBED_BUFFER_SIZE);
+	if (job.buffer)
+		job.welded = job.exp->OutputBufferMesh(*job.out, *job.node,
+											   job.node->level+1);
+	else if (job.part == MESH_WHOLE)
+		job.exp->OutputTriObject(*job.out, *job.node, job.node->level+1);
+	else
+		job.exp->OutputMeshPart(*job.out, *job.node, job.node->level+1,
+								job.part, job.first, job.last);
+	job.seconds = TimerSeconds() - start;
 }
 
-// Output a single node as WebGL and recursively output the children of
-// the node.
+// Write the meshes of the "embeds" section.  Each mesh, or each range
+// of a large mesh, is written to a buffer of its own on the worker
+// threads, and the buffers are then appended in scene order, so the
+// file does not depend on the number of threads.
 void
-WebGL2Export::WebGLOutNode(INode* node, INode* parent, int level, BOOL isLOD,
-						 BOOL lastChild, BOOL mirrored, ClassToFind targetClass, BOOL *isFirst)
+WebGL2Export::WebGLOutEmbeds(BOOL *isFirst)
 {
- // Don't gen code for LOD references, only LOD nodes
-	if (!isLOD && ObjectIsLODRef(node))
-		return;
-	
-	if (mEnableProgressBar)
-		SendMessage(hWndPDlg, 666, 0, (LPARAM) mNodes.GetNodeName(node));
-	
-	Object* obj         = node->EvalWorldState(mStart).obj;
-	Class_ID id;
-	if (obj) id = obj->ClassID();
-	BOOL    outputName  = TRUE;
-	int     numChildren = node->NumberOfChildren();
-	BOOL    isWebGL      = isWebGLObject(node, obj, parent);
-	BOOL    numAnchors  = 0;
-	BOOL    written     = FALSE;
-	BOOL    mirror      = FALSE;
-//	int     cnt;
-	/*
-	// give third party dlls a chance to write the node
-	if (!node->IsRootNode())
+	std::vector<EmbedJob> jobs;
+	std::vector<QuantJob> quantJobs;
+	std::vector<IRNode*> writes;
+	std::vector<IRNode> geometries;
+	int meshes = 0, split = 0;
+	int buffers = 0, corners = 0, welded = 0;
+	WorkPool pool;
+	size_t i;
+
+	// Only the node a shared mesh is named after writes it out, each
+	// level of detail and submesh after it under a node of its own
+	for (i = 0; i < mScene.nodes.size(); i++)
 	{
-		written = FALSE;
-		for (cnt = 0; cnt < mCallbacks->GetPreNodeCount(); cnt++)
-		{
-			DllPreNode preNode = mCallbacks->GetPreNode(cnt);
-			PreNodeParam params;
-			params.version  = 0;
-			params.indent   = level;
-			params.fName    = mFilename;
-			params.i        = mIp;
-			params.node     = node;
-
-			if (mStream)
-				fclose(mStream), mStream = NULL;
-			written = (*(preNode))(&params);
-			if (written)
-				break; // only the first one gets to write the node
-		}
-		if (!mStream)
-			mStream = _tfopen(mFilename, _T("a"));
-	}
-	*/
-	if (isWebGL && !written)
-	{
-//		if (targetClass == OBJECTS && !IsLODObject(obj))
-//			mirror = OutputNodeTransform(node, level+1, mirrored);
-
-	 // Output the data for the object at this node
-//        Indent(level+1);
-//        fprintf(mStream, _T("children? [\n"));
+		IRNode& node = mScene.nodes[i];
+		if (node.kind != IR_MESH ||
+			mScene.meshes[node.mesh]->name != node.name ||
+			mScene.meshes[node.mesh]->prim.kind != IR_PRIM_NONE)
+			continue;
+		GeometryNodes(node, geometries);
 	}
-	if ((isWebGL && (mExportHidden || !node->IsHidden()) && !written) || IsAnimTrigger(obj))
+	for (i = 0; i < geometries.size(); i++)
 	{
-		WebGLOutObject(node, parent, obj, level+2, mirrored ^ mirror, targetClass, isFirst);
+		if (!mBinaryMesh[geometries[i].mesh])
+			writes.push_back(&geometries[i]);
 	}
-	
-	if (mEnableProgressBar) SendMessage(hWndPB, PBM_STEPIT, 0, 0);
 
-	// Now output the children
-//	if (!(written & WroteNodeChildren))
-//	{
-		for (int i = 0; i < numChildren; i++)
+	for (i = 0; i < writes.size(); i++)
+	{
+		IRNode& node = *writes[i];
+		IRMesh& mesh = *mScene.meshes[node.mesh];
+		EmbedJob job;
+		job.exp = this;
+		job.node = &node;
+		job.part = MESH_WHOLE;
+		job.first = 0;
+		job.last = 0;
+		job.start = TRUE;
+		job.buffer = mBufferMesh[node.mesh];
+		job.welded = 0;
+		job.out = NULL;
+		job.seconds = 0.0;
+		meshes++;
+		if (mQuantBits >= 0 && mesh.NumFaces() > 0)
 		{
-			WebGLOutNode(node->GetChildNode(i), node, level+2, FALSE,
-				i == numChildren - 1, mirrored ^ mirror, targetClass, isFirst);
+			QuantJob quantJob = { this, &node };
+			quantJobs.push_back(quantJob);
+		}
+		if (job.buffer || mesh.NumFaces() <= EMBED_CHUNK)
+		{
+			jobs.push_back(job);
+			continue;
+		}
+		split++;
+		for (int part = MESH_HEAD; part <= MESH_FACES; part++)
+		{
+			job.part = (MeshPart) part;
+			int size = MeshPartSize(mesh, job.part);
+			job.first = 0;
+			do
+			{
+				job.last = size - job.first > EMBED_CHUNK ? job.first + EMBED_CHUNK : size;
+				jobs.push_back(job);
+				job.start = FALSE;
+				job.first = job.last;
+			} while (job.first < size);
 		}
-//	}
-/*
- // need to get a valid obj ptr WebGLOutNode (WebGLOutCoordinateInterpolator)
- // causes the obj ptr (cache) to be invalid
-	obj = node->EvalWorldState(mStart).obj;
-
-	if (obj && (obj->ClassID() == BillboardClassID) && (numChildren > 0) && !written) {
-		Indent(level+1);
-		fprintf(mStream, _T("] }\n"));
 	}
+	if (jobs.empty())
+		return;
 
-	if (!node->IsRootNode() && isWebGL && !written) {
-		OutputTouchSensors(node, level);
-		Indent(level+1);
-		fprintf(mStream, _T("]\n"));
+	double start = TimerSeconds();
+	if (!quantJobs.empty())
+	{
+		// Every part of a mesh needs the ranges of all of it
+		mQuantMesh.assign(mScene.meshes.size(), NULL);
+		pool.Run(QuantizeEmbed, &quantJobs[0], (int) quantJobs.size());
 	}
+	pool.Run(EncodeEmbed, &jobs[0], (int) jobs.size());
+	double seconds = TimerSeconds() - start;
 
-	if (!node->IsRootNode() && !written) {
-		if (node->GetParentNode()->IsRootNode())
-			WriteInterpolatorRoutes(level, FALSE);  // must be in place of field
+	for (i = 0; i < jobs.size(); i++)
+	{
+		EmbedJob& job = jobs[i];
+		if (job.start)
+			StartNode (job.node->level+1, isFirst);
+		mOut->Append(*job.out);
+		AddInstanceSavings(*mScene.meshes[job.node->mesh],
+						   (double) job.out->Size(), job.seconds);
+		delete job.out;
+		if (job.buffer)
+		{
+			buffers++;
+			corners += 3 * mScene.meshes[job.node->mesh]->NumFaces();
+			welded += job.welded;
+		}
 	}
-	*/
-//	if (isWebGL && !node->IsRootNode() && !written)
-//		EndNode(node, obj, level, lastChild);
- /*
- // give third party dlls a chance to finish up the node
-	if (!node->IsRootNode())
+	if (buffers > 0)
+		DebugPrint(_T("WebGL export: %d buffer meshes, %d face corners welded to %d vertices\n"),
+				   buffers, corners, welded);
+	if (!quantJobs.empty())
 	{
-		for (cnt = 0; cnt < mCallbacks->GetPostNodeCount(); cnt++)
+		int lo = QUANT_MAX_BITS, hi = 0, normal16 = 0, quantized = 0;
+		for (i = 0; i < mQuantMesh.size(); i++)
 		{
-			DllPostNode postNode = mCallbacks->GetPostNode(cnt);
-			PostNodeParam params;
-			params.version  = 0;
-			params.indent   = level;
-			params.fName    = mFilename;
-			params.i        = mIp;
-			params.node     = node;
-
-			if (mStream)
-				fclose(mStream), mStream = NULL;
-
-			(*(postNode))(&params);
+			QuantMesh* q = mQuantMesh[i];
+			if (!q)
+				continue;
+			quantized++;
+			if (q->pos.bits < lo)
+				lo = q->pos.bits;
+			if (q->pos.bits > hi)
+				hi = q->pos.bits;
+			if (q->normBits == 16)
+				normal16++;
+			delete q;
 		}
-		if (!mStream)
-			mStream = _tfopen(mFilename, _T("a"));
+		mQuantMesh.clear();
+		DebugPrint(_T("WebGL export: %d quantized meshes, %d to %d position bits, %d with 16 bit normals, %d written as floats to keep %d digits\n"),
+				   quantized, quantized > 0 ? lo : 0, hi, normal16,
+				   (int) quantJobs.size() - quantized, mDigits);
+	}
+	DebugPrint(_T("WebGL export: %d embedded meshes (%d split) in %d jobs on %d threads in %.1f ms\n"),
+			   meshes, split, (int) jobs.size(), pool.Threads(), seconds * 1000.0);
+	for (int i = 0; i < pool.Threads(); i++)
+	{
+		const WorkStats& stats = pool.Stats(i);
+		DebugPrint(_T("WebGL export:   thread %d: %d jobs, %d steals, %.0f%% busy\n"),
+				   i, stats.items, stats.steals,
+				   pool.RunSeconds() > 0.0 ? 100.0 * stats.busy / pool.RunSeconds() : 0.0);
 	}
-	*/
 }
 
 // Traverse the scene graph looking for LOD nodes and texture maps.
@@ -2854,6 +4656,17 @@ WebGL2Export::DoExport(const TCHAR* filename, Interface* i, WebGLExport* exp)
 	mEnableProgressBar    = exp->GetEnableProgressBar();
 	mPreLight        = exp->GetPreLight();
 	mCPVSource       = exp->GetCPVSource();
+	mBinaryGeometry  = exp->GetBinaryGeometry();
+	mBufferGeometry  = exp->GetBufferGeometry();
+	mReorderFaces    = exp->GetReorderFaces();
+	mOverdrawLoss    = exp->GetOverdrawLoss();
+	mQuantBits       = exp->GetQuantBits();
+	mBakePivot       = exp->GetBakePivot();
+	ParseLodRatios(exp->GetLodRatios().data());
+	mBatchStatic     = exp->GetBatchStatic();
+	mTexSize         = exp->GetTexSize();
+	mTexMips         = exp->GetTexMips();
+	mTexCompress     = exp->GetTexCompress();
 //	mCallbacks       = exp->GetCallbacks();
 	static TCHAR fn[1024];
 	static TCHAR pn[1024];
@@ -2882,6 +4695,8 @@ WebGL2Export::DoExport(const TCHAR* filename, Interface* i, WebGLExport* exp)
 		MessageBox(GetActiveWindow(), msg, title, MB_OK);
 		return TRUE;
 	}
+	OutBuffer out(mStream);
+	mOut = &out;
 
 	TCHAR modname[MAX_PATH];
 	TCHAR fromFile[MAX_PATH];
@@ -2920,7 +4735,7 @@ WebGL2Export::DoExport(const TCHAR* filename, Interface* i, WebGLExport* exp)
 	SetCursor(busy);
 
  // Write out the WebGL header and file info
-	fwprintf(mStream, _T("{\n"));
+	mOut->Printf(_T("{\n"));
 	if (mSceneFile)
 		WebGLOutFileInfo();
 
@@ -2970,64 +4785,82 @@ WebGL2Export::DoExport(const TCHAR* filename, Interface* i, WebGLExport* exp)
  // Write out the scene graph
 //	if (!written)
 //	{
+		CaptureScene();
+		if (mTexSize >= 0 || mTexMips >= 0 || mTexCompress)
+			ScaleTextures();
+		StartTextureCopies();
+		if (mBatchStatic)
+			BatchMeshes();
+		ConvertMeshes();
+		if (!mLodRatios.empty())
+			GenerateLods();
+		SplitMeshes();
+		if (mReorderFaces)
+			ReorderFaces();
+		GroupFaces();
+		if (mPolygonType != OUTPUT_TRIANGLES)
+			MakeQuads();
+		mBinaryMesh.assign(mScene.meshes.size(), false);
+		mBufferMesh.assign(mScene.meshes.size(), false);
+		mBinaryBytes = 0;
+
 		BOOL isFirst = TRUE;
 		if (mSceneFile)
 		{
-			fwprintf (mStream, _T("\"urlBaseType\": \"\",\n\n"));
-			fwprintf(mStream, _T("\"lights\":\n{\n"));
-			WebGLOutNode(mIp->GetRootNode(), NULL, -2, FALSE, TRUE, FALSE, LIGHTS, &isFirst);
-			fwprintf(mStream, _T("\n},\n\n"));
+			mOut->Printf(_T("\"urlBaseType\": \"\",\n\n"));
+			mOut->Printf(_T("\"lights\":\n{\n"));
+			WebGLOutScene(LIGHTS, &isFirst);
+			mOut->Printf(_T("\n},\n\n"));
 
 			isFirst = TRUE;
-			fwprintf(mStream, _T("\"cameras\":\n{\n"));
-			WebGLOutNode(mIp->GetRootNode(), NULL, -2, FALSE, TRUE, FALSE, CAMERAS, &isFirst);
-			fwprintf(mStream, _T("\n},\n\n"));
+			mOut->Printf(_T("\"cameras\":\n{\n"));
+			WebGLOutScene(CAMERAS, &isFirst);
+			mOut->Printf(_T("\n},\n\n"));
 
 			isFirst = TRUE;
-			fwprintf(mStream, _T("\"materials\":\n{\n"));
-			WebGLOutNode(mIp->GetRootNode(), NULL, -2, FALSE, TRUE, FALSE, MATERIALS, &isFirst);
-			fwprintf(mStream, _T("\n},\n\n"));
+			mOut->Printf(_T("\"materials\":\n{\n"));
+			WebGLOutScene(MATERIALS, &isFirst);
+			mOut->Printf(_T("\n},\n\n"));
 
 			isFirst = TRUE;
-			fwprintf(mStream, _T("\"objects\":\n{\n"));
-			WebGLOutNode(mIp->GetRootNode(), NULL, -2, FALSE, TRUE, FALSE, OBJECTS, &isFirst);
-			fwprintf(mStream, _T("\n},\n\n"));
+			mOut->Printf(_T("\"objects\":\n{\n"));
+			WebGLOutScene(OBJECTS, &isFirst);
+			mOut->Printf(_T("\n},\n\n"));
 
 			isFirst = TRUE;
-			fwprintf(mStream, _T("\"textures\":\n{\n"));
-			WebGLOutNode(mIp->GetRootNode(), NULL, -2, FALSE, TRUE, FALSE, TEXTURES, &isFirst);
-			fwprintf(mStream, _T("\n},\n\n"));
+			mOut->Printf(_T("\"textures\":\n{\n"));
+			WebGLOutScene(TEXTURES, &isFirst);
+			mOut->Printf(_T("\n},\n\n"));
 
 			isFirst = TRUE;
-			fwprintf(mStream, _T("\n\"geometries\":\n{\n"));
-			WebGLOutNode(mIp->GetRootNode(), NULL, -2, FALSE, TRUE, FALSE, GEOMETRIES, &isFirst);
-			fwprintf(mStream, _T("\n},\n\n"));
+			mOut->Printf(_T("\n\"geometries\":\n{\n"));
+			WebGLOutScene(GEOMETRIES, &isFirst);
+			mOut->Printf(_T("\n},\n\n"));
 		}
 
 		isFirst = TRUE;
 		if (mSceneFile)
 		{
-			fwprintf(mStream, _T("\n\"embeds\":\n{\n"));
-			WebGLOutNode(mIp->GetRootNode(), NULL, -2, FALSE, TRUE, FALSE, EMBEDS, &isFirst);
-			fwprintf(mStream, _T("\n},\n"));
+			mOut->Printf(_T("\n\"embeds\":\n{\n"));
+			WebGLOutScene(EMBEDS, &isFirst);
+			mOut->Printf(_T("\n},\n"));
 			isFirst = TRUE;
 		}
 		else
-			WebGLOutNode(mIp->GetRootNode(), NULL, -2, FALSE, TRUE, FALSE, EMBEDS, &isFirst);
+			WebGLOutScene(EMBEDS, &isFirst);
 
 		if (mSceneFile)
 		{
-			fwprintf(mStream, _T("\n\"defaults\":\n{\n"));
-			WebGLOutNode(mIp->GetRootNode(), NULL, -2, FALSE, TRUE, FALSE, DEFAULTS, &isFirst);
+			mOut->Printf(_T("\n\"defaults\":\n{\n"));
 			if (mCamera)
 			{
 				Indent(1);
-				fwprintf (mStream, _T("\"camera\" : \"%s\",\n"), mCamera->GetName());
+				mOut->Printf(_T("\"camera\" : \"%s\",\n"), mCamera->GetName());
 			}
 			Indent(1);
-			fwprintf (mStream, _T("\"bgcolor\" : [0,0,0]\n"));
-			fwprintf(mStream, _T("\n}\n"));
-			fwprintf(mStream, _T("\n}\n"));
+			mOut->Printf(_T("\"bgcolor\" : [0,0,0]\n"));
+			mOut->Printf(_T("\n}\n"));
+			mOut->Printf(_T("\n}\n"));
 		}
 //		delete mLodList;
 //		delete mTimerList;
@@ -3060,7 +4893,21 @@ WebGL2Export::DoExport(const TCHAR* filename, Interface* i, WebGLExport* exp)
 		hWndPDlg = NULL;
 	}
 
-	if(theFile.Close())
+	FinishTextureCopies();
+	mScene.Clear();
+	mObjTable.Clear();
+	mMtlTable.Clear();
+
+	BOOL flushed = out.Flush();
+	DebugPrint(_T("WebGL export: %I64u bytes, %d flushes\n"),
+			   out.BytesWritten(), out.FlushCount());
+	if (mBinaryGeometry)
+		DebugPrint(_T("WebGL export: %Iu bytes of binary geometry\n"),
+				   mBinaryBytes);
+	DebugPrint(_T("WebGL export: %d instanced nodes, saved %.0f bytes and %.1f ms\n"),
+			   mInstances, mInstanceBytes, mInstanceTime * 1000.0);
+	mOut = NULL;
+	if(theFile.Close() || !flushed)
 		return 0;
 
 	return 1;
@@ -3082,6 +4929,22 @@ WebGL2Export::WebGL2Export()
 //	mFlipBook           = FALSE;
 
 	mStream = 0;     // The file mStream to write
+	mOut = NULL;        // Buffered output to mStream
+	mBinaryGeometry = FALSE; // write meshes to binary files
+	mBinaryBytes = 0;   // bytes of the binary files
+	mBufferGeometry = FALSE; // write meshes as BufferGeometry
+	mReorderFaces = FALSE;  // put faces in vertex cache order
+	mOverdrawLoss = -1;     // no cluster sort for overdraw
+	mQuantBits = -1;        // write floats
+	mBakePivot = FALSE;     // nodes keep their object offset
+	mBatchStatic = FALSE;   // every mesh node is an object
+	mTexSize = -1;          // copy bitmaps as they are
+	mTexMips = -1;          // the browser makes the mip levels
+	mTexCompress = 0;       // no compressed variants
+	mPrimitiveCount = 0; // meshes written as three.js primitives
+	mInstances = 0;     // nodes that share another node's mesh
+	mInstanceBytes = 0.0; // output bytes saved by instancing
+	mInstanceTime = 0.0;  // seconds saved by instancing
 	mFilename = NULL;   // The export .js filename
 	mIndent = TRUE;     // Should we indent?
 	mType = Export_ThreeJS;       // Language to export (WebGL, WebGL, ...)
@@ -3143,7 +5006,8 @@ WebGL2Export::GenerateUniqueNodeNames(INode* node)
 	if (!nList->hasName)
 	{
 	 // take mangled name and get a unique name
-		nList->name    = mNodes.AddName(WebGLName(node->GetName()));
+		TCHAR name[WEBGL_NAME_SIZE];
+		nList->name    = mNodes.AddName(WebGLName(name, node->GetName()));
 		nList->hasName = TRUE;
 	}
 	
@@ -3162,23 +5026,135 @@ static DWORD HashCode(void* o, int size)
 }
 
 // Object Hash table stuff
-/*
 ObjectBucket*
-ObjectHashTable::AddObject(Object* o)
+ObjectHashTable::AddObject(Object* o, BOOL mirrored, BOOL textured,
+						   int slots, const Point3& pivot)
 {
-	DWORD hashCode = HashCode(o, OBJECT_HASH_TABLE_SIZE);	
+	DWORD hashCode = HashCode(o, mTable.Count());	
 	ObjectBucket *ob;
 
 	for(ob = mTable[hashCode]; ob; ob = ob->next)
 	{
-		if (ob->obj == o)
+		if (ob->obj == o && ob->mirrored == mirrored &&
+			ob->textured == textured && ob->slots == slots &&
+			ob->pivot == pivot)
 		{
 			return ob;
 		}
 	}
-	ob = new ObjectBucket(o);
+	if (mCount >= mTable.Count())
+	{
+		Grow();
+		hashCode = HashCode(o, mTable.Count());
+	}
+	ob = new ObjectBucket(o, mirrored, textured, slots, pivot);
 	ob->next = mTable[hashCode];
 	mTable[hashCode] = ob;
+	mCount++;
 	return ob;
 }
-*/
+
+// Double the number of slots and move the buckets over
+void
+ObjectHashTable::Grow()
+{
+	int size = 2 * mTable.Count() + 1;
+	Tab<ObjectBucket*> table;
+	table.SetCount(size);
+	for(int i = 0; i < size; i++)
+		table[i] = NULL;
+
+	for(int i = 0; i < mTable.Count(); i++)
+	{
+		ObjectBucket *ob = mTable[i];
+		while (ob)
+		{
+			ObjectBucket *next = ob->next;
+			DWORD hashCode = HashCode(ob->obj, size);
+			ob->next = table[hashCode];
+			table[hashCode] = ob;
+			ob = next;
+		}
+	}
+	mTable = table;
+}
+
+void
+ObjectHashTable::Clear()
+{
+	for(int i = 0; i < mTable.Count(); i++)
+		delete mTable[i];
+	mTable.SetCount(OBJECT_HASH_TABLE_SIZE);
+	for(int i = 0; i < OBJECT_HASH_TABLE_SIZE; i++)
+		mTable[i] = NULL;
+	mCount = 0;
+}
+
+static DWORD MtlHashCode(Mtl* m, int slot, int size)
+{
+	return (HashCode(m, size) + (DWORD) (slot + 1)) % size;
+}
+
+// Material Hash table stuff
+MtlBucket*
+MtlHashTable::AddMtl(Mtl* m, int slot)
+{
+	DWORD hashCode = MtlHashCode(m, slot, mTable.Count());
+	MtlBucket *mb;
+
+	for(mb = mTable[hashCode]; mb; mb = mb->next)
+	{
+		if (mb->mtl == m && mb->slot == slot)
+		{
+			mHits++;
+			return mb;
+		}
+	}
+	mMisses++;
+	if (mCount >= mTable.Count())
+	{
+		Grow();
+		hashCode = MtlHashCode(m, slot, mTable.Count());
+	}
+	mb = new MtlBucket(m, slot);
+	mb->next = mTable[hashCode];
+	mTable[hashCode] = mb;
+	mCount++;
+	return mb;
+}
+
+// Double the number of slots and move the buckets over
+void
+MtlHashTable::Grow()
+{
+	int size = 2 * mTable.Count() + 1;
+	Tab<MtlBucket*> table;
+	table.SetCount(size);
+	for(int i = 0; i < size; i++)
+		table[i] = NULL;
+
+	for(int i = 0; i < mTable.Count(); i++)
+	{
+		MtlBucket *mb = mTable[i];
+		while (mb)
+		{
+			MtlBucket *next = mb->next;
+			DWORD hashCode = MtlHashCode(mb->mtl, mb->slot, size);
+			mb->next = table[hashCode];
+			table[hashCode] = mb;
+			mb = next;
+		}
+	}
+	mTable = table;
+}
+
+void
+MtlHashTable::Clear()
+{
+	for(int i = 0; i < mTable.Count(); i++)
+		delete mTable[i];
+	mTable.SetCount(MTL_HASH_TABLE_SIZE);
+	for(int i = 0; i < MTL_HASH_TABLE_SIZE; i++)
+		mTable[i] = NULL;
+	mCount = mHits = mMisses = 0;
+}
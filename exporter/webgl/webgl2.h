@@ -31,6 +31,17 @@ enum ClassToFind {
 	UVS,
 	FACES
 };
+
+// The parts of an embedded mesh, in the order they are written.  The
+// parts after MESH_HEAD can be written a range of elements at a time.
+enum MeshPart {
+	MESH_HEAD,          // name, materials, metadata and colors
+	MESH_VERTICES,
+	MESH_NORMALS,
+	MESH_UVS,
+	MESH_FACES,
+	MESH_WHOLE          // all of the above at once
+};
 /*
 struct AnimRoute {
 	AnimRoute() { mToNode = NULL; }
@@ -60,51 +71,121 @@ struct InterpRoute {
 	int  mType;
 	TSTR mNode;
 };
+*/
 
-// Object hash table for instancing
+// Object hash table for instancing.  Nodes that evaluate to the same
+// object share one captured mesh, as long as they mirror it the same
+// way, bake the same pivot into it, agree on having texture
+// coordinates and have as many material slots.
 
 struct ObjectBucket {
-	ObjectBucket(Object* o)
+	ObjectBucket(Object* o, BOOL m, BOOL t, int s, const Point3& p)
 	{
 		obj = o;
-		objectUsed = FALSE;
-		hasName = FALSE;
-		hasInstName = FALSE;
+		mirrored = m;
+		textured = t;
+		slots = s;
+		pivot = p;
+		mesh = -1;
+		captureTime = 0.0;
 		next = NULL;
 	}
 	~ObjectBucket() {delete next;}
 	Object *obj;
-	BOOL    objectUsed;
-	BOOL    hasName;
-	BOOL    hasInstName;
-	TSTR    name;
-	TSTR    instName;
+	BOOL    mirrored;
+	BOOL    textured;
+	int     slots;          // material slots, which decide the face
+							// groups and embedded materials of the mesh
+	Point3  pivot;          // object offset baked into the mesh
+	int     mesh;           // index in IRScene::meshes, -1 until captured
+	double  captureTime;    // seconds it took to capture the mesh
 	ObjectBucket *next;
 };
 
-#define OBJECT_HASH_TABLE_SIZE 1001
+// The table starts small and doubles whenever it holds more objects
+// than it has slots, so chains stay short for scenes of any size.
+#define OBJECT_HASH_TABLE_SIZE 61
 
 class ObjectHashTable {
   public:
 
 	ObjectHashTable() {
+		mCount = 0;
 		mTable.SetCount(OBJECT_HASH_TABLE_SIZE);
 		for(int i = 0; i < OBJECT_HASH_TABLE_SIZE; i++)
 			mTable[i] = NULL;
 	}
 	~ObjectHashTable() {
-		for(int i = 0; i < OBJECT_HASH_TABLE_SIZE; i++)
+		for(int i = 0; i < mTable.Count(); i++)
 			delete mTable[i];
 	}
 		
 
-	ObjectBucket* AddObject(Object* obj);
+	ObjectBucket* AddObject(Object* obj, BOOL mirrored, BOOL textured,
+							int slots, const Point3& pivot);
+	void Clear();
+	int  Count() { return mCount; }
 
   private:
 
+	void Grow();
+
 	Tab<ObjectBucket*> mTable;
+	int                mCount;
 };
-*/
+
+// A material slot already evaluated: the MAX material and the
+// sub-material index it was evaluated for, and what it gave
+struct MtlBucket {
+	MtlBucket(Mtl* m, int s)
+	{
+		mtl = m;
+		slot = s;
+		material = -1;
+		next = NULL;
+	}
+	~MtlBucket() {delete next;}
+	Mtl       *mtl;
+	int        slot;
+	int        material;    // index in IRScene::materials, -1 until captured
+	MtlBucket *next;
+};
+
+// Grows like the ObjectHashTable, and counts how often a slot was
+// found already evaluated
+#define MTL_HASH_TABLE_SIZE 61
+
+class MtlHashTable {
+  public:
+
+	MtlHashTable() {
+		mCount = mHits = mMisses = 0;
+		mTable.SetCount(MTL_HASH_TABLE_SIZE);
+		for(int i = 0; i < MTL_HASH_TABLE_SIZE; i++)
+			mTable[i] = NULL;
+	}
+	~MtlHashTable() {
+		for(int i = 0; i < mTable.Count(); i++)
+			delete mTable[i];
+	}
+
+	MtlBucket* AddMtl(Mtl* mtl, int slot);
+	void Clear();
+	int  Count()  { return mCount; }
+	int  Hits()   { return mHits; }
+	int  Misses() { return mMisses; }
+
+  private:
+
+	void Grow();
+
+	Tab<MtlBucket*> mTable;
+	int             mCount;
+	int             mHits;
+	int             mMisses;
+};
+
+struct QuantMesh;
 
 class WebGL2Export {
 public:
@@ -164,59 +245,68 @@ public:
 	Interface* mIp;         // MAX interface pointer
 
 private:
-	TCHAR* point(Point3& p);
-	TCHAR* scalePoint(Point3& p);
-	TCHAR* normPoint(Point3& p);
-	TCHAR* axisPoint(Point3& p, float ang);
-	TCHAR* quat(Quat &q);
-	TCHAR* texture(UVVert& uv);
-	TCHAR* color(Color& c);
-	TCHAR* colorString(Color& c);
-	TCHAR* color(Point3& c);
-	TCHAR* floatVal(float f);
+	TCHAR* point(TCHAR* buf, Point3& p);
+	TCHAR* scalePoint(TCHAR* buf, Point3& p);
+	TCHAR* normPoint(TCHAR* buf, Point3& p);
+	TCHAR* meshPoint(TCHAR* buf, const float* p);
+	TCHAR* meshNormal(TCHAR* buf, const float* p);
+	TCHAR* axisPoint(TCHAR* buf, Point3& p, float ang);
+	TCHAR* quat(TCHAR* buf, Quat &q);
+	TCHAR* euler(TCHAR* buf, Point3& e);
+	TCHAR* texture(TCHAR* buf, UVVert& uv);
+	TCHAR* color(TCHAR* buf, Color& c);
+	TCHAR* colorString(TCHAR* buf, Color& c);
+	TCHAR* color(TCHAR* buf, Point3& c);
+	TCHAR* floatVal(TCHAR* buf, float f);
 
 	// WebGL Output routines
 	void Indent(int level);
+	void Indent(OutBuffer& out, int level);
 	int  MaybeNewLine(int width, int level);
-	void StartNode(INode* node, int level, BOOL *isFirst);
+	int  MaybeNewLine(OutBuffer& out, int width, int level);
+	void StartNode(int level, BOOL *isFirst);
 	void EndNode(INode* node, Object* obj, int level, BOOL lastChild);
 	BOOL IsBBoxTrigger(INode* node);
-	BOOL OutputNodeTransform(INode* node, int level, BOOL mirrored);
-	void OutputMultiMtl(Mtl* mtl, int level);
-	BOOL OutputMaterial(INode* node, BOOL& isWire, BOOL& twoSided, int level,
-			int textureNum, BOOL *isFirst, ClassToFind targetClass);
+	void OutputNodeTransform(IRNode& node, int level);
+	void OutputMaterial(IRMaterial& m, int level, BOOL *isFirst);
+	void OutputTexture(IRTexture& td, int level, BOOL *isFirst);
+	void ScaleTextures();
+	void StartTextureCopies();
+	void FinishTextureCopies();
+	void OutputMaterialKeys(IRNode& node);
+	void OutputEmbedMaterial(OutBuffer& out, IRNode& node, int slot,
+			int level, BOOL *isFirst);
 	BOOL HasTexture(INode *node, BOOL& isWire);
+	BOOL HasMeshTexture(INode* node);
 	TSTR PrefixUrl(TSTR& fileName);
 	TextureDesc* GetMtlTex(Mtl* mtl, BOOL &isWire);
 	TextureDesc*GetMatTex(INode* node, BOOL& isWire);
-	void OutputNormalIndices(Mesh& mesh, NormalTable* normTab, int level,
-							 int textureNum);
-	NormalTable* OutputNormals(Mesh& mesh, int level);
-	void OutputTriObject(INode* node, TriObject* obj, BOOL multiMat,
-						 BOOL isWire, BOOL twoSided, int level,
-						 int textureNum, BOOL pMirror);
-	void OutputPolygonObject(INode* node, TriObject* obj, BOOL multiMat,
-			 BOOL isWire, BOOL twoSided, int level, int textureNum,
-			 BOOL pMirror);
+	int  MeshPartSize(IRMesh& mesh, MeshPart part);
+	void OutputMeshPart(OutBuffer& out, IRNode& node, int level,
+			MeshPart part, int first, int last);
+	void OutputTriObject(OutBuffer& out, IRNode& node, int level);
+	int  OutputBufferMesh(OutBuffer& out, IRNode& node, int level);
+	bool QuantizeMesh(IRNode& node, QuantMesh& q);
+	void OutputQuantization(OutBuffer& out, QuantMesh& q);
+	void OutputFaceGroups(OutBuffer& out, IRMesh& mesh);
+	BOOL OutputBinaryMesh(IRNode& node, TSTR& url);
+	void AddInstanceSavings(IRMesh& mesh, double bytes, double seconds);
 	BOOL isWebGLObject(INode * node, Object *obj, INode* parent);
 	BOOL ChildIsAnimated(INode* node);
 	BOOL ObjIsAnimated(Object *obj);
+	BOOL IsStatic(INode* node, Object* obj);
 	BOOL ObjIsPrim(INode* node, Object* obj);
-	void WebGLOutObject(INode* node, INode* parent, Object* obj, int level,
-					   BOOL mirrored, ClassToFind targetClass, BOOL *isFirst);
-	BOOL WebGLOutCamera(INode* node, Object* obj, int level);
+	void WebGLOutObject(IRNode& node, ClassToFind targetClass, BOOL *isFirst);
+	BOOL WebGLOutCamera(IRNode& node, int level);
 //    void WebGLOutTimeSensor(INode* node, TimeSensorObject* obj, int level);
 //    BOOL WebGLOutInline(WebGLInsObject* obj, int level);
 	void WebGLOutCoordinateInterpolator(INode* node, Object *obj, int level,
 									   BOOL pMirror);
 	BOOL WebGLOutSpecialTform(INode* node, Object* obj, int level,
 							 BOOL mirrored);
-	BOOL WebGLOutSpecial(INode* node, INode* parent, Object* obj, int level,
-						BOOL mirrored);
-	BOOL WebGLOutPointLight(INode* node, LightObject* light, int level, BOOL top);
-	BOOL WebGLOutDirectLight(INode* node, LightObject* light, int level, BOOL top);
-	BOOL WebGLOutSpotLight(INode* node, LightObject* light, int level, BOOL top);
-	void OutputTopLevelLight(INode* node, LightObject *light);
+	BOOL WebGLOutPointLight(IRNode& node, int level);
+	BOOL WebGLOutDirectLight(IRNode& node, int level);
+	BOOL WebGLOutSpotLight(IRNode& node, int level);
 	void WriteControllerData(INode* node,
 							 Tab<TimeValue>& posTimes, Tab<Point3>& posKeys,
 							 Tab<TimeValue>& rotTimes, Tab<AngAxis>& rotKeys,
@@ -248,8 +338,41 @@ private:
 	void WebGLOutGridHelpers(INode*);
 
 	int  StartAnchor(INode* node, int& level);
-	void WebGLOutNode(INode* node, INode* parent, int level, BOOL isLOD,
-					 BOOL lastChild, BOOL mirrored, ClassToFind targetClass, BOOL *isFirst);
+	void WebGLOutScene(ClassToFind targetClass, BOOL *isFirst);
+	void WebGLOutEmbeds(BOOL *isFirst);
+	static void EncodeEmbed(void* data, int index);
+	static void QuantizeEmbed(void* data, int index);
+
+	// Scene capture
+	void CaptureScene();
+	void BatchMeshes();
+	void ConvertMeshes();
+	void ParseLodRatios(const TCHAR* text);
+	void GenerateLods();
+	void SplitMeshes();
+	void ReorderFaces();
+	void GroupFaces();
+	void MakeQuads();
+	void CaptureNode(INode* node, INode* parent, int level, BOOL isLOD,
+					 BOOL mirrored);
+	void CaptureObject(INode* node, int level, BOOL mirrored);
+	void CaptureTransform(INode* node, IRNode& irNode);
+	BOOL BakedPivot(INode* node, Point3& pivot);
+	void CaptureMaterials(INode* node, IRNode& irNode);
+	int  CaptureMaterial(INode* node, int textureNum);
+	int  CaptureMesh(Object* obj, BOOL textured);
+	int  CapturePrimitive(INode* node, Object* obj, IRNode& irNode);
+	void OutputPrimitive(IRPrimitive& prim, int level);
+	void OutputGeometry(IRNode& node, BOOL *isFirst);
+	void LodNode(IRNode& node, int level, IRNode& lod);
+	void SubmeshNode(IRNode& node, int index, IRNode& sub);
+	void GeometryNodes(IRNode& node, std::vector<IRNode>& nodes);
+	void OutputLods(IRNode& node, int level);
+	void OutputSubmeshes(IRNode& node, int level);
+	void CaptureNormals(Mesh& mesh, IRMesh* irMesh);
+	void CaptureLight(INode* node, LightObject* light, IRNode& irNode);
+	void CaptureCamera(INode* node, Object* obj, IRNode& irNode);
+
 	void InitInterpolators(INode* node);
 	void AddInterpolator(TCHAR* interp, int type, TCHAR *name);
 	void WriteInterpolatorRoutes(int level, BOOL isCamera);
@@ -262,6 +385,7 @@ private:
 	void GenerateUniqueNodeNames(INode* node);
 	BOOL		mSceneFile;
 	FILE*          mStream;     // The file mStream to write
+	OutBuffer*     mOut;        // Buffered output to mStream
 	TCHAR*         mFilename;   // The export filename
 	TCHAR*         mFilepath;   // The export path
 	BOOL           mGenNormals; // Generate normals in the WebGL file
@@ -293,7 +417,9 @@ private:
 	int            mTformSampleRate; // Custom sample rate
 	BOOL           mCoordSample; // TRUE for once per frame
 	int            mCoordSampleRate; // Custom sample rate
-//	ObjectHashTable mObjTable;    // Hash table of all objects in the scene
+	ObjectHashTable mObjTable;    // Hash table of all objects in the scene
+	MtlHashTable   mMtlTable;     // Hash table of the material slots evaluated
+	TexCopier      mTexCopier;    // Copies the bitmaps in the background
 	Box3           mBoundBox;     // Bounding box for the whole scene
 	TSTR           mTitle;        // Title of world
 	TSTR           mInfo;         // Info for world
@@ -306,6 +432,26 @@ private:
 	BOOL            mEnableProgressBar;      // this is used by the progress bar
 	BOOL            mPreLight;      // should we calculate the color per vertex
 	BOOL            mCPVSource;     // 1 if MAX's; 0 if should we need to calculate the color per vertex
+	BOOL            mBinaryGeometry; // write meshes to binary files
+	std::vector<bool> mBinaryMesh;  // meshes written to binary files
+	size_t          mBinaryBytes;   // bytes of the binary files
+	BOOL            mBufferGeometry; // write meshes as BufferGeometry
+	std::vector<bool> mBufferMesh;  // meshes written as BufferGeometry
+	BOOL            mReorderFaces;  // put faces in vertex cache order
+	int             mOverdrawLoss;  // ACMR percent traded for overdraw, -1 off
+	int             mQuantBits;     // position bits, 0 automatic, -1 floats
+	BOOL            mBakePivot;     // write mesh nodes at their pivot
+	std::vector<float> mLodRatios;  // faces of each LOD level over the mesh's
+	BOOL            mBatchStatic;   // merge static meshes sharing materials
+	int             mTexSize;       // largest side of scaled bitmaps, 0 any, -1 off
+	int             mTexMips;       // TexFilter of the mip levels, -1 off
+	int             mTexCompress;   // TEXCOMP_ variants of the bitmaps, 0 off
+	std::vector<QuantMesh*> mQuantMesh; // quantized meshes while writing embeds
+	int             mPrimitiveCount; // meshes written as three.js primitives
+	int             mInstances;     // nodes that share another node's mesh
+	double          mInstanceBytes; // output bytes saved by instancing
+	double          mInstanceTime;  // seconds saved by instancing
+	IRScene         mScene;         // the scene captured for export
 //	CallbackTable*  mCallbacks;     // export callback methods
 };
 
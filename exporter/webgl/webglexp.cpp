@@ -22,6 +22,11 @@
 //#include "webgl_api.h"
 #include "webglexp.h"
 #include "appd.h"
+#include "sceneir.h"
+#include "outbuf.h"
+#include "texcopy.h"
+#include "texscale.h"
+#include "texcomp.h"
 #include "webgl2.h"
 #include "helpsys.h"
 
@@ -407,86 +412,6 @@ WebGLExport::OutputNodeTransform(INode* node, int level)
 	*/
 }
 
-// Initialize the normal table
-NormalTable::NormalTable()
-{
-	tab.SetCount(NORM_TABLE_SIZE);
-	for(int i = 0; i < NORM_TABLE_SIZE; i++)
-		tab[i] = NULL;
-}
-
-NormalTable::~NormalTable()
-{
-	// Delete the buckets in the normal table hash table.
-	for(int i = 0; i < NORM_TABLE_SIZE; i++)
-		delete tab[i];
-}
-
-// Add a normal to the hash table
-void
-NormalTable::AddNormal(Point3& norm)
-{
-	// Truncate normals to a value that brings close normals into
-	// the same bucket.
-	Point3 n = NormalizeNorm(norm);
-	DWORD code = HashCode(n);
-	NormalDesc* nd;
-	for(nd = tab[code]; nd; nd = nd->next) {
-		if (nd->n == n)  // Equality OK because of normalization procedure.
-			return;
-	}
-	NormalDesc* newNorm = new NormalDesc(norm);
-	newNorm->next = tab[code];
-	tab[code] = newNorm;
-}
-
-// Get the index of a normal in the IndexedFaceSet
-int
-NormalTable::GetIndex(Point3& norm)
-{
-	Point3 n = NormalizeNorm(norm);
-	DWORD code = HashCode(n);
-	NormalDesc* nd;
-	for(nd = tab[code]; nd; nd = nd->next) {
-		if (nd->n == n)
-			return nd->index;
-	}
-	return -1;
-}
-
-
-// Produce a hash code for a normal
-DWORD
-NormalTable::HashCode(Point3& norm)
-{
-	union {
-		float p[3];
-		DWORD i[3];
-	} u;
-	u.p[0] = norm.x; u.p[1] = norm.y; u.p[2] = norm.z;
-	return ((u.i[0] >> 8) + (u.i[1] >> 16) + u.i[2]) % NORM_TABLE_SIZE;
-}
-
-// Print the hash table statistics for the normal table
-void
-NormalTable::PrintStats(FILE* mStream)
-{
-	int slots = 0;
-	int buckets = 0;
-	int i;
-	NormalDesc* nd;
-
-	for(i = 0; i < NORM_TABLE_SIZE; i++) {
-		if (tab[i]) {
-			slots++;
-			for(nd = tab[i]; nd; nd = nd->next)
-				buckets++;
-		}
-	}
-	fwprintf(mStream,_T("# slots = %d, buckets = %d, avg. chain length = %.5g\n"),
-			slots, buckets, ((double) buckets / (double) slots));
-}
-
 // Returns true IFF the mesh is all in the same smoothing group
 static BOOL
 MeshIsAllOneSmoothingGroup(Mesh& mesh)
@@ -3035,6 +2960,30 @@ AboutDlgProc(HWND hDlg, UINT msg, WPARAM wParam, LPARAM lParam)
 	return FALSE;
 }
 
+// Filter of the "Mip Levels" combo, -1 for "Off"
+static int
+TexMipsFilter(const TCHAR* text)
+{
+	if (_tcscmp(text, _T("Box")) == 0)
+		return TEXFILTER_BOX;
+	if (_tcscmp(text, _T("Lanczos")) == 0)
+		return TEXFILTER_LANCZOS;
+	return -1;
+}
+
+// TEXCOMP_ variants of the "Compressed Bitmaps" combo, 0 for "Off"
+static int
+TexCompressVariants(const TCHAR* text)
+{
+	if (_tcscmp(text, _T("DXT")) == 0)
+		return TEXCOMP_S3TC;
+	if (_tcscmp(text, _T("ETC1")) == 0)
+		return TEXCOMP_ETC1;
+	if (_tcscmp(text, _T("DXT and ETC1")) == 0)
+		return TEXCOMP_S3TC | TEXCOMP_ETC1;
+	return 0;
+}
+
 // Dialog procedure for the export dialog.
 static INT_PTR CALLBACK
 WebGLExportDlgProc(HWND hDlg, UINT msg, WPARAM wParam, LPARAM lParam) 
@@ -3088,6 +3037,26 @@ WebGLExportDlgProc(HWND hDlg, UINT msg, WPARAM wParam, LPARAM lParam)
 		CheckDlgButton(hDlg, IDC_CPV_MAX, gen);
 		CheckDlgButton(hDlg, IDC_CPV_CALC, !gen);
 
+		GetAppData(exp->mIp, BINARY_GEOMETRY_ID, _T("no"), text, MAX_PATH);
+		gen = _tcscmp(text, _T("yes")) == 0;
+		CheckDlgButton(hDlg, IDC_BINARY_GEOMETRY, gen);
+
+		GetAppData(exp->mIp, BUFFER_GEOMETRY_ID, _T("no"), text, MAX_PATH);
+		gen = _tcscmp(text, _T("yes")) == 0;
+		CheckDlgButton(hDlg, IDC_BUFFER_GEOMETRY, gen);
+
+		GetAppData(exp->mIp, REORDER_FACES_ID, _T("no"), text, MAX_PATH);
+		gen = _tcscmp(text, _T("yes")) == 0;
+		CheckDlgButton(hDlg, IDC_REORDER_FACES, gen);
+
+		GetAppData(exp->mIp, BAKE_PIVOT_ID, _T("no"), text, MAX_PATH);
+		gen = _tcscmp(text, _T("yes")) == 0;
+		CheckDlgButton(hDlg, IDC_BAKE_PIVOT, gen);
+
+		GetAppData(exp->mIp, BATCH_STATIC_ID, _T("no"), text, MAX_PATH);
+		gen = _tcscmp(text, _T("yes")) == 0;
+		CheckDlgButton(hDlg, IDC_BATCH_STATIC, gen);
+
 #ifdef _LEC_
 		GetAppData(exp->mIp, FLIP_BOOK_ID, _T("no"), text, MAX_PATH);
 		gen = _tcscmp(text, _T("yes")) == 0;
@@ -3207,6 +3176,60 @@ WebGLExportDlgProc(HWND hDlg, UINT msg, WPARAM wParam, LPARAM lParam)
 		GetAppData(exp->mIp, DIGITS_ID, _T("4"), text, MAX_PATH);
 		ComboBox_SelectString(cb, 0, text);
 
+		cb = GetDlgItem(hDlg, IDC_OVERDRAW_LOSS);
+		ComboBox_AddString(cb, _T("Off"));
+		ComboBox_AddString(cb, _T("0%"));
+		ComboBox_AddString(cb, _T("5%"));
+		ComboBox_AddString(cb, _T("10%"));
+		ComboBox_AddString(cb, _T("25%"));
+		GetAppData(exp->mIp, OVERDRAW_LOSS_ID, _T("Off"), text, MAX_PATH);
+		ComboBox_SelectString(cb, 0, text);
+
+		cb = GetDlgItem(hDlg, IDC_QUANTIZE);
+		ComboBox_AddString(cb, _T("Off"));
+		ComboBox_AddString(cb, _T("Auto"));
+		ComboBox_AddString(cb, _T("10"));
+		ComboBox_AddString(cb, _T("12"));
+		ComboBox_AddString(cb, _T("14"));
+		ComboBox_AddString(cb, _T("16"));
+		GetAppData(exp->mIp, QUANTIZE_ID, _T("Off"), text, MAX_PATH);
+		ComboBox_SelectString(cb, 0, text);
+
+		// Any list of percentages can be typed in
+		cb = GetDlgItem(hDlg, IDC_LOD_RATIOS);
+		ComboBox_AddString(cb, _T("Off"));
+		ComboBox_AddString(cb, _T("50%"));
+		ComboBox_AddString(cb, _T("50% 25%"));
+		ComboBox_AddString(cb, _T("50% 25% 10%"));
+		GetAppData(exp->mIp, LOD_RATIOS_ID, _T("Off"), text, MAX_PATH);
+		ComboBox_SetText(cb, text);
+
+		cb = GetDlgItem(hDlg, IDC_TEX_SIZE);
+		ComboBox_AddString(cb, _T("Off"));
+		ComboBox_AddString(cb, _T("Any"));
+		ComboBox_AddString(cb, _T("4096"));
+		ComboBox_AddString(cb, _T("2048"));
+		ComboBox_AddString(cb, _T("1024"));
+		ComboBox_AddString(cb, _T("512"));
+		ComboBox_AddString(cb, _T("256"));
+		GetAppData(exp->mIp, TEX_SIZE_ID, _T("Off"), text, MAX_PATH);
+		ComboBox_SelectString(cb, 0, text);
+
+		cb = GetDlgItem(hDlg, IDC_TEX_MIPS);
+		ComboBox_AddString(cb, _T("Off"));
+		ComboBox_AddString(cb, _T("Box"));
+		ComboBox_AddString(cb, _T("Lanczos"));
+		GetAppData(exp->mIp, TEX_MIPS_ID, _T("Off"), text, MAX_PATH);
+		ComboBox_SelectString(cb, 0, text);
+
+		cb = GetDlgItem(hDlg, IDC_TEX_COMPRESS);
+		ComboBox_AddString(cb, _T("Off"));
+		ComboBox_AddString(cb, _T("DXT"));
+		ComboBox_AddString(cb, _T("ETC1"));
+		ComboBox_AddString(cb, _T("DXT and ETC1"));
+		GetAppData(exp->mIp, TEX_COMPRESS_ID, _T("Off"), text, MAX_PATH);
+		ComboBox_SelectString(cb, 0, text);
+
 		cb = GetDlgItem(hDlg, IDC_POLYGON_TYPE);
 		ComboBox_AddString(cb,(GetString(IDS_OUT_TRIANGLES)));
 #if TRUE   // outputing higher order polygons
@@ -3380,6 +3403,26 @@ WebGLExportDlgProc(HWND hDlg, UINT msg, WPARAM wParam, LPARAM lParam)
 			WriteAppData(exp->mIp, CPV_SOURCE_ID, exp->GetCPVSource() ?
 						 _T("max"): _T("calc"));
 
+			exp->SetBinaryGeometry(IsDlgButtonChecked(hDlg, IDC_BINARY_GEOMETRY));
+			WriteAppData(exp->mIp, BINARY_GEOMETRY_ID, exp->GetBinaryGeometry() ?
+						 _T("yes"): _T("no"));
+
+			exp->SetBufferGeometry(IsDlgButtonChecked(hDlg, IDC_BUFFER_GEOMETRY));
+			WriteAppData(exp->mIp, BUFFER_GEOMETRY_ID, exp->GetBufferGeometry() ?
+						 _T("yes"): _T("no"));
+
+			exp->SetReorderFaces(IsDlgButtonChecked(hDlg, IDC_REORDER_FACES));
+			WriteAppData(exp->mIp, REORDER_FACES_ID, exp->GetReorderFaces() ?
+						 _T("yes"): _T("no"));
+
+			exp->SetBakePivot(IsDlgButtonChecked(hDlg, IDC_BAKE_PIVOT));
+			WriteAppData(exp->mIp, BAKE_PIVOT_ID, exp->GetBakePivot() ?
+						 _T("yes"): _T("no"));
+
+			exp->SetBatchStatic(IsDlgButtonChecked(hDlg, IDC_BATCH_STATIC));
+			WriteAppData(exp->mIp, BATCH_STATIC_ID, exp->GetBatchStatic() ?
+						 _T("yes"): _T("no"));
+
 			exp->SetUsePrefix(IsDlgButtonChecked(hDlg, IDC_USE_PREFIX));
 			WriteAppData(exp->mIp, USE_PREFIX_ID, exp->GetUsePrefix()
 						 ? _T("yes") : _T("no"));
@@ -3387,6 +3430,31 @@ WebGLExportDlgProc(HWND hDlg, UINT msg, WPARAM wParam, LPARAM lParam)
 			TSTR prefix = text;
 			exp->SetUrlPrefix(prefix);
 			WriteAppData(exp->mIp, URL_PREFIX_ID, (TCHAR *)(const TCHAR *)exp->GetUrlPrefix());
+			ComboBox_GetText(GetDlgItem(hDlg, IDC_OVERDRAW_LOSS), text, MAX_PATH);
+			exp->SetOverdrawLoss(_tcscmp(text, _T("Off")) == 0 ? -1 : _wtoi(text));
+			WriteAppData(exp->mIp, OVERDRAW_LOSS_ID, text);
+
+			ComboBox_GetText(GetDlgItem(hDlg, IDC_QUANTIZE), text, MAX_PATH);
+			exp->SetQuantBits(_tcscmp(text, _T("Off")) == 0 ? -1 : _wtoi(text));
+			WriteAppData(exp->mIp, QUANTIZE_ID, text);
+
+			ComboBox_GetText(GetDlgItem(hDlg, IDC_LOD_RATIOS), text, MAX_PATH);
+			TSTR ratios = text;
+			exp->SetLodRatios(ratios);
+			WriteAppData(exp->mIp, LOD_RATIOS_ID, text);
+
+			ComboBox_GetText(GetDlgItem(hDlg, IDC_TEX_SIZE), text, MAX_PATH);
+			exp->SetTexSize(_tcscmp(text, _T("Off")) == 0 ? -1 : _wtoi(text));
+			WriteAppData(exp->mIp, TEX_SIZE_ID, text);
+
+			ComboBox_GetText(GetDlgItem(hDlg, IDC_TEX_MIPS), text, MAX_PATH);
+			exp->SetTexMips(TexMipsFilter(text));
+			WriteAppData(exp->mIp, TEX_MIPS_ID, text);
+
+			ComboBox_GetText(GetDlgItem(hDlg, IDC_TEX_COMPRESS), text, MAX_PATH);
+			exp->SetTexCompress(TexCompressVariants(text));
+			WriteAppData(exp->mIp, TEX_COMPRESS_ID, text);
+
 			ComboBox_GetText(GetDlgItem(hDlg, IDC_DIGITS), text, MAX_PATH);
 			exp->SetDigits(_wtoi(text));
 			WriteAppData(exp->mIp, DIGITS_ID, text);
@@ -3550,6 +3618,45 @@ WebGLExport::initializeDefaults() {
 	gen = _tcscmp(text, _T("max")) == 0;
 	SetCPVSource(gen);
 
+	GetAppData(mIp, BINARY_GEOMETRY_ID, _T("no"), text, MAX_PATH);
+	gen = _tcscmp(text, _T("yes")) == 0;
+	SetBinaryGeometry(gen);
+
+	GetAppData(mIp, BUFFER_GEOMETRY_ID, _T("no"), text, MAX_PATH);
+	gen = _tcscmp(text, _T("yes")) == 0;
+	SetBufferGeometry(gen);
+
+	GetAppData(mIp, REORDER_FACES_ID, _T("no"), text, MAX_PATH);
+	gen = _tcscmp(text, _T("yes")) == 0;
+	SetReorderFaces(gen);
+
+	GetAppData(mIp, BAKE_PIVOT_ID, _T("no"), text, MAX_PATH);
+	gen = _tcscmp(text, _T("yes")) == 0;
+	SetBakePivot(gen);
+
+	GetAppData(mIp, BATCH_STATIC_ID, _T("no"), text, MAX_PATH);
+	gen = _tcscmp(text, _T("yes")) == 0;
+	SetBatchStatic(gen);
+
+	GetAppData(mIp, OVERDRAW_LOSS_ID, _T("Off"), text, MAX_PATH);
+	SetOverdrawLoss(_tcscmp(text, _T("Off")) == 0 ? -1 : _wtoi(text));
+
+	GetAppData(mIp, QUANTIZE_ID, _T("Off"), text, MAX_PATH);
+	SetQuantBits(_tcscmp(text, _T("Off")) == 0 ? -1 : _wtoi(text));
+
+	GetAppData(mIp, LOD_RATIOS_ID, _T("Off"), text, MAX_PATH);
+	TSTR ratios = text;
+	SetLodRatios(ratios);
+
+	GetAppData(mIp, TEX_SIZE_ID, _T("Off"), text, MAX_PATH);
+	SetTexSize(_tcscmp(text, _T("Off")) == 0 ? -1 : _wtoi(text));
+
+	GetAppData(mIp, TEX_MIPS_ID, _T("Off"), text, MAX_PATH);
+	SetTexMips(TexMipsFilter(text));
+
+	GetAppData(mIp, TEX_COMPRESS_ID, _T("Off"), text, MAX_PATH);
+	SetTexCompress(TexCompressVariants(text));
+
 #ifdef _LEC_
 	GetAppData(mIp, FLIP_BOOK_ID, _T("no"), text, MAX_PATH);
 	gen = _tcscmp(text, _T("yes")) == 0;
@@ -3709,6 +3816,17 @@ WebGLExport::WebGLExport()
 	mDigits = 3;     // Digits of precision on output
 	mCoordInterp = FALSE;// Generate coordinate interpolators
 	mPolygonType = OUTPUT_TRIANGLES;   // 0 triangles, 1 quads, 2 ngons
+	mBinaryGeometry = FALSE;  // write meshes to binary files
+	mBufferGeometry = FALSE;  // write meshes as BufferGeometry
+	mReorderFaces = FALSE;    // put faces in vertex cache order
+	mBakePivot = FALSE;       // nodes keep their object offset
+	mBatchStatic = FALSE;     // every mesh node is an object
+	mOverdrawLoss = -1;       // no cluster sort for overdraw
+	mQuantBits = -1;          // write floats
+	mLodRatios = _T("Off");   // no levels of detail
+	mTexSize = -1;            // copy bitmaps as they are
+	mTexMips = -1;            // the browser makes the mip levels
+	mTexCompress = 0;         // no compressed variants
 #ifdef _LEC_
 	BOOL           mFlipBook = FALSE;   // Generate one WebGL file per frame (LEC request)
 #endif
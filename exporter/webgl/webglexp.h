@@ -190,6 +190,39 @@ public:
     inline int  GetCPVSource() { return mCPVSource; }
     inline void SetCPVSource(int i) { mCPVSource = i; }
 
+    inline BOOL GetBinaryGeometry() { return mBinaryGeometry; }
+    inline void SetBinaryGeometry(BOOL b) { mBinaryGeometry = b; }
+
+    inline BOOL GetBufferGeometry() { return mBufferGeometry; }
+    inline void SetBufferGeometry(BOOL b) { mBufferGeometry = b; }
+
+    inline BOOL GetReorderFaces() { return mReorderFaces; }
+    inline void SetReorderFaces(BOOL b) { mReorderFaces = b; }
+
+    inline BOOL GetBakePivot() { return mBakePivot; }
+    inline void SetBakePivot(BOOL b) { mBakePivot = b; }
+
+    inline BOOL GetBatchStatic() { return mBatchStatic; }
+    inline void SetBatchStatic(BOOL b) { mBatchStatic = b; }
+
+    inline int  GetOverdrawLoss() { return mOverdrawLoss; }
+    inline void SetOverdrawLoss(int i) { mOverdrawLoss = i; }
+
+    inline int  GetQuantBits() { return mQuantBits; }
+    inline void SetQuantBits(int i) { mQuantBits = i; }
+
+    inline TSTR& GetLodRatios() { return mLodRatios; }
+    inline void SetLodRatios(TSTR& s) { mLodRatios = s; }
+
+    inline int  GetTexSize() { return mTexSize; }
+    inline void SetTexSize(int i) { mTexSize = i; }
+
+    inline int  GetTexMips() { return mTexMips; }
+    inline void SetTexMips(int i) { mTexMips = i; }
+
+    inline int  GetTexCompress() { return mTexCompress; }
+    inline void SetTexCompress(int i) { mTexCompress = i; }
+
 //    CallbackTable*  GetCallbacks() { return &mCallbacks; }
 
     Interface* mIp;         // MAX interface pointer
@@ -317,6 +350,17 @@ private:
     int         mPolygonType;   // 0 triangle, 1 QUADS, 2 NGONS
     BOOL       mPreLight;       // should we calculate the color per vertex
     BOOL       mCPVSource;  // 1 if MAX; 0 if we should calculate the color per vertex
+    BOOL       mBinaryGeometry; // write meshes to binary files
+    BOOL       mBufferGeometry; // write meshes as BufferGeometry
+    BOOL       mReorderFaces;   // put faces in vertex cache order
+    BOOL       mBakePivot;      // write mesh nodes at their pivot
+    BOOL       mBatchStatic;    // merge static meshes sharing materials
+    int        mOverdrawLoss;   // ACMR percent traded for overdraw, -1 off
+    int        mQuantBits;      // position bits, 0 automatic, -1 floats
+    TSTR       mLodRatios;      // faces of each LOD level in percent, "Off"
+    int        mTexSize;        // largest side of scaled bitmaps, 0 any, -1 off
+    int        mTexMips;        // TexFilter of the mip levels, -1 off
+    int        mTexCompress;    // TEXCOMP_ variants of the bitmaps, 0 off
 	NodeTable	mNodes;		// hash table of all nodes' name in the scene
 //    CallbackTable   mCallbacks; // callback methods
 };
@@ -0,0 +1,134 @@
+/**********************************************************************
+ *<
+	FILE: weld.cpp
+
+	DESCRIPTION:  Welded vertices for "buffer_mesh" geometry
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+#include "weld.h"
+
+// Hash of an index triple, mixed like the normal table hash
+static unsigned int
+HashCorner(const int* c)
+{
+	unsigned int h = (unsigned int) c[0];
+	h = h * 0x9E3779B1u + (unsigned int) c[1];
+	h = h * 0x9E3779B1u + (unsigned int) c[2];
+	h ^= h >> 16;
+	h *= 0x85EBCA6Bu;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35u;
+	h ^= h >> 16;
+	return h;
+}
+
+// Slot of a triple, or of the free slot where it belongs.  A slot holds
+// the welded vertex plus one, 0 if free.
+static unsigned int
+FindCorner(const std::vector<int>& slots, const std::vector<int>& corners,
+		   const int* c)
+{
+	unsigned int mask = (unsigned int) slots.size() - 1;
+	unsigned int slot;
+	for (slot = HashCorner(c) & mask; ; slot = (slot + 1) & mask)
+	{
+		int entry = slots[slot];
+		if (entry == 0)
+			break;
+		const int* k = &corners[3 * (entry - 1)];
+		if (k[0] == c[0] && k[1] == c[1] && k[2] == c[2])
+			break;
+	}
+	return slot;
+}
+
+void
+WeldMesh(const IRMesh& mesh, WeldedMesh& welded)
+{
+	bool hasUVs = mesh.NumTVerts() > 0;
+	int numfaces = mesh.NumFaces();
+
+	// Most meshes weld to about as many vertices as they have positions
+	unsigned int size = WELD_TABLE_SIZE;
+	while (size < 2 * (unsigned int) mesh.NumVerts())
+		size *= 2;
+	std::vector<int> slots(size, 0);
+
+	welded.corners.clear();
+	welded.indices.clear();
+	welded.corners.reserve(3 * mesh.NumVerts());
+	welded.indices.reserve(3 * numfaces);
+
+	for (int i = 0; i < numfaces; i++)
+	{
+		const IRFace& f = mesh.faces[i];
+		if (f.hidden)
+			continue;
+		for (int v = 0; v < 3; v++)
+		{
+			int c[3] = { f.v[v], mesh.faceNormals[3 * i + v],
+						 hasUVs ? f.t[v] : -1 };
+			unsigned int slot = FindCorner(slots, welded.corners, c);
+			if (slots[slot] == 0)
+			{
+				int count = welded.NumVerts();
+				if (2 * (count + 1) > (int) slots.size())
+				{
+					// Double the slots and put the corners back in
+					slots.assign(2 * slots.size(), 0);
+					for (int k = 0; k < count; k++)
+						slots[FindCorner(slots, welded.corners,
+										 &welded.corners[3 * k])] = k + 1;
+					slot = FindCorner(slots, welded.corners, c);
+				}
+				welded.corners.insert(welded.corners.end(), c, c + 3);
+				slots[slot] = count + 1;
+			}
+			welded.indices.push_back(slots[slot] - 1);
+		}
+	}
+}
+
+#ifdef WELD_BENCHMARK
+// Stand-alone check and timing on the synthetic grid:
+//
+//    g++ -O2 -DWELD_BENCHMARK weld.cpp sceneir.cpp -o weldbench
+//    ./weldbench [rows]
+//
+// Every welded triangle is checked against the corners of its face.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+int
+main(int argc, char** argv)
+{
+	int rows = argc > 1 ? atoi(argv[1]) : 1000;
+	IRMesh* mesh = IRMakeGrid(rows, rows);
+	WeldedMesh welded;
+
+	clock_t start = clock();
+	WeldMesh(*mesh, welded);
+	double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+	int bad = 0;
+	for (int i = 0; i < mesh->NumFaces(); i++)
+	{
+		const IRFace& f = mesh->faces[i];
+		for (int v = 0; v < 3; v++)
+		{
+			const int* c = &welded.corners[3 * welded.indices[3 * i + v]];
+			if (c[0] != f.v[v] || c[1] != mesh->faceNormals[3 * i + v] ||
+				c[2] != f.t[v])
+				bad++;
+		}
+	}
+	printf("%d faces: %d corners welded to %d vertices (%d positions) "
+		   "in %.3fs, %d bad\n", mesh->NumFaces(), 3 * mesh->NumFaces(),
+		   welded.NumVerts(), mesh->NumVerts(), seconds, bad);
+	delete mesh;
+	return bad != 0;
+}
+#endif
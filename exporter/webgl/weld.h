@@ -0,0 +1,44 @@
+/**********************************************************************
+ *<
+	FILE: weld.h
+
+	DESCRIPTION:  Welded vertices for "buffer_mesh" geometry
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+
+#ifndef __WELD__H__
+#define __WELD__H__
+
+// The JSON mesh format gives every face corner its own vertex, normal
+// and uv index, and three.js expands the faces to one GPU vertex per
+// corner when it loads them.  Welding finds the distinct (vertex,
+// normal, uv) index triples used by the visible faces instead, so each
+// becomes one vertex of an indexed buffer.  The color of a vertex goes
+// with its position index, so it needs no key of its own.
+//
+// Corners are compared by index, not by value, so two corners only
+// share a vertex if the mesh already shares their position, normal and
+// uv.  The triples are kept in a hash table with linear probing that
+// doubles before it is half full, like the NormalTable.
+
+#include <vector>
+#include "sceneir.h"
+
+#define WELD_TABLE_SIZE 1024    // initial number of slots, a power of two
+
+struct WeldedMesh {
+	// Position, normal and uv index of each welded vertex, in the
+	// order first used; the uv index is -1 if the mesh has no uvs
+	std::vector<int> corners;
+	// Three welded vertices per visible face
+	std::vector<int> indices;
+
+	int NumVerts() const { return (int) corners.size() / 3; }
+	int NumFaces() const { return (int) indices.size() / 3; }
+};
+
+// Weld the corners of the visible faces of a mesh
+void WeldMesh(const IRMesh& mesh, WeldedMesh& welded);
+
+#endif
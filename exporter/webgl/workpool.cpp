@@ -0,0 +1,441 @@
+/**********************************************************************
+ *<
+	FILE: workpool.cpp
+
+	DESCRIPTION:  Worker threads for the scene writer
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include "workpool.h"
+
+#ifdef _WIN32
+#include <process.h>
+#define RANGE_GET(p)         InterlockedCompareExchange64(p, 0, 0)
+#define RANGE_CAS(p, v, old) InterlockedCompareExchange64(p, v, old)
+#define RANGE_SET(p, v)      InterlockedExchange64(p, v)
+#else
+#include <unistd.h>
+#include <time.h>
+#define RANGE_GET(p)         __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define RANGE_CAS(p, v, old) __sync_val_compare_and_swap(p, old, v)
+#define RANGE_SET(p, v)      __sync_lock_test_and_set(p, v)
+#endif
+
+#define RANGE(lo, hi)   ((long long) (lo) | ((long long) (hi) << 32))
+#define RANGE_LO(r)     ((int) ((r) & 0xFFFFFFFF))
+#define RANGE_HI(r)     ((int) ((r) >> 32))
+
+static double
+Now()
+{
+#ifdef _WIN32
+	LARGE_INTEGER count, freq;
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&freq);
+	return (double) count.QuadPart / (double) freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+int
+WorkPool::Processors()
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int) info.dwNumberOfProcessors;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int) n : 1;
+#endif
+}
+
+WorkPool::WorkPool(int threads)
+{
+	mThreads = threads > 0 ? threads : Processors();
+	mFunc    = NULL;
+	mData    = NULL;
+	mRanges  = new WorkRange[mThreads];
+	mStats   = new WorkStats[mThreads];
+	mArgs    = new WorkThread[mThreads];
+	mRunSeconds = 0.0;
+	mActive  = 0;
+	mQuit    = false;
+	for (int i = 0; i < mThreads; i++)
+	{
+		mRanges[i].range = 0;
+		memset(&mStats[i], 0, sizeof(WorkStats));
+		mArgs[i].pool  = this;
+		mArgs[i].index = i;
+	}
+
+	// The caller of Run() is thread 0
+	int workers = mThreads - 1;
+#ifdef _WIN32
+	mStart   = CreateSemaphore(NULL, 0, workers > 0 ? workers : 1, NULL);
+	mDone    = CreateEvent(NULL, FALSE, FALSE, NULL);
+	mHandles = workers > 0 ? new HANDLE[workers] : NULL;
+	for (int i = 0; i < workers; i++)
+	{
+		mHandles[i] = (HANDLE) _beginthreadex(NULL, 0, ThreadProc,
+											  &mArgs[i + 1], 0, NULL);
+		if (!mHandles[i])
+		{
+			// Run with the threads we got
+			mThreads = i + 1;
+			break;
+		}
+	}
+#else
+	pthread_mutex_init(&mLock, NULL);
+	pthread_cond_init(&mWake, NULL);
+	pthread_cond_init(&mDone, NULL);
+	mRuns    = 0;
+	mHandles = workers > 0 ? new pthread_t[workers] : NULL;
+	for (int i = 0; i < workers; i++)
+	{
+		if (pthread_create(&mHandles[i], NULL, ThreadProc, &mArgs[i + 1]) != 0)
+		{
+			mThreads = i + 1;
+			break;
+		}
+	}
+#endif
+}
+
+WorkPool::~WorkPool()
+{
+	int workers = mThreads - 1;
+#ifdef _WIN32
+	mQuit = true;
+	if (workers > 0)
+		ReleaseSemaphore(mStart, workers, NULL);
+	for (int i = 0; i < workers; i++)
+	{
+		WaitForSingleObject(mHandles[i], INFINITE);
+		CloseHandle(mHandles[i]);
+	}
+	CloseHandle(mStart);
+	CloseHandle(mDone);
+#else
+	pthread_mutex_lock(&mLock);
+	mQuit = true;
+	pthread_cond_broadcast(&mWake);
+	pthread_mutex_unlock(&mLock);
+	for (int i = 0; i < workers; i++)
+		pthread_join(mHandles[i], NULL);
+	pthread_cond_destroy(&mDone);
+	pthread_cond_destroy(&mWake);
+	pthread_mutex_destroy(&mLock);
+#endif
+	delete [] mHandles;
+	delete [] mArgs;
+	delete [] mStats;
+	delete [] mRanges;
+}
+
+// Take the next item from the front of a thread's own range, -1 if
+// the range is empty
+int
+WorkPool::Pop(int thread)
+{
+	volatile long long* p = &mRanges[thread].range;
+	for (;;)
+	{
+		long long old = RANGE_GET(p);
+		int lo = RANGE_LO(old);
+		int hi = RANGE_HI(old);
+		if (lo >= hi)
+			return -1;
+		if (RANGE_CAS(p, RANGE(lo + 1, hi), old) == old)
+			return lo;
+	}
+}
+
+// Move the back half of the range of another thread to this thread's
+// range, which is empty.  Returns false if there was nothing left.
+bool
+WorkPool::Steal(int thread)
+{
+	for (int i = 1; i < mThreads; i++)
+	{
+		volatile long long* p = &mRanges[(thread + i) % mThreads].range;
+		for (;;)
+		{
+			long long old = RANGE_GET(p);
+			int lo = RANGE_LO(old);
+			int hi = RANGE_HI(old);
+			if (lo >= hi)
+				break;
+			int mid = lo + (hi - lo) / 2;
+			if (RANGE_CAS(p, RANGE(lo, mid), old) == old)
+			{
+				// Nobody touches an empty range, so a plain store is safe
+				RANGE_SET(&mRanges[thread].range, RANGE(mid, hi));
+				mStats[thread].steals++;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// Run items until no thread has any left
+void
+WorkPool::Work(int thread)
+{
+	WorkStats& stats = mStats[thread];
+
+	for (;;)
+	{
+		int item = Pop(thread);
+		if (item < 0)
+		{
+			if (!Steal(thread))
+				break;
+			continue;
+		}
+		double start = Now();
+		mFunc(mData, item);
+		stats.busy += Now() - start;
+		stats.items++;
+	}
+}
+
+#ifdef _WIN32
+unsigned __stdcall
+WorkPool::ThreadProc(void* param)
+{
+	WorkThread* arg = (WorkThread*) param;
+	WorkPool* pool = arg->pool;
+
+	for (;;)
+	{
+		WaitForSingleObject(pool->mStart, INFINITE);
+		if (pool->mQuit)
+			break;
+		pool->Work(arg->index);
+		if (InterlockedDecrement(&pool->mActive) == 0)
+			SetEvent(pool->mDone);
+	}
+	return 0;
+}
+#else
+void*
+WorkPool::ThreadProc(void* param)
+{
+	WorkThread* arg = (WorkThread*) param;
+	WorkPool* pool = arg->pool;
+	int runs = 0;
+
+	pthread_mutex_lock(&pool->mLock);
+	for (;;)
+	{
+		while (pool->mRuns == runs && !pool->mQuit)
+			pthread_cond_wait(&pool->mWake, &pool->mLock);
+		if (pool->mQuit)
+			break;
+		runs = pool->mRuns;
+		pthread_mutex_unlock(&pool->mLock);
+		pool->Work(arg->index);
+		pthread_mutex_lock(&pool->mLock);
+		if (--pool->mActive == 0)
+			pthread_cond_signal(&pool->mDone);
+	}
+	pthread_mutex_unlock(&pool->mLock);
+	return NULL;
+}
+#endif
+
+void
+WorkPool::Run(WorkFunc func, void* data, int count)
+{
+	double start = Now();
+
+	mFunc = func;
+	mData = data;
+	for (int i = 0; i < mThreads; i++)
+	{
+		long long lo = (long long) count * i / mThreads;
+		long long hi = (long long) count * (i + 1) / mThreads;
+		mRanges[i].range = RANGE(lo, hi);
+		memset(&mStats[i], 0, sizeof(WorkStats));
+	}
+
+	int workers = mThreads - 1;
+	if (workers == 0 || count <= 1)
+	{
+		Work(0);
+		mRunSeconds = Now() - start;
+		return;
+	}
+
+	mActive = workers;
+#ifdef _WIN32
+	ReleaseSemaphore(mStart, workers, NULL);
+	Work(0);
+	WaitForSingleObject(mDone, INFINITE);
+#else
+	pthread_mutex_lock(&mLock);
+	mRuns++;
+	pthread_cond_broadcast(&mWake);
+	pthread_mutex_unlock(&mLock);
+	Work(0);
+	pthread_mutex_lock(&mLock);
+	while (mActive > 0)
+		pthread_cond_wait(&mDone, &mLock);
+	pthread_mutex_unlock(&mLock);
+#endif
+	mRunSeconds = Now() - start;
+}
+
+#ifdef WORKPOOL_BENCHMARK
+// Stand-alone timing of a few very large meshes and many tiny ones,
+// written one after the other and on the pool, with every mesh one
+// item and with the large meshes split into chunks of elements:
+//
+//    g++ -O2 -DWORKPOOL_BENCHMARK -o poolbench workpool.cpp outbuf.cpp
+//        fltfmt.cpp sceneir.cpp -lpthread
+//    ./poolbench [threads]
+//
+// The items are put together in order, and every pooled output must be
+// the same bytes as the serial one.  The utilization of each thread is
+// printed for the pooled runs.
+
+#include <stdio.h>
+#include <vector>
+#include "fltfmt.h"
+#include "outbuf.h"
+#include "sceneir.h"
+
+#define CHUNK 16384
+
+// A piece of a mesh: vertices [first, last), or faces when faces is set
+struct Job {
+	const IRMesh* mesh;
+	bool          faces;
+	int           first;
+	int           last;
+	OutBuffer*    out;
+};
+
+static void
+WriteJob(void* data, int index)
+{
+	Job& job = ((Job*) data)[index];
+	TCHAR buf[FLT_FMT_MAX];
+
+	job.out = new OutBuffer(NULL, 64 * 1024);
+	OutBuffer& out = *job.out;
+	for (int i = job.first; i < job.last; i++)
+	{
+		if (job.faces)
+		{
+			for (int v = 0; v < 3; v++)
+			{
+				out.PutInt(job.mesh->faces[i].v[v]);
+				out.Put(_T(","), 1);
+			}
+		}
+		else
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				float f = job.mesh->verts[3 * i + k];
+				out.Put(buf, (int) (FltGeneral(buf, f, 6) - buf));
+				out.Put(_T(","), 1);
+			}
+		}
+	}
+}
+
+static void
+AddJobs(std::vector<Job>& jobs, const IRMesh* mesh, bool faces, int count,
+		int chunk)
+{
+	for (int first = 0; first < count || first == 0; first += chunk)
+	{
+		Job job;
+		job.mesh = mesh;
+		job.faces = faces;
+		job.first = first;
+		job.last = first + chunk < count ? first + chunk : count;
+		job.out = NULL;
+		jobs.push_back(job);
+	}
+}
+
+// Write all meshes, returns the seconds it took and the text in all
+static double
+WriteAll(std::vector<IRMesh*>& meshes, int chunk, WorkPool* pool,
+		 OutBuffer& all)
+{
+	std::vector<Job> jobs;
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		AddJobs(jobs, meshes[i], false, meshes[i]->NumVerts(), chunk);
+		AddJobs(jobs, meshes[i], true, meshes[i]->NumFaces(), chunk);
+	}
+
+	double start = Now();
+	if (pool)
+		pool->Run(WriteJob, &jobs[0], (int) jobs.size());
+	else
+		for (size_t i = 0; i < jobs.size(); i++)
+			WriteJob(&jobs[0], (int) i);
+	for (size_t i = 0; i < jobs.size(); i++)
+	{
+		all.Append(*jobs[i].out);
+		delete jobs[i].out;
+	}
+	return Now() - start;
+}
+
+int
+main(int argc, char** argv)
+{
+	int threads = argc > 1 ? atoi(argv[1]) : 0;
+	std::vector<IRMesh*> meshes;
+
+	// Two car bodies and a lot of bolts
+	meshes.push_back(IRMakeGrid(600, 600));
+	for (int i = 0; i < 3000; i++)
+		meshes.push_back(IRMakeGrid(2 + i % 5, 2 + i % 3));
+	meshes.push_back(IRMakeGrid(500, 500));
+
+	OutBuffer serial;
+	double serialTime = WriteAll(meshes, 1 << 30, NULL, serial);
+	printf("%d meshes, %lu bytes: serial %.3fs\n", (int) meshes.size(),
+		   (unsigned long) serial.Size(), serialTime);
+
+	WorkPool pool(threads);
+	int result = 0;
+	for (int split = 0; split < 2; split++)
+	{
+		OutBuffer pooled;
+		double t = WriteAll(meshes, split ? CHUNK : 1 << 30, &pool, pooled);
+		bool same = pooled.Size() == serial.Size() &&
+			memcmp(pooled.Data(), serial.Data(), serial.Size()) == 0;
+		printf("%s: %d threads %.3fs (x%.1f), output %s\n",
+			   split ? "split meshes" : "whole meshes", pool.Threads(), t,
+			   serialTime / t, same ? "identical" : "DIFFERENT");
+		for (int i = 0; i < pool.Threads(); i++)
+		{
+			const WorkStats& st = pool.Stats(i);
+			printf("  thread %2d: %5d items, %3d steals, busy %5.1f%%\n", i,
+				   st.items, st.steals, 100.0 * st.busy / pool.RunSeconds());
+		}
+		if (!same)
+			result = 1;
+	}
+
+	for (size_t i = 0; i < meshes.size(); i++)
+		delete meshes[i];
+	return result;
+}
+#endif
@@ -0,0 +1,108 @@
+/**********************************************************************
+ *<
+	FILE: workpool.h
+
+	DESCRIPTION:  Worker threads for the scene writer
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+
+#ifndef __WORKPOOL__H__
+#define __WORKPOOL__H__
+
+// A WorkPool keeps one thread per processor waiting for work.  Run()
+// calls func(data, i) for every i below count, spread over the workers
+// and the calling thread, and returns when all calls are done.
+//
+// Each thread starts with its own contiguous range of the items and
+// takes them from the front.  A thread that runs out steals the back
+// half of the range of another thread, so a thread stuck on one large
+// item does not hold up the small items queued behind it.  Ranges are
+// a pair of indices updated with compare and swap; there are no locks
+// while a run is going on.
+//
+// The pool does not order the results: an item writes into its own
+// slot of data and the caller puts the slots together once Run()
+// returns.  Only one Run() may be active on a pool at a time.
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+typedef void (*WorkFunc)(void* data, int index);
+
+// What one thread of the pool did during the last Run()
+struct WorkStats {
+	int    items;       // items it ran
+	int    steals;      // ranges it took from other threads
+	double busy;        // seconds spent running items
+};
+
+class WorkPool {
+public:
+	// threads is the number of threads that run items, including the
+	// caller of Run(); 0 means one per processor
+	WorkPool(int threads = 0);
+	~WorkPool();
+
+	void Run(WorkFunc func, void* data, int count);
+	int  Threads() const { return mThreads; }
+
+	// Utilization of the last Run().  Thread 0 is the caller.
+	const WorkStats& Stats(int thread) const { return mStats[thread]; }
+	double RunSeconds() const { return mRunSeconds; }
+
+	// Number of processors of the machine
+	static int Processors();
+
+private:
+	WorkPool(const WorkPool&);
+	WorkPool& operator=(const WorkPool&);
+
+	// Items [lo, hi) of a thread, packed as lo | hi << 32, alone on
+	// its cache line
+	struct WorkRange {
+		volatile long long range;
+		char               pad[64 - sizeof(long long)];
+	};
+
+	// Argument of a worker thread
+	struct WorkThread {
+		WorkPool* pool;
+		int       index;
+	};
+
+	int  Pop(int thread);
+	bool Steal(int thread);
+	void Work(int thread);
+#ifdef _WIN32
+	static unsigned __stdcall ThreadProc(void* param);
+#else
+	static void* ThreadProc(void* param);
+#endif
+
+	int           mThreads;
+	WorkFunc      mFunc;        // the current run
+	void*         mData;
+	WorkRange*    mRanges;      // one per thread
+	WorkStats*    mStats;       // one per thread
+	WorkThread*   mArgs;        // one per worker thread
+	double        mRunSeconds;
+	volatile long mActive;      // workers still busy with the run
+	bool          mQuit;
+#ifdef _WIN32
+	HANDLE*       mHandles;
+	HANDLE        mStart;       // released once per worker for each run
+	HANDLE        mDone;        // set by the last worker to finish
+#else
+	pthread_t*      mHandles;
+	pthread_mutex_t mLock;
+	pthread_cond_t  mWake;
+	pthread_cond_t  mDone;
+	int             mRuns;      // number of runs started
+#endif
+};
+
+#endif
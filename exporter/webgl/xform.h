@@ -0,0 +1,41 @@
+/**********************************************************************
+ *<
+	FILE: xform.h
+
+	DESCRIPTION:  Batched conversion of mesh arrays to the scene space
+
+ *>	Copyright (c) 2013, All Rights Reserved.
+ **********************************************************************/
+
+#ifndef __XFORM__H__
+#define __XFORM__H__
+
+// The scene file is Y up unless Z up output is chosen, and mirrored
+// meshes have their vertices negated.  Instead of converting each
+// point while it is formatted, a whole vertex or normal array is
+// converted in place once after capture:
+//
+//   p = p + offset             pivot offset baked into the mesh
+//   p = -p                     mirrored meshes
+//   (x, y, z) -> (x, z, -y)    Y up
+//
+// Where SSE is available four points (three registers) are done per
+// step, the axis swap being a few shuffles and the negations one xor;
+// the remainder and other processors take the scalar path.  Both give
+// the same bits.
+//
+// Nothing in here depends on the MAX SDK.
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#define XFORM_SSE
+#endif
+
+// Convert count points of x, y, z.  offset may be NULL.
+void XformPoints(float* v, int count, const float* offset, bool mirror,
+				 bool yUp);
+
+// The same without the vector unit, for the tail and for checking
+void XformPointsScalar(float* v, int count, const float* offset,
+					   bool mirror, bool yUp);
+
+#endif
@@ -3350,6 +3350,8 @@ SB.JsonScene.loadScene = function(url, param, callback)
 	var scene = new SB.JsonScene(param);
 	
 	var loader = new THREE.SceneLoader;
+	if (SB.Graphics.instance)
+		loader.renderer = SB.Graphics.instance.renderer;
 	loader.load(url, function (data) {
 		scene.handleLoaded(data);
 		if (callback)
@@ -181,6 +181,12 @@ THREE.RGBFormat = 1020;
 THREE.RGBAFormat = 1021;
 THREE.LuminanceFormat = 1022;
 THREE.LuminanceAlphaFormat = 1023;
+
+// Compressed texture formats
+
+THREE.RGB_S3TC_DXT1_Format = 2001;
+THREE.RGBA_S3TC_DXT5_Format = 2004;
+THREE.RGB_ETC1_Format = 2101;
 /**
  * @author alteredq / http://alteredqualia.com/
  */
@@ -10376,6 +10382,8 @@ THREE.Texture = function ( image, mapping, wrapS, wrapT, magFilter, minFilter, f
 	this.offset = new THREE.Vector2( 0, 0 );
 	this.repeat = new THREE.Vector2( 1, 1 );
 
+	this.mipmaps = [];
+
 	this.generateMipmaps = true;
 	this.premultiplyAlpha = false;
 	this.flipY = true;
@@ -10396,6 +10404,8 @@ THREE.Texture.prototype = {
 		clonedTexture.offset.copy( this.offset );
 		clonedTexture.repeat.copy( this.repeat );
 
+		clonedTexture.mipmaps = this.mipmaps.slice( 0 );
+
 		clonedTexture.generateMipmaps = this.generateMipmaps;
 		clonedTexture.premultiplyAlpha = this.premultiplyAlpha;
 		clonedTexture.flipY = this.flipY;
@@ -10430,6 +10440,35 @@ THREE.DataTexture.prototype.clone = function () {
 
 	return clonedTexture;
 
+};
+
+// Block compressed levels, largest first, each { data, width, height }.
+// WebGL can neither generate mip levels of these nor flip them, so all
+// levels are given and their rows are stored bottom first.
+
+THREE.CompressedTexture = function ( mipmaps, width, height, format, type, mapping, wrapS, wrapT, magFilter, minFilter ) {
+
+	THREE.Texture.call( this, null, mapping, wrapS, wrapT, magFilter, minFilter, format, type );
+
+	this.image = { width: width, height: height };
+	this.mipmaps = mipmaps;
+
+	this.generateMipmaps = false;
+	this.flipY = false;
+
+};
+
+THREE.CompressedTexture.prototype = Object.create( THREE.Texture.prototype );
+
+THREE.CompressedTexture.prototype.clone = function () {
+
+	var clonedTexture = new THREE.CompressedTexture( this.mipmaps, this.image.width, this.image.height, this.format, this.type, this.mapping, this.wrapS, this.wrapT, this.magFilter, this.minFilter );
+
+	clonedTexture.offset.copy( this.offset );
+	clonedTexture.repeat.copy( this.repeat );
+
+	return clonedTexture;
+
 };
 /**
  * @author mrdoob / http://mrdoob.com/
@@ -14883,6 +14922,8 @@ THREE.WebGLRenderer = function ( parameters ) {
 	var _glExtensionTextureFloat;
 	var _glExtensionStandardDerivatives;
 	var _glExtensionTextureFilterAnisotropic;
+	var _glExtensionCompressedTextureS3TC;
+	var _glExtensionCompressedTextureETC1;
 
 	initGL();
 
@@ -14915,6 +14956,18 @@ THREE.WebGLRenderer = function ( parameters ) {
 
 	};
 
+	this.supportsCompressedTextureS3TC = function () {
+
+		return _glExtensionCompressedTextureS3TC;
+
+	};
+
+	this.supportsCompressedTextureETC1 = function () {
+
+		return _glExtensionCompressedTextureETC1;
+
+	};
+
 	this.getMaxAnisotropy  = function () {
 
 		return _maxAnisotropy;
@@ -20931,23 +20984,43 @@ THREE.WebGLRenderer = function ( parameters ) {
 			_gl.pixelStorei( _gl.UNPACK_PREMULTIPLY_ALPHA_WEBGL, texture.premultiplyAlpha );
 
 			var image = texture.image,
+			mipmaps = texture.mipmaps,
 			isImagePowerOfTwo = isPowerOfTwo( image.width ) && isPowerOfTwo( image.height ),
 			glFormat = paramThreeToGL( texture.format ),
 			glType = paramThreeToGL( texture.type );
 
 			setTextureParameters( _gl.TEXTURE_2D, texture, isImagePowerOfTwo );
 
-			if ( texture instanceof THREE.DataTexture ) {
+			if ( texture instanceof THREE.CompressedTexture ) {
+
+				for ( var i = 0, il = mipmaps.length; i < il; i ++ ) {
+
+					var mipmap = mipmaps[ i ];
+					_gl.compressedTexImage2D( _gl.TEXTURE_2D, i, glFormat, mipmap.width, mipmap.height, 0, mipmap.data );
+
+				}
+
+			} else if ( texture instanceof THREE.DataTexture ) {
 
 				_gl.texImage2D( _gl.TEXTURE_2D, 0, glFormat, image.width, image.height, 0, glFormat, glType, image.data );
 
+			} else if ( mipmaps && mipmaps.length > 0 && isImagePowerOfTwo ) {
+
+				// pre-filtered levels, the image first
+
+				for ( var i = 0, il = mipmaps.length; i < il; i ++ ) {
+
+					_gl.texImage2D( _gl.TEXTURE_2D, i, glFormat, glFormat, glType, mipmaps[ i ] );
+
+				}
+
 			} else {
 
 				_gl.texImage2D( _gl.TEXTURE_2D, 0, glFormat, glFormat, glType, texture.image );
 
 			}
 
-			if ( texture.generateMipmaps && isImagePowerOfTwo ) _gl.generateMipmap( _gl.TEXTURE_2D );
+			if ( texture.generateMipmaps && isImagePowerOfTwo && ! ( mipmaps && mipmaps.length > 0 ) ) _gl.generateMipmap( _gl.TEXTURE_2D );
 
 			texture.needsUpdate = false;
 
@@ -21301,6 +21374,19 @@ THREE.WebGLRenderer = function ( parameters ) {
 		if ( p === THREE.OneMinusDstColorFactor ) return _gl.ONE_MINUS_DST_COLOR;
 		if ( p === THREE.SrcAlphaSaturateFactor ) return _gl.SRC_ALPHA_SATURATE;
 
+		if ( _glExtensionCompressedTextureS3TC ) {
+
+			if ( p === THREE.RGB_S3TC_DXT1_Format ) return _glExtensionCompressedTextureS3TC.COMPRESSED_RGB_S3TC_DXT1_EXT;
+			if ( p === THREE.RGBA_S3TC_DXT5_Format ) return _glExtensionCompressedTextureS3TC.COMPRESSED_RGBA_S3TC_DXT5_EXT;
+
+		}
+
+		if ( _glExtensionCompressedTextureETC1 ) {
+
+			if ( p === THREE.RGB_ETC1_Format ) return _glExtensionCompressedTextureETC1.COMPRESSED_RGB_ETC1_WEBGL;
+
+		}
+
 		return 0;
 
 	};
@@ -21426,6 +21512,12 @@ THREE.WebGLRenderer = function ( parameters ) {
 											   _gl.getExtension( 'MOZ_EXT_texture_filter_anisotropic' ) ||
 											   _gl.getExtension( 'WEBKIT_EXT_texture_filter_anisotropic' );
 
+		_glExtensionCompressedTextureS3TC = _gl.getExtension( 'WEBGL_compressed_texture_s3tc' ) ||
+											_gl.getExtension( 'MOZ_WEBGL_compressed_texture_s3tc' ) ||
+											_gl.getExtension( 'WEBKIT_WEBGL_compressed_texture_s3tc' );
+
+		_glExtensionCompressedTextureETC1 = _gl.getExtension( 'WEBGL_compressed_texture_etc1' );
+
 
 		if ( ! _glExtensionTextureFloat ) {
 
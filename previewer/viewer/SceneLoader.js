@@ -11,6 +11,11 @@ THREE.SceneLoader = function () {
 	this.callbackSync = function () {};
 	this.callbackProgress = function () {};
 
+	// when set, textures are loaded from their compressed variants where
+	// this renderer supports them
+
+	this.renderer = null;
+
 };
 
 THREE.SceneLoader.prototype.constructor = THREE.SceneLoader;
@@ -123,6 +128,195 @@ THREE.SceneLoader.prototype.createScene = function ( json, callbackFinished, url
 
 	};
 
+	// load a texture with its pre-filtered mip levels; the levels are
+	// uploaded once the image and all of them are in
+
+	function load_texture_mipmaps( url, mipmaps, mapping, callback ) {
+
+		var texture = new THREE.Texture( new Image(), mapping ),
+			images = [],
+			pending = mipmaps.length + 1;
+
+		var load_level = function ( n, level_url ) {
+
+			var loader = new THREE.ImageLoader();
+
+			loader.addEventListener( 'load', function ( event ) {
+
+				images[ n ] = event.content;
+				pending --;
+
+				if ( pending === 0 ) {
+
+					texture.image = images[ 0 ];
+					texture.mipmaps = images;
+					texture.needsUpdate = true;
+
+				}
+
+				callback();
+
+			} );
+
+			loader.crossOrigin = THREE.ImageUtils.crossOrigin;
+			loader.load( get_url( level_url, data.urlBaseType ) );
+
+		};
+
+		load_level( 0, url );
+
+		for ( var i = 0; i < mipmaps.length; i ++ ) {
+
+			load_level( i + 1, mipmaps[ i ] );
+
+		}
+
+		return texture;
+
+	};
+
+	// the compressed variant of a texture the renderer can draw, if any
+
+	function compressed_variant( tt ) {
+
+		var renderer = scope.renderer;
+
+		if ( ! tt.compressed || ! renderer || ! renderer.supportsCompressedTextureS3TC ) return null;
+
+		if ( tt.compressed.s3tc && renderer.supportsCompressedTextureS3TC() ) {
+
+			return { url: tt.compressed.s3tc, parse: parse_dds };
+
+		}
+
+		if ( tt.compressed.etc1 && renderer.supportsCompressedTextureETC1() ) {
+
+			return { url: tt.compressed.etc1, parse: parse_ktx };
+
+		}
+
+		return null;
+
+	};
+
+	// DXT1 or DXT5 levels of a .dds file
+
+	function parse_dds( buffer ) {
+
+		var header = new Int32Array( buffer, 0, 32 );
+
+		if ( header[ 0 ] !== 0x20534444 ) return null;
+
+		var format, blockBytes;
+
+		if ( header[ 21 ] === 0x31545844 ) {
+
+			format = THREE.RGB_S3TC_DXT1_Format;
+			blockBytes = 8;
+
+		} else if ( header[ 21 ] === 0x35545844 ) {
+
+			format = THREE.RGBA_S3TC_DXT5_Format;
+			blockBytes = 16;
+
+		} else {
+
+			return null;
+
+		}
+
+		var width = header[ 4 ], height = header[ 3 ],
+			count = Math.max( header[ 7 ], 1 ),
+			offset = header[ 1 ] + 4,
+			mipmaps = [];
+
+		for ( var i = 0; i < count; i ++ ) {
+
+			var size = Math.floor( ( width + 3 ) / 4 ) * Math.floor( ( height + 3 ) / 4 ) * blockBytes;
+
+			mipmaps.push( { data: new Uint8Array( buffer, offset, size ), width: width, height: height } );
+
+			offset += size;
+			width = Math.max( width >> 1, 1 );
+			height = Math.max( height >> 1, 1 );
+
+		}
+
+		return { format: format, width: header[ 4 ], height: header[ 3 ], mipmaps: mipmaps };
+
+	};
+
+	// ETC1 levels of a .ktx file
+
+	function parse_ktx( buffer ) {
+
+		var header = new Int32Array( buffer, 12, 13 );
+
+		if ( header[ 0 ] !== 0x04030201 || header[ 4 ] !== 0x8D64 ) return null;
+
+		var width = header[ 6 ], height = header[ 7 ],
+			count = Math.max( header[ 11 ], 1 ),
+			offset = 64 + header[ 12 ],
+			mipmaps = [];
+
+		for ( var i = 0; i < count; i ++ ) {
+
+			var size = new Int32Array( buffer, offset, 1 )[ 0 ];
+
+			mipmaps.push( { data: new Uint8Array( buffer, offset + 4, size ), width: width, height: height } );
+
+			offset += 4 + ( ( size + 3 ) & ~3 );
+			width = Math.max( width >> 1, 1 );
+			height = Math.max( height >> 1, 1 );
+
+		}
+
+		return { format: THREE.RGB_ETC1_Format, width: header[ 6 ], height: header[ 7 ], mipmaps: mipmaps };
+
+	};
+
+	// load a compressed texture with all its levels from one file
+
+	function load_compressed_texture( variant, mapping, callback ) {
+
+		var texture = new THREE.CompressedTexture( [], 0, 0, THREE.RGB_S3TC_DXT1_Format, undefined, mapping ),
+			url = get_url( variant.url, data.urlBaseType ),
+			xhr = new XMLHttpRequest();
+
+		xhr.onreadystatechange = function () {
+
+			if ( xhr.readyState === 4 ) {
+
+				var levels = ( xhr.status === 200 || xhr.status === 0 ) && xhr.response ? variant.parse( xhr.response ) : null;
+
+				if ( levels ) {
+
+					texture.format = levels.format;
+					texture.image.width = levels.width;
+					texture.image.height = levels.height;
+					texture.mipmaps = levels.mipmaps;
+					texture.needsUpdate = true;
+
+				} else {
+
+					console.error( "THREE.SceneLoader: Couldn't load compressed texture [" + url + "]" );
+
+				}
+
+				callback();
+
+			}
+
+		};
+
+		xhr.open( "GET", url, true );
+		xhr.responseType = "arraybuffer";
+		xhr.send( null );
+
+		return texture;
+
+	};
+
 	// the toplevel loader function, delegates to handle_children
 
 	function handle_objects() {
@@ -149,9 +343,9 @@ THREE.SceneLoader.prototype.createScene = function ( json, callbackFinished, url
 
 					geometry = result.geometries[ o.geometry ];
 
-					// geometry already loaded
+					// geometry already loaded, with all its levels of detail
 
-					if ( geometry ) {
+					if ( geometry && lod_loaded( o ) ) {
 
 						var hasNormals = false;
 
@@ -199,6 +393,13 @@ THREE.SceneLoader.prototype.createScene = function ( json, callbackFinished, url
 						}
 
 						object = new THREE.Mesh( geometry, material );
+
+						if ( o.lod !== undefined ) {
+
+							object = create_lod( object, o, hasNormals );
+
+						}
+
 						object.name = dd;
 
 						if ( m ) {
@@ -288,11 +489,16 @@ THREE.SceneLoader.prototype.createScene = function ( json, callbackFinished, url
 					}
 				}
 
-				if ( o.children !== undefined ) {
+			}
 
-					handle_children( object, o.children );
+			// children may wait for geometries that load after their
+			// parent, such as the submeshes of a large mesh
 
-				}
+			o = children[ dd ];
+
+			if ( result.objects[ dd ] !== undefined && o.children !== undefined ) {
+
+				handle_children( result.objects[ dd ], o.children );
 
 			}
 
@@ -333,6 +539,269 @@ THREE.SceneLoader.prototype.createScene = function ( json, callbackFinished, url
 
 	};
 
+	// whether the geometries of all the levels of an object are in
+
+	function lod_loaded( o ) {
+
+		if ( o.lod === undefined ) return true;
+
+		for ( var l = 0; l < o.lod.length; l ++ ) {
+
+			if ( ! result.geometries[ o.lod[ l ].geometry ] ) return false;
+
+		}
+
+		return true;
+
+	}
+
+	// the exporter writes coarser copies of large meshes, each with the
+	// camera distance it takes over from; the viewer switches them
+
+	function create_lod( mesh, o, hasNormals ) {
+
+		var lod = new THREE.LOD();
+		lod.addLevel( mesh, 0 );
+
+		for ( var l = 0; l < o.lod.length; l ++ ) {
+
+			var geometry = result.geometries[ o.lod[ l ].geometry ];
+
+			if ( hasNormals ) geometry.computeTangents();
+			geometry.materials = mesh.geometry.materials;
+
+			var level = new THREE.Mesh( geometry, mesh.material );
+			level.castShadow = o.castShadow;
+			level.receiveShadow = o.receiveShadow;
+			lod.addLevel( level, o.lod[ l ].distance );
+
+		}
+
+		mesh.castShadow = o.castShadow;
+		mesh.receiveShadow = o.receiveShadow;
+
+		return lod;
+
+	}
+
+	// primitives are built centered and along y; "rotation" and
+	// "offset" put them where the exporter had them
+
+	function place_primitive( geometry, g ) {
+
+		if ( g.rotation ) {
+
+			var m = new THREE.Matrix4();
+			m.setRotationFromEuler( new THREE.Vector3( g.rotation[ 0 ], g.rotation[ 1 ], g.rotation[ 2 ] ) );
+			geometry.applyMatrix( m );
+
+		}
+
+		if ( g.offset ) {
+
+			geometry.applyMatrix( new THREE.Matrix4().makeTranslation( g.offset[ 0 ], g.offset[ 1 ], g.offset[ 2 ] ) );
+
+		}
+
+		return geometry;
+
+	};
+
+	// quantized attributes: positions and uvs are steps across the
+	// bounding box of the mesh, normals two octahedral components
+
+	function dequantize( q, min, scale ) {
+
+		return min + q * scale;
+
+	};
+
+	function oct_decode( x, y, bits, out, offset ) {
+
+		var m = ( 1 << ( bits - 1 ) ) - 1,
+			z, fx, len;
+
+		x /= m;
+		y /= m;
+		z = 1 - Math.abs( x ) - Math.abs( y );
+
+		if ( z < 0 ) {
+
+			fx = ( 1 - Math.abs( y ) ) * ( x < 0 ? -1 : 1 );
+			y = ( 1 - Math.abs( x ) ) * ( y < 0 ? -1 : 1 );
+			x = fx;
+
+		}
+
+		len = Math.sqrt( x * x + y * y + z * z );
+
+		out[ offset ] = x / len;
+		out[ offset + 1 ] = y / len;
+		out[ offset + 2 ] = z / len;
+
+	};
+
+	// turn the quantized arrays of an "embedded_mesh" back into floats,
+	// in place
+
+	function dequantize_model( json, quant ) {
+
+		var p = quant.position, u = quant.uv, i, k, normals;
+
+		for ( i = 0; i < json.vertices.length; i ++ ) {
+
+			k = i % 3;
+			json.vertices[ i ] = dequantize( json.vertices[ i ], p.min[ k ], p.scale[ k ] );
+
+		}
+
+		if ( json.uvs && json.uvs[ 0 ] ) {
+
+			for ( i = 0; i < json.uvs[ 0 ].length; i ++ ) {
+
+				k = i % 2;
+				json.uvs[ 0 ][ i ] = dequantize( json.uvs[ 0 ][ i ], u.min[ k ], u.scale[ k ] );
+
+			}
+
+		}
+
+		if ( json.normals ) {
+
+			normals = new Array( json.normals.length / 2 * 3 );
+
+			for ( i = 0; i < json.normals.length / 2; i ++ ) {
+
+				oct_decode( json.normals[ 2 * i ], json.normals[ 2 * i + 1 ], quant.normal.bits, normals, 3 * i );
+
+			}
+
+			json.normals = normals;
+
+		}
+
+	};
+
+	// "buffer_mesh" geometries hold one interleaved vertex array and one
+	// index array; split them into the attribute arrays of a BufferGeometry
+
+	function create_buffer_geometry( json ) {
+
+		var sizes = { position: 3, normal: 3, uv: 2, color: 3 },
+			quant = json.metadata && json.metadata.quantization,
+			stride = json.stride,
+			vertices = json.vertices,
+			indices = json.indices.slice( 0 ),
+			count = vertices.length / stride,
+			extra = [],
+			geometry = new THREE.BufferGeometry(),
+			offset = 0, a, i, k, t;
+
+		// the renderer draws with 16 bit indices: a triangle whose vertices
+		// are further apart gets copies of them at the end of the arrays
+
+		for ( t = 0; t < indices.length; t += 3 ) {
+
+			var span = Math.max( indices[ t ], indices[ t + 1 ], indices[ t + 2 ] ) -
+					   Math.min( indices[ t ], indices[ t + 1 ], indices[ t + 2 ] );
+
+			if ( span > 65535 ) {
+
+				for ( k = 0; k < 3; k ++ ) {
+
+					extra.push( indices[ t + k ] );
+					indices[ t + k ] = count + extra.length - 1;
+
+				}
+
+			}
+
+		}
+
+		for ( a = 0; a < json.attributes.length; a ++ ) {
+
+			var name = json.attributes[ a ],
+				size = sizes[ name ],
+				stored = quant && name === "normal" ? 2 : size,
+				range = quant && ( name === "position" ? quant.position : name === "uv" ? quant.uv : null ),
+				array = new Float32Array( ( count + extra.length ) * size );
+
+			for ( i = 0; i < count + extra.length; i ++ ) {
+
+				var source = ( i < count ? i : extra[ i - count ] ) * stride + offset;
+
+				if ( quant && name === "normal" ) {
+
+					oct_decode( vertices[ source ], vertices[ source + 1 ], quant.normal.bits, array, i * size );
+
+				} else if ( range ) {
+
+					for ( k = 0; k < size; k ++ ) {
+
+						array[ i * size + k ] = dequantize( vertices[ source + k ], range.min[ k ], range.scale[ k ] );
+
+					}
+
+				} else {
+
+					for ( k = 0; k < size; k ++ ) {
+
+						array[ i * size + k ] = vertices[ source + k ];
+
+					}
+
+				}
+
+			}
+
+			geometry.attributes[ name ] = { itemSize: size, array: array, numItems: ( count + extra.length ) * size };
+			offset += stored;
+
+		}
+
+		// cut the triangles into runs whose vertices span less than 65536,
+		// indexed from the lowest
+
+		var index = new Uint16Array( indices.length ),
+			start = 0;
+
+		geometry.offsets = [];
+
+		while ( start < indices.length ) {
+
+			var lo = indices[ start ], hi = lo, end = start;
+
+			while ( end < indices.length ) {
+
+				var tlo = Math.min( lo, indices[ end ], indices[ end + 1 ], indices[ end + 2 ] ),
+					thi = Math.max( hi, indices[ end ], indices[ end + 1 ], indices[ end + 2 ] );
+
+				if ( thi - tlo > 65535 ) break;
+
+				lo = tlo;
+				hi = thi;
+				end += 3;
+
+			}
+
+			for ( i = start; i < end; i ++ ) {
+
+				index[ i ] = indices[ i ] - lo;
+
+			}
+
+			geometry.offsets.push( { start: start, count: end - start, index: lo } );
+			start = end;
+
+		}
+
+		geometry.attributes.index = { itemSize: 1, array: index, numItems: indices.length };
+		geometry.computeBoundingSphere();
+
+		return geometry;
+
+	};
+
 	function async_callback_gate() {
 
 		var progress = {
@@ -519,22 +988,22 @@ THREE.SceneLoader.prototype.createScene = function ( json, callbackFinished, url
 		if ( g.type === "cube" ) {
 
 			geometry = new THREE.CubeGeometry( g.width, g.height, g.depth, g.segmentsWidth, g.segmentsHeight, g.segmentsDepth, null, g.flipped, g.sides );
-			result.geometries[ dg ] = geometry;
+			result.geometries[ dg ] = place_primitive( geometry, g );
 
 		} else if ( g.type === "plane" ) {
 
 			geometry = new THREE.PlaneGeometry( g.width, g.height, g.segmentsWidth, g.segmentsHeight );
-			result.geometries[ dg ] = geometry;
+			result.geometries[ dg ] = place_primitive( geometry, g );
 
 		} else if ( g.type === "sphere" ) {
 
 			geometry = new THREE.SphereGeometry( g.radius, g.segmentsWidth, g.segmentsHeight );
-			result.geometries[ dg ] = geometry;
+			result.geometries[ dg ] = place_primitive( geometry, g );
 
 		} else if ( g.type === "cylinder" ) {
 
 			geometry = new THREE.CylinderGeometry( g.topRad, g.botRad, g.height, g.radSegs, g.heightSegs );
-			result.geometries[ dg ] = geometry;
+			result.geometries[ dg ] = place_primitive( geometry, g );
 
 		} else if ( g.type === "torus" ) {
 
@@ -559,6 +1028,12 @@ THREE.SceneLoader.prototype.createScene = function ( json, callbackFinished, url
 			var modelJson = data.embeds[ g.id ],
 				texture_path = "";
 
+			if ( modelJson && modelJson.metadata && modelJson.metadata.quantization ) {
+
+				dequantize_model( modelJson, modelJson.metadata.quantization );
+
+			}
+
 			// pass metadata along to jsonLoader so it knows the format version
 
 			modelJson.metadata = data.metadata;
@@ -569,6 +1044,16 @@ THREE.SceneLoader.prototype.createScene = function ( json, callbackFinished, url
 
 			}
 
+		} else if ( g.type === "buffer_mesh" ) {
+
+			var bufferJson = data.embeds[ g.id ];
+
+			if ( bufferJson ) {
+
+				result.geometries[ dg ] = create_buffer_geometry( bufferJson );
+
+			}
+
 		}
 
 	}
@@ -593,9 +1078,15 @@ THREE.SceneLoader.prototype.createScene = function ( json, callbackFinished, url
 
 		} else {
 
-			counter_textures += 1;
+			var levels = tt.mipmaps && ! compressed_variant( tt ) ? tt.mipmaps.length + 1 : 1;
 
-			scope.onLoadStart();
+			counter_textures += levels;
+
+			for( var n = 0; n < levels; n ++ ) {
+
+				scope.onLoadStart();
+
+			}
 
 		}
 
@@ -628,7 +1119,21 @@ THREE.SceneLoader.prototype.createScene = function ( json, callbackFinished, url
 
 		} else {
 
-			texture = THREE.ImageUtils.loadTexture( get_url( tt.url, data.urlBaseType ), tt.mapping, generateTextureCallback( 1 ) );
+			var variant = compressed_variant( tt );
+
+			if ( variant ) {
+
+				texture = load_compressed_texture( variant, tt.mapping, generateTextureCallback( 1 ) );
+
+			} else if ( tt.mipmaps ) {
+
+				texture = load_texture_mipmaps( tt.url, tt.mipmaps, tt.mapping, generateTextureCallback( 1 ) );
+
+			} else {
+
+				texture = THREE.ImageUtils.loadTexture( get_url( tt.url, data.urlBaseType ), tt.mapping, generateTextureCallback( 1 ) );
+
+			}
 
 			if ( THREE[ tt.minFilter ] !== undefined )
 				texture.minFilter = THREE[ tt.minFilter ];
@@ -59,6 +59,40 @@ SceneViewer.prototype.replaceScene = function(jsonScene)
 	this.fitToScene();
 	this.jsonScene = jsonScene;
 	
+	this.lods = [];
+	this.findLods(jsonScene.object);
+}
+
+SceneViewer.prototype.findLods = function(object)
+{
+	if (object instanceof THREE.LOD)
+	{
+		this.lods.push(object);
+	}
+	
+	var i, len = object.children.length;
+	for (i = 0; i < len; i++)
+	{
+		this.findLods(object.children[i]);
+	}
+}
+
+// Show the level of detail of each object that suits its distance
+// from the camera, before the frame is drawn
+SceneViewer.prototype.updateServices = function()
+{
+	var camera = SB.Graphics.instance.camera;
+	
+	if (this.lods && camera)
+	{
+		var i, len = this.lods.length;
+		for (i = 0; i < len; i++)
+		{
+			this.lods[i].update(camera);
+		}
+	}
+	
+	SB.Game.prototype.updateServices.call(this);
 }
 
 SceneViewer.prototype.createGrid = function()